@@ -10,12 +10,15 @@ class IObj {
 protected:
   virtual ~IObj() = default;
 
+  /** Runs once the last reference is dropped; objects shared with another thread may defer deletion */
+  virtual void finalRelease() noexcept { delete this; }
+
 public:
   void increment() noexcept { m_refCount.fetch_add(1, std::memory_order_relaxed); }
   void decrement() noexcept {
     if (m_refCount.fetch_sub(1, std::memory_order_release) == 1) {
       std::atomic_thread_fence(std::memory_order_acquire);
-      delete this;
+      finalRelease();
     }
   }
 };
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+namespace boo2 {
+
+/** Append the trace scopes recorded since the last flush to json as a Chrome trace
+ *  ({"traceEvents": [...]}), which chrome://tracing and the Perfetto UI load. Scopes cover the
+ *  mixer pump, voices, submixes, surround processing, MIDI receive and HID transfer threads;
+ *  each of up to 64 threads tracing at once keeps its most recent 65536, and a thread's buffer
+ *  passes to a new thread once the flush after it exits has read it. Timestamps are steady_clock
+ *  microseconds (the monotonic clock on Linux), so traces line up with others taken against
+ *  that clock. Only BOO2_TRACE builds record; otherwise returns false and leaves json untouched */
+bool FlushTrace(std::string& json);
+
+/** As above, writing the trace to a new file at path; false if it can't be written */
+bool FlushTrace(const char* path);
+
+} // namespace boo2
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "boo2/audiodev/IAudioSubmix.hpp"
+#include "boo2/audiodev/IAudioVoice.hpp"
+
+namespace boo2 {
+class HRTFConvolver;
+
+/** Head-related impulse response pair measured from one direction */
+struct AudioHRIR {
+  float m_azimuth = 0.f;   /**< Degrees clockwise from front */
+  float m_elevation = 0.f; /**< Degrees above the horizontal plane */
+  std::vector<float> m_left;
+  std::vector<float> m_right;
+};
+
+/** Set of HRIR measurements around the listener. Directions between measurements are
+ *  interpolated from the nearest ones; responses are resampled to the mix rate as needed */
+struct AudioHRIRSet {
+  double m_sampleRate = 48000.0;
+  std::vector<AudioHRIR> m_measurements;
+
+  /** Analytic spherical-head responses (head shadow and interaural delay, no pinna cues)
+   *  for use when no measured set is available */
+  static AudioHRIRSet SphericalHead(double sampleRate = 48000.0);
+};
+
+/** Submix effect rendering each channel as a virtual speaker of layout through the HRIR set,
+ *  leaving the binaural result in FrontLeft/FrontRight and silencing the other channels.
+ *  Use it on engines mixing in surround; IAudioVoiceEngine::enableHRTF() renders the main output.
+ *  Output lags input by 128 frames. */
+class AudioHRTFRenderer : public IAudioSubmixCallback {
+  std::shared_ptr<const AudioHRIRSet> m_hrirs;
+  AudioChannelSet m_layout;
+  std::unique_ptr<HRTFConvolver> m_convolver;
+
+public:
+  AudioHRTFRenderer(std::shared_ptr<const AudioHRIRSet> hrirs, AudioChannelSet layout, double sampleRate);
+  ~AudioHRTFRenderer();
+
+  bool canApplyEffect() const override { return m_convolver.operator bool(); }
+  void applyEffect(float* audio, size_t frameCount, const ChannelMap& chanMap, double sampleRate) const override;
+  void resetOutputSampleRate(double sampleRate) override;
+};
+
+} // namespace boo2
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+
+namespace boo2 {
+
+/** Levels of a metered bus (see IAudioSubmix::enableMetering() and
+ *  IAudioVoiceEngine::enableOutputMetering()), refreshed every 100ms of audio.
+ *  Level arrays are indexed by AudioChannel and are linear; channels the bus lacks read 0.
+ *  Loudness follows ITU-R BS.1770 (K-weighting, surround channels +1.5dB, LFE excluded) */
+struct AudioMeterReading {
+  std::array<float, 8> m_peak{};     /**< Sample peak over the last 400ms */
+  std::array<float, 8> m_truePeak{}; /**< Peak of the 4x oversampled signal over the last 400ms */
+  std::array<float, 8> m_rms{};      /**< RMS over the last 400ms */
+  float m_momentaryLUFS = -INFINITY; /**< Loudness over the last 400ms; -inf when silent */
+  float m_shortTermLUFS = -INFINITY; /**< Loudness over the last 3s; -inf when silent */
+};
+
+} // namespace boo2
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace boo2 {
+
+/** Linear attack-decay-sustain-release envelope evaluated by the engine at the mixing rate.
+ *  Zero-length stages are skipped; the defaults hold full level until release */
+struct AudioEnvelope {
+  double m_attackMs = 0.0;
+  double m_decayMs = 0.0;
+  float m_sustain = 1.0f; /**< Level held after decay, 0-1 */
+  double m_releaseMs = 0.0;
+};
+
+/** Encoding of a sampler voice's resident sample */
+enum class AudioSampleFormat {
+  PCM16,    /**< Interleaved int16 in m_samples */
+  DSPADPCM, /**< Nintendo DSP-ADPCM per channel: 8-byte frames of a predictor/scale byte and 14 samples */
+  IMAADPCM  /**< Headerless IMA-ADPCM per channel, low nibble first */
+};
+
+/** Decoder state of one ADPCM channel: DSP-ADPCM keeps its last two samples, IMA-ADPCM its
+ *  predictor (in m_hist1) and step index */
+struct AudioADPCMState {
+  int16_t m_hist1 = 0;
+  int16_t m_hist2 = 0;
+  uint8_t m_stepIndex = 0;
+};
+
+/** One channel of an ADPCM sample, as stored in DSP-ADPCM headers */
+struct AudioADPCMChannel {
+  const uint8_t* m_data = nullptr;
+  int16_t m_coefs[8][2] = {}; /**< DSP-ADPCM predictor pairs; unused by IMA-ADPCM */
+  AudioADPCMState m_initial;  /**< State before the first sample */
+};
+
+/** Resident sample and playback parameters of a sampler voice (see IAudioVoiceEngine::allocateNewSamplerVoice()).
+ *  The engine reads m_samples (or the ADPCM data, decoding as it plays) in place for the life of the voice;
+ *  only the loop crossfade is copied */
+struct AudioSamplerInfo {
+  AudioSampleFormat m_format = AudioSampleFormat::PCM16;
+  const int16_t* m_samples = nullptr; /**< Interleaved PCM */
+  AudioADPCMChannel m_adpcm[2];       /**< Compressed channels, for the ADPCM formats */
+  size_t m_frames = 0;
+  unsigned m_channels = 1; /**< 1 or 2 */
+  double m_sampleRate = 48000.0;
+
+  /** Frames [m_loopStart, m_loopEnd) repeat until the voice ends; the sample plays once
+   *  when m_loopEnd isn't past m_loopStart */
+  size_t m_loopStart = 0;
+  size_t m_loopEnd = 0;
+  /** Frames before m_loopEnd blended linearly into those before m_loopStart, hiding the seam.
+   *  Clamped to the loop length and to m_loopStart */
+  size_t m_loopCrossfade = 0;
+
+  AudioEnvelope m_gainEnvelope;
+  /** Pitch offset of m_pitchEnvelopeCents at full envelope level, on top of setPitchRatio() */
+  AudioEnvelope m_pitchEnvelope;
+  double m_pitchEnvelopeCents = 0.0;
+
+  float m_velocity = 1.0f; /**< Note velocity, 0-1 */
+  /** Amplitude follows velocity squared at 1, ignores velocity at 0 */
+  float m_velocitySensitivity = 1.0f;
+};
+
+} // namespace boo2
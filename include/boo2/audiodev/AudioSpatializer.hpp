@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "boo2/audiodev/IAudioVoice.hpp"
+
+namespace boo2 {
+struct IAudioSubmix;
+
+/** Emitter positions for AudioSpatializer in structure-of-arrays form */
+struct AudioEmitterBatch {
+  size_t m_count = 0;
+  const float* m_x = nullptr;
+  const float* m_y = nullptr;
+  const float* m_z = nullptr;
+  /** Optional per-emitter spread in [0, 1]; 0 is a point source, 1 plays equally from every speaker */
+  const float* m_spread = nullptr;
+};
+
+/** Batch VBAP-style panner producing send-matrix coefficients (AudioChannel enum for index)
+ *  for many emitters at once. Speakers lie in the listener's horizontal plane; emitter elevation
+ *  widens the spread instead. Layouts without rear speakers fold rear emitters to the front. */
+class AudioSpatializer {
+  struct Speaker {
+    AudioChannel m_channel;
+    float m_lateral, m_forward;
+  };
+  struct SpeakerPair {
+    int m_a, m_b;
+    /* Inverse of the 2x2 matrix of the pair's direction vectors */
+    float m_inv[4];
+  };
+  std::array<Speaker, 8> m_speakers;
+  size_t m_speakerCount = 0;
+  std::array<SpeakerPair, 8> m_pairs;
+  size_t m_pairCount = 0;
+  bool m_foldRear = false;
+
+  float m_position[3] = {};
+  float m_right[3] = {1.f, 0.f, 0.f};
+  float m_front[3] = {0.f, 1.f, 0.f};
+  float m_up[3] = {0.f, 0.f, 1.f};
+
+  float m_minDistance = 1.f;
+  float m_maxDistance = 1000.f;
+  float m_rolloff = 1.f;
+
+  void _solve(float dx, float dy, float dz, float spread, float coefs[8]) const;
+
+public:
+  explicit AudioSpatializer(AudioChannelSet layout = AudioChannelSet::Stereo) { setLayout(layout); }
+
+  /** Speaker arrangement to pan across; typically IAudioVoiceEngine::getAvailableSet() */
+  void setLayout(AudioChannelSet layout);
+
+  /** Listener position and orientation; front and up need not be normalized */
+  void setListener(const float position[3], const float front[3], const float up[3]);
+
+  /** Inverse-distance attenuation clamped to [minDistance, maxDistance] */
+  void setDistanceModel(float minDistance, float maxDistance, float rolloff);
+
+  /** Write mono channel-levels for every emitter; coefsOut holds emitters.m_count rows */
+  void computeLevels(const AudioEmitterBatch& emitters, float (*coefsOut)[8]) const;
+
+  /** Feed computed levels into each voice's send matrix for submix (null for main) as ramps of rampMs */
+  static void applyLevels(size_t count, IAudioVoice* const* voices, const float (*coefs)[8],
+                          IAudioSubmix* submix = nullptr, double rampMs = 5.0);
+};
+
+} // namespace boo2
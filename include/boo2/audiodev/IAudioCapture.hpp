@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "boo2/BooObject.hpp"
+
+namespace boo2 {
+struct ChannelMap;
+
+/** Container written by a file capture */
+enum class AudioCaptureFile {
+  WAV, /**< 32-bit float WAV in the format of the first captured block */
+  Raw  /**< Headerless interleaved 32-bit float samples */
+};
+
+/** Counters of a running capture; the mixing thread never waits on the writer,
+ *  so blocks that find the ring full are dropped and counted instead */
+struct AudioCaptureStats {
+  uint64_t m_framesWritten = 0; /**< Frames handed to the file or callback */
+  uint64_t m_droppedBlocks = 0; /**< Blocks lost to a full ring */
+  uint64_t m_droppedFrames = 0;
+  uint64_t m_skippedFrames = 0; /**< Frames left out of a WAV file after the output format changed */
+};
+
+/** Receives captured audio on the capture's writer thread, in mixing order */
+struct IAudioCaptureCallback {
+  virtual void captureAudio(const float* audio, size_t frameCount, const ChannelMap& chanMap,
+                            double sampleRate) = 0;
+};
+
+/** Capture tap returned by IAudioVoiceEngine::captureToFile() and captureToCallback().
+ *  Releasing the last token stops the tap, writes out whatever is still buffered and closes the file */
+struct IAudioCapture : IObj {
+  virtual AudioCaptureStats getStats() const = 0;
+};
+
+} // namespace boo2
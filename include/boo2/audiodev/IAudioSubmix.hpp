@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <memory>
 #include "boo2/BooObject.hpp"
+#include "boo2/audiodev/AudioMeter.hpp"
 
 namespace boo2 {
 struct IAudioVoice;
@@ -18,18 +19,26 @@ struct IAudioSubmix : IObj {
   /** Set channel-levels for target submix (AudioChannel enum for array index) */
   virtual void setSendLevel(IAudioSubmix* submix, float level, bool slew) = 0;
 
-  /** Gets fixed sample rate of submix this way */
+  /** Gets fixed sample rate of submix this way (the rate its effect runs at) */
   virtual double getSampleRate() const = 0;
+
+  /** Start (from silence) or stop measuring this submix's levels after its effect.
+   *  Metering runs in the mixing pass and costs nothing while disabled */
+  virtual void enableMetering(bool enable) = 0;
+
+  /** Latest levels published by the mixer; never blocks it */
+  virtual AudioMeterReading getMeterReading() const = 0;
 };
 
 struct IAudioSubmixCallback {
   /** Client-provided claim to implement / is ready to call applyEffect() */
   virtual bool canApplyEffect() const = 0;
 
-  /** Client-provided effect solution for interleaved, master sample-rate audio */
+  /** Client-provided effect solution for interleaved audio at the submix's sample rate */
   virtual void applyEffect(float* audio, size_t frameCount, const ChannelMap& chanMap, double sampleRate) const = 0;
 
-  /** Notify of output sample rate changes (for instance, changing the default audio device on Windows) */
+  /** Notify of output sample rate or channel layout changes (for instance, changing the default audio
+   *  device on Windows); re-query the layout from the chanMap passed to applyEffect */
   virtual void resetOutputSampleRate(double sampleRate) = 0;
 };
 
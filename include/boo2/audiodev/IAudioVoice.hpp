@@ -44,8 +44,24 @@ static inline unsigned ChannelCount(AudioChannelSet layout) {
   return 0;
 }
 
+/** Shape of an engine-evaluated parameter ramp */
+enum class AudioRampCurve {
+  Linear,    /**< Constant-rate interpolation between old and new values */
+  SCurve,    /**< Smoothstep; eases in and out of the ramp */
+  EqualPower /**< Sine/cosine crossfade; holds perceived loudness when panning or fading */
+};
+
+/** Response of a voice's built-in filter */
+enum class AudioFilterType {
+  None,     /**< Pass audio through unfiltered */
+  LowPass,  /**< Second-order low-pass, as for occlusion or air absorption */
+  HighPass  /**< Second-order high-pass */
+};
+
 struct IAudioVoice : IObj {
-  /** Set sample rate into voice (may result in audio discontinuities) */
+  /** Set sample rate into voice (may result in audio discontinuities). The new resampler is built on the
+   *  calling thread and swapped in at the next block; called from a voice or engine callback, it's built
+   *  on the engine's reclaimer thread instead and takes effect some tens of milliseconds later */
   virtual void resetSampleRate(double sampleRate) = 0;
 
   /** Reset channel-levels to silence; unbind all submixes */
@@ -57,9 +73,39 @@ struct IAudioVoice : IObj {
   /** Set channel-levels for stereo audio source (AudioChannel enum for array index) */
   virtual void setStereoChannelLevels(IAudioSubmix* submix, const float coefs[8][2], bool slew) = 0;
 
+  /** Ramp channel-levels for mono audio source toward coefs over ms milliseconds.
+   *  The engine interpolates every sample; a new ramp continues from the levels reached so far */
+  virtual void rampMonoChannelLevels(IAudioSubmix* submix, const float coefs[8], double ms,
+                                     AudioRampCurve curve = AudioRampCurve::Linear) = 0;
+
+  /** Ramp channel-levels for stereo audio source toward coefs over ms milliseconds */
+  virtual void rampStereoChannelLevels(IAudioSubmix* submix, const float coefs[8][2], double ms,
+                                       AudioRampCurve curve = AudioRampCurve::Linear) = 0;
+
+  /** Set channel-levels for multichannel audio source (AudioChannel enum for the first index, source channel
+   *  for the second); mono and stereo voices use the first one or two columns */
+  virtual void setMultichannelLevels(IAudioSubmix* submix, const float coefs[8][8], bool slew) = 0;
+
+  /** Ramp channel-levels for multichannel audio source toward coefs over ms milliseconds */
+  virtual void rampMultichannelLevels(IAudioSubmix* submix, const float coefs[8][8], double ms,
+                                      AudioRampCurve curve = AudioRampCurve::Linear) = 0;
+
   /** Called by client to dynamically adjust the pitch of voices with dynamic pitch enabled */
   virtual void setPitchRatio(double ratio, bool slew) = 0;
 
+  /** Glide the pitch of a dynamic-pitch voice to ratio over ms milliseconds, interpolated
+   *  per sample by the resampler */
+  virtual void glidePitchRatio(double ratio, double ms) = 0;
+
+  /** Filter the voice's resampled audio before routing and mixing. cutoff is in Hz and q is the
+   *  resonance (0.7071 for a flat passband); the engine filters many voices at once, so this costs
+   *  far less than filtering in routeAudio */
+  virtual void setFilter(AudioFilterType type, double cutoff, double q, bool slew) = 0;
+
+  /** Sweep the filter toward a new response over ms milliseconds. Cutoff moves geometrically;
+   *  a change of type crossfades between the two responses */
+  virtual void rampFilter(AudioFilterType type, double cutoff, double q, double ms) = 0;
+
   /** Instructs platform to begin consuming sample data; invoking callback as needed */
   virtual void start() = 0;
 
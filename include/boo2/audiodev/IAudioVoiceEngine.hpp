@@ -1,12 +1,16 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "boo2/BooObject.hpp"
+#include "boo2/audiodev/AudioHRTF.hpp"
+#include "boo2/audiodev/AudioSampler.hpp"
+#include "boo2/audiodev/IAudioCapture.hpp"
 #include "boo2/audiodev/IAudioSubmix.hpp"
 #include "boo2/audiodev/IAudioVoice.hpp"
 #include "boo2/audiodev/IMIDIPort.hpp"
@@ -16,8 +20,12 @@ struct IAudioVoiceEngine;
 
 /** Time-sensitive event callback for synchronizing the client with rendered audio waveform */
 struct IAudioVoiceEngineCallback {
-  /** All mixing occurs in virtual 5ms intervals;
-   *  this is called at the start of each interval for all mixable entities */
+  /** All mixing occurs in blocks of AudioVoiceEngineOptions::m_blockMs;
+   *  this is called at the start of each block with its duration in seconds.
+   *  The default forwards to on5MsInterval() for existing clients */
+  virtual void onBlockInterval(IAudioVoiceEngine& engine, double dt) { on5MsInterval(engine, dt); }
+
+  /** Former name of onBlockInterval(), called with the same (not necessarily 5ms) durations */
   virtual void on5MsInterval(IAudioVoiceEngine& engine, double dt) {}
 
   /** When a pumping cycle is complete this is called to allow the client to
@@ -25,6 +33,59 @@ struct IAudioVoiceEngineCallback {
   virtual void onPumpCycleComplete(IAudioVoiceEngine& engine) {}
 };
 
+/** Optional configuration for the host platform's voice engine */
+struct AudioVoiceEngineOptions {
+  /** Mix on a backend-owned thread driven by the audio server rather than from
+   *  pumpAndMixVoices(). IAudioVoiceEngineCallback events then arrive on that thread,
+   *  and pumpAndMixVoices() only services deferred device changes. Combine with
+   *  m_realtimeMixing to raise that thread's priority. (PulseAudio only) */
+  bool m_threadedMixing = false;
+
+  /** Length of an internal mixing block in milliseconds, clamped to [1, 50]. Engine callbacks,
+   *  resampler input and backend periods follow it; 10-20ms blocks cut per-block overhead in
+   *  offline rendering and dense scenes, 1-2ms blocks suit low-latency monitoring */
+  double m_blockMs = 5.0;
+
+  /** Mix voices and submixes at this rate whatever the device runs at, converting the finished
+   *  mix once on output. Device switches then replace that one resampler instead of every voice's,
+   *  and effect state survives them. 0 mixes at the device rate */
+  double m_mixSampleRate = 0.0;
+
+  /** Requested output buffering in milliseconds; 0 keeps the backend's conservative default.
+   *  Values down to 10-20ms are reasonable when the mixer keeps up. (PulseAudio and ALSA) */
+  double m_targetLatencyMs = 0.0;
+
+  /** Grow the output buffer on underruns and shrink it back toward m_targetLatencyMs
+   *  after a sustained period without them. (PulseAudio only) */
+  bool m_adaptiveLatency = false;
+
+  /** Treat whichever thread mixes as real-time: request SCHED_FIFO (then SCHED_RR, then a raised
+   *  nice value; THREAD_PRIORITY_TIME_CRITICAL on Windows), pre-fault scratch buffers at their
+   *  largest mix size and mlock engine-owned buffers. Query getRealtimeStatus() for what was
+   *  actually granted */
+  bool m_realtimeMixing = false;
+};
+
+/** Real-time guarantees obtained for the mixing thread (see AudioVoiceEngineOptions::m_realtimeMixing) */
+struct AudioRealtimeStatus {
+  enum class Scheduling { Default, Elevated, RoundRobin, FIFO };
+  Scheduling m_scheduling = Scheduling::Default;
+  /** Real-time priority for RoundRobin/FIFO; nice value for Elevated */
+  int m_priority = 0;
+  bool m_memoryLocked = false;
+  bool m_buffersPrefaulted = false;
+};
+
+/** Mixing-thread cost of the engine's pumps since timing was enabled (see IAudioVoiceEngine::enableMixTiming()),
+ *  for tracking mixer performance across builds. Client callbacks run by the pump are included,
+ *  except onPumpCycleComplete() */
+struct AudioMixTiming {
+  uint64_t m_pumps = 0;
+  uint64_t m_frames = 0;          /**< Output frames the pumps produced */
+  double m_meanNsPerFrame = 0.0;  /**< Total pump time over m_frames */
+  double m_worstNsPerFrame = 0.0; /**< Costliest single pump, per frame */
+};
+
 /** Mixing and sample-rate-conversion system. Allocates voices and mixes them
  *  before sending the final samples to an OS-supplied audio-queue */
 struct IAudioVoiceEngine {
@@ -44,8 +105,27 @@ struct IAudioVoiceEngine {
   virtual ObjToken<IAudioVoice> allocateNewStereoVoice(double sampleRate, IAudioVoiceCallback* cb,
                                                        bool dynamicPitch = false) = 0;
 
-  /** Client calls this to allocate a Submix for gathering audio together for effects processing */
-  virtual ObjToken<IAudioSubmix> allocateNewSubmix(bool mainOut, IAudioSubmixCallback* cb, int busId) = 0;
+  /** Same as allocateNewMonoVoice, but source audio interleaves the channels listed in channels, in order.
+   *  The voice routes each source channel to the matching output channel until levels are set;
+   *  setMultichannelLevels() mixes any source channel to any output. Returns null unless channels
+   *  holds 1 to 8 channels */
+  virtual ObjToken<IAudioVoice> allocateNewMultichannelVoice(double sampleRate, const ChannelMap& channels,
+                                                             IAudioVoiceCallback* cb, bool dynamicPitch = false) = 0;
+
+  /** Allocate a voice that plays info's resident sample entirely inside the engine; looping, the gain
+   *  and pitch envelopes and velocity need no callback. start() triggers the note from the first frame
+   *  (retriggering if it's playing) and stop() enters the release stage; the voice stops itself once
+   *  the gain envelope or a one-shot sample ends, and releasing the token cuts it off. Channel levels
+   *  and pitch control work as on other voices. Returns null unless info holds mono or stereo samples.
+   *  ADPCM samples are decoded as they play, so they stay resident at 4 bits per sample */
+  virtual ObjToken<IAudioVoice> allocateNewSamplerVoice(const AudioSamplerInfo& info) = 0;
+
+  /** Client calls this to allocate a Submix for gathering audio together for effects processing.
+   *  A rateDivider above 1 (at most 8) runs the effect at the master rate divided by it, for buses
+   *  like reverb that don't need full bandwidth. Audio into and out of the submix stays at the master
+   *  rate; the polyphase filtering bandlimits it and delays it by 24 * rateDivider - 1 frames */
+  virtual ObjToken<IAudioSubmix> allocateNewSubmix(bool mainOut, IAudioSubmixCallback* cb, int busId,
+                                                   unsigned rateDivider = 1) = 0;
 
   /** Client can register for key callback events from the mixing engine this way */
   virtual void setCallbackInterface(IAudioVoiceEngineCallback* cb) = 0;
@@ -62,6 +142,29 @@ struct IAudioVoiceEngine {
   /** Enable or disable Lt/Rt surround encoding. If successful, getAvailableSet() will return Surround51 */
   virtual bool enableLtRt(bool enable) = 0;
 
+  /** Enable binaural rendering for headphones through hrirs (null to disable); replaces Lt/Rt.
+   *  If successful, getAvailableSet() will return Surround71 and voices panned across it are
+   *  heard from their virtual speaker directions */
+  virtual bool enableHRTF(std::shared_ptr<const AudioHRIRSet> hrirs) = 0;
+
+  /** Record the final output (or, with submix set, that submix after its effect) to a WAV or raw
+   *  float file while playback continues. The mixing thread copies each block into a ring holding
+   *  bufferSeconds of audio, and a background thread writes it out; blocks that find the ring full
+   *  are dropped and counted in getStats(). Returns null if path can't be opened */
+  virtual ObjToken<IAudioCapture> captureToFile(IAudioSubmix* submix, const char* path, AudioCaptureFile format,
+                                                double bufferSeconds = 1.0) = 0;
+
+  /** As captureToFile(), delivering the blocks to cb on the capture's writer thread instead */
+  virtual ObjToken<IAudioCapture> captureToCallback(IAudioSubmix* submix, IAudioCaptureCallback* cb,
+                                                    double bufferSeconds = 1.0) = 0;
+
+  /** Start (from silence) or stop measuring the final output in the device format
+   *  (see IAudioSubmix::enableMetering() for buses) */
+  virtual void enableOutputMetering(bool enable) = 0;
+
+  /** Latest output levels published by the mixer; never blocks it */
+  virtual AudioMeterReading getOutputMeterReading() const = 0;
+
   /** Get current Audio output in use */
   virtual std::string getCurrentAudioOutput() const = 0;
 
@@ -98,17 +201,47 @@ struct IAudioVoiceEngine {
   /** If this returns true, MIDI callbacks are assumed to be *not* thread-safe; need protection via mutex */
   virtual bool useMIDILock() const = 0;
 
-  /** Get canonical count of frames for each 5ms output block */
+  /** Get canonical count of frames for each mixing block at the mixing rate
+   *  (see AudioVoiceEngineOptions::m_blockMs and m_mixSampleRate) */
+  virtual size_t getBlockFrames() const = 0;
+
+  /** Get count of frames at the mixing rate spanning 5ms, the duration of parameter slews */
   virtual size_t get5MsFrames() const = 0;
+
+  /** Most recently measured delay in seconds between mixing a frame and hearing it; 0 if unknown */
+  virtual double getOutputLatency() const = 0;
+
+  /** Guarantees granted to the mixing thread; scheduling stays at its defaults until it has mixed once */
+  virtual AudioRealtimeStatus getRealtimeStatus() const = 0;
+
+  /** Start (from zero) or stop timing the mixer's pumps; off by default */
+  virtual void enableMixTiming(bool enable) = 0;
+
+  /** Pump timing gathered so far; never blocks the mixer */
+  virtual AudioMixTiming getMixTiming() const = 0;
 };
 
 /** Construct host platform's voice engine */
-std::unique_ptr<IAudioVoiceEngine> NewAudioVoiceEngine();
+std::unique_ptr<IAudioVoiceEngine> NewAudioVoiceEngine(const AudioVoiceEngineOptions& options = {});
 
-/** Construct WAV-rendering voice engine */
-std::unique_ptr<IAudioVoiceEngine> NewWAVAudioVoiceEngine(const char* path, double sampleRate, int numChans);
+/** Construct WAV-rendering voice engine; m_threadedMixing and the latency options don't apply to it */
+std::unique_ptr<IAudioVoiceEngine> NewWAVAudioVoiceEngine(const char* path, double sampleRate, int numChans,
+                                                          const AudioVoiceEngineOptions& options = {});
 #if _WIN32
-std::unique_ptr<IAudioVoiceEngine> NewWAVAudioVoiceEngine(const wchar_t* path, double sampleRate, int numChans);
+std::unique_ptr<IAudioVoiceEngine> NewWAVAudioVoiceEngine(const wchar_t* path, double sampleRate, int numChans,
+                                                          const AudioVoiceEngineOptions& options = {});
+#endif
+
+/** Switch an engine from NewWAVAudioVoiceEngine to a new output rate, as a device change would.
+ *  Later blocks are written at that rate; the WAV header keeps the original one */
+void ResetWAVAudioVoiceEngineSampleRate(IAudioVoiceEngine& engine, double sampleRate);
+
+#if __linux__
+/** Construct voice engine driving an ALSA PCM directly, without a sound server.
+ *  Any PCM name is accepted ("default", "hw:0", "null", file plugin definitions, ...).
+ *  Returns empty unique_ptr if the PCM can't be opened and configured */
+std::unique_ptr<IAudioVoiceEngine> NewALSAAudioVoiceEngine(const char* pcmName = "default",
+                                                           const AudioVoiceEngineOptions& options = {});
 #endif
 
 } // namespace boo2
\ No newline at end of file
@@ -45,6 +45,7 @@ template <class N, class H, class P = IObj> struct ListNode : P {
   H m_head;
   N* m_next;
   N* m_prev = nullptr;
+  bool m_linked = true;
   ListNode(H head) : m_head(head) {
     auto lk = N::_getHeadLock(head);
     m_next = N::_getHeadPtr(head);
@@ -54,7 +55,8 @@ template <class N, class H, class P = IObj> struct ListNode : P {
   }
 
 protected:
-  ~ListNode() {
+  /* Removes the node from its list ahead of destruction; the caller holds the head lock */
+  void _unlink() {
     if (m_prev) {
       if (m_next)
         m_next->m_prev = m_prev;
@@ -64,6 +66,12 @@ protected:
         m_next->m_prev = nullptr;
       N::_getHeadPtr(m_head) = m_next;
     }
+    m_linked = false;
+  }
+
+  ~ListNode() {
+    if (m_linked)
+      _unlink();
   }
 };
 
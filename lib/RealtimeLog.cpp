@@ -0,0 +1,216 @@
+#include "RealtimeLog.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace boo2 {
+static logvisor::Module Log("boo::RealtimeLog");
+
+namespace {
+/* A drained argument, resolved against its record's text */
+struct RealtimeLogValue {
+  const RealtimeLogArg* m_arg;
+  const char* m_text;
+};
+} // namespace
+} // namespace boo2
+
+/* Formats a captured argument with the replacement field's own spec */
+template <>
+struct fmt::formatter<boo2::RealtimeLogValue> {
+  char m_field[32] = {};
+  size_t m_fieldLength = 0;
+
+  constexpr auto parse(format_parse_context& ctx) {
+    m_field[0] = '{';
+    m_field[1] = ':';
+    m_fieldLength = 2;
+    auto it = ctx.begin();
+    for (; it != ctx.end() && *it != '}'; ++it)
+      if (m_fieldLength < sizeof(m_field) - 1)
+        m_field[m_fieldLength++] = *it;
+    m_field[m_fieldLength++] = '}';
+    return it;
+  }
+
+  template <typename T>
+  std::string _format(const T& value) const {
+    return fmt::vformat(fmt::string_view(m_field, m_fieldLength), fmt::make_format_args(value));
+  }
+
+  template <typename FormatContext>
+  auto format(const boo2::RealtimeLogValue& value, FormatContext& ctx) const {
+    using Type = boo2::RealtimeLogArg::Type;
+    const boo2::RealtimeLogArg& arg = *value.m_arg;
+    std::string str;
+    switch (arg.m_type) {
+    case Type::None:
+      break;
+    case Type::Bool: {
+      bool b = arg.m_unsigned != 0;
+      str = _format(b);
+      break;
+    }
+    case Type::Signed:
+      str = _format(arg.m_signed);
+      break;
+    case Type::Unsigned:
+      str = _format(arg.m_unsigned);
+      break;
+    case Type::Float:
+      str = _format(arg.m_float);
+      break;
+    case Type::Pointer:
+      str = _format(arg.m_pointer);
+      break;
+    case Type::String: {
+      fmt::string_view view(value.m_text + arg.m_string.m_offset, arg.m_string.m_length);
+      str = _format(view);
+      break;
+    }
+    }
+    return std::copy(str.begin(), str.end(), ctx.out());
+  }
+};
+
+namespace boo2 {
+namespace {
+/* Bounded multi-producer queue after Vyukov: each slot's sequence says whose turn it is.
+ * Producers claim a position with one CAS; the drain thread is the only consumer */
+class RealtimeLogRing {
+  static constexpr size_t Capacity = 256;
+  static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+  struct Slot {
+    std::atomic<size_t> m_sequence;
+    RealtimeLogRecord m_record;
+  };
+  Slot m_slots[Capacity];
+  alignas(64) std::atomic<size_t> m_enqueuePos{0};
+  alignas(64) size_t m_dequeuePos = 0;
+  std::atomic<size_t> m_dropped{0};
+
+public:
+  RealtimeLogRing() {
+    for (size_t i = 0; i < Capacity; ++i)
+      m_slots[i].m_sequence.store(i, std::memory_order_relaxed);
+  }
+
+  void push(const RealtimeLogRecord& record) {
+    size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+      slot = &m_slots[pos & (Capacity - 1)];
+      size_t seq = slot->m_sequence.load(std::memory_order_acquire);
+      intptr_t diff = intptr_t(seq) - intptr_t(pos);
+      if (diff == 0) {
+        if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      } else {
+        pos = m_enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+    slot->m_record = record;
+    slot->m_sequence.store(pos + 1, std::memory_order_release);
+  }
+
+  /* Drain thread only */
+  bool pop(RealtimeLogRecord& record) {
+    Slot& slot = m_slots[m_dequeuePos & (Capacity - 1)];
+    if (slot.m_sequence.load(std::memory_order_acquire) != m_dequeuePos + 1)
+      return false;
+    record = slot.m_record;
+    slot.m_sequence.store(m_dequeuePos + Capacity, std::memory_order_release);
+    ++m_dequeuePos;
+    return true;
+  }
+
+  size_t takeDropped() { return m_dropped.exchange(0, std::memory_order_relaxed); }
+};
+
+RealtimeLogRing Ring;
+
+/* Serializes starting and stopping the drain thread */
+std::mutex LifecycleMutex;
+std::thread DrainThread;
+unsigned DrainRefs = 0;
+
+std::mutex DrainMutex;
+std::condition_variable DrainCv;
+bool DrainStop = false;
+
+/* Latency a drained report may have; real-time threads never wake the drain */
+constexpr std::chrono::milliseconds DrainInterval(50);
+
+void Report(const RealtimeLogRecord& record) {
+  RealtimeLogValue values[RealtimeLogRecord::MaxArgs];
+  for (unsigned i = 0; i < RealtimeLogRecord::MaxArgs; ++i)
+    values[i] = {&record.m_args[i], record.m_text};
+  fmt::string_view format(record.m_format, record.m_formatLength);
+  std::string message;
+  try {
+    message = fmt::vformat(format, fmt::make_format_args(values[0], values[1], values[2], values[3]));
+  } catch (const fmt::format_error&) {
+    message = std::string(format.data(), format.size());
+  }
+  record.m_module->report(record.m_level, FMT_STRING("{}"), message);
+}
+
+void DrainRing() {
+  RealtimeLogRecord record;
+  while (Ring.pop(record))
+    Report(record);
+  if (size_t dropped = Ring.takeDropped())
+    Log.report(logvisor::Warning, FMT_STRING("{} real-time reports dropped; log ring full"), dropped);
+}
+
+void DrainProc() {
+  logvisor::RegisterThreadName("Boo Realtime Log");
+  std::unique_lock<std::mutex> lk(DrainMutex);
+  while (!DrainCv.wait_for(lk, DrainInterval, []() { return DrainStop; })) {
+    lk.unlock();
+    DrainRing();
+    lk.lock();
+  }
+  lk.unlock();
+  DrainRing();
+}
+} // namespace
+
+void RealtimeLogPush(const RealtimeLogRecord& record) { Ring.push(record); }
+
+void RealtimeLogFatal(const RealtimeLogRecord& record) {
+  Report(record);
+  std::abort();
+}
+
+RealtimeLogDrain::RealtimeLogDrain() {
+  std::unique_lock<std::mutex> lifeLk(LifecycleMutex);
+  if (DrainRefs++ == 0) {
+    DrainStop = false;
+    DrainThread = std::thread(DrainProc);
+  }
+}
+
+RealtimeLogDrain::~RealtimeLogDrain() {
+  std::unique_lock<std::mutex> lifeLk(LifecycleMutex);
+  if (--DrainRefs != 0)
+    return;
+  {
+    std::unique_lock<std::mutex> lk(DrainMutex);
+    DrainStop = true;
+  }
+  DrainCv.notify_one();
+  DrainThread.join();
+}
+
+} // namespace boo2
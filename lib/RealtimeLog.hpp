@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+#include <logvisor/logvisor.hpp>
+
+namespace boo2 {
+
+/** One argument of a deferred report, captured by value */
+struct RealtimeLogArg {
+  enum class Type : uint8_t { None, Bool, Signed, Unsigned, Float, Pointer, String };
+  Type m_type = Type::None;
+  union {
+    int64_t m_signed;
+    uint64_t m_unsigned;
+    double m_float;
+    const void* m_pointer;
+    /* Range of the record's text */
+    struct {
+      uint16_t m_offset;
+      uint16_t m_length;
+    } m_string;
+  };
+  RealtimeLogArg() : m_unsigned(0) {}
+};
+
+/** A report as captured on a real-time thread. The format is a string literal, so its address
+ *  identifies it; arguments keep their values (strings are copied, truncated to fit) and are only
+ *  formatted once drained */
+struct RealtimeLogRecord {
+  static constexpr unsigned MaxArgs = 4;
+  static constexpr size_t MaxText = 128;
+
+  logvisor::Module* m_module = nullptr;
+  logvisor::Level m_level = logvisor::Info;
+  const char* m_format = nullptr;
+  size_t m_formatLength = 0;
+  RealtimeLogArg m_args[MaxArgs];
+  unsigned m_argCount = 0;
+  uint16_t m_textLength = 0;
+  char m_text[MaxText];
+
+  template <typename T>
+  void capture(const T& value) {
+    RealtimeLogArg& arg = m_args[m_argCount++];
+    if constexpr (std::is_same_v<T, bool>) {
+      arg.m_type = RealtimeLogArg::Type::Bool;
+      arg.m_unsigned = value;
+    } else if constexpr (std::is_enum_v<T>) {
+      arg.m_type = RealtimeLogArg::Type::Signed;
+      arg.m_signed = int64_t(value);
+    } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+      arg.m_type = RealtimeLogArg::Type::Signed;
+      arg.m_signed = value;
+    } else if constexpr (std::is_integral_v<T>) {
+      arg.m_type = RealtimeLogArg::Type::Unsigned;
+      arg.m_unsigned = value;
+    } else if constexpr (std::is_floating_point_v<T>) {
+      arg.m_type = RealtimeLogArg::Type::Float;
+      arg.m_float = value;
+    } else if constexpr (std::is_convertible_v<const T&, const char*>) {
+      const char* str = value;
+      _captureString(arg, str ? std::string_view(str) : std::string_view("(null)"));
+    } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+      _captureString(arg, value);
+    } else if constexpr (std::is_pointer_v<T>) {
+      arg.m_type = RealtimeLogArg::Type::Pointer;
+      arg.m_pointer = value;
+    } else {
+      static_assert(sizeof(T) == 0, "argument type can't be captured by a real-time report");
+    }
+  }
+
+private:
+  void _captureString(RealtimeLogArg& arg, std::string_view str) {
+    size_t length = std::min(str.size(), MaxText - m_textLength);
+    std::memcpy(m_text + m_textLength, str.data(), length);
+    arg.m_type = RealtimeLogArg::Type::String;
+    arg.m_string.m_offset = m_textLength;
+    arg.m_string.m_length = uint16_t(length);
+    m_textLength += uint16_t(length);
+  }
+};
+
+/** Copy a record into the log ring; lock-free and allocation-free. A full ring drops the record,
+ *  and the drain reports how many were dropped */
+void RealtimeLogPush(const RealtimeLogRecord& record);
+
+/** Make a fatal report on the calling thread and abort */
+[[noreturn]] void RealtimeLogFatal(const RealtimeLogRecord& record);
+
+/** Log from a thread that must not block: same arguments as logvisor::Module::report(), but the
+ *  report is queued and made on the drain thread. Fatal reports are not queued: the process is
+ *  ending anyway, so they are made and abort right away, drain or not */
+template <typename S, typename... Args>
+void RealtimeReport(logvisor::Module& module, logvisor::Level level, const S& format, const Args&... args) {
+  static_assert(sizeof...(Args) <= RealtimeLogRecord::MaxArgs, "too many arguments for a real-time report");
+  const fmt::string_view formatView = format;
+  RealtimeLogRecord record;
+  record.m_module = &module;
+  record.m_level = level;
+  record.m_format = formatView.data();
+  record.m_formatLength = formatView.size();
+  (record.capture(args), ...);
+  if (level == logvisor::Fatal)
+    RealtimeLogFatal(record);
+  RealtimeLogPush(record);
+}
+
+/** Keeps the background thread that drains the log ring into logvisor running while any
+ *  instance exists. Owners of real-time threads hold one; the last to go flushes the ring */
+class RealtimeLogDrain {
+public:
+  RealtimeLogDrain();
+  ~RealtimeLogDrain();
+  RealtimeLogDrain(const RealtimeLogDrain&) = delete;
+  RealtimeLogDrain& operator=(const RealtimeLogDrain&) = delete;
+};
+
+} // namespace boo2
@@ -0,0 +1,262 @@
+#include "Trace.hpp"
+#include "boo2/Trace.hpp"
+
+#include <cstdio>
+
+#if BOO2_TRACE
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <fmt/format.h>
+
+#if _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#if __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace boo2 {
+namespace {
+constexpr size_t ThreadEvents = 65536;
+constexpr unsigned MaxThreads = 64;
+
+struct TraceEvent {
+  std::atomic<const char*> m_name;
+  std::atomic<uint64_t> m_begin;
+  std::atomic<uint64_t> m_end;
+};
+
+/* Events of one thread, oldest overwritten first. m_started counts events begun, m_finished
+ * events completed; a flush keeps only what m_started shows wasn't overwritten while it read */
+struct ThreadBuffer {
+  uint64_t m_tid;
+  std::atomic<const char*> m_name{nullptr};
+  std::atomic<size_t> m_started{0};
+  std::atomic<size_t> m_finished{0};
+  /* Flushing thread only */
+  size_t m_flushed = 0;
+  TraceEvent m_events[ThreadEvents];
+
+  explicit ThreadBuffer(uint64_t tid) : m_tid(tid) {}
+};
+
+/* A slot goes Unused -> Claimed -> Live when a thread first traces, Live -> Exited when that thread
+ * ends, and Exited -> Reusable once a flush has read its last events. A later thread claims a
+ * Reusable slot before an Unused one, so its buffer is recycled rather than another allocated */
+enum class SlotState : unsigned { Unused, Claimed, Live, Exited, Reusable };
+
+std::atomic<SlotState> SlotStates[MaxThreads];
+ThreadBuffer* Buffers[MaxThreads];
+std::mutex FlushMutex;
+
+/* Gives the slot back when its thread ends; later scopes on that thread record nothing */
+struct LocalSlot {
+  ThreadBuffer* m_buffer = nullptr;
+  unsigned m_slot = 0;
+  bool m_rejected = false;
+
+  ~LocalSlot() {
+    if (m_buffer)
+      SlotStates[m_slot].store(SlotState::Exited, std::memory_order_release);
+    m_buffer = nullptr;
+    m_rejected = true;
+  }
+};
+
+thread_local LocalSlot Local;
+
+uint64_t Now() {
+  return uint64_t(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+uint64_t ThreadId() {
+#if _WIN32
+  return GetCurrentThreadId();
+#elif __linux__
+  return uint64_t(syscall(SYS_gettid));
+#else
+  static std::atomic<uint64_t> Serial{0};
+  return Serial.fetch_add(1, std::memory_order_relaxed) + 1;
+#endif
+}
+
+uint64_t ProcessId() {
+#if _WIN32
+  return GetCurrentProcessId();
+#else
+  return uint64_t(getpid());
+#endif
+}
+
+bool ClaimSlot(unsigned slot, SlotState from) {
+  SlotState state = from;
+  return SlotStates[slot].compare_exchange_strong(state, SlotState::Claimed, std::memory_order_acquire,
+                                                  std::memory_order_relaxed);
+}
+
+/* First use on a thread claims a slot. A recycled buffer is reset for the new thread; a fresh one
+ * comes from calloc (never operator new, which allocation-trapped mixes forbid) and stays with its
+ * slot for the rest of the process */
+ThreadBuffer* GetBuffer() {
+  if (Local.m_buffer || Local.m_rejected)
+    return Local.m_buffer;
+  for (unsigned slot = 0; slot < MaxThreads; ++slot) {
+    if (!ClaimSlot(slot, SlotState::Reusable))
+      continue;
+    ThreadBuffer* buf = Buffers[slot];
+    buf->m_tid = ThreadId();
+    buf->m_name.store(nullptr, std::memory_order_relaxed);
+    buf->m_started.store(0, std::memory_order_relaxed);
+    buf->m_finished.store(0, std::memory_order_relaxed);
+    SlotStates[slot].store(SlotState::Live, std::memory_order_release);
+    Local.m_slot = slot;
+    return Local.m_buffer = buf;
+  }
+  for (unsigned slot = 0; slot < MaxThreads; ++slot) {
+    if (!ClaimSlot(slot, SlotState::Unused))
+      continue;
+    void* mem = std::calloc(1, sizeof(ThreadBuffer));
+    if (!mem) {
+      SlotStates[slot].store(SlotState::Unused, std::memory_order_release);
+      break;
+    }
+    Buffers[slot] = new (mem) ThreadBuffer(ThreadId());
+    SlotStates[slot].store(SlotState::Live, std::memory_order_release);
+    Local.m_slot = slot;
+    return Local.m_buffer = Buffers[slot];
+  }
+  Local.m_rejected = true;
+  return nullptr;
+}
+
+void AppendEscaped(std::string& json, const char* str) {
+  for (; *str; ++str) {
+    if (*str == '"' || *str == '\\')
+      json.push_back('\\');
+    json.push_back(*str);
+  }
+}
+} // namespace
+
+TraceScope::TraceScope(const char* name) : m_name(name), m_begin(Now()) { GetBuffer(); }
+
+TraceScope::~TraceScope() {
+  ThreadBuffer* buf = Local.m_buffer;
+  if (!buf)
+    return;
+  uint64_t end = Now();
+  size_t index = buf->m_finished.load(std::memory_order_relaxed);
+  buf->m_started.store(index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  TraceEvent& ev = buf->m_events[index % ThreadEvents];
+  ev.m_name.store(m_name, std::memory_order_relaxed);
+  ev.m_begin.store(m_begin, std::memory_order_relaxed);
+  ev.m_end.store(end, std::memory_order_relaxed);
+  buf->m_finished.store(index + 1, std::memory_order_release);
+}
+
+void TraceThreadName(const char* name) {
+  if (ThreadBuffer* buf = GetBuffer())
+    buf->m_name.store(name, std::memory_order_relaxed);
+}
+
+bool FlushTrace(std::string& json) {
+  std::unique_lock<std::mutex> lk(FlushMutex);
+  uint64_t pid = ProcessId();
+  json += "{\"traceEvents\":[";
+  bool first = true;
+  auto separate = [&]() {
+    if (!first)
+      json += ",\n";
+    first = false;
+  };
+
+  struct Event {
+    const char* m_name;
+    uint64_t m_begin;
+    uint64_t m_end;
+  };
+  std::vector<Event> events;
+  for (unsigned i = 0; i < MaxThreads; ++i) {
+    /* Only flushes move a slot out of Exited, so an exited thread's buffer stays put while read */
+    SlotState state = SlotStates[i].load(std::memory_order_acquire);
+    if (state != SlotState::Live && state != SlotState::Exited)
+      continue;
+    ThreadBuffer* buf = Buffers[i];
+
+    if (const char* name = buf->m_name.load(std::memory_order_relaxed)) {
+      separate();
+      json += fmt::format(FMT_STRING("{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":{},\"tid\":{},"
+                                     "\"args\":{{\"name\":\""),
+                          pid, buf->m_tid);
+      AppendEscaped(json, name);
+      json += "\"}}";
+    }
+
+    /* Read like a seqlock: events begun while copying may have overwritten the oldest ones */
+    size_t finished = buf->m_finished.load(std::memory_order_acquire);
+    size_t begin = std::max(buf->m_flushed, finished > ThreadEvents ? finished - ThreadEvents : size_t(0));
+    events.clear();
+    for (size_t e = begin; e < finished; ++e) {
+      TraceEvent& ev = buf->m_events[e % ThreadEvents];
+      events.push_back({ev.m_name.load(std::memory_order_relaxed), ev.m_begin.load(std::memory_order_relaxed),
+                        ev.m_end.load(std::memory_order_relaxed)});
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    size_t started = buf->m_started.load(std::memory_order_relaxed);
+    size_t valid = started > ThreadEvents ? started - ThreadEvents : 0;
+    buf->m_flushed = finished;
+
+    for (size_t e = std::max(begin, valid); e < finished; ++e) {
+      const Event& ev = events[e - begin];
+      separate();
+      json += "{\"name\":\"";
+      AppendEscaped(json, ev.m_name);
+      json += fmt::format(FMT_STRING("\",\"ph\":\"X\",\"pid\":{},\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}"), pid,
+                          buf->m_tid, ev.m_begin / 1000.0, (ev.m_end - ev.m_begin) / 1000.0);
+    }
+
+    /* Everything the exited thread recorded is out; hand its buffer to the next thread */
+    if (state == SlotState::Exited) {
+      buf->m_flushed = 0;
+      SlotStates[i].store(SlotState::Reusable, std::memory_order_release);
+    }
+  }
+
+  json += "\n],\"displayTimeUnit\":\"ns\"}\n";
+  return true;
+}
+
+bool FlushTrace(const char* path) {
+  std::string json;
+  FlushTrace(json);
+  FILE* fp = fopen(path, "wb");
+  if (!fp)
+    return false;
+  bool ok = fwrite(json.data(), 1, json.size(), fp) == json.size();
+  return fclose(fp) == 0 && ok;
+}
+
+} // namespace boo2
+#else
+namespace boo2 {
+
+bool FlushTrace(std::string&) { return false; }
+
+bool FlushTrace(const char*) { return false; }
+
+} // namespace boo2
+#endif
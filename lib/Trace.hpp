@@ -0,0 +1,35 @@
+#pragma once
+
+#if BOO2_TRACE
+#include <cstdint>
+#endif
+
+namespace boo2 {
+
+#if BOO2_TRACE
+/** Records the time spent in its scope to the calling thread's trace buffer, flushed by
+ *  FlushTrace(). name must be a string literal. Lock-free and allocation-free after the thread's
+ *  first scope. Only active in BOO2_TRACE builds; otherwise compiles away. */
+class TraceScope {
+  const char* m_name;
+  uint64_t m_begin;
+
+public:
+  explicit TraceScope(const char* name);
+  ~TraceScope();
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+};
+
+/** Label the calling thread in flushed traces; name must be a string literal */
+void TraceThreadName(const char* name);
+#else
+class TraceScope {
+public:
+  explicit TraceScope(const char*) {}
+};
+
+inline void TraceThreadName(const char*) {}
+#endif
+
+} // namespace boo2
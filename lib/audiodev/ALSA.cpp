@@ -0,0 +1,417 @@
+#include "AudioVoiceEngine.hpp"
+
+#include "LinuxMidi.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <logvisor/logvisor.hpp>
+
+namespace boo2 {
+logvisor::Module ALSALog("boo::ALSA");
+
+/* Legacy-equivalent buffering when no target latency is requested */
+static constexpr double DefaultBufferMs = 120.0;
+
+static constexpr unsigned DefaultSampleRate = 48000;
+
+/* Mix formats in order of preference; float is rendered directly into the mmap area */
+static constexpr std::array<snd_pcm_format_t, 3> PreferredFormats = {
+    {SND_PCM_FORMAT_FLOAT_LE, SND_PCM_FORMAT_S32_LE, SND_PCM_FORMAT_S16_LE}};
+
+struct ALSAAudioVoiceEngine : LinuxMidi {
+  snd_pcm_t* m_pcm = nullptr;
+  std::string m_pcmName;
+  snd_pcm_format_t m_format = SND_PCM_FORMAT_UNKNOWN;
+  snd_pcm_uframes_t m_bufferFrames = 0;
+  bool m_mmap = false;
+
+  /* Mix target when the device format isn't float or the PCM can't be mapped */
+  std::vector<float> m_staging;
+
+  /* Negotiated parameters of a PCM that hasn't replaced m_pcm yet */
+  struct PCMSetup {
+    snd_pcm_format_t m_format = SND_PCM_FORMAT_UNKNOWN;
+    unsigned m_sampleRate = 0;
+    snd_pcm_uframes_t m_periodFrames = 0;
+    snd_pcm_uframes_t m_bufferFrames = 0;
+    bool m_mmap = false;
+    AudioVoiceEngineMixInfo m_mixInfo;
+  };
+
+  static void _parseChannelMap(snd_pcm_t* pcm, unsigned channels, AudioVoiceEngineMixInfo& mixInfo) {
+    ChannelMap& chmapOut = mixInfo.m_channelMap;
+    chmapOut.m_channelCount = channels;
+
+    /* ALSA's default ordering is used when the PCM can't report one */
+    static const std::array<AudioChannel, 8> DefaultOrder = {
+        {AudioChannel::FrontLeft, AudioChannel::FrontRight, AudioChannel::RearLeft, AudioChannel::RearRight,
+         AudioChannel::FrontCenter, AudioChannel::LFE, AudioChannel::SideLeft, AudioChannel::SideRight}};
+    for (unsigned c = 0; c < channels; ++c)
+      chmapOut.m_channels[c] = c < DefaultOrder.size() ? DefaultOrder[c] : AudioChannel::Unknown;
+
+    if (snd_pcm_chmap_t* chm = snd_pcm_get_chmap(pcm)) {
+      for (unsigned c = 0; c < std::min(chm->channels, channels); ++c) {
+        switch (chm->pos[c]) {
+        case SND_CHMAP_FL:
+          chmapOut.m_channels[c] = AudioChannel::FrontLeft;
+          break;
+        case SND_CHMAP_FR:
+          chmapOut.m_channels[c] = AudioChannel::FrontRight;
+          break;
+        case SND_CHMAP_RL:
+          chmapOut.m_channels[c] = AudioChannel::RearLeft;
+          break;
+        case SND_CHMAP_RR:
+          chmapOut.m_channels[c] = AudioChannel::RearRight;
+          break;
+        case SND_CHMAP_FC:
+          chmapOut.m_channels[c] = AudioChannel::FrontCenter;
+          break;
+        case SND_CHMAP_LFE:
+          chmapOut.m_channels[c] = AudioChannel::LFE;
+          break;
+        case SND_CHMAP_SL:
+          chmapOut.m_channels[c] = AudioChannel::SideLeft;
+          break;
+        case SND_CHMAP_SR:
+          chmapOut.m_channels[c] = AudioChannel::SideRight;
+          break;
+        default:
+          chmapOut.m_channels[c] = AudioChannel::Unknown;
+          break;
+        }
+      }
+      free(chm);
+    }
+
+    switch (channels) {
+    case 2:
+      mixInfo.m_channels = AudioChannelSet::Stereo;
+      break;
+    case 4:
+      mixInfo.m_channels = AudioChannelSet::Quad;
+      break;
+    case 6:
+      mixInfo.m_channels = AudioChannelSet::Surround51;
+      break;
+    case 8:
+      mixInfo.m_channels = AudioChannelSet::Surround71;
+      break;
+    default:
+      mixInfo.m_channels = AudioChannelSet::Unknown;
+      break;
+    }
+  }
+
+  /* Channels to ask of a PCM: its widest channel map, else its only channel count, else stereo.
+   * Plugin PCMs (default, plug, dmix, null) accept almost any count and would have alsa-lib fold
+   * a surround mix down to stereo hardware, leaving Lt/Rt and HRTF off */
+  static unsigned _preferredChannels(snd_pcm_t* pcm, snd_pcm_hw_params_t* hwParams) {
+    unsigned channels = 0;
+    if (snd_pcm_chmap_query_t** maps = snd_pcm_query_chmaps(pcm)) {
+      for (snd_pcm_chmap_query_t** query = maps; *query; ++query) {
+        unsigned count = (*query)->map.channels;
+        if (count <= 8 && count > channels && snd_pcm_hw_params_test_channels(pcm, hwParams, count) == 0)
+          channels = count;
+      }
+      snd_pcm_free_chmaps(maps);
+    }
+    if (channels)
+      return channels;
+
+    unsigned minChannels = 0, maxChannels = 0;
+    if (snd_pcm_hw_params_get_channels_min(hwParams, &minChannels) >= 0 &&
+        snd_pcm_hw_params_get_channels_max(hwParams, &maxChannels) >= 0 && minChannels == maxChannels &&
+        minChannels <= 8)
+      return minChannels;
+    return 2;
+  }
+
+  bool _negotiate(snd_pcm_t* pcm, PCMSetup& setup) const {
+    snd_pcm_hw_params_t* hwParams;
+    snd_pcm_hw_params_alloca(&hwParams);
+    int err;
+    if ((err = snd_pcm_hw_params_any(pcm, hwParams)) < 0) {
+      ALSALog.report(logvisor::Error, FMT_STRING("Unable to snd_pcm_hw_params_any(): {}"), snd_strerror(err));
+      return false;
+    }
+
+    setup.m_mmap = snd_pcm_hw_params_set_access(pcm, hwParams, SND_PCM_ACCESS_MMAP_INTERLEAVED) >= 0;
+    if (!setup.m_mmap && (err = snd_pcm_hw_params_set_access(pcm, hwParams, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
+      ALSALog.report(logvisor::Error, FMT_STRING("No interleaved access available: {}"), snd_strerror(err));
+      return false;
+    }
+
+    setup.m_format = SND_PCM_FORMAT_UNKNOWN;
+    for (snd_pcm_format_t fmt : PreferredFormats) {
+      if (snd_pcm_hw_params_set_format(pcm, hwParams, fmt) >= 0) {
+        setup.m_format = fmt;
+        break;
+      }
+    }
+    if (setup.m_format == SND_PCM_FORMAT_UNKNOWN) {
+      ALSALog.report(logvisor::Error, FMT_STRING("No supported sample format; try a plughw: device"));
+      return false;
+    }
+
+    unsigned channels = _preferredChannels(pcm, hwParams);
+    if ((err = snd_pcm_hw_params_set_channels_near(pcm, hwParams, &channels)) < 0) {
+      ALSALog.report(logvisor::Error, FMT_STRING("Unable to set channel count: {}"), snd_strerror(err));
+      return false;
+    }
+
+    setup.m_sampleRate = DefaultSampleRate;
+    if ((err = snd_pcm_hw_params_set_rate_near(pcm, hwParams, &setup.m_sampleRate, nullptr)) < 0) {
+      ALSALog.report(logvisor::Error, FMT_STRING("Unable to set sample rate: {}"), snd_strerror(err));
+      return false;
+    }
+
+    /* Ask for one mixing block per period and let the driver round to what it supports */
+    setup.m_periodFrames = _blockFramesForRate(setup.m_sampleRate);
+    if ((err = snd_pcm_hw_params_set_period_size_near(pcm, hwParams, &setup.m_periodFrames, nullptr)) < 0) {
+      ALSALog.report(logvisor::Error, FMT_STRING("Unable to set period size: {}"), snd_strerror(err));
+      return false;
+    }
+
+    double bufferMs = m_options.m_targetLatencyMs > 0.0 ? m_options.m_targetLatencyMs : DefaultBufferMs;
+    double bufferFrames = bufferMs * setup.m_sampleRate / 1000.0;
+    snd_pcm_uframes_t periods =
+        std::max(snd_pcm_uframes_t(std::ceil(bufferFrames / setup.m_periodFrames)), snd_pcm_uframes_t(2));
+    setup.m_bufferFrames = setup.m_periodFrames * periods;
+    if ((err = snd_pcm_hw_params_set_buffer_size_near(pcm, hwParams, &setup.m_bufferFrames)) < 0) {
+      ALSALog.report(logvisor::Error, FMT_STRING("Unable to set buffer size: {}"), snd_strerror(err));
+      return false;
+    }
+
+    if ((err = snd_pcm_hw_params(pcm, hwParams)) < 0) {
+      ALSALog.report(logvisor::Error, FMT_STRING("Unable to snd_pcm_hw_params(): {}"), snd_strerror(err));
+      return false;
+    }
+    snd_pcm_hw_params_get_period_size(hwParams, &setup.m_periodFrames, nullptr);
+    snd_pcm_hw_params_get_buffer_size(hwParams, &setup.m_bufferFrames);
+
+    /* Playback is started explicitly once the buffer has been primed */
+    snd_pcm_sw_params_t* swParams;
+    snd_pcm_sw_params_alloca(&swParams);
+    snd_pcm_sw_params_current(pcm, swParams);
+    snd_pcm_sw_params_set_avail_min(pcm, swParams, setup.m_periodFrames);
+    snd_pcm_sw_params_set_start_threshold(pcm, swParams, setup.m_bufferFrames);
+    if ((err = snd_pcm_sw_params(pcm, swParams)) < 0) {
+      ALSALog.report(logvisor::Error, FMT_STRING("Unable to snd_pcm_sw_params(): {}"), snd_strerror(err));
+      return false;
+    }
+
+    setup.m_mixInfo.m_sampleRate = setup.m_sampleRate;
+    setup.m_mixInfo.m_bitsPerSample = 32;
+    setup.m_mixInfo.m_periodFrames = setup.m_periodFrames;
+    _parseChannelMap(pcm, channels, setup.m_mixInfo);
+    return true;
+  }
+
+  /* Opens and configures name; the current PCM is only replaced on success */
+  bool _openPCM(const char* name) {
+    snd_pcm_t* pcm;
+    int err;
+    if ((err = snd_pcm_open(&pcm, name, SND_PCM_STREAM_PLAYBACK, 0)) < 0) {
+      ALSALog.report(logvisor::Error, FMT_STRING("Unable to snd_pcm_open({}): {}"), name, snd_strerror(err));
+      return false;
+    }
+
+    PCMSetup setup;
+    if (!_negotiate(pcm, setup)) {
+      snd_pcm_close(pcm);
+      return false;
+    }
+
+    if (m_pcm)
+      snd_pcm_close(m_pcm);
+    m_pcm = pcm;
+    m_pcmName = name;
+    m_format = setup.m_format;
+    m_bufferFrames = setup.m_bufferFrames;
+    m_mmap = setup.m_mmap;
+    m_mixInfo = setup.m_mixInfo;
+    _setBlockFrames(setup.m_sampleRate);
+    if (m_format != SND_PCM_FORMAT_FLOAT_LE || !m_mmap)
+      m_staging.resize(m_bufferFrames * m_mixInfo.m_channelMap.m_channelCount);
+    else
+      m_staging = std::vector<float>();
+
+    ALSALog.report(logvisor::Info, FMT_STRING("Opened {}: {} Hz, {} channels, {} frame periods, {} frame buffer{}"),
+                   name, setup.m_sampleRate, m_mixInfo.m_channelMap.m_channelCount, setup.m_periodFrames,
+                   m_bufferFrames, m_mmap ? ", mmap" : "");
+    _resetSampleRate();
+    return true;
+  }
+
+  explicit ALSAAudioVoiceEngine(const char* pcmName, const AudioVoiceEngineOptions& options) : LinuxMidi(options) {
+    _openPCM(pcmName);
+  }
+
+  ~ALSAAudioVoiceEngine() override {
+    if (m_pcm) {
+      snd_pcm_drop(m_pcm);
+      snd_pcm_close(m_pcm);
+    }
+  }
+
+  /* Handles underruns and suspends; false if the PCM is unusable */
+  bool _recover(int err) {
+    if (err == -EPIPE)
+      RealtimeReport(ALSALog, logvisor::Warning, FMT_STRING("Output underrun"));
+    if ((err = snd_pcm_recover(m_pcm, err, 1)) < 0) {
+      RealtimeReport(ALSALog, logvisor::Error, FMT_STRING("Unable to recover PCM: {}"), snd_strerror(err));
+      return false;
+    }
+    return true;
+  }
+
+  template <typename T>
+  static void _convertSamples(T* dst, const float* src, size_t count, float scale) {
+    for (size_t i = 0; i < count; ++i)
+      dst[i] = T(std::clamp(src[i], -1.f, 1.f) * scale);
+  }
+
+  /* Renders frames of mixed output into interleaved device-format memory */
+  void _renderTo(void* dst, size_t frames) {
+    if (m_format == SND_PCM_FORMAT_FLOAT_LE) {
+      _pumpAndMixVoices(frames, static_cast<float*>(dst));
+      return;
+    }
+    _pumpAndMixVoices(frames, m_staging.data());
+    size_t samples = frames * m_mixInfo.m_channelMap.m_channelCount;
+    if (m_format == SND_PCM_FORMAT_S32_LE)
+      _convertSamples(static_cast<int32_t*>(dst), m_staging.data(), samples, 2147483520.f);
+    else
+      _convertSamples(static_cast<int16_t*>(dst), m_staging.data(), samples, 32767.f);
+  }
+
+  /* Writes up to frames via snd_pcm_mmap_begin/commit; returns false after a failed recovery */
+  bool _writeMMap(snd_pcm_uframes_t frames) {
+    while (frames) {
+      const snd_pcm_channel_area_t* areas;
+      snd_pcm_uframes_t offset;
+      snd_pcm_uframes_t contig = frames;
+      int err;
+      if ((err = snd_pcm_mmap_begin(m_pcm, &areas, &offset, &contig)) < 0)
+        return _recover(err);
+
+      /* Interleaved: one area describes every channel of the frame */
+      uint8_t* dst = static_cast<uint8_t*>(areas[0].addr) + (areas[0].first + offset * areas[0].step) / 8;
+      _renderTo(dst, contig);
+
+      snd_pcm_sframes_t committed = snd_pcm_mmap_commit(m_pcm, offset, contig);
+      if (committed < 0)
+        return _recover(int(committed));
+      if (snd_pcm_uframes_t(committed) != contig)
+        return _recover(-EPIPE);
+      frames -= contig;
+    }
+    return true;
+  }
+
+  bool _writeRW(snd_pcm_uframes_t frames) {
+    size_t frameSz = snd_pcm_frames_to_bytes(m_pcm, 1);
+    std::vector<float>& buf = m_staging;
+    while (frames) {
+      snd_pcm_uframes_t chunk = std::min(frames, m_bufferFrames);
+      /* Non-float formats convert in place; the sample width never exceeds a float */
+      _renderTo(buf.data(), chunk);
+      const uint8_t* src = reinterpret_cast<const uint8_t*>(buf.data());
+      snd_pcm_uframes_t left = chunk;
+      while (left) {
+        snd_pcm_sframes_t written = snd_pcm_writei(m_pcm, src, left);
+        if (written < 0) {
+          if (!_recover(int(written)))
+            return false;
+          continue;
+        }
+        src += written * frameSz;
+        left -= written;
+      }
+      frames -= chunk;
+    }
+    return true;
+  }
+
+  void pumpAndMixVoices() override {
+    if (!m_pcm) {
+      /* Dummy pump mode */
+      _pumpDummy();
+      return;
+    }
+
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(m_pcm);
+    if (avail >= 0 && snd_pcm_uframes_t(avail) < m_mixInfo.m_periodFrames &&
+        snd_pcm_state(m_pcm) == SND_PCM_STATE_RUNNING) {
+      /* Block until at least one period can be written, like the PulseAudio mainloop iteration */
+      int timeoutMs = int(m_bufferFrames * 1000 / m_mixInfo.m_sampleRate) + 1;
+      int err = snd_pcm_wait(m_pcm, timeoutMs);
+      avail = err < 0 ? err : snd_pcm_avail_update(m_pcm);
+    }
+    if (avail < 0) {
+      if (!_recover(int(avail)))
+        return;
+      avail = snd_pcm_avail_update(m_pcm);
+      if (avail < 0)
+        return;
+    }
+
+    /* Whole periods only so the mixer always sees its configured interval */
+    snd_pcm_uframes_t frames = snd_pcm_uframes_t(avail) / m_mixInfo.m_periodFrames * m_mixInfo.m_periodFrames;
+    if (frames && !(m_mmap ? _writeMMap(frames) : _writeRW(frames)))
+      return;
+
+    if (snd_pcm_state(m_pcm) == SND_PCM_STATE_PREPARED) {
+      int err;
+      if ((err = snd_pcm_start(m_pcm)) < 0)
+        _recover(err);
+    }
+  }
+
+  double getOutputLatency() const override {
+    snd_pcm_sframes_t delay;
+    if (!m_pcm || snd_pcm_delay(m_pcm, &delay) < 0 || delay < 0)
+      return 0.0;
+    return delay / m_mixInfo.m_sampleRate;
+  }
+
+  std::vector<std::pair<std::string, std::string>> enumerateAudioOutputs() const override {
+    std::vector<std::pair<std::string, std::string>> ret;
+    void** hints;
+    if (snd_device_name_hint(-1, "pcm", &hints) < 0)
+      return ret;
+    for (void** h = hints; *h; ++h) {
+      char* name = snd_device_name_get_hint(*h, "NAME");
+      char* desc = snd_device_name_get_hint(*h, "DESC");
+      char* ioid = snd_device_name_get_hint(*h, "IOID");
+      /* A missing IOID means the device does both directions */
+      if (name && (!ioid || !strcmp(ioid, "Output")))
+        ret.emplace_back(name, desc ? desc : name);
+      free(name);
+      free(desc);
+      free(ioid);
+    }
+    snd_device_name_free_hint(hints);
+    return ret;
+  }
+
+  std::string getCurrentAudioOutput() const override { return m_pcmName; }
+
+  bool setCurrentAudioOutput(const char* name) override { return _openPCM(name); }
+};
+
+std::unique_ptr<IAudioVoiceEngine> NewALSAAudioVoiceEngine(const char* pcmName,
+                                                           const AudioVoiceEngineOptions& options) {
+  std::unique_ptr<IAudioVoiceEngine> ret = std::make_unique<ALSAAudioVoiceEngine>(pcmName, options);
+  if (!static_cast<ALSAAudioVoiceEngine&>(*ret).m_pcm)
+    return {};
+  return ret;
+}
+
+} // namespace boo2
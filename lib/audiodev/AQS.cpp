@@ -669,7 +669,7 @@ struct AQSAudioVoiceEngine : BaseAudioVoiceEngine {
     m_mixInfo.m_sampleRate = desc.mSampleRate;
     m_mixInfo.m_sampleFormat = SOXR_FLOAT32_I;
     m_mixInfo.m_bitsPerSample = 32;
-    m_5msFrames = desc.mSampleRate * 5 / 1000;
+    _setBlockFrames(desc.mSampleRate);
 
     ChannelMap& chMapOut = m_mixInfo.m_channelMap;
     chMapOut.m_channelCount = 0;
@@ -773,7 +773,7 @@ struct AQSAudioVoiceEngine : BaseAudioVoiceEngine {
     while (chMapOut.m_channelCount < chCount)
       chMapOut.m_channels[chMapOut.m_channelCount++] = AudioChannel::Unknown;
 
-    m_mixInfo.m_periodFrames = m_5msFrames;
+    m_mixInfo.m_periodFrames = m_blockFrames;
     for (int i = 0; i < AQS_NUM_BUFFERS; ++i)
       if (AudioQueueAllocateBuffer(m_queue, m_mixInfo.m_periodFrames * chCount * 4, &m_buffers[i])) {
         Log.report(logvisor::Fatal, FMT_STRING("unable to create audio queue buffer"));
@@ -809,8 +809,9 @@ struct AQSAudioVoiceEngine : BaseAudioVoiceEngine {
     return noErr;
   }
 
-  AQSAudioVoiceEngine()
-  : m_runLoopMode(CFPointer<CFStringRef>::adopt(
+  explicit AQSAudioVoiceEngine(const AudioVoiceEngineOptions& options)
+  : BaseAudioVoiceEngine(options)
+  , m_runLoopMode(CFPointer<CFStringRef>::adopt(
         CFStringCreateWithCStringNoCopy(nullptr, "BooAQSMode", kCFStringEncodingUTF8, kCFAllocatorNull))) {
     AudioObjectPropertyAddress propertyAddress;
     propertyAddress.mScope = kAudioObjectPropertyScopeGlobal;
@@ -856,8 +857,8 @@ struct AQSAudioVoiceEngine : BaseAudioVoiceEngine {
   }
 };
 
-std::unique_ptr<IAudioVoiceEngine> NewAudioVoiceEngine() {
-  std::unique_ptr<IAudioVoiceEngine> ret = std::make_unique<AQSAudioVoiceEngine>();
+std::unique_ptr<IAudioVoiceEngine> NewAudioVoiceEngine(const AudioVoiceEngineOptions& options) {
+  std::unique_ptr<IAudioVoiceEngine> ret = std::make_unique<AQSAudioVoiceEngine>(options);
   if (!static_cast<AQSAudioVoiceEngine&>(*ret).m_queue)
     return {};
   return ret;
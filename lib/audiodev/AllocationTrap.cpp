@@ -0,0 +1,105 @@
+#include "AllocationTrap.hpp"
+
+#if BOO2_AUDIO_ALLOCATION_TRAP
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if __GLIBC__
+#include <cerrno>
+#endif
+
+namespace boo2 {
+/* Initial-exec so checking it from malloc never has TLS setup allocate */
+#if __GNUC__
+__attribute__((tls_model("initial-exec")))
+#endif
+static thread_local int TrapDepth = 0;
+
+AllocationTrap::AllocationTrap() { ++TrapDepth; }
+AllocationTrap::~AllocationTrap() { --TrapDepth; }
+
+static void CheckAllocation(std::size_t size) {
+  if (TrapDepth) {
+    /* Disarm so a stdio allocation can't recurse; logging would allocate, so report straight to stderr */
+    TrapDepth = 0;
+    std::fprintf(stderr, "boo2: %zu byte heap allocation inside the audio mix path\n", size);
+    std::abort();
+  }
+}
+} // namespace boo2
+
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define BOO2_SANITIZER_MALLOC 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer)
+#define BOO2_SANITIZER_MALLOC 1
+#endif
+#endif
+
+#if __GLIBC__ && !BOO2_SANITIZER_MALLOC
+/* C allocations (soxr, pffft) go through malloc; interpose the glibc entry points as well.
+ * Sanitizers replace malloc themselves, so there only operator new is trapped */
+extern "C" {
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void* ptr, std::size_t size);
+void* __libc_memalign(std::size_t alignment, std::size_t size);
+
+void* malloc(std::size_t size) noexcept {
+  boo2::CheckAllocation(size);
+  return __libc_malloc(size);
+}
+
+void* calloc(std::size_t count, std::size_t size) noexcept {
+  boo2::CheckAllocation(count * size);
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, std::size_t size) noexcept {
+  boo2::CheckAllocation(size);
+  return __libc_realloc(ptr, size);
+}
+
+void* memalign(std::size_t alignment, std::size_t size) noexcept {
+  boo2::CheckAllocation(size);
+  return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(std::size_t alignment, std::size_t size) noexcept { return memalign(alignment, size); }
+
+int posix_memalign(void** ptr, std::size_t alignment, std::size_t size) noexcept {
+  boo2::CheckAllocation(size);
+  void* mem = __libc_memalign(alignment, size);
+  if (!mem)
+    return ENOMEM;
+  *ptr = mem;
+  return 0;
+}
+}
+#endif
+
+/* Replaces the unaligned global allocation functions; aligned forms keep the library default */
+void* operator new(std::size_t size) {
+  boo2::CheckAllocation(size);
+  if (void* ptr = std::malloc(size ? size : 1))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  boo2::CheckAllocation(size);
+  return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+#endif
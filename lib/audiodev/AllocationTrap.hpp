@@ -0,0 +1,23 @@
+#pragma once
+
+namespace boo2 {
+
+#if BOO2_AUDIO_ALLOCATION_TRAP
+/** While in scope, any global operator new on this thread aborts the process, as does malloc and
+ *  its relatives on glibc.
+ *  Only active in BOO2_AUDIO_ALLOCATION_TRAP builds; otherwise compiles away. */
+class AllocationTrap {
+public:
+  AllocationTrap();
+  ~AllocationTrap();
+  AllocationTrap(const AllocationTrap&) = delete;
+  AllocationTrap& operator=(const AllocationTrap&) = delete;
+};
+#else
+class AllocationTrap {
+public:
+  AllocationTrap() {}
+};
+#endif
+
+} // namespace boo2
@@ -0,0 +1,114 @@
+#include "AudioADPCM.hpp"
+
+#include <algorithm>
+
+#ifdef __ARM_NEON
+#include "sse2neon.h"
+#define __SSE2__ 1
+#elif __SSE2__
+#include <immintrin.h>
+#endif
+
+#undef min
+#undef max
+
+namespace boo2 {
+
+static constexpr int32_t NibbleToInt[16] = {0, 1, 2, 3, 4, 5, 6, 7, -8, -7, -6, -5, -4, -3, -2, -1};
+
+static constexpr int32_t IMAIndexTable[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+static constexpr int32_t IMAStepTable[89] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,    19,    21,    23,    25,    28,
+    31,    34,    37,    41,    45,    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+    130,   143,   157,   173,   190,   209,   230,   253,   279,   307,   337,   371,   408,   449,   494,
+    544,   598,   658,   724,   796,   876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+    2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,  5894,  6484,  7132,  7845,  8630,
+    9493,  10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+/* Scaled residuals of one DSP-ADPCM frame, (nibble << scale << 11) + 1024, ready for the predictor */
+static void ExpandDSPFrame(const uint8_t* frame, int32_t residuals[16]) {
+  unsigned shift = (frame[0] & 0xf) + 11;
+#if __SSE2__
+  /* Split the 7 data bytes into high and low nibbles, interleaved in playback order */
+  __m128i bytes = _mm_srli_si128(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(frame)), 1);
+  __m128i lowMask = _mm_set1_epi8(0xf);
+  __m128i hi = _mm_and_si128(_mm_srli_epi16(bytes, 4), lowMask);
+  __m128i lo = _mm_and_si128(bytes, lowMask);
+  __m128i nibbles = _mm_unpacklo_epi8(hi, lo);
+  /* Sign-extend 4 bits, then widen to 32 */
+  __m128i eight = _mm_set1_epi8(8);
+  nibbles = _mm_sub_epi8(_mm_xor_si128(nibbles, eight), eight);
+  __m128i words[2] = {_mm_srai_epi16(_mm_unpacklo_epi8(nibbles, nibbles), 8),
+                      _mm_srai_epi16(_mm_unpackhi_epi8(nibbles, nibbles), 8)};
+  __m128i count = _mm_cvtsi32_si128(int(shift));
+  __m128i round = _mm_set1_epi32(1024);
+  for (int i = 0; i < 2; ++i) {
+    __m128i lo32 = _mm_srai_epi32(_mm_unpacklo_epi16(words[i], words[i]), 16);
+    __m128i hi32 = _mm_srai_epi32(_mm_unpackhi_epi16(words[i], words[i]), 16);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(residuals + i * 8), _mm_add_epi32(_mm_sll_epi32(lo32, count), round));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(residuals + i * 8 + 4),
+                     _mm_add_epi32(_mm_sll_epi32(hi32, count), round));
+  }
+#else
+  for (size_t s = 0; s < DSPADPCMFrameSamples; ++s) {
+    uint8_t byte = frame[1 + s / 2];
+    residuals[s] = int32_t(uint32_t(NibbleToInt[(s & 1) ? byte & 0xf : byte >> 4]) << shift) + 1024;
+  }
+#endif
+}
+
+void DecodeDSPADPCM(const AudioADPCMChannel& chan, AudioADPCMState& state, size_t pos, size_t count, int16_t* out,
+                    unsigned stride) {
+  int32_t hist1 = state.m_hist1;
+  int32_t hist2 = state.m_hist2;
+  alignas(16) int32_t residuals[16];
+  while (count) {
+    const uint8_t* frame = chan.m_data + pos / DSPADPCMFrameSamples * 8;
+    size_t first = pos % DSPADPCMFrameSamples;
+    size_t n = std::min(DSPADPCMFrameSamples - first, count);
+    ExpandDSPFrame(frame, residuals);
+
+    /* The predictor recursion is inherently serial */
+    const int32_t coef1 = chan.m_coefs[frame[0] >> 4 & 0x7][0];
+    const int32_t coef2 = chan.m_coefs[frame[0] >> 4 & 0x7][1];
+    for (size_t s = first; s < first + n; ++s) {
+      int32_t sample = std::clamp((residuals[s] + coef1 * hist1 + coef2 * hist2) >> 11, -32768, 32767);
+      hist2 = hist1;
+      hist1 = sample;
+      *out = int16_t(sample);
+      out += stride;
+    }
+
+    pos += n;
+    count -= n;
+  }
+  state.m_hist1 = int16_t(hist1);
+  state.m_hist2 = int16_t(hist2);
+}
+
+void DecodeIMAADPCM(const AudioADPCMChannel& chan, AudioADPCMState& state, size_t pos, size_t count, int16_t* out,
+                    unsigned stride) {
+  int32_t predictor = state.m_hist1;
+  int32_t index = std::min(int32_t(state.m_stepIndex), 88);
+  for (size_t end = pos + count; pos < end; ++pos) {
+    uint8_t byte = chan.m_data[pos / 2];
+    unsigned nibble = (pos & 1) ? byte >> 4 : byte & 0xf;
+    int32_t step = IMAStepTable[index];
+    int32_t diff = step >> 3;
+    if (nibble & 4)
+      diff += step;
+    if (nibble & 2)
+      diff += step >> 1;
+    if (nibble & 1)
+      diff += step >> 2;
+    predictor = std::clamp(nibble & 8 ? predictor - diff : predictor + diff, -32768, 32767);
+    index = std::clamp(index + IMAIndexTable[nibble], 0, 88);
+    *out = int16_t(predictor);
+    out += stride;
+  }
+  state.m_hist1 = int16_t(predictor);
+  state.m_stepIndex = uint8_t(index);
+}
+
+} // namespace boo2
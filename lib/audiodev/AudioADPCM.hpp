@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "boo2/audiodev/AudioSampler.hpp"
+
+namespace boo2 {
+
+/** Samples per 8-byte DSP-ADPCM frame */
+constexpr size_t DSPADPCMFrameSamples = 14;
+
+/** Decode count samples of chan, starting at sample pos, into every stride-th element of out.
+ *  state holds the decoder state just before pos and is advanced past the last sample decoded */
+void DecodeDSPADPCM(const AudioADPCMChannel& chan, AudioADPCMState& state, size_t pos, size_t count, int16_t* out,
+                    unsigned stride);
+void DecodeIMAADPCM(const AudioADPCMChannel& chan, AudioADPCMState& state, size_t pos, size_t count, int16_t* out,
+                    unsigned stride);
+
+} // namespace boo2
@@ -0,0 +1,248 @@
+#include "AudioCapture.hpp"
+#include "AudioSubmix.hpp"
+#include "AudioVoiceEngine.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <logvisor/logvisor.hpp>
+
+#if __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#undef min
+#undef max
+
+namespace boo2 {
+
+/* Polling period of the writer; the mixing thread never signals it */
+static constexpr std::chrono::milliseconds DrainInterval{20};
+
+/* Nice value of writer threads; below the mixer, above the reclaimer */
+static constexpr int WriterNiceness = 5;
+
+/* Smallest ring, so a single large pump still fits */
+static constexpr size_t MinRingBytes = 64 * 1024;
+
+/* WAVEFORMATEXTENSIBLE speaker bit for each AudioChannel */
+static constexpr uint32_t SpeakerBits[] = {
+    0x00000001, /* FrontLeft */
+    0x00000002, /* FrontRight */
+    0x00000010, /* RearLeft */
+    0x00000020, /* RearRight */
+    0x00000004, /* FrontCenter */
+    0x00000008, /* LFE */
+    0x00000200, /* SideLeft */
+    0x00000400, /* SideRight */
+};
+
+AudioCapture::AudioCapture(BaseAudioVoiceEngine& root, AudioSubmix* source, FILE* fp, AudioCaptureFile fileFormat,
+                           IAudioCaptureCallback* cb, double bufferSeconds)
+: ListNode<AudioCapture, BaseAudioVoiceEngine*, IAudioCapture>(&root)
+, m_source(source)
+, m_sourceToken(source)
+, m_fp(fp)
+, m_fileFormat(fileFormat)
+, m_cb(cb) {
+  const AudioVoiceEngineMixInfo& info = source ? root.clientMixInfo() : root.m_mixInfo;
+  m_wavSampleRate = source ? root.mixInfo().m_sampleRate : info.m_sampleRate;
+  m_wavChanMap = info.m_channelMap;
+
+  /* Room for bufferSeconds of the current format, with headers to spare */
+  double bytes = std::max(bufferSeconds, 0.0) * m_wavSampleRate * m_wavChanMap.m_channelCount * sizeof(float) * 1.25;
+  m_ringSize = MinRingBytes;
+  while (m_ringSize < bytes)
+    m_ringSize <<= 1;
+  /* Value-initialized so the pages are resident before the mixer writes them */
+  m_ring.reset(new uint8_t[m_ringSize]());
+
+  m_writerThread = std::thread(&AudioCapture::_writerProc, this);
+}
+
+AudioCapture::~AudioCapture() {
+  /* Off every snapshot by now; the writer drains what remains and exits */
+  {
+    std::unique_lock<std::mutex> lk(m_writerMutex);
+    m_writerStop = true;
+  }
+  m_writerCv.notify_one();
+  m_writerThread.join();
+
+  if (m_fp) {
+    if (m_fileFormat == AudioCaptureFile::WAV)
+      _finishWAV();
+    fclose(m_fp);
+  }
+}
+
+void AudioCapture::finalRelease() noexcept { m_head->_retireCapture(this); }
+
+AudioCapture*& AudioCapture::_getHeadPtr(BaseAudioVoiceEngine* head) { return head->m_captureHead; }
+std::unique_lock<std::recursive_mutex> AudioCapture::_getHeadLock(BaseAudioVoiceEngine* head) {
+  return std::unique_lock<std::recursive_mutex>{head->m_dataMutex};
+}
+
+AudioCaptureStats AudioCapture::getStats() const {
+  AudioCaptureStats stats;
+  stats.m_framesWritten = m_framesWritten.load(std::memory_order_relaxed);
+  stats.m_droppedBlocks = m_droppedBlocks.load(std::memory_order_relaxed);
+  stats.m_droppedFrames = m_droppedFrames.load(std::memory_order_relaxed);
+  stats.m_skippedFrames = m_skippedFrames.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void AudioCapture::_writeRing(uint64_t pos, const void* data, size_t bytes) {
+  size_t offset = size_t(pos & (m_ringSize - 1));
+  size_t first = std::min(bytes, m_ringSize - offset);
+  memcpy(m_ring.get() + offset, data, first);
+  memcpy(m_ring.get(), static_cast<const uint8_t*>(data) + first, bytes - first);
+}
+
+void AudioCapture::_readRing(uint64_t pos, void* data, size_t bytes) const {
+  size_t offset = size_t(pos & (m_ringSize - 1));
+  size_t first = std::min(bytes, m_ringSize - offset);
+  memcpy(data, m_ring.get() + offset, first);
+  memcpy(static_cast<uint8_t*>(data) + first, m_ring.get(), bytes - first);
+}
+
+void AudioCapture::_push(const float* audio, size_t frames, const ChannelMap& chanMap, double sampleRate) {
+  size_t sampleBytes = sizeof(float) * frames * chanMap.m_channelCount;
+  uint64_t writePos = m_writePos.load(std::memory_order_relaxed);
+  uint64_t readPos = m_readPos.load(std::memory_order_acquire);
+  if (sizeof(BlockHeader) + sampleBytes > m_ringSize - size_t(writePos - readPos)) {
+    m_droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+    m_droppedFrames.fetch_add(frames, std::memory_order_relaxed);
+    return;
+  }
+
+  BlockHeader header{frames, sampleRate, chanMap};
+  _writeRing(writePos, &header, sizeof(BlockHeader));
+  _writeRing(writePos + sizeof(BlockHeader), audio, sampleBytes);
+  m_writePos.store(writePos + sizeof(BlockHeader) + sampleBytes, std::memory_order_release);
+}
+
+void AudioCapture::_drain() {
+  uint64_t writePos = m_writePos.load(std::memory_order_acquire);
+  uint64_t readPos = m_readPos.load(std::memory_order_relaxed);
+  while (readPos != writePos) {
+    BlockHeader header;
+    _readRing(readPos, &header, sizeof(BlockHeader));
+    size_t sampleCount = header.m_frames * header.m_chanMap.m_channelCount;
+    if (m_drainBuf.size() < sampleCount)
+      m_drainBuf.resize(sampleCount);
+    _readRing(readPos + sizeof(BlockHeader), m_drainBuf.data(), sizeof(float) * sampleCount);
+    readPos += sizeof(BlockHeader) + sizeof(float) * sampleCount;
+
+    /* Hand the space back before the (possibly slow) delivery */
+    m_readPos.store(readPos, std::memory_order_release);
+    _deliver(header, m_drainBuf.data());
+  }
+}
+
+void AudioCapture::_deliver(const BlockHeader& header, const float* audio) {
+  if (!m_fp) {
+    m_cb->captureAudio(audio, header.m_frames, header.m_chanMap, header.m_sampleRate);
+    m_framesWritten.fetch_add(header.m_frames, std::memory_order_relaxed);
+    return;
+  }
+
+  size_t sampleCount = header.m_frames * header.m_chanMap.m_channelCount;
+  if (m_fileFormat == AudioCaptureFile::WAV) {
+    if (!m_wavStarted) {
+      m_wavSampleRate = header.m_sampleRate;
+      m_wavChanMap = header.m_chanMap;
+      _writeWAVHeader();
+    } else if (header.m_sampleRate != m_wavSampleRate ||
+               header.m_chanMap.m_channelCount != m_wavChanMap.m_channelCount) {
+      /* A WAV file has one format; keep it rather than corrupt the stream */
+      m_skippedFrames.fetch_add(header.m_frames, std::memory_order_relaxed);
+      return;
+    }
+    m_wavDataBytes += sizeof(float) * sampleCount;
+  }
+
+  fwrite(audio, sizeof(float), sampleCount, m_fp);
+  m_framesWritten.fetch_add(header.m_frames, std::memory_order_relaxed);
+}
+
+void AudioCapture::_writeWAVHeader() {
+  m_wavStarted = true;
+  uint16_t numChans = uint16_t(m_wavChanMap.m_channelCount);
+  bool extensible = numChans > 2;
+
+  fwrite("RIFF", 1, 4, m_fp);
+  uint32_t chunkSize = extensible ? 60 : 36;
+  fwrite(&chunkSize, 1, 4, m_fp);
+  fwrite("WAVE", 1, 4, m_fp);
+
+  fwrite("fmt ", 1, 4, m_fp);
+  uint32_t fmtSize = extensible ? 40 : 16;
+  fwrite(&fmtSize, 1, 4, m_fp);
+  uint16_t audioFmt = extensible ? 0xFFFE : 3;
+  fwrite(&audioFmt, 1, 2, m_fp);
+  fwrite(&numChans, 1, 2, m_fp);
+  uint32_t sampRate = uint32_t(m_wavSampleRate);
+  fwrite(&sampRate, 1, 4, m_fp);
+  uint16_t blockAlign = 4 * numChans;
+  uint32_t byteRate = sampRate * blockAlign;
+  fwrite(&byteRate, 1, 4, m_fp);
+  fwrite(&blockAlign, 1, 2, m_fp);
+  uint16_t bps = 32;
+  fwrite(&bps, 1, 2, m_fp);
+
+  if (extensible) {
+    uint16_t extSize = 22;
+    fwrite(&extSize, 1, 2, m_fp);
+    fwrite(&bps, 1, 2, m_fp);
+    uint32_t speakerMask = 0;
+    for (unsigned c = 0; c < numChans; ++c) {
+      auto chan = size_t(m_wavChanMap.m_channels[c]);
+      if (chan < std::size(SpeakerBits))
+        speakerMask |= SpeakerBits[chan];
+    }
+    fwrite(&speakerMask, 1, 4, m_fp);
+    fwrite("\x03\x00\x00\x00\x00\x00\x10\x00\x80\x00\x00\xaa\x00\x38\x9b\x71", 1, 16, m_fp);
+  }
+
+  fwrite("data", 1, 4, m_fp);
+  uint32_t dataSize = 0;
+  fwrite(&dataSize, 1, 4, m_fp);
+}
+
+void AudioCapture::_finishWAV() {
+  /* Nothing captured; still leave a valid (empty) file in the format at creation */
+  if (!m_wavStarted)
+    _writeWAVHeader();
+
+  bool extensible = m_wavChanMap.m_channelCount > 2;
+  uint32_t dataSize = uint32_t(std::min(m_wavDataBytes, uint64_t(UINT32_MAX - 60)));
+  uint32_t chunkSize = (extensible ? 60 : 36) + dataSize;
+  fseek(m_fp, 4, SEEK_SET);
+  fwrite(&chunkSize, 1, 4, m_fp);
+  fseek(m_fp, extensible ? 64 : 40, SEEK_SET);
+  fwrite(&dataSize, 1, 4, m_fp);
+}
+
+void AudioCapture::_writerProc() {
+  logvisor::RegisterThreadName("Boo Audio Capture");
+#if __linux__
+  setpriority(PRIO_PROCESS, id_t(syscall(SYS_gettid)), WriterNiceness);
+#elif _WIN32
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#endif
+
+  std::unique_lock<std::mutex> lk(m_writerMutex);
+  while (!m_writerCv.wait_for(lk, DrainInterval, [this]() { return m_writerStop; })) {
+    lk.unlock();
+    _drain();
+    lk.lock();
+  }
+  lk.unlock();
+  _drain();
+}
+
+} // namespace boo2
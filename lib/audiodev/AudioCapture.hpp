@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "boo2/audiodev/IAudioCapture.hpp"
+#include "boo2/audiodev/IAudioVoice.hpp"
+#include "../Common.hpp"
+
+namespace boo2 {
+class BaseAudioVoiceEngine;
+class AudioSubmix;
+struct IAudioSubmix;
+
+/** Tap copying finished mix blocks into a single-producer ring drained by its own writer thread.
+ *  The mixing thread only copies and publishes a position; a block that doesn't fit is dropped */
+class AudioCapture : public ListNode<AudioCapture, BaseAudioVoiceEngine*, IAudioCapture> {
+  friend class BaseAudioVoiceEngine;
+
+  /* Leads each block in the ring */
+  struct BlockHeader {
+    size_t m_frames;
+    double m_sampleRate;
+    ChannelMap m_chanMap;
+  };
+
+  /* Submix tapped after its effect; null taps the final output */
+  AudioSubmix* m_source;
+  ObjToken<IAudioSubmix> m_sourceToken;
+
+  /* Link in the engine's garbage stack when released on the mixing thread */
+  AudioCapture* m_nextGarbage = nullptr;
+
+  /* Power-of-two byte ring; positions count bytes ever written and read */
+  std::unique_ptr<uint8_t[]> m_ring;
+  size_t m_ringSize;
+  std::atomic<uint64_t> m_writePos = 0;
+  std::atomic<uint64_t> m_readPos = 0;
+
+  /* Destination: a file, or the callback when m_fp is null */
+  FILE* m_fp;
+  AudioCaptureFile m_fileFormat;
+  IAudioCaptureCallback* m_cb;
+  bool m_wavStarted = false;
+  double m_wavSampleRate;
+  ChannelMap m_wavChanMap;
+  uint64_t m_wavDataBytes = 0;
+
+  std::atomic<uint64_t> m_framesWritten = 0;
+  std::atomic<uint64_t> m_droppedBlocks = 0;
+  std::atomic<uint64_t> m_droppedFrames = 0;
+  std::atomic<uint64_t> m_skippedFrames = 0;
+
+  std::thread m_writerThread;
+  std::mutex m_writerMutex;
+  std::condition_variable m_writerCv;
+  bool m_writerStop = false;
+  std::vector<float> m_drainBuf;
+
+  void _writeRing(uint64_t pos, const void* data, size_t bytes);
+  void _readRing(uint64_t pos, void* data, size_t bytes) const;
+  void _writerProc();
+  void _drain();
+  void _deliver(const BlockHeader& header, const float* audio);
+  void _writeWAVHeader();
+  void _finishWAV();
+
+  /* Called from the mixing thread only */
+  void _push(const float* audio, size_t frames, const ChannelMap& chanMap, double sampleRate);
+
+protected:
+  void finalRelease() noexcept override;
+
+public:
+  AudioCapture(BaseAudioVoiceEngine& root, AudioSubmix* source, FILE* fp, AudioCaptureFile fileFormat,
+               IAudioCaptureCallback* cb, double bufferSeconds);
+  ~AudioCapture() override;
+  static AudioCapture*& _getHeadPtr(BaseAudioVoiceEngine* head);
+  static std::unique_lock<std::recursive_mutex> _getHeadLock(BaseAudioVoiceEngine* head);
+
+  AudioCaptureStats getStats() const override;
+
+  /** Calls f(ptr, bytes) for each buffer the mixing thread touches */
+  template <typename F>
+  void VisitBuffers(F&& f) const {
+    f(m_ring.get(), m_ringSize);
+  }
+};
+
+} // namespace boo2
@@ -0,0 +1,260 @@
+#include "AudioFilterBank.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846 /* pi */
+#endif
+
+#ifdef __ARM_NEON
+#include "sse2neon.h"
+#define __SSE__ 1
+#elif __SSE__
+#include <immintrin.h>
+#endif
+
+#undef min
+#undef max
+
+namespace boo2 {
+
+BiquadCoefs DesignBiquad(AudioFilterType type, double cutoff, double q, double sampleRate) {
+  BiquadCoefs ret;
+  if (type == AudioFilterType::None || sampleRate <= 0.0)
+    return ret;
+
+  double w0 = 2.0 * M_PI * std::clamp(cutoff, 10.0, sampleRate * 0.49) / sampleRate;
+  double cosW0 = std::cos(w0);
+  double alpha = std::sin(w0) / (2.0 * std::max(q, 0.1));
+  double a0 = 1.0 + alpha;
+  double b1 = type == AudioFilterType::LowPass ? 1.0 - cosW0 : -(1.0 + cosW0);
+  double b0 = type == AudioFilterType::LowPass ? b1 / 2.0 : -b1 / 2.0;
+  ret.b0 = float(b0 / a0);
+  ret.b1 = float(b1 / a0);
+  ret.b2 = float(b0 / a0);
+  ret.a1 = float(-2.0 * cosW0 / a0);
+  ret.a2 = float((1.0 - alpha) / a0);
+  return ret;
+}
+
+BiquadCoefs VoiceFilter::_coefsAt(size_t pos) const {
+  if (pos >= m_rampFrames)
+    return DesignBiquad(m_type, m_cutoff, m_q, m_sampleRate);
+
+  double t = pos / double(m_rampFrames);
+  if (m_sweep)
+    return DesignBiquad(m_type, m_fromCutoff * std::pow(m_cutoff / m_fromCutoff, t), m_fromQ + (m_q - m_fromQ) * t,
+                        m_sampleRate);
+
+  /* The stable (a1, a2) region is convex, so blending two stable responses stays stable */
+  BiquadCoefs to = DesignBiquad(m_type, m_cutoff, m_q, m_sampleRate);
+  float w = float(t);
+  return {m_fromCoefs.b0 + (to.b0 - m_fromCoefs.b0) * w, m_fromCoefs.b1 + (to.b1 - m_fromCoefs.b1) * w,
+          m_fromCoefs.b2 + (to.b2 - m_fromCoefs.b2) * w, m_fromCoefs.a1 + (to.a1 - m_fromCoefs.a1) * w,
+          m_fromCoefs.a2 + (to.a2 - m_fromCoefs.a2) * w};
+}
+
+void VoiceFilter::_applyRequest(AudioFilterType type, double cutoff, double q, size_t rampFrames) {
+  /* A new ramp continues from the response reached so far */
+  bool ramping = m_rampPos < m_rampFrames;
+  double curCutoff = m_cutoff;
+  double curQ = m_q;
+  if (ramping && m_sweep) {
+    double t = m_rampPos / double(m_rampFrames);
+    curCutoff = m_fromCutoff * std::pow(m_cutoff / m_fromCutoff, t);
+    curQ = m_fromQ + (m_q - m_fromQ) * t;
+  }
+  m_sweep = (!ramping || m_sweep) && type == m_type && m_type != AudioFilterType::None;
+  m_fromCutoff = curCutoff;
+  m_fromQ = curQ;
+  m_fromCoefs = m_coefs;
+
+  m_type = type;
+  m_cutoff = cutoff;
+  m_q = q;
+  m_rampFrames = rampFrames;
+  m_rampPos = 0;
+  m_coefs = _coefsAt(0);
+}
+
+void VoiceFilter::request(AudioFilterType type, double cutoff, double q, size_t rampFrames) {
+  /* Concurrent requesters take turns */
+  uint32_t sequence = m_reqSequence.load(std::memory_order_relaxed);
+  do {
+    while (sequence & 1)
+      sequence = m_reqSequence.load(std::memory_order_relaxed);
+  } while (!m_reqSequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_relaxed));
+  std::atomic_thread_fence(std::memory_order_release);
+  m_reqType.store(type, std::memory_order_relaxed);
+  m_reqCutoff.store(std::max(cutoff, 1.0), std::memory_order_relaxed);
+  m_reqQ.store(q, std::memory_order_relaxed);
+  m_reqFrames.store(rampFrames, std::memory_order_relaxed);
+  m_reqSequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool VoiceFilter::_takeRequest(AudioFilterType& type, double& cutoff, double& q, size_t& rampFrames) {
+  /* A request caught half written is left for the following block */
+  uint32_t sequence = m_reqSequence.load(std::memory_order_acquire);
+  if (sequence == m_reqTaken || (sequence & 1))
+    return false;
+  type = m_reqType.load(std::memory_order_relaxed);
+  cutoff = m_reqCutoff.load(std::memory_order_relaxed);
+  q = m_reqQ.load(std::memory_order_relaxed);
+  rampFrames = m_reqFrames.load(std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (m_reqSequence.load(std::memory_order_relaxed) != sequence)
+    return false;
+  m_reqTaken = sequence;
+  return true;
+}
+
+bool VoiceFilter::beginBlock(size_t frames, double sampleRate, BiquadCoefs& start, BiquadCoefs& end) {
+  if (m_sampleRate != sampleRate) {
+    m_sampleRate = sampleRate;
+    m_coefs = _coefsAt(m_rampPos);
+  }
+  AudioFilterType type;
+  double cutoff, q;
+  size_t rampFrames;
+  if (_takeRequest(type, cutoff, q, rampFrames))
+    _applyRequest(type, cutoff, q, rampFrames);
+
+  if (m_type == AudioFilterType::None && m_rampPos >= m_rampFrames) {
+    /* Re-enabling starts from rest */
+    std::fill(std::begin(m_z1), std::end(m_z1), 0.f);
+    std::fill(std::begin(m_z2), std::end(m_z2), 0.f);
+    return false;
+  }
+
+  start = m_coefs;
+  if (m_rampPos < m_rampFrames) {
+    m_rampPos = std::min(m_rampPos + frames, m_rampFrames);
+    m_coefs = _coefsAt(m_rampPos);
+  }
+  end = m_coefs;
+  return true;
+}
+
+void AudioFilterBank::Reserve(size_t frames) {
+  if (frames <= m_maxFrames)
+    return;
+  m_maxFrames = frames;
+  m_staging.assign(MaxLanes * m_maxFrames, 0.f);
+}
+
+void AudioFilterBank::Stage(AudioVoice* voice, VoiceFilter& filter, const float* audio, unsigned channels,
+                            size_t frames, const BiquadCoefs& start, const BiquadCoefs& end) {
+  const float* startCoefs = &start.b0;
+  const float* endCoefs = &end.b0;
+  for (unsigned c = 0; c < channels; ++c) {
+    unsigned lane = m_laneCount + c;
+    float* dst = _lane(lane);
+    for (size_t f = 0; f < frames; ++f)
+      dst[f * 4] = audio[f * channels + c];
+    for (int k = 0; k < 5; ++k) {
+      m_coefs[k][lane] = startCoefs[k];
+      m_steps[k][lane] = (endCoefs[k] - startCoefs[k]) / float(frames);
+    }
+    m_z1[lane] = filter.m_z1[c];
+    m_z2[lane] = filter.m_z2[c];
+    m_laneFrames[lane] = frames;
+  }
+  m_voices[m_voiceCount++] = {voice, &filter, m_laneCount, channels, frames};
+  m_laneCount += channels;
+}
+
+void AudioFilterBank::_filterLane(unsigned lane, size_t begin, size_t end) {
+  float b0 = m_coefs[0][lane], b1 = m_coefs[1][lane], b2 = m_coefs[2][lane];
+  float a1 = m_coefs[3][lane], a2 = m_coefs[4][lane];
+  float z1 = m_z1[lane], z2 = m_z2[lane];
+  float* data = _lane(lane);
+  for (size_t f = begin; f < end; ++f) {
+    float x = data[f * 4];
+    float y = b0 * x + z1;
+    z1 = b1 * x - a1 * y + z2;
+    z2 = b2 * x - a2 * y;
+    data[f * 4] = y;
+    b0 += m_steps[0][lane];
+    b1 += m_steps[1][lane];
+    b2 += m_steps[2][lane];
+    a1 += m_steps[3][lane];
+    a2 += m_steps[4][lane];
+  }
+  m_z1[lane] = z1;
+  m_z2[lane] = z2;
+}
+
+void AudioFilterBank::Process() {
+  unsigned groups = (m_laneCount + 3) / 4;
+
+  /* Unused lanes of the last group filter nothing, harmlessly */
+  for (unsigned lane = m_laneCount; lane < groups * 4; ++lane) {
+    for (int k = 0; k < 5; ++k)
+      m_coefs[k][lane] = m_steps[k][lane] = 0.f;
+    m_z1[lane] = m_z2[lane] = 0.f;
+    m_laneFrames[lane] = SIZE_MAX;
+  }
+
+  for (unsigned g = 0; g < groups; ++g) {
+    unsigned first = g * 4;
+    unsigned last = std::min(first + 4, m_laneCount);
+    size_t done = 0;
+
+#if __SSE__
+    /* The frames every lane has, four lanes per step */
+    size_t frames = *std::min_element(m_laneFrames + first, m_laneFrames + first + 4);
+    __m128 b0 = _mm_load_ps(m_coefs[0] + first), b1 = _mm_load_ps(m_coefs[1] + first);
+    __m128 b2 = _mm_load_ps(m_coefs[2] + first), a1 = _mm_load_ps(m_coefs[3] + first);
+    __m128 a2 = _mm_load_ps(m_coefs[4] + first);
+    __m128 z1 = _mm_load_ps(m_z1 + first), z2 = _mm_load_ps(m_z2 + first);
+    float* data = _lane(first);
+
+    bool ramping = false;
+    for (int k = 0; k < 5; ++k)
+      for (unsigned lane = first; lane < first + 4; ++lane)
+        ramping |= m_steps[k][lane] != 0.f;
+
+    if (ramping) {
+      __m128 db0 = _mm_load_ps(m_steps[0] + first), db1 = _mm_load_ps(m_steps[1] + first);
+      __m128 db2 = _mm_load_ps(m_steps[2] + first), da1 = _mm_load_ps(m_steps[3] + first);
+      __m128 da2 = _mm_load_ps(m_steps[4] + first);
+      for (size_t f = 0; f < frames; ++f, data += 4) {
+        __m128 x = _mm_loadu_ps(data);
+        __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), z1);
+        z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), z2);
+        z2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+        _mm_storeu_ps(data, y);
+        b0 = _mm_add_ps(b0, db0);
+        b1 = _mm_add_ps(b1, db1);
+        b2 = _mm_add_ps(b2, db2);
+        a1 = _mm_add_ps(a1, da1);
+        a2 = _mm_add_ps(a2, da2);
+      }
+    } else {
+      for (size_t f = 0; f < frames; ++f, data += 4) {
+        __m128 x = _mm_loadu_ps(data);
+        __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), z1);
+        z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), z2);
+        z2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+        _mm_storeu_ps(data, y);
+      }
+    }
+
+    _mm_store_ps(m_coefs[0] + first, b0);
+    _mm_store_ps(m_coefs[1] + first, b1);
+    _mm_store_ps(m_coefs[2] + first, b2);
+    _mm_store_ps(m_coefs[3] + first, a1);
+    _mm_store_ps(m_coefs[4] + first, a2);
+    _mm_store_ps(m_z1 + first, z1);
+    _mm_store_ps(m_z2 + first, z2);
+    done = frames;
+#endif
+
+    /* Lanes with more frames (a voice that produced a short block alongside full ones) finish alone */
+    for (unsigned lane = first; lane < last; ++lane)
+      _filterLane(lane, done, m_laneFrames[lane]);
+  }
+}
+
+} // namespace boo2
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "boo2/audiodev/IAudioVoice.hpp"
+
+namespace boo2 {
+class AudioVoice;
+
+/** Normalized biquad coefficients for direct form II transposed */
+struct BiquadCoefs {
+  float b0 = 1.f;
+  float b1 = 0.f;
+  float b2 = 0.f;
+  float a1 = 0.f;
+  float a2 = 0.f;
+};
+
+/** Response and state of one voice's filter. Client threads request responses;
+ *  everything else belongs to the mixing thread */
+class VoiceFilter {
+  /* Client request, consumed by the next audible block. Posted as a sequence-lock write like
+   * AudioLevelPost; odd while a post is in progress */
+  std::atomic<uint32_t> m_reqSequence = 0;
+  std::atomic<AudioFilterType> m_reqType = AudioFilterType::None;
+  std::atomic<double> m_reqCutoff = 0.0;
+  std::atomic<double> m_reqQ = 0.0;
+  std::atomic<size_t> m_reqFrames = 0;
+  /* Mixer-side: sequence of the last request taken */
+  uint32_t m_reqTaken = 0;
+
+  /* Target response, and where the ramp toward it started */
+  AudioFilterType m_type = AudioFilterType::None;
+  double m_cutoff = 0.0;
+  double m_q = 0.0;
+  double m_fromCutoff = 0.0;
+  double m_fromQ = 0.0;
+  BiquadCoefs m_fromCoefs;
+  /* Ramps within one type sweep cutoff and Q; others blend coefficients */
+  bool m_sweep = false;
+  size_t m_rampFrames = 0;
+  size_t m_rampPos = 0;
+
+  double m_sampleRate = 0.0;
+  BiquadCoefs m_coefs;
+
+  BiquadCoefs _coefsAt(size_t pos) const;
+  bool _takeRequest(AudioFilterType& type, double& cutoff, double& q, size_t& rampFrames);
+  void _applyRequest(AudioFilterType type, double cutoff, double q, size_t rampFrames);
+
+public:
+  static constexpr unsigned MaxChannels = 8;
+  /* Filter state per channel */
+  float m_z1[MaxChannels] = {};
+  float m_z2[MaxChannels] = {};
+
+  void request(AudioFilterType type, double cutoff, double q, size_t rampFrames);
+
+  /** Apply any request and advance over an audible block of frames. Returns false when the block
+   *  passes unfiltered; otherwise start and end hold the coefficients to interpolate across it */
+  bool beginBlock(size_t frames, double sampleRate, BiquadCoefs& start, BiquadCoefs& end);
+};
+
+/** RBJ cookbook response at sampleRate; None is a pass-through */
+BiquadCoefs DesignBiquad(AudioFilterType type, double cutoff, double q, double sampleRate);
+
+/** Filters the resampled blocks of many voices together. Each voice channel is a lane; lanes sit
+ *  four to a frame in the staging buffer, so one SSE biquad step filters four channels of
+ *  (usually) different voices. The mixing thread stages voices until the bank is full, then
+ *  processes and drains it back to them for mixing */
+class AudioFilterBank {
+public:
+  static constexpr unsigned MaxLanes = 32;
+
+private:
+  /* Lane l of frame f at [(l / 4 * m_maxFrames + f) * 4 + l % 4] */
+  std::vector<float> m_staging;
+  size_t m_maxFrames = 0;
+
+  /* Per lane: b0, b1, b2, a1, a2 at the block start, their per-frame steps, and filter state */
+  alignas(16) float m_coefs[5][MaxLanes];
+  alignas(16) float m_steps[5][MaxLanes];
+  alignas(16) float m_z1[MaxLanes];
+  alignas(16) float m_z2[MaxLanes];
+  size_t m_laneFrames[MaxLanes];
+
+  struct StagedVoice {
+    AudioVoice* m_voice;
+    VoiceFilter* m_filter;
+    unsigned m_firstLane;
+    unsigned m_channels;
+    size_t m_frames;
+  };
+  StagedVoice m_voices[MaxLanes];
+  unsigned m_voiceCount = 0;
+  unsigned m_laneCount = 0;
+
+  float* _lane(unsigned lane) { return m_staging.data() + (lane / 4 * m_maxFrames) * 4 + lane % 4; }
+  void _filterLane(unsigned lane, size_t begin, size_t end);
+
+public:
+  /** Size staging for blocks of up to frames; client thread, before mixing at that size */
+  void Reserve(size_t frames);
+
+  bool Empty() const { return m_voiceCount == 0; }
+  bool Fits(unsigned channels) const { return m_laneCount + channels <= MaxLanes; }
+
+  /** Copy frames of interleaved audio into lanes, to be filtered from start toward end coefficients */
+  void Stage(AudioVoice* voice, VoiceFilter& filter, const float* audio, unsigned channels, size_t frames,
+             const BiquadCoefs& start, const BiquadCoefs& end);
+
+  /** Run every staged lane's filter */
+  void Process();
+
+  /** Interleave each staged voice's filtered block into scratch and hand it to
+   *  func(voice, frames), then empty the bank */
+  template <class Func>
+  void Drain(float* scratch, Func&& func) {
+    for (unsigned v = 0; v < m_voiceCount; ++v) {
+      StagedVoice& staged = m_voices[v];
+      for (unsigned c = 0; c < staged.m_channels; ++c) {
+        unsigned lane = staged.m_firstLane + c;
+        const float* src = _lane(lane);
+        for (size_t f = 0; f < staged.m_frames; ++f)
+          scratch[f * staged.m_channels + c] = src[f * 4];
+        /* Flush decayed state before it turns denormal */
+        staged.m_filter->m_z1[c] = std::abs(m_z1[lane]) < 1e-15f ? 0.f : m_z1[lane];
+        staged.m_filter->m_z2[c] = std::abs(m_z2[lane]) < 1e-15f ? 0.f : m_z2[lane];
+      }
+      func(staged.m_voice, staged.m_frames);
+    }
+    m_voiceCount = 0;
+    m_laneCount = 0;
+  }
+
+  template <class Func>
+  void VisitBuffers(Func&& func) {
+    func(m_staging.data(), m_staging.size() * sizeof(float));
+  }
+};
+
+} // namespace boo2
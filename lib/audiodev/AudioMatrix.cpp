@@ -28,13 +28,13 @@ float* AudioMatrixMono::mixMonoSampleData(const AudioVoiceEngineMixInfo& info, c
   const ChannelMap& chmap = info.m_channelMap;
   for (size_t s = 0; s < samples; ++s, ++dataIn) {
     if (m_slewFrames && m_curSlewFrame < m_slewFrames) {
-      double t = m_curSlewFrame / double(m_slewFrames);
-      double omt = 1.0 - t;
+      float wNew, wOld;
+      RampWeights(m_curve, m_curSlewFrame / float(m_slewFrames), wNew, wOld);
 
       for (unsigned c = 0; c < chmap.m_channelCount; ++c) {
         AudioChannel ch = chmap.m_channels[c];
         if (ch != AudioChannel::Unknown) {
-          *dataOut = *dataOut + *dataIn * (m_coefs.v[int(ch)] * t + m_oldCoefs.v[int(ch)] * omt);
+          *dataOut = *dataOut + *dataIn * (m_coefs.v[int(ch)] * wNew + m_oldCoefs.v[int(ch)] * wOld);
           ++dataOut;
         }
       }
@@ -78,14 +78,14 @@ float* AudioMatrixStereo::mixStereoSampleData(const AudioVoiceEngineMixInfo& inf
   const ChannelMap& chmap = info.m_channelMap;
   for (size_t f = 0; f < frames; ++f, dataIn += 2) {
     if (m_slewFrames && m_curSlewFrame < m_slewFrames) {
-      double t = m_curSlewFrame / double(m_slewFrames);
-      double omt = 1.0 - t;
+      float wNew, wOld;
+      RampWeights(m_curve, m_curSlewFrame / float(m_slewFrames), wNew, wOld);
 
       for (unsigned c = 0; c < chmap.m_channelCount; ++c) {
         AudioChannel ch = chmap.m_channels[c];
         if (ch != AudioChannel::Unknown) {
-          *dataOut = *dataOut + *dataIn * (m_coefs.v[int(ch)][0] * t + m_oldCoefs.v[int(ch)][0] * omt) +
-                     *dataIn * (m_coefs.v[int(ch)][1] * t + m_oldCoefs.v[int(ch)][1] * omt);
+          *dataOut = *dataOut + dataIn[0] * (m_coefs.v[int(ch)][0] * wNew + m_oldCoefs.v[int(ch)][0] * wOld) +
+                     dataIn[1] * (m_coefs.v[int(ch)][1] * wNew + m_oldCoefs.v[int(ch)][1] * wOld);
           ++dataOut;
         }
       }
@@ -104,4 +104,51 @@ float* AudioMatrixStereo::mixStereoSampleData(const AudioVoiceEngineMixInfo& inf
   return dataOut;
 }
 
+void AudioMatrixMultichannel::setDefaultMatrixCoefficients(const ChannelMap& srcChannels) {
+  m_curSlewFrame = 0;
+  m_slewFrames = 0;
+  memset(&m_coefs, 0, sizeof(m_coefs));
+  for (unsigned i = 0; i < srcChannels.m_channelCount; ++i) {
+    AudioChannel ch = srcChannels.m_channels[i];
+    if (ch != AudioChannel::Unknown)
+      m_coefs.v[i][int(ch)] = 1.0;
+  }
+}
+
+float* AudioMatrixMultichannel::mixMultichannelSampleData(const AudioVoiceEngineMixInfo& info, const float* dataIn,
+                                                          unsigned srcChannels, float* dataOut, size_t frames) {
+  const ChannelMap& chmap = info.m_channelMap;
+  for (size_t f = 0; f < frames; ++f, dataIn += srcChannels) {
+    if (m_slewFrames && m_curSlewFrame < m_slewFrames) {
+      float wNew, wOld;
+      RampWeights(m_curve, m_curSlewFrame / float(m_slewFrames), wNew, wOld);
+
+      for (unsigned c = 0; c < chmap.m_channelCount; ++c) {
+        AudioChannel ch = chmap.m_channels[c];
+        if (ch != AudioChannel::Unknown) {
+          float sum = 0.f;
+          for (unsigned i = 0; i < srcChannels; ++i)
+            sum += dataIn[i] * (m_coefs.v[i][int(ch)] * wNew + m_oldCoefs.v[i][int(ch)] * wOld);
+          *dataOut = *dataOut + sum;
+          ++dataOut;
+        }
+      }
+
+      ++m_curSlewFrame;
+    } else {
+      for (unsigned c = 0; c < chmap.m_channelCount; ++c) {
+        AudioChannel ch = chmap.m_channels[c];
+        if (ch != AudioChannel::Unknown) {
+          float sum = 0.f;
+          for (unsigned i = 0; i < srcChannels; ++i)
+            sum += dataIn[i] * m_coefs.v[i][int(ch)];
+          *dataOut = *dataOut + sum;
+          ++dataOut;
+        }
+      }
+    }
+  }
+  return dataOut;
+}
+
 } // namespace boo2
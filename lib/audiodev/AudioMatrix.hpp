@@ -2,6 +2,7 @@
 
 #include <cfloat>
 #include <climits>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
 
@@ -17,6 +18,24 @@
 namespace boo2 {
 struct AudioVoiceEngineMixInfo;
 
+/** Weights of the new and old coefficients at ramp position t in [0, 1] */
+static inline void RampWeights(AudioRampCurve curve, float t, float& wNew, float& wOld) {
+  switch (curve) {
+  case AudioRampCurve::SCurve:
+    wNew = t * t * (3.f - 2.f * t);
+    wOld = 1.f - wNew;
+    break;
+  case AudioRampCurve::EqualPower:
+    wNew = std::sin(t * float(M_PI_2));
+    wOld = std::cos(t * float(M_PI_2));
+    break;
+  default:
+    wNew = t;
+    wOld = 1.f - t;
+    break;
+  }
+}
+
 class AudioMatrixMono {
   union Coefs {
     float v[8];
@@ -29,26 +48,40 @@ class AudioMatrixMono {
   Coefs m_oldCoefs = {};
   size_t m_slewFrames = 0;
   size_t m_curSlewFrame = ~size_t(0);
+  AudioRampCurve m_curve = AudioRampCurve::Linear;
 
 public:
   AudioMatrixMono() { setDefaultMatrixCoefficients(AudioChannelSet::Stereo); }
 
   void setDefaultMatrixCoefficients(AudioChannelSet acSet);
-  void setMatrixCoefficients(const float coefs[8], size_t slewFrames = 0) {
-    m_slewFrames = slewFrames;
+  void setMatrixCoefficients(const float coefs[8], size_t slewFrames = 0,
+                             AudioRampCurve curve = AudioRampCurve::Linear) {
+    if (m_curSlewFrame < m_slewFrames) {
+      /* Retargeting mid-ramp continues from the levels reached so far */
+      if (m_curSlewFrame != 0) {
+        float wNew, wOld;
+        RampWeights(m_curve, m_curSlewFrame / float(m_slewFrames), wNew, wOld);
+        for (int i = 0; i < 8; ++i)
+          m_oldCoefs.v[i] = m_coefs.v[i] * wNew + m_oldCoefs.v[i] * wOld;
+      }
+    } else {
+      /* No ramp pending; start from the current levels */
 #if __SSE__
-    if (m_curSlewFrame != 0) {
       m_oldCoefs.q[0] = m_coefs.q[0];
       m_oldCoefs.q[1] = m_coefs.q[1];
+#else
+      for (int i = 0; i < 8; ++i)
+        m_oldCoefs.v[i] = m_coefs.v[i];
+#endif
     }
+    m_slewFrames = slewFrames;
+    m_curve = curve;
+#if __SSE__
     m_coefs.q[0] = _mm_loadu_ps(coefs);
     m_coefs.q[1] = _mm_loadu_ps(&coefs[4]);
 #else
-    for (int i = 0; i < 8; ++i) {
-      if (m_curSlewFrame != 0)
-        m_oldCoefs.v[i] = m_coefs.v[i];
+    for (int i = 0; i < 8; ++i)
       m_coefs.v[i] = coefs[i];
-    }
 #endif
     m_curSlewFrame = 0;
   }
@@ -79,30 +112,47 @@ class AudioMatrixStereo {
   Coefs m_oldCoefs = {};
   size_t m_slewFrames = 0;
   size_t m_curSlewFrame = ~size_t(0);
+  AudioRampCurve m_curve = AudioRampCurve::Linear;
 
 public:
   AudioMatrixStereo() { setDefaultMatrixCoefficients(AudioChannelSet::Stereo); }
 
   void setDefaultMatrixCoefficients(AudioChannelSet acSet);
-  void setMatrixCoefficients(const float coefs[8][2], size_t slewFrames = 0) {
-    m_slewFrames = slewFrames;
+  void setMatrixCoefficients(const float coefs[8][2], size_t slewFrames = 0,
+                             AudioRampCurve curve = AudioRampCurve::Linear) {
+    if (m_curSlewFrame < m_slewFrames) {
+      /* Retargeting mid-ramp continues from the levels reached so far */
+      if (m_curSlewFrame != 0) {
+        float wNew, wOld;
+        RampWeights(m_curve, m_curSlewFrame / float(m_slewFrames), wNew, wOld);
+        for (int i = 0; i < 8; ++i) {
+          m_oldCoefs.v[i][0] = m_coefs.v[i][0] * wNew + m_oldCoefs.v[i][0] * wOld;
+          m_oldCoefs.v[i][1] = m_coefs.v[i][1] * wNew + m_oldCoefs.v[i][1] * wOld;
+        }
+      }
+    } else {
+      /* No ramp pending; start from the current levels */
 #if __SSE__
-    if (m_curSlewFrame != 0) {
       m_oldCoefs.q[0] = m_coefs.q[0];
       m_oldCoefs.q[1] = m_coefs.q[1];
       m_oldCoefs.q[2] = m_coefs.q[2];
       m_oldCoefs.q[3] = m_coefs.q[3];
+#else
+      for (int i = 0; i < 8; ++i) {
+        m_oldCoefs.v[i][0] = m_coefs.v[i][0];
+        m_oldCoefs.v[i][1] = m_coefs.v[i][1];
+      }
+#endif
     }
+    m_slewFrames = slewFrames;
+    m_curve = curve;
+#if __SSE__
     m_coefs.q[0] = _mm_loadu_ps(coefs[0]);
     m_coefs.q[1] = _mm_loadu_ps(coefs[2]);
     m_coefs.q[2] = _mm_loadu_ps(coefs[4]);
     m_coefs.q[3] = _mm_loadu_ps(coefs[6]);
 #else
     for (int i = 0; i < 8; ++i) {
-      if (m_curSlewFrame != 0) {
-        m_oldCoefs.v[i][0] = m_coefs.v[i][0];
-        m_oldCoefs.v[i][1] = m_coefs.v[i][1];
-      }
       m_coefs.v[i][0] = coefs[i][0];
       m_coefs.v[i][1] = coefs[i][1];
     }
@@ -124,4 +174,64 @@ public:
   }
 };
 
+/** General matrix for sources of up to 8 interleaved channels */
+class AudioMatrixMultichannel {
+  /* Column per source channel, indexed by AudioChannel */
+  union Coefs {
+    float v[8][8];
+#if __SSE__
+    __m128 q[8][2];
+#endif
+  };
+  Coefs m_coefs = {};
+  Coefs m_oldCoefs = {};
+  size_t m_slewFrames = 0;
+  size_t m_curSlewFrame = ~size_t(0);
+  AudioRampCurve m_curve = AudioRampCurve::Linear;
+
+public:
+  /** Route each source channel to the output channel of the same name */
+  void setDefaultMatrixCoefficients(const ChannelMap& srcChannels);
+
+  /** coefs is indexed by AudioChannel, then by source channel */
+  void setMatrixCoefficients(const float coefs[8][8], size_t slewFrames = 0,
+                             AudioRampCurve curve = AudioRampCurve::Linear) {
+    if (m_curSlewFrame < m_slewFrames) {
+      /* Retargeting mid-ramp continues from the levels reached so far */
+      if (m_curSlewFrame != 0) {
+        float wNew, wOld;
+        RampWeights(m_curve, m_curSlewFrame / float(m_slewFrames), wNew, wOld);
+        for (int i = 0; i < 8; ++i)
+          for (int o = 0; o < 8; ++o)
+            m_oldCoefs.v[i][o] = m_coefs.v[i][o] * wNew + m_oldCoefs.v[i][o] * wOld;
+      }
+    } else {
+      /* No ramp pending; start from the current levels */
+      m_oldCoefs = m_coefs;
+    }
+    m_slewFrames = slewFrames;
+    m_curve = curve;
+    for (int i = 0; i < 8; ++i)
+      for (int o = 0; o < 8; ++o)
+        m_coefs.v[i][o] = coefs[o][i];
+    m_curSlewFrame = 0;
+  }
+
+  float* mixMultichannelSampleData(const AudioVoiceEngineMixInfo& info, const float* dataIn, unsigned srcChannels,
+                                   float* dataOut, size_t frames);
+
+  bool isSilent() const {
+    if (m_curSlewFrame < m_slewFrames)
+      for (int i = 0; i < 8; ++i)
+        for (int o = 0; o < 8; ++o)
+          if (m_oldCoefs.v[i][o] > FLT_EPSILON)
+            return false;
+    for (int i = 0; i < 8; ++i)
+      for (int o = 0; o < 8; ++o)
+        if (m_coefs.v[i][o] > FLT_EPSILON)
+          return false;
+    return true;
+  }
+};
+
 } // namespace boo2
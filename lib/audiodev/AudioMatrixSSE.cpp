@@ -13,8 +13,8 @@ union TVectorUnion {
 #endif
 };
 
-static constexpr TVectorUnion Min32Vec = {{INT32_MIN, INT32_MIN, INT32_MIN, INT32_MIN}};
-static constexpr TVectorUnion Max32Vec = {{INT32_MAX, INT32_MAX, INT32_MAX, INT32_MAX}};
+static constexpr TVectorUnion Min32Vec = {{float(INT32_MIN), float(INT32_MIN), float(INT32_MIN), float(INT32_MIN)}};
+static constexpr TVectorUnion Max32Vec = {{float(INT32_MAX), float(INT32_MAX), float(INT32_MAX), float(INT32_MAX)}};
 
 void AudioMatrixMono::setDefaultMatrixCoefficients(AudioChannelSet acSet) {
   m_curSlewFrame = 0;
@@ -41,22 +41,24 @@ float* AudioMatrixMono::mixMonoSampleData(const AudioVoiceEngineMixInfo& info, c
   const ChannelMap& chmap = info.m_channelMap;
   for (size_t s = 0; s < samples; ++s, ++dataIn) {
     if (m_slewFrames && m_curSlewFrame < m_slewFrames) {
-      float t = m_curSlewFrame / float(m_slewFrames);
-      float omt = 1.f - t;
+      float wNew, wOld;
+      RampWeights(m_curve, m_curSlewFrame / float(m_slewFrames), wNew, wOld);
 
-      switch (chmap.m_channelCount) {
+      /* Frames go two at a time on stereo output while a pair remains */
+      switch (s + 1 < samples ? chmap.m_channelCount : 0) {
       case 2: {
         ++m_curSlewFrame;
-        float t2 = m_curSlewFrame / float(m_slewFrames);
-        float omt2 = 1.f - t2;
+        float wNew2, wOld2;
+        RampWeights(m_curve, m_curSlewFrame / float(m_slewFrames), wNew2, wOld2);
 
+        /* Low lanes are the first of the two frames */
         TVectorUnion coefs, samps;
-        coefs.q = _mm_add_ps(
-            _mm_mul_ps(_mm_shuffle_ps(m_coefs.q[0], m_coefs.q[0], _MM_SHUFFLE(1, 0, 1, 0)), _mm_set_ps(t, t, t2, t2)),
-            _mm_mul_ps(_mm_shuffle_ps(m_oldCoefs.q[0], m_oldCoefs.q[0], _MM_SHUFFLE(1, 0, 1, 0)),
-                       _mm_set_ps(omt, omt, omt2, omt2)));
-        samps.q = _mm_loadu_ps(dataIn);
-        samps.q = _mm_shuffle_ps(samps.q, samps.q, _MM_SHUFFLE(1, 0, 1, 0));
+        coefs.q = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(m_coefs.q[0], m_coefs.q[0], _MM_SHUFFLE(1, 0, 1, 0)),
+                                        _mm_set_ps(wNew2, wNew2, wNew, wNew)),
+                             _mm_mul_ps(_mm_shuffle_ps(m_oldCoefs.q[0], m_oldCoefs.q[0], _MM_SHUFFLE(1, 0, 1, 0)),
+                                        _mm_set_ps(wOld2, wOld2, wOld, wOld)));
+        samps.q = _mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(dataIn)));
+        samps.q = _mm_shuffle_ps(samps.q, samps.q, _MM_SHUFFLE(1, 1, 0, 0));
 
         __m128 pre = _mm_add_ps(_mm_loadu_ps(dataOut), _mm_mul_ps(coefs.q, samps.q));
         _mm_storeu_ps(dataOut, pre);
@@ -70,7 +72,7 @@ float* AudioMatrixMono::mixMonoSampleData(const AudioVoiceEngineMixInfo& info, c
         for (unsigned c = 0; c < chmap.m_channelCount; ++c) {
           AudioChannel ch = chmap.m_channels[c];
           if (ch != AudioChannel::Unknown) {
-            *dataOut = *dataOut + *dataIn * (m_coefs.v[int(ch)] * t + m_oldCoefs.v[int(ch)] * omt);
+            *dataOut = *dataOut + *dataIn * (m_coefs.v[int(ch)] * wNew + m_oldCoefs.v[int(ch)] * wOld);
             ++dataOut;
           }
         }
@@ -80,12 +82,12 @@ float* AudioMatrixMono::mixMonoSampleData(const AudioVoiceEngineMixInfo& info, c
 
       ++m_curSlewFrame;
     } else {
-      switch (chmap.m_channelCount) {
+      switch (s + 1 < samples ? chmap.m_channelCount : 0) {
       case 2: {
         TVectorUnion coefs, samps;
         coefs.q = _mm_shuffle_ps(m_coefs.q[0], m_coefs.q[0], _MM_SHUFFLE(1, 0, 1, 0));
-        samps.q = _mm_loadu_ps(dataIn);
-        samps.q = _mm_shuffle_ps(samps.q, samps.q, _MM_SHUFFLE(1, 0, 1, 0));
+        samps.q = _mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(dataIn)));
+        samps.q = _mm_shuffle_ps(samps.q, samps.q, _MM_SHUFFLE(1, 1, 0, 0));
 
         __m128 pre = _mm_add_ps(_mm_loadu_ps(dataOut), _mm_mul_ps(coefs.q, samps.q));
         _mm_storeu_ps(dataOut, pre);
@@ -139,14 +141,14 @@ float* AudioMatrixStereo::mixStereoSampleData(const AudioVoiceEngineMixInfo& inf
   const ChannelMap& chmap = info.m_channelMap;
   for (size_t f = 0; f < frames; ++f, dataIn += 2) {
     if (m_slewFrames && m_curSlewFrame < m_slewFrames) {
-      double t = m_curSlewFrame / double(m_slewFrames);
-      double omt = 1.0 - t;
+      float wNew, wOld;
+      RampWeights(m_curve, m_curSlewFrame / float(m_slewFrames), wNew, wOld);
 
       for (unsigned c = 0; c < chmap.m_channelCount; ++c) {
         AudioChannel ch = chmap.m_channels[c];
         if (ch != AudioChannel::Unknown) {
-          *dataOut = *dataOut + *dataIn * (m_coefs.v[int(ch)][0] * t + m_oldCoefs.v[int(ch)][0] * omt) +
-                     *dataIn * (m_coefs.v[int(ch)][1] * t + m_oldCoefs.v[int(ch)][1] * omt);
+          *dataOut = *dataOut + dataIn[0] * (m_coefs.v[int(ch)][0] * wNew + m_oldCoefs.v[int(ch)][0] * wOld) +
+                     dataIn[1] * (m_coefs.v[int(ch)][1] * wNew + m_oldCoefs.v[int(ch)][1] * wOld);
           ++dataOut;
         }
       }
@@ -165,4 +167,82 @@ float* AudioMatrixStereo::mixStereoSampleData(const AudioVoiceEngineMixInfo& inf
   return dataOut;
 }
 
+void AudioMatrixMultichannel::setDefaultMatrixCoefficients(const ChannelMap& srcChannels) {
+  m_curSlewFrame = 0;
+  m_slewFrames = 0;
+  for (int i = 0; i < 8; ++i) {
+    m_coefs.q[i][0] = _mm_setzero_ps();
+    m_coefs.q[i][1] = _mm_setzero_ps();
+  }
+  for (unsigned i = 0; i < srcChannels.m_channelCount; ++i) {
+    AudioChannel ch = srcChannels.m_channels[i];
+    if (ch != AudioChannel::Unknown)
+      m_coefs.v[i][int(ch)] = 1.0;
+  }
+}
+
+float* AudioMatrixMultichannel::mixMultichannelSampleData(const AudioVoiceEngineMixInfo& info, const float* dataIn,
+                                                          unsigned srcChannels, float* dataOut, size_t frames) {
+  /* Columns permuted into the output's channel order, so each frame is srcChannels broadcast
+   * multiply-adds and one contiguous accumulate */
+  const ChannelMap& chmap = info.m_channelMap;
+  Coefs cols, oldCols;
+  unsigned outChannels = 0;
+  for (unsigned c = 0; c < chmap.m_channelCount; ++c) {
+    AudioChannel ch = chmap.m_channels[c];
+    if (ch == AudioChannel::Unknown)
+      continue;
+    for (unsigned i = 0; i < srcChannels; ++i) {
+      cols.v[i][outChannels] = m_coefs.v[i][int(ch)];
+      oldCols.v[i][outChannels] = m_oldCoefs.v[i][int(ch)];
+    }
+    ++outChannels;
+  }
+  for (unsigned i = 0; i < srcChannels; ++i)
+    for (unsigned o = outChannels; o < 8; ++o)
+      cols.v[i][o] = oldCols.v[i][o] = 0.f;
+
+  for (size_t f = 0; f < frames; ++f, dataIn += srcChannels) {
+    __m128 acc[2] = {_mm_setzero_ps(), _mm_setzero_ps()};
+    if (m_slewFrames && m_curSlewFrame < m_slewFrames) {
+      float wNew, wOld;
+      RampWeights(m_curve, m_curSlewFrame / float(m_slewFrames), wNew, wOld);
+      __m128 wNewV = _mm_set1_ps(wNew);
+      __m128 wOldV = _mm_set1_ps(wOld);
+      for (unsigned i = 0; i < srcChannels; ++i) {
+        __m128 samp = _mm_set1_ps(dataIn[i]);
+        for (int h = 0; h < 2; ++h)
+          acc[h] = _mm_add_ps(acc[h], _mm_mul_ps(samp, _mm_add_ps(_mm_mul_ps(cols.q[i][h], wNewV),
+                                                                  _mm_mul_ps(oldCols.q[i][h], wOldV))));
+      }
+      ++m_curSlewFrame;
+    } else {
+      for (unsigned i = 0; i < srcChannels; ++i) {
+        __m128 samp = _mm_set1_ps(dataIn[i]);
+        acc[0] = _mm_add_ps(acc[0], _mm_mul_ps(samp, cols.q[i][0]));
+        acc[1] = _mm_add_ps(acc[1], _mm_mul_ps(samp, cols.q[i][1]));
+      }
+    }
+
+    switch (outChannels) {
+    case 8:
+      _mm_storeu_ps(dataOut + 4, _mm_add_ps(_mm_loadu_ps(dataOut + 4), acc[1]));
+      [[fallthrough]];
+    case 4:
+      _mm_storeu_ps(dataOut, _mm_add_ps(_mm_loadu_ps(dataOut), acc[0]));
+      break;
+    default: {
+      TVectorUnion sums[2];
+      sums[0].q = acc[0];
+      sums[1].q = acc[1];
+      for (unsigned o = 0; o < outChannels; ++o)
+        dataOut[o] += sums[o / 4].v[o % 4];
+      break;
+    }
+    }
+    dataOut += outChannels;
+  }
+  return dataOut;
+}
+
 } // namespace boo2
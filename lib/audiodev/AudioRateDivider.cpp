@@ -0,0 +1,144 @@
+#include "AudioRateDivider.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#undef min
+#undef max
+
+namespace boo2 {
+#ifndef M_PI
+#define M_PI 3.14159265358979323846 /* pi */
+#endif
+
+/* Kaiser window shape; about 70dB of stopband attenuation */
+static constexpr double KaiserBeta = 7.0;
+
+/* Zeroth-order modified Bessel function of the first kind */
+static double BesselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 32; ++k) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12)
+      break;
+  }
+  return sum;
+}
+
+void AudioRateDivider::Reserve(unsigned divider, size_t maxFrames) {
+  divider = std::clamp(divider, 1u, MaxDivider);
+  if (divider == m_divider && maxFrames <= m_maxFrames)
+    return;
+  bool reshaped = divider != m_divider;
+  m_divider = divider;
+  m_maxFrames = std::max(maxFrames, m_maxFrames);
+  if (m_divider == 1) {
+    m_taps.clear();
+    m_input.clear();
+    m_reduced.clear();
+    return;
+  }
+
+  /* Transition band centered on the reduced Nyquist frequency, 0.2 of the reduced rate wide */
+  size_t tapCount = size_t(TapsPerPhase) * m_divider;
+  if (m_taps.size() != tapCount) {
+    m_taps.resize(tapCount);
+    double cutoff = 0.5 / m_divider;
+    double center = (tapCount - 1) / 2.0;
+    double norm = BesselI0(KaiserBeta);
+    double sum = 0.0;
+    for (size_t j = 0; j < tapCount; ++j) {
+      double x = j - center;
+      double sinc = x == 0.0 ? 2.0 * cutoff : std::sin(2.0 * M_PI * cutoff * x) / (M_PI * x);
+      double r = x / center;
+      double window = BesselI0(KaiserBeta * std::sqrt(std::max(1.0 - r * r, 0.0))) / norm;
+      m_taps[j] = float(sinc * window);
+      sum += m_taps[j];
+    }
+    for (float& tap : m_taps)
+      tap = float(tap / sum);
+  }
+
+  size_t maxReduced = m_maxFrames / m_divider + 1;
+  m_input.resize((tapCount - 1 + m_maxFrames) * MaxChannels);
+  m_reduced.resize((TapsPerPhase + maxReduced) * MaxChannels);
+  if (reshaped) {
+    std::fill(m_input.begin(), m_input.end(), 0.f);
+    std::fill(m_reduced.begin(), m_reduced.end(), 0.f);
+    m_phase = 0;
+  }
+}
+
+float* AudioRateDivider::Decimate(const float* input, unsigned chanCount, size_t frames, size_t& reducedFrames) {
+  const size_t history = m_taps.size() - 1;
+  if (chanCount != m_chanCount) {
+    std::fill(m_input.begin(), m_input.end(), 0.f);
+    std::fill(m_reduced.begin(), m_reduced.end(), 0.f);
+    m_phase = 0;
+    m_chanCount = chanCount;
+  }
+  const unsigned chans = m_chanCount;
+  float* in = m_input.data();
+  float* out = m_reduced.data() + TapsPerPhase * chans;
+  memcpy(in + history * chans, input, sizeof(float) * frames * chans);
+
+  /* A reduced frame completes on the last master frame of each period */
+  size_t count = 0;
+  size_t first = m_divider - 1 - m_phase;
+  for (size_t f = first; f < frames; f += m_divider) {
+    const float* newest = in + (history + f) * chans;
+    float* dst = out + count * chans;
+    for (unsigned c = 0; c < chans; ++c)
+      dst[c] = 0.f;
+    for (size_t j = 0; j < m_taps.size(); ++j) {
+      const float tap = m_taps[j];
+      const float* src = newest - j * chans;
+      for (unsigned c = 0; c < chans; ++c)
+        dst[c] += tap * src[c];
+    }
+    ++count;
+  }
+
+  memmove(in, in + frames * chans, sizeof(float) * history * chans);
+  m_blockPhase = m_phase;
+  m_phase = unsigned((m_phase + frames) % m_divider);
+  m_reducedFrames = count;
+  reducedFrames = count;
+  return out;
+}
+
+void AudioRateDivider::Interpolate(float* output, size_t frames) {
+  const unsigned chans = m_chanCount;
+  const float* reduced = m_reduced.data() + TapsPerPhase * chans;
+  const float gain = float(m_divider);
+
+  /* Index of the newest reduced frame at or before the current master frame */
+  ptrdiff_t newest = -1;
+  unsigned phase = m_blockPhase;
+  for (size_t f = 0; f < frames; ++f) {
+    if (phase == m_divider - 1)
+      ++newest;
+    /* Master frames elapsed since that reduced frame selects the polyphase branch */
+    unsigned offset = (phase + 1) % m_divider;
+    float* dst = output + f * chans;
+    for (unsigned c = 0; c < chans; ++c)
+      dst[c] = 0.f;
+    for (unsigned m = 0; m < TapsPerPhase; ++m) {
+      const float tap = m_taps[offset + m * m_divider] * gain;
+      const float* src = reduced + (newest - ptrdiff_t(m)) * ptrdiff_t(chans);
+      for (unsigned c = 0; c < chans; ++c)
+        dst[c] += tap * src[c];
+    }
+    if (++phase == m_divider)
+      phase = 0;
+  }
+
+  /* Keep the newest reduced frames as interpolator history */
+  memmove(m_reduced.data(), m_reduced.data() + m_reducedFrames * chans,
+          sizeof(float) * TapsPerPhase * chans);
+}
+
+} // namespace boo2
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace boo2 {
+
+/** Polyphase decimator/interpolator pair running a bus at an integer fraction of the master rate.
+ *  Both halves share one Kaiser-windowed low-pass; the round trip delays audio by
+ *  TapsPerPhase * divider - 1 frames. Buffers are sized by Reserve() for up to MaxChannels, so the
+ *  mix path never allocates, even when the bus layout changes under it. */
+class AudioRateDivider {
+public:
+  static constexpr unsigned TapsPerPhase = 24;
+  static constexpr unsigned MaxDivider = 8;
+  static constexpr unsigned MaxChannels = 8;
+
+private:
+  unsigned m_divider = 1;
+  unsigned m_chanCount = 0;
+  size_t m_maxFrames = 0;
+  /* Master-rate frames into the current reduced-rate period */
+  unsigned m_phase = 0;
+  unsigned m_blockPhase = 0;
+  size_t m_reducedFrames = 0;
+  std::vector<float> m_taps;
+  /* Filter history followed by the block being decimated */
+  std::vector<float> m_input;
+  /* Interpolator history followed by the reduced-rate block handed to the effect */
+  std::vector<float> m_reduced;
+
+public:
+  /** Configure for divider and size buffers for blocks of up to maxFrames; resets history on change */
+  void Reserve(unsigned divider, size_t maxFrames);
+
+  /** Low-pass and decimate interleaved master-rate frames of chanCount channels; returns the reduced block,
+   *  valid until Interpolate(). History is reset when the channel count changes */
+  float* Decimate(const float* input, unsigned chanCount, size_t frames, size_t& reducedFrames);
+
+  /** Interpolate the (processed) reduced block back to frames master-rate frames, overwriting output */
+  void Interpolate(float* output, size_t frames);
+
+  unsigned divider() const { return m_divider; }
+
+  /** Calls f(ptr, bytes) for each owned buffer */
+  template <typename F>
+  void VisitBuffers(F&& f) const {
+    f(const_cast<float*>(m_taps.data()), sizeof(float) * m_taps.size());
+    f(const_cast<float*>(m_input.data()), sizeof(float) * m_input.size());
+    f(const_cast<float*>(m_reduced.data()), sizeof(float) * m_reduced.size());
+  }
+};
+
+} // namespace boo2
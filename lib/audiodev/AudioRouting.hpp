@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "boo2/audiodev/IAudioSubmix.hpp"
+#include "boo2/audiodev/IAudioVoice.hpp"
+
+namespace boo2 {
+
+/** Routes of a voice or submix as seen by the mixer. Tables are immutable once published: clients
+ *  copy, edit and republish them under the engine's data mutex, and a replaced table is freed
+ *  together with the snapshot it outlived. Routes themselves are shared between successive tables,
+ *  so mixer state kept in them (ramps, levels) carries over */
+template <class Route>
+using AudioRoutingTable = std::vector<std::shared_ptr<Route>>;
+
+/** Route of table leading into submix, if any */
+template <class Route>
+Route* FindRoute(const AudioRoutingTable<Route>* table, const IAudioSubmix* submix) {
+  if (table)
+    for (const std::shared_ptr<Route>& route : *table)
+      if (route->m_submix == submix)
+        return route.get();
+  return nullptr;
+}
+
+/** Levels posted by client threads for the mixer to pick up at its next block. Posting is a
+ *  sequence-lock write, so it never blocks the mixer or allocates; a post the mixer catches half
+ *  written is left for the following block */
+template <size_t N>
+class AudioLevelPost {
+  /* Odd while a post is in progress */
+  std::atomic<uint32_t> m_sequence = 0;
+  std::array<std::atomic<float>, N> m_levels;
+  std::atomic<size_t> m_slewFrames = 0;
+  std::atomic<AudioRampCurve> m_curve = AudioRampCurve::Linear;
+
+  /* Mixer-side: sequence of the last post taken */
+  uint32_t m_taken = 0;
+
+public:
+  void post(const float* levels, size_t slewFrames, AudioRampCurve curve = AudioRampCurve::Linear) {
+    /* Concurrent posters take turns */
+    uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+    do {
+      while (sequence & 1)
+        sequence = m_sequence.load(std::memory_order_relaxed);
+    } while (!m_sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_relaxed));
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < N; ++i)
+      m_levels[i].store(levels[i], std::memory_order_relaxed);
+    m_slewFrames.store(slewFrames, std::memory_order_relaxed);
+    m_curve.store(curve, std::memory_order_relaxed);
+    m_sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  /** Mixer-side: copy out the newest complete post, if there is one not yet taken */
+  bool take(float* levels, size_t& slewFrames, AudioRampCurve& curve) {
+    uint32_t sequence = m_sequence.load(std::memory_order_acquire);
+    if (sequence == m_taken || (sequence & 1))
+      return false;
+    for (size_t i = 0; i < N; ++i)
+      levels[i] = m_levels[i].load(std::memory_order_relaxed);
+    slewFrames = m_slewFrames.load(std::memory_order_relaxed);
+    curve = m_curve.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m_sequence.load(std::memory_order_relaxed) != sequence)
+      return false;
+    m_taken = sequence;
+    return true;
+  }
+};
+
+} // namespace boo2
@@ -0,0 +1,380 @@
+#include "AudioSamplerVoice.hpp"
+#include "AudioSubmix.hpp"
+#include "AudioVoiceEngine.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace boo2 {
+
+static AudioMatrixMono DefaultMonoMtx;
+static AudioMatrixStereo DefaultStereoMtx;
+
+/* Mixes a sampler voice's block through a route's matrix, or the default one when unrouted */
+static void MixSamplerBlock(AudioMatrixMono* mtx, const AudioVoiceEngineMixInfo& info, const float* audio,
+                            float* out, size_t frames) {
+  (mtx ? *mtx : DefaultMonoMtx).mixMonoSampleData(info, audio, out, frames);
+}
+
+static void MixSamplerBlock(AudioMatrixStereo* mtx, const AudioVoiceEngineMixInfo& info, const float* audio,
+                            float* out, size_t frames) {
+  (mtx ? *mtx : DefaultStereoMtx).mixStereoSampleData(info, audio, out, frames);
+}
+
+static size_t MsToFrames(double ms, double sampleRate) { return size_t(std::max(ms, 0.0) * sampleRate / 1000.0); }
+
+SamplerEnvelope::SamplerEnvelope(const AudioEnvelope& env, double sampleRate) : m_env(env) {
+  m_env.m_sustain = std::clamp(m_env.m_sustain, 0.f, 1.f);
+  setSampleRate(sampleRate);
+}
+
+void SamplerEnvelope::setSampleRate(double sampleRate) {
+  size_t oldFrames = m_stage == Stage::Attack ? m_attackFrames
+                     : m_stage == Stage::Decay ? m_decayFrames
+                     : m_stage == Stage::Release ? m_releaseFrames
+                                                 : 0;
+  m_attackFrames = MsToFrames(m_env.m_attackMs, sampleRate);
+  m_decayFrames = MsToFrames(m_env.m_decayMs, sampleRate);
+  m_releaseFrames = MsToFrames(m_env.m_releaseMs, sampleRate);
+
+  /* Keep the progress through a ramp in progress, at the new rate */
+  if (m_remaining != SIZE_MAX && oldFrames) {
+    size_t newFrames = m_stage == Stage::Attack ? m_attackFrames
+                       : m_stage == Stage::Decay ? m_decayFrames
+                                                 : m_releaseFrames;
+    float target = m_stage == Stage::Attack ? 1.f : m_stage == Stage::Decay ? m_env.m_sustain : 0.f;
+    m_remaining = std::max(size_t(double(m_remaining) * newFrames / oldFrames), size_t(1));
+    m_step = (target - m_level) / float(m_remaining);
+  }
+}
+
+void SamplerEnvelope::_enter(Stage stage) {
+  m_stage = stage;
+  float target;
+  Stage next;
+  switch (stage) {
+  case Stage::Attack:
+    m_remaining = m_attackFrames;
+    target = 1.f;
+    next = Stage::Decay;
+    break;
+  case Stage::Decay:
+    m_remaining = m_decayFrames;
+    target = m_env.m_sustain;
+    next = Stage::Sustain;
+    break;
+  case Stage::Release:
+    m_remaining = m_releaseFrames;
+    target = 0.f;
+    next = Stage::Done;
+    break;
+  case Stage::Sustain:
+    m_level = m_env.m_sustain;
+    m_step = 0.f;
+    m_remaining = SIZE_MAX;
+    return;
+  default:
+    m_level = 0.f;
+    m_step = 0.f;
+    m_remaining = SIZE_MAX;
+    return;
+  }
+
+  if (!m_remaining) {
+    m_level = target;
+    _enter(next);
+    return;
+  }
+  m_step = (target - m_level) / float(m_remaining);
+}
+
+void SamplerEnvelope::trigger() {
+  m_level = 0.f;
+  _enter(Stage::Attack);
+}
+
+void SamplerEnvelope::release() {
+  if (m_stage < Stage::Release)
+    _enter(Stage::Release);
+}
+
+float SamplerEnvelope::advance(size_t frames) {
+  while (frames && m_remaining != SIZE_MAX) {
+    size_t n = std::min(frames, m_remaining);
+    m_level += m_step * float(n);
+    frames -= n;
+    if (!(m_remaining -= n))
+      _enter(m_stage == Stage::Attack ? Stage::Decay : m_stage == Stage::Decay ? Stage::Sustain : Stage::Done);
+  }
+  return m_level;
+}
+
+void SamplerEnvelope::apply(float* audio, size_t frames, unsigned channels, float gain) {
+  while (frames) {
+    size_t n = std::min(frames, m_remaining);
+    float level = m_level;
+    if (m_step == 0.f) {
+      float g = level * gain;
+      for (size_t i = 0; i < n * channels; ++i)
+        audio[i] *= g;
+    } else {
+      for (size_t f = 0; f < n; ++f) {
+        level += m_step;
+        float g = level * gain;
+        for (unsigned c = 0; c < channels; ++c)
+          audio[f * channels + c] *= g;
+      }
+    }
+    audio += n * channels;
+    frames -= n;
+    m_level = level;
+    if (m_remaining != SIZE_MAX && !(m_remaining -= n))
+      _enter(m_stage == Stage::Attack ? Stage::Decay : m_stage == Stage::Decay ? Stage::Sustain : Stage::Done);
+  }
+}
+
+AudioSamplerSource::AudioSamplerSource(const AudioSamplerInfo& info, double mixRate)
+: m_info(info), m_gainEnv(info.m_gainEnvelope, mixRate), m_pitchEnv(info.m_pitchEnvelope, mixRate) {
+  unsigned chans = m_info.m_channels;
+  for (unsigned c = 0; c < chans; ++c)
+    m_adpcmState[c] = m_loopState[c] = m_info.m_adpcm[c].m_initial;
+
+  m_info.m_loopEnd = std::min(m_info.m_loopEnd, m_info.m_frames);
+  if (!looping()) {
+    m_info.m_loopStart = m_info.m_loopEnd = 0;
+  } else {
+    m_loopCrossfade = std::min({m_info.m_loopCrossfade, m_info.m_loopStart, m_info.m_loopEnd - m_info.m_loopStart});
+    const int16_t* fadeIn = nullptr;
+    const int16_t* fadeOut = nullptr;
+    std::vector<int16_t> decoded;
+    if (compressed()) {
+      /* Decode once up to the loop end for the state at the loop start and both crossfade spans */
+      size_t fadeInStart = m_info.m_loopStart - m_loopCrossfade;
+      size_t fadeOutStart = m_info.m_loopEnd - m_loopCrossfade;
+      std::vector<int16_t> discard(std::min(fadeInStart, size_t(4096)) * chans);
+      decoded.resize(m_loopCrossfade * 2 * chans);
+      for (size_t pos = 0; pos < fadeInStart;) {
+        size_t frames = std::min(fadeInStart - pos, discard.size() / chans);
+        _decode(m_loopState, pos, frames, discard.data());
+        pos += frames;
+      }
+      _decode(m_loopState, fadeInStart, m_loopCrossfade, decoded.data());
+      AudioADPCMState state[2] = {m_loopState[0], m_loopState[1]};
+      discard.resize(std::min(fadeOutStart - m_info.m_loopStart, size_t(4096)) * chans);
+      for (size_t pos = m_info.m_loopStart; pos < fadeOutStart;) {
+        size_t frames = std::min(fadeOutStart - pos, discard.size() / chans);
+        _decode(state, pos, frames, discard.data());
+        pos += frames;
+      }
+      _decode(state, fadeOutStart, m_loopCrossfade, decoded.data() + m_loopCrossfade * chans);
+      fadeIn = decoded.data();
+      fadeOut = decoded.data() + m_loopCrossfade * chans;
+    } else {
+      fadeIn = m_info.m_samples + (m_info.m_loopStart - m_loopCrossfade) * chans;
+      fadeOut = m_info.m_samples + (m_info.m_loopEnd - m_loopCrossfade) * chans;
+    }
+    if (m_loopCrossfade) {
+      /* Blend once here so the mixer can hand the crossfade to the resampler like any other span */
+      m_crossfade.reset(new int16_t[m_loopCrossfade * chans]);
+      for (size_t i = 0; i < m_loopCrossfade * chans; ++i) {
+        float t = float(i / chans + 1) / float(m_loopCrossfade + 1);
+        m_crossfade[i] = int16_t(std::lrint(fadeOut[i] * (1.f - t) + fadeIn[i] * t));
+      }
+    }
+  }
+
+  float velocity = std::clamp(info.m_velocity, 0.f, 1.f);
+  float sensitivity = std::clamp(info.m_velocitySensitivity, 0.f, 1.f);
+  m_velocityGain = 1.f - sensitivity + sensitivity * velocity * velocity;
+}
+
+void AudioSamplerSource::setMixRate(double mixRate) {
+  m_gainEnv.setSampleRate(mixRate);
+  m_pitchEnv.setSampleRate(mixRate);
+}
+
+bool AudioSamplerSource::beginBlock(AudioVoice& voice, size_t frames) {
+  bool noteOff = m_noteOff.exchange(false, std::memory_order_acquire);
+  if (m_trigger.exchange(false, std::memory_order_acquire)) {
+    /* A start supersedes a stop requested before it */
+    noteOff = false;
+    m_pos = 0;
+    m_tailFrames = 0;
+    for (unsigned c = 0; c < m_info.m_channels; ++c)
+      m_adpcmState[c] = m_info.m_adpcm[c].m_initial;
+    m_gainEnv.trigger();
+    m_pitchEnv.trigger();
+  }
+  if (noteOff) {
+    m_gainEnv.release();
+    m_pitchEnv.release();
+  }
+  if (voice.m_setPitchRatio) {
+    m_glideFrom = m_glideFrames ? m_glideFrom + (m_glideTo - m_glideFrom) * double(m_glidePos) / m_glideFrames
+                                : m_glideTo;
+    m_glideTo = voice.m_pitchRatio;
+    m_glideFrames = voice.m_pitchSlewFrames;
+    m_glidePos = 0;
+    voice.m_setPitchRatio = false;
+  }
+
+  if (m_gainEnv.done())
+    return false;
+  /* A one-shot sample ends once its last frames have cleared the resampler; the input
+   * runs at most one request ahead of the output */
+  if (m_pos >= m_info.m_frames &&
+      m_tailFrames >= size_t(soxr_delay(voice.m_src) * voice.m_sampleRatio) + voice.m_head->_voiceInputFrames())
+    return false;
+
+  m_glidePos = std::min(m_glidePos + frames, m_glideFrames);
+  double ratio =
+      m_glideFrames ? m_glideFrom + (m_glideTo - m_glideFrom) * double(m_glidePos) / m_glideFrames : m_glideTo;
+  ratio *= std::exp2(m_pitchEnv.advance(frames) * m_info.m_pitchEnvelopeCents / 1200.0);
+  ratio *= voice.m_sampleRateIn / voice.m_sampleRateOut;
+  if (ratio != voice.m_sampleRatio) {
+    /* soxr interpolates the ratio per output sample across the block */
+    voice.m_sampleRatio = ratio;
+    soxr_set_io_ratio(voice.m_src, ratio, frames);
+  }
+  return true;
+}
+
+void AudioSamplerSource::_decode(AudioADPCMState* state, size_t pos, size_t frames, int16_t* out) const {
+  unsigned chans = m_info.m_channels;
+  for (unsigned c = 0; c < chans; ++c) {
+    if (m_info.m_format == AudioSampleFormat::DSPADPCM)
+      DecodeDSPADPCM(m_info.m_adpcm[c], state[c], pos, frames, out + c, chans);
+    else
+      DecodeIMAADPCM(m_info.m_adpcm[c], state[c], pos, frames, out + c, chans);
+  }
+}
+
+const int16_t* AudioSamplerSource::_read(size_t& frames, std::vector<int16_t>& scratch) {
+  if (!compressed())
+    return m_info.m_samples + m_pos * m_info.m_channels;
+  frames = std::min(frames, scratch.size() / m_info.m_channels);
+  _decode(m_adpcmState, m_pos, frames, scratch.data());
+  return scratch.data();
+}
+
+size_t AudioSamplerSource::supply(const int16_t** data, size_t frames, std::vector<int16_t>& scratch) {
+  unsigned chans = m_info.m_channels;
+  if (looping()) {
+    size_t fadeStart = m_info.m_loopEnd - m_loopCrossfade;
+    if (m_pos < fadeStart) {
+      frames = std::min(frames, fadeStart - m_pos);
+      *data = _read(frames, scratch);
+    } else {
+      frames = std::min(frames, m_info.m_loopEnd - m_pos);
+      *data = m_crossfade.get() + (m_pos - fadeStart) * chans;
+    }
+    m_pos += frames;
+    if (m_pos == m_info.m_loopEnd) {
+      m_pos = m_info.m_loopStart;
+      for (unsigned c = 0; c < chans; ++c)
+        m_adpcmState[c] = m_loopState[c];
+    }
+    return frames;
+  }
+
+  if (m_pos < m_info.m_frames) {
+    frames = std::min(frames, m_info.m_frames - m_pos);
+    *data = _read(frames, scratch);
+    m_pos += frames;
+    return frames;
+  }
+
+  /* Past the end: silence flushes the resampler without ending its input */
+  frames = std::min(frames, scratch.size() / chans);
+  memset(scratch.data(), 0, frames * chans * sizeof(int16_t));
+  *data = scratch.data();
+  m_tailFrames += frames;
+  return frames;
+}
+
+void AudioSamplerSource::skip(size_t frames, double ratio, std::vector<int16_t>& scratch, size_t maxInput) {
+  m_gainEnv.advance(frames);
+  const int16_t* dummy;
+  size_t remFrames = size_t(std::ceil(frames * ratio));
+  while (remFrames) {
+    size_t thisFrames = supply(&dummy, std::min(remFrames, maxInput), scratch);
+    if (!thisFrames)
+      break;
+    remFrames -= thisFrames;
+  }
+}
+
+template <class VoiceBase>
+AudioSamplerVoice<VoiceBase>::AudioSamplerVoice(BaseAudioVoiceEngine& root, const AudioSamplerInfo& info)
+: VoiceBase(root, nullptr, info.m_sampleRate, true), m_source(info, root.mixInfo().m_sampleRate) {
+  if (this->m_src)
+    _bindResampler(this->m_src);
+}
+
+template <class VoiceBase>
+void AudioSamplerVoice<VoiceBase>::_bindResampler(soxr_t src) {
+  soxr_set_input_fn(src, soxr_input_fn_t(SRCCallback), this, this->m_head->_voiceInputFrames());
+}
+
+template <class VoiceBase>
+void AudioSamplerVoice<VoiceBase>::_swapResampler(soxr_t& src, double rateIn, double rateOut) {
+  bool setPitchRatio = this->m_setPitchRatio;
+  VoiceBase::_swapResampler(src, rateIn, rateOut);
+  this->m_setPitchRatio = setPitchRatio;
+  m_source.setMixRate(rateOut);
+}
+
+template <class VoiceBase>
+size_t AudioSamplerVoice<VoiceBase>::SRCCallback(AudioSamplerVoice* ctx, const int16_t** data, size_t frames) {
+  return ctx->m_source.supply(data, frames, ctx->m_head->m_scratchIn);
+}
+
+template <class VoiceBase>
+size_t AudioSamplerVoice<VoiceBase>::_pump(size_t frames, float* out) {
+  this->_takeResampler();
+  if (!m_source.beginBlock(*this, frames)) {
+    this->m_running = false;
+    return 0;
+  }
+  this->_takeSendLevels();
+
+  if (this->isSilent()) {
+    m_source.skip(frames, this->m_sampleRatio, this->m_head->m_scratchIn, this->m_head->_voiceInputFrames());
+    return 0;
+  }
+
+  size_t oDone = soxr_output(this->m_src, out, frames);
+  m_source.applyGain(out, oDone);
+  return oDone;
+}
+
+template <class VoiceBase>
+void AudioSamplerVoice<VoiceBase>::_mix(size_t frames, float* audio, double dt) {
+  /* No client routing; the block is mixed straight from the resampler */
+  const AudioVoiceEngineMixInfo& info = this->m_head->_blockMixInfo();
+  const AudioRoutingTable<Send>* sends = this->m_sendTable.load(std::memory_order_acquire);
+  if (sends && sends->size()) {
+    for (const std::shared_ptr<Send>& send : *sends) {
+      AudioSubmix& smx = *reinterpret_cast<AudioSubmix*>(send->m_submix);
+      MixSamplerBlock(&send->m_matrix, info, audio, smx._getMergeBuf(frames), frames);
+    }
+  } else {
+    AudioSubmix& smx = *this->m_head->m_mainSubmix;
+    MixSamplerBlock(static_cast<decltype(Send::m_matrix)*>(nullptr), info, audio, smx._getMergeBuf(frames), frames);
+  }
+}
+
+template <class VoiceBase>
+void AudioSamplerVoice<VoiceBase>::start() {
+  m_source.m_trigger.store(true, std::memory_order_release);
+  this->m_running = true;
+}
+
+template <class VoiceBase>
+void AudioSamplerVoice<VoiceBase>::stop() { m_source.m_noteOff.store(true, std::memory_order_release); }
+
+template class AudioSamplerVoice<AudioVoiceMono>;
+template class AudioSamplerVoice<AudioVoiceStereo>;
+
+} // namespace boo2
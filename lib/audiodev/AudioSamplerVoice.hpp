@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "boo2/audiodev/AudioSampler.hpp"
+#include "AudioADPCM.hpp"
+#include "AudioVoice.hpp"
+
+namespace boo2 {
+
+/** AudioEnvelope stepped in mixing-rate frames */
+class SamplerEnvelope {
+  enum class Stage { Attack, Decay, Sustain, Release, Done };
+
+  AudioEnvelope m_env;
+  size_t m_attackFrames = 0;
+  size_t m_decayFrames = 0;
+  size_t m_releaseFrames = 0;
+
+  Stage m_stage = Stage::Done;
+  float m_level = 0.f;
+  float m_step = 0.f;
+  /* Frames left in the current stage; SIZE_MAX while holding */
+  size_t m_remaining = SIZE_MAX;
+
+  void _enter(Stage stage);
+
+public:
+  SamplerEnvelope(const AudioEnvelope& env, double sampleRate);
+  void setSampleRate(double sampleRate);
+  void trigger();
+  void release();
+  bool done() const { return m_stage == Stage::Done; }
+
+  /** Level after frames more frames */
+  float advance(size_t frames);
+
+  /** Scale interleaved audio by the per-frame level times gain, advancing the envelope */
+  void apply(float* audio, size_t frames, unsigned channels, float gain);
+};
+
+/** Playback state of a sampler voice: feeds resident PCM to the voice's resampler without copying
+ *  (or decodes ADPCM into the engine's input scratch) and steps its envelopes. Driven only from
+ *  the mixing thread, except where noted */
+class AudioSamplerSource {
+  AudioSamplerInfo m_info;
+  float m_velocityGain;
+  size_t m_loopCrossfade = 0;
+  /* Last m_loopCrossfade frames of the loop, already blended with the frames before its start */
+  std::unique_ptr<int16_t[]> m_crossfade;
+
+  SamplerEnvelope m_gainEnv;
+  SamplerEnvelope m_pitchEnv;
+
+  /* Linear glide of the client pitch ratio, in mixing-rate frames */
+  double m_glideFrom = 1.0;
+  double m_glideTo = 1.0;
+  size_t m_glideFrames = 0;
+  size_t m_glidePos = 0;
+
+  /* Next input frame; zeros fed past the end of a one-shot sample */
+  size_t m_pos = 0;
+  size_t m_tailFrames = 0;
+
+  /* ADPCM decoder state before m_pos, and before the loop start */
+  AudioADPCMState m_adpcmState[2];
+  AudioADPCMState m_loopState[2];
+
+  bool looping() const { return m_info.m_loopEnd > m_info.m_loopStart; }
+  bool compressed() const { return m_info.m_format != AudioSampleFormat::PCM16; }
+  void _decode(AudioADPCMState* state, size_t pos, size_t frames, int16_t* out) const;
+  const int16_t* _read(size_t& frames, std::vector<int16_t>& scratch);
+
+public:
+  /* Client-thread requests, consumed by the next block */
+  std::atomic<bool> m_trigger = false;
+  std::atomic<bool> m_noteOff = false;
+
+  AudioSamplerSource(const AudioSamplerInfo& info, double mixRate);
+  unsigned channels() const { return m_info.m_channels; }
+  double sampleRate() const { return m_info.m_sampleRate; }
+  void setMixRate(double mixRate);
+
+  /** Apply pending requests and step the envelopes over frames; returns false once the voice has
+   *  nothing left to play. Sets voice's resampler to glide to the pitch reached at the block's end */
+  bool beginBlock(AudioVoice& voice, size_t frames);
+
+  /** Resampler input: points data at up to frames frames of the sample (or of scratch, holding
+   *  zeros once a one-shot sample ends) */
+  size_t supply(const int16_t** data, size_t frames, std::vector<int16_t>& scratch);
+
+  /** Advance the sample and gain envelope over frames without resampling, as for an inaudible voice */
+  void skip(size_t frames, double ratio, std::vector<int16_t>& scratch, size_t maxInput);
+
+  /** Apply the gain envelope and velocity to the resampled block */
+  void applyGain(float* audio, size_t frames) { m_gainEnv.apply(audio, frames, m_info.m_channels, m_velocityGain); }
+};
+
+/** Voice playing an AudioSamplerSource through the mono or stereo base voice (VoiceBase), mixed
+ *  into that voice's sends. Instantiated for AudioVoiceMono and AudioVoiceStereo only */
+template <class VoiceBase>
+class AudioSamplerVoice : public VoiceBase {
+  using Send = typename VoiceBase::Send;
+  AudioSamplerSource m_source;
+  static size_t SRCCallback(AudioSamplerVoice* ctx, const int16_t** data, size_t requestedLen);
+  void _bindResampler(soxr_t src) override;
+  void _swapResampler(soxr_t& src, double rateIn, double rateOut) override;
+  size_t _pump(size_t frames, float* out) override;
+  void _mix(size_t frames, float* audio, double dt) override;
+
+public:
+  AudioSamplerVoice(BaseAudioVoiceEngine& root, const AudioSamplerInfo& info);
+  void start() override;
+  void stop() override;
+};
+
+using AudioSamplerVoiceMono = AudioSamplerVoice<AudioVoiceMono>;
+using AudioSamplerVoiceStereo = AudioSamplerVoice<AudioVoiceStereo>;
+
+} // namespace boo2
@@ -0,0 +1,309 @@
+#include "boo2/audiodev/AudioSpatializer.hpp"
+#include "boo2/audiodev/IAudioSubmix.hpp"
+#include "Common.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846 /* pi */
+#endif
+
+#ifdef __ARM_NEON
+#include "sse2neon.h"
+#define __SSE__ 1
+#elif __SSE__
+#include <immintrin.h>
+#endif
+
+namespace boo2 {
+
+/* Gains this far below zero still count as inside a speaker pair (shared edges) */
+static constexpr float PairEpsilon = 1e-4f;
+
+/* Horizontal distance under which an emitter has no usable direction */
+static constexpr float DirectionEpsilon = 1e-6f;
+
+struct SpeakerAngle {
+  AudioChannel m_channel;
+  float m_azimuth; /* Degrees clockwise from front */
+};
+
+static constexpr SpeakerAngle StereoSpeakers[] = {{AudioChannel::FrontLeft, -30.f}, {AudioChannel::FrontRight, 30.f}};
+
+static constexpr SpeakerAngle QuadSpeakers[] = {{AudioChannel::FrontLeft, -45.f},
+                                                {AudioChannel::FrontRight, 45.f},
+                                                {AudioChannel::RearLeft, -135.f},
+                                                {AudioChannel::RearRight, 135.f}};
+
+static constexpr SpeakerAngle Surround51Speakers[] = {{AudioChannel::FrontLeft, -30.f},
+                                                      {AudioChannel::FrontRight, 30.f},
+                                                      {AudioChannel::FrontCenter, 0.f},
+                                                      {AudioChannel::RearLeft, -110.f},
+                                                      {AudioChannel::RearRight, 110.f}};
+
+static constexpr SpeakerAngle Surround71Speakers[] = {
+    {AudioChannel::FrontLeft, -30.f}, {AudioChannel::FrontRight, 30.f}, {AudioChannel::FrontCenter, 0.f},
+    {AudioChannel::SideLeft, -90.f},  {AudioChannel::SideRight, 90.f},  {AudioChannel::RearLeft, -150.f},
+    {AudioChannel::RearRight, 150.f}};
+
+static void Normalize(float v[3]) {
+  float len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  if (len > DirectionEpsilon)
+    for (int i = 0; i < 3; ++i)
+      v[i] /= len;
+}
+
+static void LayoutSpeakers(AudioChannelSet layout, const SpeakerAngle*& begin, const SpeakerAngle*& end) {
+  switch (layout) {
+  case AudioChannelSet::Quad:
+    begin = std::begin(QuadSpeakers);
+    end = std::end(QuadSpeakers);
+    break;
+  case AudioChannelSet::Surround51:
+    begin = std::begin(Surround51Speakers);
+    end = std::end(Surround51Speakers);
+    break;
+  case AudioChannelSet::Surround71:
+    begin = std::begin(Surround71Speakers);
+    end = std::end(Surround71Speakers);
+    break;
+  default:
+    begin = std::begin(StereoSpeakers);
+    end = std::end(StereoSpeakers);
+    break;
+  }
+}
+
+bool SpeakerAzimuth(AudioChannelSet layout, AudioChannel channel, float& azimuth) {
+  const SpeakerAngle* begin;
+  const SpeakerAngle* end;
+  LayoutSpeakers(layout, begin, end);
+  for (const SpeakerAngle* it = begin; it != end; ++it) {
+    if (it->m_channel == channel) {
+      azimuth = it->m_azimuth;
+      return true;
+    }
+  }
+  return false;
+}
+
+void AudioSpatializer::setLayout(AudioChannelSet layout) {
+  const SpeakerAngle* begin;
+  const SpeakerAngle* end;
+  LayoutSpeakers(layout, begin, end);
+
+  std::array<SpeakerAngle, 8> sorted;
+  size_t count = std::copy(begin, end, sorted.begin()) - sorted.begin();
+  std::sort(sorted.begin(), sorted.begin() + count,
+            [](const SpeakerAngle& a, const SpeakerAngle& b) { return a.m_azimuth < b.m_azimuth; });
+
+  m_speakerCount = count;
+  m_foldRear = true;
+  for (size_t i = 0; i < count; ++i) {
+    float rad = sorted[i].m_azimuth * float(M_PI) / 180.f;
+    m_speakers[i] = {sorted[i].m_channel, std::sin(rad), std::cos(rad)};
+    if (std::fabs(sorted[i].m_azimuth) > 90.f)
+      m_foldRear = false;
+  }
+
+  /* Adjacent speakers around the circle; arcs of 180 degrees or more can't be spanned by a pair */
+  m_pairCount = 0;
+  for (size_t i = 0; i < count; ++i) {
+    size_t j = (i + 1) % count;
+    float gap = sorted[j].m_azimuth - sorted[i].m_azimuth;
+    if (gap <= 0.f)
+      gap += 360.f;
+    if (gap >= 180.f)
+      continue;
+    const Speaker& a = m_speakers[i];
+    const Speaker& b = m_speakers[j];
+    float det = a.m_lateral * b.m_forward - b.m_lateral * a.m_forward;
+    m_pairs[m_pairCount++] = {int(i), int(j),
+                              {b.m_forward / det, -b.m_lateral / det, -a.m_forward / det, a.m_lateral / det}};
+  }
+}
+
+void AudioSpatializer::setListener(const float position[3], const float front[3], const float up[3]) {
+  for (int i = 0; i < 3; ++i) {
+    m_position[i] = position[i];
+    m_front[i] = front[i];
+  }
+  Normalize(m_front);
+  m_right[0] = m_front[1] * up[2] - m_front[2] * up[1];
+  m_right[1] = m_front[2] * up[0] - m_front[0] * up[2];
+  m_right[2] = m_front[0] * up[1] - m_front[1] * up[0];
+  Normalize(m_right);
+  m_up[0] = m_right[1] * m_front[2] - m_right[2] * m_front[1];
+  m_up[1] = m_right[2] * m_front[0] - m_right[0] * m_front[2];
+  m_up[2] = m_right[0] * m_front[1] - m_right[1] * m_front[0];
+}
+
+void AudioSpatializer::setDistanceModel(float minDistance, float maxDistance, float rolloff) {
+  m_minDistance = std::max(minDistance, DirectionEpsilon);
+  m_maxDistance = std::max(maxDistance, m_minDistance);
+  m_rolloff = std::max(rolloff, 0.f);
+}
+
+void AudioSpatializer::_solve(float dx, float dy, float dz, float spread, float coefs[8]) const {
+  float lateral = dx * m_right[0] + dy * m_right[1] + dz * m_right[2];
+  float forward = dx * m_front[0] + dy * m_front[1] + dz * m_front[2];
+  float up = dx * m_up[0] + dy * m_up[1] + dz * m_up[2];
+  float horiz = std::sqrt(lateral * lateral + forward * forward);
+  float dist = std::sqrt(horiz * horiz + up * up);
+
+  float clamped = std::clamp(dist, m_minDistance, m_maxDistance);
+  float atten = m_minDistance / (m_minDistance + m_rolloff * (clamped - m_minDistance));
+
+  if (horiz < DirectionEpsilon) {
+    lateral = 0.f;
+    forward = 1.f;
+    spread = 1.f;
+  } else {
+    lateral /= horiz;
+    forward /= horiz;
+    spread = std::max(spread, std::fabs(up) / dist);
+  }
+  spread = std::clamp(spread, 0.f, 1.f);
+  if (m_foldRear)
+    forward = std::fabs(forward);
+
+  float gains[8] = {};
+  bool done = false;
+  for (size_t p = 0; p < m_pairCount && !done; ++p) {
+    const SpeakerPair& pair = m_pairs[p];
+    float g1 = pair.m_inv[0] * lateral + pair.m_inv[1] * forward;
+    float g2 = pair.m_inv[2] * lateral + pair.m_inv[3] * forward;
+    if (g1 >= -PairEpsilon && g2 >= -PairEpsilon) {
+      g1 = std::max(g1, 0.f);
+      g2 = std::max(g2, 0.f);
+      float norm = 1.f / std::sqrt(std::max(g1 * g1 + g2 * g2, DirectionEpsilon));
+      gains[pair.m_a] = g1 * norm;
+      gains[pair.m_b] = g2 * norm;
+      done = true;
+    }
+  }
+  if (!done) {
+    /* Outside every pair (beyond the front arc of a stereo layout); clamp to the nearest speaker */
+    size_t nearest = 0;
+    float best = -2.f;
+    for (size_t s = 0; s < m_speakerCount; ++s) {
+      float d = m_speakers[s].m_lateral * lateral + m_speakers[s].m_forward * forward;
+      if (d > best) {
+        best = d;
+        nearest = s;
+      }
+    }
+    gains[nearest] = 1.f;
+  }
+
+  for (int c = 0; c < 8; ++c)
+    coefs[c] = 0.f;
+  float spreadPower = spread / float(m_speakerCount);
+  for (size_t s = 0; s < m_speakerCount; ++s)
+    coefs[int(m_speakers[s].m_channel)] =
+        std::sqrt((1.f - spread) * gains[s] * gains[s] + spreadPower) * atten;
+}
+
+void AudioSpatializer::computeLevels(const AudioEmitterBatch& emitters, float (*coefsOut)[8]) const {
+  size_t i = 0;
+#if __SSE__
+  /* Four emitters per iteration; the same math as _solve() with selects in place of branches */
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  const __m128 dirEps = _mm_set1_ps(DirectionEpsilon);
+  const __m128 pairEps = _mm_set1_ps(-PairEpsilon);
+  const __m128 minDist = _mm_set1_ps(m_minDistance);
+  const __m128 maxDist = _mm_set1_ps(m_maxDistance);
+  const __m128 rolloff = _mm_set1_ps(m_rolloff);
+  const __m128 invSpeakers = _mm_set1_ps(1.f / float(m_speakerCount));
+  for (; i + 4 <= emitters.m_count; i += 4) {
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(emitters.m_x + i), _mm_set1_ps(m_position[0]));
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(emitters.m_y + i), _mm_set1_ps(m_position[1]));
+    __m128 dz = _mm_sub_ps(_mm_loadu_ps(emitters.m_z + i), _mm_set1_ps(m_position[2]));
+    auto project = [&](const float axis[3]) {
+      return _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_set1_ps(axis[0])), _mm_mul_ps(dy, _mm_set1_ps(axis[1]))),
+                        _mm_mul_ps(dz, _mm_set1_ps(axis[2])));
+    };
+    __m128 lateral = project(m_right);
+    __m128 forward = project(m_front);
+    __m128 up = project(m_up);
+    __m128 horiz = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(lateral, lateral), _mm_mul_ps(forward, forward)));
+    __m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(horiz, horiz), _mm_mul_ps(up, up)));
+
+    __m128 clamped = _mm_min_ps(_mm_max_ps(dist, minDist), maxDist);
+    __m128 atten = _mm_div_ps(minDist, _mm_add_ps(minDist, _mm_mul_ps(rolloff, _mm_sub_ps(clamped, minDist))));
+
+    __m128 spread = emitters.m_spread ? _mm_loadu_ps(emitters.m_spread + i) : zero;
+    __m128 noDir = _mm_cmplt_ps(horiz, dirEps);
+    __m128 invHoriz = _mm_div_ps(one, _mm_max_ps(horiz, dirEps));
+    lateral = _mm_andnot_ps(noDir, _mm_mul_ps(lateral, invHoriz));
+    forward = _mm_or_ps(_mm_andnot_ps(noDir, _mm_mul_ps(forward, invHoriz)), _mm_and_ps(noDir, one));
+    __m128 elevation = _mm_div_ps(_mm_and_ps(up, absMask), _mm_max_ps(dist, dirEps));
+    spread = _mm_or_ps(_mm_andnot_ps(noDir, _mm_max_ps(spread, elevation)), _mm_and_ps(noDir, one));
+    spread = _mm_min_ps(_mm_max_ps(spread, zero), one);
+    if (m_foldRear)
+      forward = _mm_and_ps(forward, absMask);
+
+    __m128 gains[8];
+    for (size_t s = 0; s < m_speakerCount; ++s)
+      gains[s] = zero;
+    __m128 done = zero;
+    for (size_t p = 0; p < m_pairCount; ++p) {
+      const SpeakerPair& pair = m_pairs[p];
+      __m128 g1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(pair.m_inv[0]), lateral),
+                             _mm_mul_ps(_mm_set1_ps(pair.m_inv[1]), forward));
+      __m128 g2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(pair.m_inv[2]), lateral),
+                             _mm_mul_ps(_mm_set1_ps(pair.m_inv[3]), forward));
+      __m128 inside = _mm_andnot_ps(done, _mm_and_ps(_mm_cmpge_ps(g1, pairEps), _mm_cmpge_ps(g2, pairEps)));
+      g1 = _mm_max_ps(g1, zero);
+      g2 = _mm_max_ps(g2, zero);
+      __m128 norm =
+          _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(g1, g1), _mm_mul_ps(g2, g2)), dirEps)));
+      gains[pair.m_a] = _mm_or_ps(gains[pair.m_a], _mm_and_ps(inside, _mm_mul_ps(g1, norm)));
+      gains[pair.m_b] = _mm_or_ps(gains[pair.m_b], _mm_and_ps(inside, _mm_mul_ps(g2, norm)));
+      done = _mm_or_ps(done, inside);
+    }
+    if (_mm_movemask_ps(done) != 0xf) {
+      /* Nearest-speaker clamp for lanes outside every pair */
+      __m128 best = _mm_set1_ps(-2.f);
+      __m128 nearest[8];
+      for (size_t s = 0; s < m_speakerCount; ++s) {
+        __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m_speakers[s].m_lateral), lateral),
+                              _mm_mul_ps(_mm_set1_ps(m_speakers[s].m_forward), forward));
+        __m128 better = _mm_cmpgt_ps(d, best);
+        for (size_t t = 0; t < s; ++t)
+          nearest[t] = _mm_andnot_ps(better, nearest[t]);
+        nearest[s] = better;
+        best = _mm_max_ps(best, d);
+      }
+      for (size_t s = 0; s < m_speakerCount; ++s)
+        gains[s] = _mm_or_ps(gains[s], _mm_andnot_ps(done, _mm_and_ps(nearest[s], one)));
+    }
+
+    alignas(16) float lanes[8][4] = {};
+    __m128 pointWeight = _mm_sub_ps(one, spread);
+    __m128 spreadPower = _mm_mul_ps(spread, invSpeakers);
+    for (size_t s = 0; s < m_speakerCount; ++s) {
+      __m128 g = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(pointWeight, _mm_mul_ps(gains[s], gains[s])), spreadPower));
+      _mm_store_ps(lanes[int(m_speakers[s].m_channel)], _mm_mul_ps(g, atten));
+    }
+    for (int l = 0; l < 4; ++l)
+      for (int c = 0; c < 8; ++c)
+        coefsOut[i + l][c] = lanes[c][l];
+  }
+#endif
+  for (; i < emitters.m_count; ++i)
+    _solve(emitters.m_x[i] - m_position[0], emitters.m_y[i] - m_position[1], emitters.m_z[i] - m_position[2],
+           emitters.m_spread ? emitters.m_spread[i] : 0.f, coefsOut[i]);
+}
+
+void AudioSpatializer::applyLevels(size_t count, IAudioVoice* const* voices, const float (*coefs)[8],
+                                   IAudioSubmix* submix, double rampMs) {
+  for (size_t i = 0; i < count; ++i)
+    if (voices[i])
+      voices[i]->rampMonoChannelLevels(submix, coefs[i], rampMs);
+}
+
+} // namespace boo2
@@ -1,6 +1,7 @@
 #include "AudioSubmix.hpp"
 #include "AudioVoice.hpp"
 #include "AudioVoiceEngine.hpp"
+#include "../Trace.hpp"
 
 #include <algorithm>
 
@@ -9,20 +10,30 @@
 
 namespace boo2 {
 
-AudioSubmix::AudioSubmix(BaseAudioVoiceEngine& root, IAudioSubmixCallback* cb, int busId, bool mainOut)
-: ListNode<AudioSubmix, BaseAudioVoiceEngine*, IAudioSubmix>(&root), m_busId(busId), m_mainOut(mainOut), m_cb(cb) {
+AudioSubmix::AudioSubmix(BaseAudioVoiceEngine& root, IAudioSubmixCallback* cb, int busId, bool mainOut,
+                         unsigned rateDivider)
+: ListNode<AudioSubmix, BaseAudioVoiceEngine*, IAudioSubmix>(&root)
+, m_busId(busId)
+, m_mainOut(mainOut)
+, m_cb(cb)
+, m_rateDivider(std::clamp(rateDivider, 1u, AudioRateDivider::MaxDivider)) {
+  _reserveScratch(m_head->m_mixBlockFrames);
   if (mainOut)
     setSendLevel(m_head->m_mainSubmix.get(), 1.f, false);
 }
 
-AudioSubmix::~AudioSubmix() { m_head->m_submixesDirty = true; }
+AudioSubmix::~AudioSubmix() { delete m_sendTable.load(); }
+
+void AudioSubmix::finalRelease() noexcept { m_head->_retireSubmix(this); }
 
 AudioSubmix*& AudioSubmix::_getHeadPtr(BaseAudioVoiceEngine* head) { return head->m_submixHead; }
 std::unique_lock<std::recursive_mutex> AudioSubmix::_getHeadLock(BaseAudioVoiceEngine* head) {
   return std::unique_lock<std::recursive_mutex>{head->m_dataMutex};
 }
 
-bool AudioSubmix::_isDirectDependencyOf(AudioSubmix* send) { return m_sendGains.find(send) != m_sendGains.cend(); }
+bool AudioSubmix::_isDirectDependencyOf(AudioSubmix* send) {
+  return FindRoute(m_sendTable.load(std::memory_order_acquire), send) != nullptr;
+}
 
 bool AudioSubmix::_mergeC3(std::list<AudioSubmix*>& output, std::vector<std::list<AudioSubmix*>>& lists) {
   for (auto outerIt = lists.begin(); outerIt != lists.cend(); ++outerIt) {
@@ -65,41 +76,71 @@ std::list<AudioSubmix*> AudioSubmix::_linearizeC3() {
   return ret;
 }
 
-void AudioSubmix::_zeroFill() {
-  if (m_scratch.size())
-    std::fill(m_scratch.begin(), m_scratch.end(), 0);
+void AudioSubmix::_zeroFill(size_t frames) {
+  size_t sampleCount = frames * m_head->_blockMixInfo().m_channelMap.m_channelCount;
+  std::fill(m_scratch.begin(), m_scratch.begin() + std::min(sampleCount, m_scratch.size()), 0.f);
 }
 
 float* AudioSubmix::_getMergeBuf(size_t frames) {
   if (m_redirect)
     return m_redirect;
 
-  size_t sampleCount = frames * m_head->clientMixInfo().m_channelMap.m_channelCount;
+  /* Sized by _reserveScratch() for the largest interval */
+  return m_scratch.data();
+}
+
+void AudioSubmix::_reserveScratch(size_t frames) {
+  /* Room for any client layout (up to eight channels), so enabling LtRt or HRTF never reallocates under the mixer */
+  size_t sampleCount = frames * 8;
   if (m_scratch.size() < sampleCount)
     m_scratch.resize(sampleCount);
-
-  return m_scratch.data();
+  m_rateConverter.Reserve(m_rateDivider, frames);
 }
 
 size_t AudioSubmix::_pumpAndMix(size_t frames) {
-  const ChannelMap& chMap = m_head->clientMixInfo().m_channelMap;
+  TraceScope trace("AudioSubmix::_pumpAndMix");
+  const ChannelMap& chMap = m_head->_blockMixInfo().m_channelMap;
   size_t chanCount = chMap.m_channelCount;
+  m_output = m_redirect ? m_redirect : m_scratch.data();
 
   if (m_redirect) {
     if (m_cb && m_cb->canApplyEffect())
       m_cb->applyEffect(m_redirect, frames, chMap, m_head->mixInfo().m_sampleRate);
+    m_meter.Process(m_redirect, frames, chMap, m_head->mixInfo().m_sampleRate);
     m_redirect += chanCount * frames;
   } else {
-    size_t sampleCount = frames * chanCount;
-    if (m_scratch.size() < sampleCount)
-      m_scratch.resize(sampleCount);
-    if (m_cb && m_cb->canApplyEffect())
-      m_cb->applyEffect(m_scratch.data(), frames, chMap, m_head->mixInfo().m_sampleRate);
+    if (m_cb && m_cb->canApplyEffect()) {
+      if (m_rateDivider > 1) {
+        size_t reducedFrames;
+        float* reduced = m_rateConverter.Decimate(m_scratch.data(), chanCount, frames, reducedFrames);
+        if (reducedFrames)
+          m_cb->applyEffect(reduced, reducedFrames, chMap, getSampleRate());
+        m_rateConverter.Interpolate(m_scratch.data(), frames);
+      } else {
+        m_cb->applyEffect(m_scratch.data(), frames, chMap, m_head->mixInfo().m_sampleRate);
+      }
+    }
+    m_meter.Process(m_scratch.data(), frames, chMap, m_head->mixInfo().m_sampleRate);
+
+    const AudioRoutingTable<Send>* sends = m_sendTable.load(std::memory_order_acquire);
+    if (!sends)
+      return frames;
+    for (const std::shared_ptr<Send>& send : *sends) {
+      float level;
+      size_t slewFrames;
+      AudioRampCurve curve;
+      if (send->m_post.take(&level, slewFrames, curve)) {
+        send->m_gains[0] = send->m_gains[1];
+        send->m_gains[1] = level;
+        m_slewFrames = slewFrames;
+        m_curSlewFrame = 0;
+      }
+    }
 
     size_t curSlewFrame = m_slewFrames;
-    for (auto& smx : m_sendGains) {
+    for (const std::shared_ptr<Send>& send : *sends) {
       curSlewFrame = m_curSlewFrame;
-      AudioSubmix& sm = *reinterpret_cast<AudioSubmix*>(smx.first);
+      AudioSubmix& sm = *reinterpret_cast<AudioSubmix*>(send->m_submix);
       auto it = m_scratch.begin();
       float* dataOut = sm._getMergeBuf(frames);
 
@@ -109,7 +150,7 @@ size_t AudioSubmix::_pumpAndMix(size_t frames) {
           double omt = 1.0 - t;
 
           for (unsigned c = 0; c < chanCount; ++c) {
-            *dataOut = *dataOut + *it * (smx.second[1] * t + smx.second[0] * omt);
+            *dataOut = *dataOut + *it * (send->m_gains[1] * t + send->m_gains[0] * omt);
             ++it;
             ++dataOut;
           }
@@ -117,7 +158,7 @@ size_t AudioSubmix::_pumpAndMix(size_t frames) {
           ++curSlewFrame;
         } else {
           for (unsigned c = 0; c < chanCount; ++c) {
-            *dataOut = *dataOut + *it * smx.second[1];
+            *dataOut = *dataOut + *it * send->m_gains[1];
             ++it;
             ++dataOut;
           }
@@ -132,32 +173,31 @@ size_t AudioSubmix::_pumpAndMix(size_t frames) {
 
 void AudioSubmix::_resetOutputSampleRate() {
   if (m_cb)
-    m_cb->resetOutputSampleRate(m_head->mixInfo().m_sampleRate);
+    m_cb->resetOutputSampleRate(getSampleRate());
 }
 
 void AudioSubmix::resetSendLevels() {
-  if (m_sendGains.empty())
-    return;
-  m_sendGains.clear();
-  m_head->m_submixesDirty = true;
+  if (m_sendTable.load(std::memory_order_relaxed))
+    m_head->_replaceRouting(m_sendTable, nullptr);
 }
 
 void AudioSubmix::setSendLevel(IAudioSubmix* submix, float level, bool slew) {
-  auto search = m_sendGains.find(submix);
-  if (search == m_sendGains.cend()) {
-    search = m_sendGains.emplace(submix, std::array<float, 2>{1.f, 1.f}).first;
-    m_head->m_submixesDirty = true;
+  size_t slewFrames = slew ? m_head->m_5msFrames : 0;
+  if (Send* send = FindRoute(m_sendTable.load(std::memory_order_acquire), submix)) {
+    send->m_post.post(&level, slewFrames);
+    return;
   }
+  auto send = std::make_shared<Send>(submix);
+  send->m_post.post(&level, slewFrames);
+  m_head->_addRoute(m_sendTable, std::move(send));
+}
 
-  m_slewFrames = slew ? m_head->m_5msFrames : 0;
-  m_curSlewFrame = 0;
+void AudioSubmix::enableMetering(bool enable) { m_meter.Enable(enable); }
 
-  search->second[0] = search->second[1];
-  search->second[1] = level;
-}
+AudioMeterReading AudioSubmix::getMeterReading() const { return m_meter.Read(); }
 
 const AudioVoiceEngineMixInfo& AudioSubmix::mixInfo() const { return m_head->mixInfo(); }
 
-double AudioSubmix::getSampleRate() const { return mixInfo().m_sampleRate; }
+double AudioSubmix::getSampleRate() const { return mixInfo().m_sampleRate / m_rateDivider; }
 
 } // namespace boo2
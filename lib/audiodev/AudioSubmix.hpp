@@ -1,15 +1,18 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <list>
 #include <mutex>
-#include <unordered_map>
 #include <vector>
 
 #include "boo2/audiodev/IAudioSubmix.hpp"
 #include "../Common.hpp"
+#include "AudioRateDivider.hpp"
+#include "AudioRouting.hpp"
+#include "MeterProcessing.hpp"
 
 #ifdef __ARM_NEON
 #include "sse2neon.h"
@@ -23,15 +26,20 @@ struct VSTVoiceEngine;
 struct WAVOutVoiceEngine;
 
 namespace boo2 {
+class AudioCapture;
 class BaseAudioVoiceEngine;
 class AudioVoice;
 struct AudioVoiceEngineMixInfo;
 /* Output gains for each mix-send/channel */
 
 class AudioSubmix : public ListNode<AudioSubmix, BaseAudioVoiceEngine*, IAudioSubmix> {
+  friend class AudioCapture;
   friend class BaseAudioVoiceEngine;
   friend class AudioVoiceMono;
   friend class AudioVoiceStereo;
+  friend class AudioVoiceMultichannel;
+  template <class VoiceBase>
+  friend class AudioSamplerVoice;
   friend struct WASAPIAudioVoiceEngine;
   friend struct ::AudioUnitVoiceEngine;
   friend struct ::VSTVoiceEngine;
@@ -44,12 +52,21 @@ class AudioSubmix : public ListNode<AudioSubmix, BaseAudioVoiceEngine*, IAudioSu
   /* Callback (effect source, optional) */
   IAudioSubmixCallback* m_cb;
 
-  /* Slew state for output gains */
+  /* Link in the engine's garbage stack when released on the mixing thread */
+  AudioSubmix* m_nextGarbage = nullptr;
+
+  /* Slew state for output gains (mixer-owned) */
   size_t m_slewFrames = 0;
   size_t m_curSlewFrame = 0;
 
-  /* Output gains for each mix-send/channel */
-  std::unordered_map<IAudioSubmix*, std::array<float, 2>> m_sendGains;
+  /* Output gains for each mix-send/channel; previous and target, applied by the mixer */
+  struct Send {
+    IAudioSubmix* m_submix;
+    std::array<float, 2> m_gains = {1.f, 1.f};
+    AudioLevelPost<1> m_post;
+    explicit Send(IAudioSubmix* submix) : m_submix(submix) {}
+  };
+  std::atomic<const AudioRoutingTable<Send>*> m_sendTable = nullptr;
 
   /* Temporary scratch buffers for accumulating submix audio */
   std::vector<float> m_scratch;
@@ -57,33 +74,52 @@ class AudioSubmix : public ListNode<AudioSubmix, BaseAudioVoiceEngine*, IAudioSu
   /* Override scratch buffers with alternate destination */
   float* m_redirect = nullptr;
 
+  /* Post-effect audio of the last interval, for capture taps */
+  float* m_output = nullptr;
+
+  /* Opt-in levels of the post-effect bus */
+  MeterProcessing m_meter;
+
+  /* Effect runs at master rate / m_rateDivider; sends and inputs stay at master rate */
+  unsigned m_rateDivider;
+  AudioRateDivider m_rateConverter;
+
   /* C3-linearization support (to mitigate a potential diamond problem on 'clever' submix routes) */
   bool _isDirectDependencyOf(AudioSubmix* send);
   std::list<AudioSubmix*> _linearizeC3();
   static bool _mergeC3(std::list<AudioSubmix*>& output, std::vector<std::list<AudioSubmix*>>& lists);
 
   /* Fill scratch buffers with silence for new mix cycle */
-  void _zeroFill();
+  void _zeroFill(size_t frames);
 
   /* Receive audio from a single voice / submix */
   float* _getMergeBuf(size_t frames);
 
+  /* Size scratch for the largest mix interval ahead of time */
+  void _reserveScratch(size_t frames);
+
   /* Mix scratch buffers into sends */
   size_t _pumpAndMix(size_t frames);
 
   void _resetOutputSampleRate();
 
+  /* Deletion waits until the mixer no longer sees this submix */
+  void finalRelease() noexcept override;
+
 public:
   static AudioSubmix*& _getHeadPtr(BaseAudioVoiceEngine* head);
   static std::unique_lock<std::recursive_mutex> _getHeadLock(BaseAudioVoiceEngine* head);
 
-  AudioSubmix(BaseAudioVoiceEngine& root, IAudioSubmixCallback* cb, int busId, bool mainOut);
+  AudioSubmix(BaseAudioVoiceEngine& root, IAudioSubmixCallback* cb, int busId, bool mainOut,
+              unsigned rateDivider = 1);
   ~AudioSubmix() override;
 
   void resetSendLevels() override;
   void setSendLevel(IAudioSubmix* submix, float level, bool slew) override;
   const AudioVoiceEngineMixInfo& mixInfo() const;
   double getSampleRate() const override;
+  void enableMetering(bool enable) override;
+  AudioMeterReading getMeterReading() const override;
 };
 
 } // namespace boo2
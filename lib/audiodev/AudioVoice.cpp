@@ -1,6 +1,7 @@
 #include "AudioVoice.hpp"
 #include "AudioVoiceEngine.hpp"
 #include "logvisor/logvisor.hpp"
+#include <algorithm>
 #include <cmath>
 
 namespace boo2 {
@@ -12,19 +13,26 @@ static AudioMatrixStereo DefaultStereoMtx;
 AudioVoice::AudioVoice(BaseAudioVoiceEngine& root, IAudioVoiceCallback* cb, bool dynamicRate)
 : ListNode<AudioVoice, BaseAudioVoiceEngine*, IAudioVoice>(&root), m_cb(cb), m_dynamicRate(dynamicRate) {}
 
-AudioVoice::~AudioVoice() { soxr_delete(m_src); }
+AudioVoice::~AudioVoice() {
+  soxr_delete(m_src);
+  delete m_pendingSrc.load();
+  delete m_retiredSrc.load();
+}
+
+void AudioVoice::finalRelease() noexcept { m_head->_retireVoice(this); }
 
 AudioVoice*& AudioVoice::_getHeadPtr(BaseAudioVoiceEngine* head) { return head->m_voiceHead; }
 std::unique_lock<std::recursive_mutex> AudioVoice::_getHeadLock(BaseAudioVoiceEngine* head) {
   return std::unique_lock<std::recursive_mutex>{head->m_dataMutex};
 }
 
-void AudioVoice::_setPitchRatio(double ratio, bool slew) {
+void AudioVoice::_setPitchRatio(double ratio, size_t slewFrames) {
   if (m_dynamicRate) {
     m_sampleRatio = ratio * m_sampleRateIn / m_sampleRateOut;
-    soxr_error_t err = soxr_set_io_ratio(m_src, m_sampleRatio, slew ? m_head->m_5msFrames : 0);
+    /* soxr interpolates the ratio per output sample across the slew */
+    soxr_error_t err = soxr_set_io_ratio(m_src, m_sampleRatio, slewFrames);
     if (err) {
-      Log.report(logvisor::Fatal, FMT_STRING("unable to set resampler rate: {}"), soxr_strerror(err));
+      RealtimeReport(Log, logvisor::Fatal, FMT_STRING("unable to set resampler rate: {}"), soxr_strerror(err));
       m_setPitchRatio = false;
       return;
     }
@@ -32,22 +40,106 @@ void AudioVoice::_setPitchRatio(double ratio, bool slew) {
   m_setPitchRatio = false;
 }
 
+soxr_t AudioVoice::_createResampler(double sampleRate) {
+  double rateOut = m_head->mixInfo().m_sampleRate;
+  soxr_io_spec_t ioSpec = soxr_io_spec(SOXR_INT16_I, SOXR_FLOAT32_I);
+  soxr_quality_spec_t qSpec = soxr_quality_spec(SOXR_20_BITQ, m_dynamicRate ? SOXR_VR : 0);
+
+  soxr_error_t err;
+  soxr_t src = soxr_create(sampleRate, rateOut, _channelCount(), &err, &ioSpec, &qSpec, nullptr);
+
+  if (err) {
+    Log.report(logvisor::Fatal, FMT_STRING("unable to create soxr resampler: {}"), soxr_strerror(err));
+    soxr_delete(src);
+    return nullptr;
+  }
+
+  _bindResampler(src);
+  return src;
+}
+
+void AudioVoice::_swapResampler(soxr_t& src, double rateIn, double rateOut) {
+  std::swap(m_src, src);
+  m_sampleRateIn = rateIn;
+  m_sampleRateOut = rateOut;
+  m_sampleRatio = m_sampleRateIn / m_sampleRateOut;
+  _setPitchRatio(m_pitchRatio, 0);
+}
+
+void AudioVoice::_resetSampleRate(double sampleRate) {
+  /* A converter still waiting for the mixer was built for the old mixing rate; rebuild it instead */
+  if (ResamplerSwap* pending = m_pendingSrc.exchange(nullptr, std::memory_order_acquire)) {
+    sampleRate = pending->m_sampleRateIn;
+    delete pending;
+  }
+  if (soxr_t src = _createResampler(sampleRate)) {
+    _swapResampler(src, sampleRate, m_head->mixInfo().m_sampleRate);
+    soxr_delete(src);
+  }
+}
+
+void AudioVoice::_postResampler(double sampleRate) {
+  delete m_retiredSrc.exchange(nullptr, std::memory_order_acquire);
+  soxr_t src = _createResampler(sampleRate);
+  if (!src)
+    return;
+  auto* swap = new ResamplerSwap{src, sampleRate, m_head->mixInfo().m_sampleRate};
+  /* Supersedes a converter the mixer hasn't taken yet */
+  delete m_pendingSrc.exchange(swap, std::memory_order_acq_rel);
+}
+
+void AudioVoice::_serviceResampler() {
+  double requested = m_requestedSampleRate.exchange(0.0, std::memory_order_relaxed);
+  if (requested > 0.0)
+    _postResampler(requested);
+  else
+    delete m_retiredSrc.exchange(nullptr, std::memory_order_acquire);
+}
+
+void AudioVoice::_takeResampler() {
+  /* One carrier is out at a time; a newer converter waits for the last replaced one to be freed */
+  if (!m_pendingSrc.load(std::memory_order_relaxed) || m_retiredSrc.load(std::memory_order_relaxed))
+    return;
+  ResamplerSwap* swap = m_pendingSrc.exchange(nullptr, std::memory_order_acquire);
+  if (!swap)
+    return;
+  _swapResampler(swap->m_src, swap->m_sampleRateIn, swap->m_sampleRateOut);
+  m_retiredSrc.store(swap, std::memory_order_release);
+}
+
 void AudioVoice::_midUpdate() {
-  if (m_resetSampleRate)
-    _resetSampleRate(m_deferredSampleRate);
+  _takeResampler();
   if (m_setPitchRatio)
-    _setPitchRatio(m_pitchRatio, m_slew);
+    _setPitchRatio(m_pitchRatio, m_pitchSlewFrames);
 }
 
-void AudioVoice::setPitchRatio(double ratio, bool slew) {
+size_t AudioVoice::_rampFrames(double ms) const { return size_t(m_head->mixInfo().m_sampleRate * ms / 1000.0); }
+
+void AudioVoice::setPitchRatio(double ratio, bool slew) { glidePitchRatio(ratio, slew ? 5.0 : 0.0); }
+
+void AudioVoice::glidePitchRatio(double ratio, double ms) {
   m_setPitchRatio = true;
   m_pitchRatio = ratio;
-  m_slew = slew;
+  m_pitchSlewFrames = _rampFrames(ms);
+}
+
+void AudioVoice::setFilter(AudioFilterType type, double cutoff, double q, bool slew) {
+  rampFilter(type, cutoff, q, slew ? 5.0 : 0.0);
+}
+
+void AudioVoice::rampFilter(AudioFilterType type, double cutoff, double q, double ms) {
+  m_filter.request(type, cutoff, q, _rampFrames(ms));
 }
 
 void AudioVoice::resetSampleRate(double sampleRate) {
-  m_resetSampleRate = true;
-  m_deferredSampleRate = sampleRate;
+  /* The mixer must not create converters; from its own callbacks, leave the work to the reclaimer */
+  if (m_head->_isMixingThread()) {
+    m_requestedSampleRate.store(sampleRate, std::memory_order_relaxed);
+    return;
+  }
+  std::unique_lock<std::recursive_mutex> lk(m_head->m_dataMutex);
+  m_requestedSampleRate.store(0.0, std::memory_order_relaxed);
+  _postResampler(sampleRate);
 }
 
 void AudioVoice::start() { m_running = true; }
@@ -59,34 +151,16 @@ AudioVoiceMono::AudioVoiceMono(BaseAudioVoiceEngine& root, IAudioVoiceCallback*
   _resetSampleRate(sampleRate);
 }
 
-void AudioVoiceMono::_resetSampleRate(double sampleRate) {
-  soxr_delete(m_src);
-
-  double rateOut = m_head->mixInfo().m_sampleRate;
-  soxr_io_spec_t ioSpec = soxr_io_spec(SOXR_INT16_I, SOXR_FLOAT32_I);
-  soxr_quality_spec_t qSpec = soxr_quality_spec(SOXR_20_BITQ, m_dynamicRate ? SOXR_VR : 0);
-
-  soxr_error_t err;
-  m_src = soxr_create(sampleRate, rateOut, 1, &err, &ioSpec, &qSpec, nullptr);
+AudioVoiceMono::~AudioVoiceMono() { delete m_sendTable.load(); }
 
-  if (err) {
-    Log.report(logvisor::Fatal, FMT_STRING("unable to create soxr resampler: {}"), soxr_strerror(err));
-    m_resetSampleRate = false;
-    return;
-  }
-
-  m_sampleRateIn = sampleRate;
-  m_sampleRateOut = rateOut;
-  m_sampleRatio = m_sampleRateIn / m_sampleRateOut;
-  soxr_set_input_fn(m_src, soxr_input_fn_t(SRCCallback), this, 0);
-  _setPitchRatio(m_pitchRatio, false);
-  m_resetSampleRate = false;
+void AudioVoiceMono::_bindResampler(soxr_t src) {
+  soxr_set_input_fn(src, soxr_input_fn_t(SRCCallback), this, m_head->_voiceInputFrames());
 }
 
 size_t AudioVoiceMono::SRCCallback(AudioVoiceMono* ctx, int16_t** data, size_t frames) {
+  /* soxr's max_ilen keeps requests within the reserved scratch */
   std::vector<int16_t>& scratchIn = ctx->m_head->m_scratchIn;
-  if (scratchIn.size() < frames)
-    scratchIn.resize(frames);
+  frames = std::min(frames, scratchIn.size());
   *data = scratchIn.data();
   if (ctx->m_silentOut) {
     memset(scratchIn.data(), 0, frames * 2);
@@ -95,10 +169,17 @@ size_t AudioVoiceMono::SRCCallback(AudioVoiceMono* ctx, int16_t** data, size_t f
     return ctx->m_cb->supplyAudio(*ctx, frames, scratchIn.data());
 }
 
+void AudioVoiceMono::_takeSendLevels() {
+  if (const AudioRoutingTable<Send>* sends = m_sendTable.load(std::memory_order_acquire))
+    for (const std::shared_ptr<Send>& send : *sends)
+      send->takeLevels();
+}
+
 bool AudioVoiceMono::isSilent() const {
-  if (m_sendMatrices.size()) {
-    for (auto& mtx : m_sendMatrices)
-      if (!mtx.second.isSilent())
+  const AudioRoutingTable<Send>* sends = m_sendTable.load(std::memory_order_acquire);
+  if (sends && sends->size()) {
+    for (const std::shared_ptr<Send>& send : *sends)
+      if (!send->m_matrix.isSilent())
         return false;
     return true;
   } else {
@@ -106,70 +187,92 @@ bool AudioVoiceMono::isSilent() const {
   }
 }
 
-size_t AudioVoiceMono::pumpAndMix(size_t frames) {
-  auto& scratchPre = m_head->m_scratchPre;
-  if (scratchPre.size() < frames)
-    scratchPre.resize(frames + 2);
-
-  auto& scratchPost = m_head->m_scratchPost;
-  if (scratchPost.size() < frames)
-    scratchPost.resize(frames + 2);
-
+size_t AudioVoiceMono::_pump(size_t frames, float* out) {
   double dt = frames / m_sampleRateOut;
   m_cb->preSupplyAudio(*this, dt);
   _midUpdate();
+  _takeSendLevels();
 
   if (isSilent()) {
+    /* Keep the source advancing, in chunks the shared scratch can hold */
     int16_t* dummy;
-    SRCCallback(this, &dummy, size_t(std::ceil(frames * m_sampleRatio)));
+    size_t remFrames = size_t(std::ceil(frames * m_sampleRatio));
+    while (remFrames) {
+      size_t thisFrames = std::min(remFrames, m_head->_voiceInputFrames());
+      if (SRCCallback(this, &dummy, thisFrames) < thisFrames)
+        break;
+      remFrames -= thisFrames;
+    }
     return 0;
   }
 
-  size_t oDone = soxr_output(m_src, scratchPre.data(), frames);
-
-  if (oDone) {
-    if (m_sendMatrices.size()) {
-      for (auto& mtx : m_sendMatrices) {
-        AudioSubmix& smx = *reinterpret_cast<AudioSubmix*>(mtx.first);
-        m_cb->routeAudio(oDone, 1, dt, smx.m_busId, scratchPre.data(), scratchPost.data());
-        mtx.second.mixMonoSampleData(m_head->clientMixInfo(), scratchPost.data(), smx._getMergeBuf(oDone), oDone);
-      }
-    } else {
-      AudioSubmix& smx = *m_head->m_mainSubmix;
-      m_cb->routeAudio(oDone, 1, dt, m_head->m_mainSubmix->m_busId, scratchPre.data(), scratchPost.data());
-      DefaultMonoMtx.mixMonoSampleData(m_head->clientMixInfo(), scratchPost.data(), smx._getMergeBuf(oDone), oDone);
+  return soxr_output(m_src, out, frames);
+}
+
+void AudioVoiceMono::_mix(size_t frames, float* audio, double dt) {
+  /* Sized by _reserveMixBuffers() for the largest interval */
+  auto& scratchPost = m_head->m_scratchPost;
+
+  const AudioRoutingTable<Send>* sends = m_sendTable.load(std::memory_order_acquire);
+  if (sends && sends->size()) {
+    for (const std::shared_ptr<Send>& send : *sends) {
+      AudioSubmix& smx = *reinterpret_cast<AudioSubmix*>(send->m_submix);
+      m_cb->routeAudio(frames, 1, dt, smx.m_busId, audio, scratchPost.data());
+      send->m_matrix.mixMonoSampleData(m_head->_blockMixInfo(), scratchPost.data(), smx._getMergeBuf(frames),
+                                       frames);
     }
+  } else {
+    AudioSubmix& smx = *m_head->m_mainSubmix;
+    m_cb->routeAudio(frames, 1, dt, m_head->m_mainSubmix->m_busId, audio, scratchPost.data());
+    DefaultMonoMtx.mixMonoSampleData(m_head->_blockMixInfo(), scratchPost.data(), smx._getMergeBuf(frames), frames);
   }
-
-  return oDone;
 }
 
 void AudioVoiceMono::resetChannelLevels() {
-  m_head->m_submixesDirty = true;
-  m_sendMatrices.clear();
+  if (m_sendTable.load(std::memory_order_relaxed))
+    m_head->_replaceRouting(m_sendTable, nullptr);
 }
 
 void AudioVoiceMono::setMonoChannelLevels(IAudioSubmix* submix, const float coefs[8], bool slew) {
+  rampMonoChannelLevels(submix, coefs, slew ? 5.0 : 0.0, AudioRampCurve::Linear);
+}
+
+void AudioVoiceMono::setStereoChannelLevels(IAudioSubmix* submix, const float coefs[8][2], bool slew) {
+  rampStereoChannelLevels(submix, coefs, slew ? 5.0 : 0.0, AudioRampCurve::Linear);
+}
+
+void AudioVoiceMono::rampMonoChannelLevels(IAudioSubmix* submix, const float coefs[8], double ms,
+                                           AudioRampCurve curve) {
   if (!submix)
     submix = m_head->m_mainSubmix.get();
 
-  auto search = m_sendMatrices.find(submix);
-  if (search == m_sendMatrices.cend())
-    search = m_sendMatrices.emplace(submix, AudioMatrixMono{}).first;
-  search->second.setMatrixCoefficients(coefs, slew ? m_head->m_5msFrames : 0);
+  size_t slewFrames = _rampFrames(ms);
+  if (Send* send = FindRoute(m_sendTable.load(std::memory_order_acquire), submix)) {
+    send->m_post.post(coefs, slewFrames, curve);
+    return;
+  }
+  /* The mixer can't see a new route yet, so it is set up in place */
+  auto send = std::make_shared<Send>(submix);
+  send->m_matrix.setMatrixCoefficients(coefs, slewFrames, curve);
+  m_head->_addRoute(m_sendTable, std::move(send));
 }
 
-void AudioVoiceMono::setStereoChannelLevels(IAudioSubmix* submix, const float coefs[8][2], bool slew) {
+void AudioVoiceMono::rampStereoChannelLevels(IAudioSubmix* submix, const float coefs[8][2], double ms,
+                                             AudioRampCurve curve) {
   float newCoefs[8] = {coefs[0][0], coefs[1][0], coefs[2][0], coefs[3][0],
                        coefs[4][0], coefs[5][0], coefs[6][0], coefs[7][0]};
+  rampMonoChannelLevels(submix, newCoefs, ms, curve);
+}
 
-  if (!submix)
-    submix = m_head->m_mainSubmix.get();
+void AudioVoiceMono::setMultichannelLevels(IAudioSubmix* submix, const float coefs[8][8], bool slew) {
+  rampMultichannelLevels(submix, coefs, slew ? 5.0 : 0.0, AudioRampCurve::Linear);
+}
 
-  auto search = m_sendMatrices.find(submix);
-  if (search == m_sendMatrices.cend())
-    search = m_sendMatrices.emplace(submix, AudioMatrixMono{}).first;
-  search->second.setMatrixCoefficients(newCoefs, slew ? m_head->m_5msFrames : 0);
+void AudioVoiceMono::rampMultichannelLevels(IAudioSubmix* submix, const float coefs[8][8], double ms,
+                                            AudioRampCurve curve) {
+  float newCoefs[8] = {coefs[0][0], coefs[1][0], coefs[2][0], coefs[3][0],
+                       coefs[4][0], coefs[5][0], coefs[6][0], coefs[7][0]};
+  rampMonoChannelLevels(submix, newCoefs, ms, curve);
 }
 
 AudioVoiceStereo::AudioVoiceStereo(BaseAudioVoiceEngine& root, IAudioVoiceCallback* cb, double sampleRate,
@@ -178,35 +281,17 @@ AudioVoiceStereo::AudioVoiceStereo(BaseAudioVoiceEngine& root, IAudioVoiceCallba
   _resetSampleRate(sampleRate);
 }
 
-void AudioVoiceStereo::_resetSampleRate(double sampleRate) {
-  soxr_delete(m_src);
+AudioVoiceStereo::~AudioVoiceStereo() { delete m_sendTable.load(); }
 
-  double rateOut = m_head->mixInfo().m_sampleRate;
-  soxr_io_spec_t ioSpec = soxr_io_spec(SOXR_INT16_I, SOXR_FLOAT32_I);
-  soxr_quality_spec_t qSpec = soxr_quality_spec(SOXR_20_BITQ, m_dynamicRate ? SOXR_VR : 0);
-
-  soxr_error_t err;
-  m_src = soxr_create(sampleRate, rateOut, 2, &err, &ioSpec, &qSpec, nullptr);
-
-  if (!m_src) {
-    Log.report(logvisor::Fatal, FMT_STRING("unable to create soxr resampler: {}"), soxr_strerror(err));
-    m_resetSampleRate = false;
-    return;
-  }
-
-  m_sampleRateIn = sampleRate;
-  m_sampleRateOut = rateOut;
-  m_sampleRatio = m_sampleRateIn / m_sampleRateOut;
-  soxr_set_input_fn(m_src, soxr_input_fn_t(SRCCallback), this, 0);
-  _setPitchRatio(m_pitchRatio, false);
-  m_resetSampleRate = false;
+void AudioVoiceStereo::_bindResampler(soxr_t src) {
+  soxr_set_input_fn(src, soxr_input_fn_t(SRCCallback), this, m_head->_voiceInputFrames());
 }
 
 size_t AudioVoiceStereo::SRCCallback(AudioVoiceStereo* ctx, int16_t** data, size_t frames) {
+  /* soxr's max_ilen keeps requests within the reserved scratch */
   std::vector<int16_t>& scratchIn = ctx->m_head->m_scratchIn;
+  frames = std::min(frames, scratchIn.size() / 2);
   size_t samples = frames * 2;
-  if (scratchIn.size() < samples)
-    scratchIn.resize(samples);
   *data = scratchIn.data();
   if (ctx->m_silentOut) {
     memset(scratchIn.data(), 0, samples * 2);
@@ -215,10 +300,17 @@ size_t AudioVoiceStereo::SRCCallback(AudioVoiceStereo* ctx, int16_t** data, size
     return ctx->m_cb->supplyAudio(*ctx, frames, scratchIn.data());
 }
 
+void AudioVoiceStereo::_takeSendLevels() {
+  if (const AudioRoutingTable<Send>* sends = m_sendTable.load(std::memory_order_acquire))
+    for (const std::shared_ptr<Send>& send : *sends)
+      send->takeLevels();
+}
+
 bool AudioVoiceStereo::isSilent() const {
-  if (m_sendMatrices.size()) {
-    for (auto& mtx : m_sendMatrices)
-      if (!mtx.second.isSilent())
+  const AudioRoutingTable<Send>* sends = m_sendTable.load(std::memory_order_acquire);
+  if (sends && sends->size()) {
+    for (const std::shared_ptr<Send>& send : *sends)
+      if (!send->m_matrix.isSilent())
         return false;
     return true;
   } else {
@@ -226,73 +318,239 @@ bool AudioVoiceStereo::isSilent() const {
   }
 }
 
-size_t AudioVoiceStereo::pumpAndMix(size_t frames) {
-  size_t samples = frames * 2;
-
-  auto& scratchPre = m_head->m_scratchPre;
-  if (scratchPre.size() < samples)
-    scratchPre.resize(samples + 4);
-
-  auto& scratchPost = m_head->m_scratchPost;
-  if (scratchPost.size() < samples)
-    scratchPost.resize(samples + 4);
-
+size_t AudioVoiceStereo::_pump(size_t frames, float* out) {
   double dt = frames / m_sampleRateOut;
   m_cb->preSupplyAudio(*this, dt);
   _midUpdate();
+  _takeSendLevels();
 
   if (isSilent()) {
+    /* Keep the source advancing, in chunks the shared scratch can hold */
     int16_t* dummy;
-    SRCCallback(this, &dummy, size_t(std::ceil(frames * m_sampleRatio)));
+    size_t remFrames = size_t(std::ceil(frames * m_sampleRatio));
+    while (remFrames) {
+      size_t thisFrames = std::min(remFrames, m_head->_voiceInputFrames());
+      if (SRCCallback(this, &dummy, thisFrames) < thisFrames)
+        break;
+      remFrames -= thisFrames;
+    }
     return 0;
   }
 
-  size_t oDone = soxr_output(m_src, scratchPre.data(), frames);
-
-  if (oDone) {
-    if (m_sendMatrices.size()) {
-      for (auto& mtx : m_sendMatrices) {
-        AudioSubmix& smx = *reinterpret_cast<AudioSubmix*>(mtx.first);
-        m_cb->routeAudio(oDone, 2, dt, smx.m_busId, scratchPre.data(), scratchPost.data());
-        mtx.second.mixStereoSampleData(m_head->clientMixInfo(), scratchPost.data(), smx._getMergeBuf(oDone), oDone);
-      }
-    } else {
-      AudioSubmix& smx = *m_head->m_mainSubmix;
-      m_cb->routeAudio(oDone, 2, dt, m_head->m_mainSubmix->m_busId, scratchPre.data(), scratchPost.data());
-      DefaultStereoMtx.mixStereoSampleData(m_head->clientMixInfo(), scratchPost.data(), smx._getMergeBuf(oDone),
-                                           oDone);
+  return soxr_output(m_src, out, frames);
+}
+
+void AudioVoiceStereo::_mix(size_t frames, float* audio, double dt) {
+  /* Sized by _reserveMixBuffers() for the largest interval */
+  auto& scratchPost = m_head->m_scratchPost;
+
+  const AudioRoutingTable<Send>* sends = m_sendTable.load(std::memory_order_acquire);
+  if (sends && sends->size()) {
+    for (const std::shared_ptr<Send>& send : *sends) {
+      AudioSubmix& smx = *reinterpret_cast<AudioSubmix*>(send->m_submix);
+      m_cb->routeAudio(frames, 2, dt, smx.m_busId, audio, scratchPost.data());
+      send->m_matrix.mixStereoSampleData(m_head->_blockMixInfo(), scratchPost.data(), smx._getMergeBuf(frames),
+                                         frames);
     }
+  } else {
+    AudioSubmix& smx = *m_head->m_mainSubmix;
+    m_cb->routeAudio(frames, 2, dt, m_head->m_mainSubmix->m_busId, audio, scratchPost.data());
+    DefaultStereoMtx.mixStereoSampleData(m_head->_blockMixInfo(), scratchPost.data(), smx._getMergeBuf(frames),
+                                         frames);
   }
-
-  return oDone;
 }
 
 void AudioVoiceStereo::resetChannelLevels() {
-  m_head->m_submixesDirty = true;
-  m_sendMatrices.clear();
+  if (m_sendTable.load(std::memory_order_relaxed))
+    m_head->_replaceRouting(m_sendTable, nullptr);
 }
 
 void AudioVoiceStereo::setMonoChannelLevels(IAudioSubmix* submix, const float coefs[8], bool slew) {
+  rampMonoChannelLevels(submix, coefs, slew ? 5.0 : 0.0, AudioRampCurve::Linear);
+}
+
+void AudioVoiceStereo::setStereoChannelLevels(IAudioSubmix* submix, const float coefs[8][2], bool slew) {
+  rampStereoChannelLevels(submix, coefs, slew ? 5.0 : 0.0, AudioRampCurve::Linear);
+}
+
+void AudioVoiceStereo::rampMonoChannelLevels(IAudioSubmix* submix, const float coefs[8], double ms,
+                                             AudioRampCurve curve) {
   float newCoefs[8][2] = {{coefs[0], coefs[0]}, {coefs[1], coefs[1]}, {coefs[2], coefs[2]}, {coefs[3], coefs[3]},
                           {coefs[4], coefs[4]}, {coefs[5], coefs[5]}, {coefs[6], coefs[6]}, {coefs[7], coefs[7]}};
+  rampStereoChannelLevels(submix, newCoefs, ms, curve);
+}
 
+void AudioVoiceStereo::rampStereoChannelLevels(IAudioSubmix* submix, const float coefs[8][2], double ms,
+                                               AudioRampCurve curve) {
   if (!submix)
     submix = m_head->m_mainSubmix.get();
 
-  auto search = m_sendMatrices.find(submix);
-  if (search == m_sendMatrices.cend())
-    search = m_sendMatrices.emplace(submix, AudioMatrixStereo{}).first;
-  search->second.setMatrixCoefficients(newCoefs, slew ? m_head->m_5msFrames : 0);
+  size_t slewFrames = _rampFrames(ms);
+  if (Send* send = FindRoute(m_sendTable.load(std::memory_order_acquire), submix)) {
+    send->m_post.post(coefs[0], slewFrames, curve);
+    return;
+  }
+  /* The mixer can't see a new route yet, so it is set up in place */
+  auto send = std::make_shared<Send>(submix);
+  send->m_matrix.setMatrixCoefficients(coefs, slewFrames, curve);
+  m_head->_addRoute(m_sendTable, std::move(send));
 }
 
-void AudioVoiceStereo::setStereoChannelLevels(IAudioSubmix* submix, const float coefs[8][2], bool slew) {
+void AudioVoiceStereo::setMultichannelLevels(IAudioSubmix* submix, const float coefs[8][8], bool slew) {
+  rampMultichannelLevels(submix, coefs, slew ? 5.0 : 0.0, AudioRampCurve::Linear);
+}
+
+void AudioVoiceStereo::rampMultichannelLevels(IAudioSubmix* submix, const float coefs[8][8], double ms,
+                                              AudioRampCurve curve) {
+  float newCoefs[8][2] = {{coefs[0][0], coefs[0][1]}, {coefs[1][0], coefs[1][1]}, {coefs[2][0], coefs[2][1]},
+                          {coefs[3][0], coefs[3][1]}, {coefs[4][0], coefs[4][1]}, {coefs[5][0], coefs[5][1]},
+                          {coefs[6][0], coefs[6][1]}, {coefs[7][0], coefs[7][1]}};
+  rampStereoChannelLevels(submix, newCoefs, ms, curve);
+}
+
+AudioVoiceMultichannel::AudioVoiceMultichannel(BaseAudioVoiceEngine& root, IAudioVoiceCallback* cb, double sampleRate,
+                                               const ChannelMap& channels, bool dynamicRate)
+: AudioVoice(root, cb, dynamicRate), m_srcChannels(channels) {
+  m_defaultMtx.setDefaultMatrixCoefficients(m_srcChannels);
+  _resetSampleRate(sampleRate);
+}
+
+AudioVoiceMultichannel::~AudioVoiceMultichannel() { delete m_sendTable.load(); }
+
+void AudioVoiceMultichannel::_bindResampler(soxr_t src) {
+  soxr_set_input_fn(src, soxr_input_fn_t(SRCCallback), this, m_head->_voiceInputFrames());
+}
+
+size_t AudioVoiceMultichannel::SRCCallback(AudioVoiceMultichannel* ctx, int16_t** data, size_t frames) {
+  /* soxr's max_ilen keeps requests within the reserved scratch */
+  std::vector<int16_t>& scratchIn = ctx->m_head->m_scratchIn;
+  unsigned chans = ctx->m_srcChannels.m_channelCount;
+  frames = std::min(frames, scratchIn.size() / chans);
+  *data = scratchIn.data();
+  if (ctx->m_silentOut) {
+    memset(scratchIn.data(), 0, frames * chans * 2);
+    return frames;
+  } else
+    return ctx->m_cb->supplyAudio(*ctx, frames, scratchIn.data());
+}
+
+void AudioVoiceMultichannel::_takeSendLevels() {
+  if (const AudioRoutingTable<Send>* sends = m_sendTable.load(std::memory_order_acquire))
+    for (const std::shared_ptr<Send>& send : *sends)
+      send->takeLevels();
+}
+
+bool AudioVoiceMultichannel::isSilent() const {
+  const AudioRoutingTable<Send>* sends = m_sendTable.load(std::memory_order_acquire);
+  if (sends && sends->size()) {
+    for (const std::shared_ptr<Send>& send : *sends)
+      if (!send->m_matrix.isSilent())
+        return false;
+    return true;
+  } else {
+    return m_defaultMtx.isSilent();
+  }
+}
+
+size_t AudioVoiceMultichannel::_pump(size_t frames, float* out) {
+  double dt = frames / m_sampleRateOut;
+  m_cb->preSupplyAudio(*this, dt);
+  _midUpdate();
+  _takeSendLevels();
+
+  if (isSilent()) {
+    /* Keep the source advancing, in chunks the shared scratch can hold */
+    int16_t* dummy;
+    size_t remFrames = size_t(std::ceil(frames * m_sampleRatio));
+    while (remFrames) {
+      size_t thisFrames = std::min(remFrames, m_head->_voiceInputFrames());
+      if (SRCCallback(this, &dummy, thisFrames) < thisFrames)
+        break;
+      remFrames -= thisFrames;
+    }
+    return 0;
+  }
+
+  return soxr_output(m_src, out, frames);
+}
+
+void AudioVoiceMultichannel::_mix(size_t frames, float* audio, double dt) {
+  /* Sized by _reserveMixBuffers() for the largest interval */
+  auto& scratchPost = m_head->m_scratchPost;
+  unsigned chans = m_srcChannels.m_channelCount;
+
+  const AudioRoutingTable<Send>* sends = m_sendTable.load(std::memory_order_acquire);
+  if (sends && sends->size()) {
+    for (const std::shared_ptr<Send>& send : *sends) {
+      AudioSubmix& smx = *reinterpret_cast<AudioSubmix*>(send->m_submix);
+      m_cb->routeAudio(frames, chans, dt, smx.m_busId, audio, scratchPost.data());
+      send->m_matrix.mixMultichannelSampleData(m_head->_blockMixInfo(), scratchPost.data(), chans,
+                                               smx._getMergeBuf(frames), frames);
+    }
+  } else {
+    AudioSubmix& smx = *m_head->m_mainSubmix;
+    m_cb->routeAudio(frames, chans, dt, m_head->m_mainSubmix->m_busId, audio, scratchPost.data());
+    m_defaultMtx.mixMultichannelSampleData(m_head->_blockMixInfo(), scratchPost.data(), chans,
+                                           smx._getMergeBuf(frames), frames);
+  }
+}
+
+void AudioVoiceMultichannel::resetChannelLevels() {
+  if (m_sendTable.load(std::memory_order_relaxed))
+    m_head->_replaceRouting(m_sendTable, nullptr);
+}
+
+void AudioVoiceMultichannel::setMonoChannelLevels(IAudioSubmix* submix, const float coefs[8], bool slew) {
+  rampMonoChannelLevels(submix, coefs, slew ? 5.0 : 0.0, AudioRampCurve::Linear);
+}
+
+void AudioVoiceMultichannel::setStereoChannelLevels(IAudioSubmix* submix, const float coefs[8][2], bool slew) {
+  rampStereoChannelLevels(submix, coefs, slew ? 5.0 : 0.0, AudioRampCurve::Linear);
+}
+
+void AudioVoiceMultichannel::setMultichannelLevels(IAudioSubmix* submix, const float coefs[8][8], bool slew) {
+  rampMultichannelLevels(submix, coefs, slew ? 5.0 : 0.0, AudioRampCurve::Linear);
+}
+
+void AudioVoiceMultichannel::rampMonoChannelLevels(IAudioSubmix* submix, const float coefs[8], double ms,
+                                                   AudioRampCurve curve) {
+  /* Every source channel takes the same levels */
+  float newCoefs[8][8];
+  for (int o = 0; o < 8; ++o)
+    for (int i = 0; i < 8; ++i)
+      newCoefs[o][i] = coefs[o];
+  rampMultichannelLevels(submix, newCoefs, ms, curve);
+}
+
+void AudioVoiceMultichannel::rampStereoChannelLevels(IAudioSubmix* submix, const float coefs[8][2], double ms,
+                                                     AudioRampCurve curve) {
+  /* Left-side source channels take the left column, right-side the right, the rest an even blend */
+  float newCoefs[8][8];
+  for (unsigned i = 0; i < 8; ++i) {
+    AudioChannel ch = i < m_srcChannels.m_channelCount ? m_srcChannels.m_channels[i] : AudioChannel::Unknown;
+    bool left = ch == AudioChannel::FrontLeft || ch == AudioChannel::RearLeft || ch == AudioChannel::SideLeft;
+    bool right = ch == AudioChannel::FrontRight || ch == AudioChannel::RearRight || ch == AudioChannel::SideRight;
+    for (int o = 0; o < 8; ++o)
+      newCoefs[o][i] = left ? coefs[o][0] : right ? coefs[o][1] : (coefs[o][0] + coefs[o][1]) * 0.5f;
+  }
+  rampMultichannelLevels(submix, newCoefs, ms, curve);
+}
+
+void AudioVoiceMultichannel::rampMultichannelLevels(IAudioSubmix* submix, const float coefs[8][8], double ms,
+                                                    AudioRampCurve curve) {
   if (!submix)
     submix = m_head->m_mainSubmix.get();
 
-  auto search = m_sendMatrices.find(submix);
-  if (search == m_sendMatrices.cend())
-    search = m_sendMatrices.emplace(submix, AudioMatrixStereo{}).first;
-  search->second.setMatrixCoefficients(coefs, slew ? m_head->m_5msFrames : 0);
+  size_t slewFrames = _rampFrames(ms);
+  if (Send* send = FindRoute(m_sendTable.load(std::memory_order_acquire), submix)) {
+    send->m_post.post(coefs[0], slewFrames, curve);
+    return;
+  }
+  /* The mixer can't see a new route yet, so it is set up in place */
+  auto send = std::make_shared<Send>(submix);
+  send->m_matrix.setDefaultMatrixCoefficients(m_srcChannels);
+  send->m_matrix.setMatrixCoefficients(coefs, slewFrames, curve);
+  m_head->_addRoute(m_sendTable, std::move(send));
 }
 
 } // namespace boo2
\ No newline at end of file
@@ -1,10 +1,13 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include <mutex>
-#include <unordered_map>
 
 #include "boo2/audiodev/IAudioVoice.hpp"
+#include "AudioFilterBank.hpp"
 #include "AudioMatrix.hpp"
+#include "AudioRouting.hpp"
 #include "AudioVoiceEngine.hpp"
 #include "Common.hpp"
 
@@ -19,9 +22,30 @@ class BaseAudioVoiceEngine;
 struct AudioVoiceEngineMixInfo;
 struct IAudioSubmix;
 
+/** A voice's route into one submix. The matrix and its ramp belong to the mixer; clients post new
+ *  levels to the route and add or drop routes by publishing a new table of them */
+template <class Matrix, class Coefs>
+struct AudioVoiceSend {
+  IAudioSubmix* m_submix;
+  Matrix m_matrix;
+  AudioLevelPost<sizeof(Coefs) / sizeof(float)> m_post;
+
+  explicit AudioVoiceSend(IAudioSubmix* submix) : m_submix(submix) {}
+
+  /* Mixer-side: ramp to the newest posted levels */
+  void takeLevels() {
+    Coefs coefs;
+    size_t slewFrames;
+    AudioRampCurve curve;
+    if (m_post.take(reinterpret_cast<float*>(&coefs), slewFrames, curve))
+      m_matrix.setMatrixCoefficients(coefs, slewFrames, curve);
+  }
+};
+
 class AudioVoice : public ListNode<AudioVoice, BaseAudioVoiceEngine*, IAudioVoice> {
   friend class BaseAudioVoiceEngine;
   friend class AudioSubmix;
+  friend class AudioSamplerSource;
   friend struct WASAPIAudioVoiceEngine;
   friend struct ::AudioUnitVoiceEngine;
   friend struct ::VSTVoiceEngine;
@@ -40,22 +64,68 @@ protected:
   /* Running bool */
   bool m_running = false;
 
-  /* Deferred sample-rate reset */
-  bool m_resetSampleRate = false;
-  double m_deferredSampleRate;
-  virtual void _resetSampleRate(double sampleRate) = 0;
+  /* Link in the engine's garbage stack when released on the mixing thread */
+  AudioVoice* m_nextGarbage = nullptr;
+
+  /* Converter built off the mixing thread for the mixer to swap in. The mixer hands the converter
+   * it replaces back in the same carrier, which is then freed off the mixing thread too */
+  struct ResamplerSwap {
+    soxr_t m_src;
+    double m_sampleRateIn;
+    double m_sampleRateOut;
+    ~ResamplerSwap() { soxr_delete(m_src); }
+  };
+  std::atomic<ResamplerSwap*> m_pendingSrc = nullptr;
+  std::atomic<ResamplerSwap*> m_retiredSrc = nullptr;
+
+  /* Rate asked for from the mixing thread, built by the engine's reclaimer; 0 if none */
+  std::atomic<double> m_requestedSampleRate = 0.0;
+
+  /* Converter from sampleRate to the current mixing rate, reading from this voice; null on failure */
+  soxr_t _createResampler(double sampleRate);
+  virtual void _bindResampler(soxr_t src) = 0;
+
+  /* Exchanges m_src with src, which converts rateIn to rateOut */
+  virtual void _swapResampler(soxr_t& src, double rateIn, double rateOut);
+
+  /* Replace the converter right away, as on a device change; engine data mutex held, mixer idle */
+  void _resetSampleRate(double sampleRate);
+
+  /* Build a converter for the mixer to take up; engine data mutex held */
+  void _postResampler(double sampleRate);
+
+  /* Reclaimer-side: free the last replaced converter and build any requested one */
+  void _serviceResampler();
+
+  /* Mixer-side: swap in a posted converter once the last one replaced has been freed */
+  void _takeResampler();
 
   /* Deferred pitch ratio set */
   bool m_setPitchRatio = false;
   double m_pitchRatio = 1.0;
   double m_sampleRatio = 1.0;
-  bool m_slew = false;
-  void _setPitchRatio(double ratio, bool slew);
+  size_t m_pitchSlewFrames = 0;
+  void _setPitchRatio(double ratio, size_t slewFrames);
+
+  /* Output frames spanned by a ramp of ms milliseconds */
+  size_t _rampFrames(double ms) const;
 
   /* Mid-pump update */
   void _midUpdate();
 
-  virtual size_t pumpAndMix(size_t frames) = 0;
+  /* Built-in filter, run by the engine's filter bank between _pump() and _mix() */
+  VoiceFilter m_filter;
+
+  virtual unsigned _channelCount() const = 0;
+
+  /* Resample the next block of up to frames into out; 0 when the voice is silent or finished */
+  virtual size_t _pump(size_t frames, float* out) = 0;
+
+  /* Route and mix frames of a pumped block; dt spans the whole block */
+  virtual void _mix(size_t frames, float* audio, double dt) = 0;
+
+  /* Deletion waits until the mixer no longer sees this voice */
+  void finalRelease() noexcept override;
 
   AudioVoice(BaseAudioVoiceEngine& root, IAudioVoiceCallback* cb, bool dynamicRate);
 
@@ -66,6 +136,9 @@ public:
   ~AudioVoice() override;
   void resetSampleRate(double sampleRate) override;
   void setPitchRatio(double ratio, bool slew) override;
+  void glidePitchRatio(double ratio, double ms) override;
+  void setFilter(AudioFilterType type, double cutoff, double q, bool slew) override;
+  void rampFilter(AudioFilterType type, double cutoff, double q, double ms) override;
   void start() override;
   void stop() override;
   double getSampleRateIn() const { return m_sampleRateIn; }
@@ -73,33 +146,88 @@ public:
 };
 
 class AudioVoiceMono : public AudioVoice {
-  std::unordered_map<IAudioSubmix*, AudioMatrixMono> m_sendMatrices;
-  bool m_silentOut = false;
-  void _resetSampleRate(double sampleRate) override;
   static size_t SRCCallback(AudioVoiceMono* ctx, int16_t** data, size_t requestedLen);
+
+protected:
+  using Send = AudioVoiceSend<AudioMatrixMono, float[8]>;
+  std::atomic<const AudioRoutingTable<Send>*> m_sendTable = nullptr;
+  bool m_silentOut = false;
+  void _bindResampler(soxr_t src) override;
+  void _takeSendLevels();
   bool isSilent() const;
-  size_t pumpAndMix(size_t frames) override;
+  unsigned _channelCount() const override { return 1; }
+  size_t _pump(size_t frames, float* out) override;
+  void _mix(size_t frames, float* audio, double dt) override;
 
 public:
   AudioVoiceMono(BaseAudioVoiceEngine& root, IAudioVoiceCallback* cb, double sampleRate, bool dynamicRate);
+  ~AudioVoiceMono() override;
   void resetChannelLevels() override;
   void setMonoChannelLevels(IAudioSubmix* submix, const float coefs[8], bool slew) override;
   void setStereoChannelLevels(IAudioSubmix* submix, const float coefs[8][2], bool slew) override;
+  void rampMonoChannelLevels(IAudioSubmix* submix, const float coefs[8], double ms, AudioRampCurve curve) override;
+  void rampStereoChannelLevels(IAudioSubmix* submix, const float coefs[8][2], double ms,
+                               AudioRampCurve curve) override;
+  void setMultichannelLevels(IAudioSubmix* submix, const float coefs[8][8], bool slew) override;
+  void rampMultichannelLevels(IAudioSubmix* submix, const float coefs[8][8], double ms,
+                              AudioRampCurve curve) override;
 };
 
 class AudioVoiceStereo : public AudioVoice {
-  std::unordered_map<IAudioSubmix*, AudioMatrixStereo> m_sendMatrices;
-  bool m_silentOut = false;
-  void _resetSampleRate(double sampleRate) override;
   static size_t SRCCallback(AudioVoiceStereo* ctx, int16_t** data, size_t requestedLen);
+
+protected:
+  using Send = AudioVoiceSend<AudioMatrixStereo, float[8][2]>;
+  std::atomic<const AudioRoutingTable<Send>*> m_sendTable = nullptr;
+  bool m_silentOut = false;
+  void _bindResampler(soxr_t src) override;
+  void _takeSendLevels();
   bool isSilent() const;
-  size_t pumpAndMix(size_t frames) override;
+  unsigned _channelCount() const override { return 2; }
+  size_t _pump(size_t frames, float* out) override;
+  void _mix(size_t frames, float* audio, double dt) override;
 
 public:
   AudioVoiceStereo(BaseAudioVoiceEngine& root, IAudioVoiceCallback* cb, double sampleRate, bool dynamicRate);
+  ~AudioVoiceStereo() override;
+  void resetChannelLevels() override;
+  void setMonoChannelLevels(IAudioSubmix* submix, const float coefs[8], bool slew) override;
+  void setStereoChannelLevels(IAudioSubmix* submix, const float coefs[8][2], bool slew) override;
+  void rampMonoChannelLevels(IAudioSubmix* submix, const float coefs[8], double ms, AudioRampCurve curve) override;
+  void rampStereoChannelLevels(IAudioSubmix* submix, const float coefs[8][2], double ms,
+                               AudioRampCurve curve) override;
+  void setMultichannelLevels(IAudioSubmix* submix, const float coefs[8][8], bool slew) override;
+  void rampMultichannelLevels(IAudioSubmix* submix, const float coefs[8][8], double ms,
+                              AudioRampCurve curve) override;
+};
+
+class AudioVoiceMultichannel : public AudioVoice {
+  ChannelMap m_srcChannels;
+  AudioMatrixMultichannel m_defaultMtx;
+  using Send = AudioVoiceSend<AudioMatrixMultichannel, float[8][8]>;
+  std::atomic<const AudioRoutingTable<Send>*> m_sendTable = nullptr;
+  bool m_silentOut = false;
+  void _bindResampler(soxr_t src) override;
+  void _takeSendLevels();
+  static size_t SRCCallback(AudioVoiceMultichannel* ctx, int16_t** data, size_t requestedLen);
+  bool isSilent() const;
+  unsigned _channelCount() const override { return m_srcChannels.m_channelCount; }
+  size_t _pump(size_t frames, float* out) override;
+  void _mix(size_t frames, float* audio, double dt) override;
+
+public:
+  AudioVoiceMultichannel(BaseAudioVoiceEngine& root, IAudioVoiceCallback* cb, double sampleRate,
+                         const ChannelMap& channels, bool dynamicRate);
+  ~AudioVoiceMultichannel() override;
   void resetChannelLevels() override;
   void setMonoChannelLevels(IAudioSubmix* submix, const float coefs[8], bool slew) override;
   void setStereoChannelLevels(IAudioSubmix* submix, const float coefs[8][2], bool slew) override;
+  void rampMonoChannelLevels(IAudioSubmix* submix, const float coefs[8], double ms, AudioRampCurve curve) override;
+  void rampStereoChannelLevels(IAudioSubmix* submix, const float coefs[8][2], double ms,
+                               AudioRampCurve curve) override;
+  void setMultichannelLevels(IAudioSubmix* submix, const float coefs[8][8], bool slew) override;
+  void rampMultichannelLevels(IAudioSubmix* submix, const float coefs[8][8], double ms,
+                              AudioRampCurve curve) override;
 };
 
 } // namespace boo2
\ No newline at end of file
@@ -1,85 +1,649 @@
 #include "AudioVoiceEngine.hpp"
+#include "AudioSamplerVoice.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cmath>
 #include <cstring>
 
+#include "AllocationTrap.hpp"
+#include "../Trace.hpp"
+
+#include <logvisor/logvisor.hpp>
+
+#if !defined(_WIN32) && !defined(__SWITCH__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#if __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
 namespace boo2 {
+static logvisor::Module Log("boo::AudioVoiceEngine");
+
+/* Real-time priority requested for the mixing thread; clamped to what the policy allows */
+static constexpr int RealtimePriority = 10;
+
+/* Nice value used when no real-time policy is available, matching rtkit's default */
+static constexpr int ElevatedNiceness = -11;
+
+/* Range accepted for AudioVoiceEngineOptions::m_blockMs */
+static constexpr double MinBlockMs = 1.0;
+static constexpr double MaxBlockMs = 50.0;
+
+/* Nice value of the reclaimer thread; freeing memory is never urgent */
+static constexpr int ReclaimerNiceness = 10;
+
+/* Polling period of the reclaimer; the mixing thread never signals it */
+static constexpr std::chrono::milliseconds ReclaimInterval{50};
+
+/* Engine being mixed on this thread, if any; releases here are deferred to the reclaimer */
+static thread_local BaseAudioVoiceEngine* MixingEngine = nullptr;
+
+/* Stack depth touched by the mixing thread so deep callbacks don't fault it in */
+static constexpr size_t PrefaultStackBytes = 64 * 1024;
+
+/* Smallest page size of supported platforms; touching more often than needed is harmless */
+static constexpr size_t PrefaultPageBytes = 4096;
 
 BaseAudioVoiceEngine::~BaseAudioVoiceEngine() {
+  {
+    std::unique_lock<std::mutex> lk(m_reclaimerMutex);
+    m_reclaimerStop = true;
+  }
+  m_reclaimerCv.notify_one();
+  m_reclaimerThread.join();
+  _collectGarbage();
+
   m_mainSubmix.reset();
+  soxr_delete(m_outputSrc);
+  /* No mixing can be in flight once the backend is torn down */
+  _reclaimSnapshots(true);
+  delete m_snapshot.exchange(nullptr);
   assert(m_voiceHead == nullptr && "Dangling voices detected");
   assert(m_submixHead == nullptr && "Dangling submixes detected");
+  assert(m_captureHead == nullptr && "Dangling captures detected");
+#if !defined(_WIN32) && !defined(__SWITCH__)
+  for (const LockedRange& range : m_lockedRanges)
+    munlock(range.m_ptr, range.m_bytes);
+#endif
 }
 
-void BaseAudioVoiceEngine::_pumpAndMixVoices(size_t frames, float* dataOut) {
-  if (dataOut)
-    memset(dataOut, 0, sizeof(float) * frames * m_mixInfo.m_channelMap.m_channelCount);
-
-  if (m_ltRtProcessing) {
-    size_t sampleCount = m_5msFrames * 5;
-    if (m_ltRtIn.size() < sampleCount)
-      m_ltRtIn.resize(sampleCount);
-    m_mainSubmix->m_redirect = m_ltRtIn.data();
-  } else {
-    m_mainSubmix->m_redirect = dataOut;
+#if !defined(_WIN32) && !defined(__SWITCH__)
+static bool SetRealtimePolicy(int policy, AudioRealtimeStatus::Scheduling scheduling, AudioRealtimeStatus& status) {
+  sched_param param = {};
+  param.sched_priority =
+      std::clamp(RealtimePriority, sched_get_priority_min(policy), sched_get_priority_max(policy));
+  if (pthread_setschedparam(pthread_self(), policy, &param))
+    return false;
+  status.m_scheduling = scheduling;
+  status.m_priority = param.sched_priority;
+  return true;
+}
+#endif
+
+static void PrefaultStack() {
+  volatile uint8_t stack[PrefaultStackBytes];
+  for (size_t i = 0; i < PrefaultStackBytes; i += PrefaultPageBytes)
+    stack[i] = 0;
+  (void)stack[0];
+}
+
+void BaseAudioVoiceEngine::_setupRealtimeThread() {
+  m_realtimeThread = std::this_thread::get_id();
+  AudioRealtimeStatus status;
+
+#if _WIN32
+  if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
+    status.m_scheduling = AudioRealtimeStatus::Scheduling::Elevated;
+    status.m_priority = THREAD_PRIORITY_TIME_CRITICAL;
   }
+#elif !defined(__SWITCH__)
+  if (!SetRealtimePolicy(SCHED_FIFO, AudioRealtimeStatus::Scheduling::FIFO, status) &&
+      !SetRealtimePolicy(SCHED_RR, AudioRealtimeStatus::Scheduling::RoundRobin, status)) {
+#if __linux__
+    /* Linux applies per-thread nice values by thread id */
+    if (!setpriority(PRIO_PROCESS, id_t(syscall(SYS_gettid)), ElevatedNiceness)) {
+      status.m_scheduling = AudioRealtimeStatus::Scheduling::Elevated;
+      status.m_priority = ElevatedNiceness;
+    }
+#endif
+  }
+#endif
+  PrefaultStack();
 
-  if (m_submixesDirty) {
-    m_linearizedSubmixes = m_mainSubmix->_linearizeC3();
-    m_submixesDirty = false;
+  {
+    std::unique_lock<std::mutex> lk(m_realtimeStatusMutex);
+    status.m_memoryLocked = m_realtimeStatus.m_memoryLocked;
+    status.m_buffersPrefaulted = m_realtimeStatus.m_buffersPrefaulted;
+    m_realtimeStatus = status;
   }
 
-  size_t remFrames = frames;
-  while (remFrames) {
-    size_t thisFrames;
-    if (remFrames < m_5msFrames) {
-      thisFrames = remFrames;
-      if (m_engineCallback)
-        m_engineCallback->on5MsInterval(*this, thisFrames / double(m_5msFrames) * 5.0 / 1000.0);
-    } else {
-      thisFrames = m_5msFrames;
-      if (m_engineCallback)
-        m_engineCallback->on5MsInterval(*this, 5.0 / 1000.0);
-    }
+  if (status.m_scheduling == AudioRealtimeStatus::Scheduling::Default)
+    RealtimeReport(Log, logvisor::Warning, FMT_STRING("Unable to raise mixing thread priority"));
+}
+
+static bool PrefaultAndLock(void* ptr, size_t bytes) {
+  /* Touch every page so the first real mix doesn't take the faults */
+  volatile uint8_t* p = static_cast<uint8_t*>(ptr);
+  for (size_t i = 0; i < bytes; i += PrefaultPageBytes)
+    p[i] = p[i];
+  p[bytes - 1] = p[bytes - 1];
+#if !defined(_WIN32) && !defined(__SWITCH__)
+  return !mlock(ptr, bytes);
+#else
+  return false;
+#endif
+}
+
+void BaseAudioVoiceEngine::_publishSnapshot() {
+  std::unique_lock<std::recursive_mutex> lk(m_dataMutex);
+  auto* snapshot = new MixSnapshot;
+  snapshot->m_generation = m_snapshotGeneration.load() + 1;
+  if (m_voiceHead)
+    for (AudioVoice& vox : *m_voiceHead)
+      snapshot->m_voices.push_back(&vox);
+  if (m_mainSubmix) {
+    std::list<AudioSubmix*> linearized = m_mainSubmix->_linearizeC3();
+    snapshot->m_submixes.assign(linearized.rbegin(), linearized.rend());
+  }
+  if (m_captureHead)
+    for (AudioCapture& cap : *m_captureHead)
+      snapshot->m_captures.push_back(&cap);
+  snapshot->m_ltRtProcessing = m_ltRtProcessing.get();
+  snapshot->m_hrtfProcessing = m_hrtfProcessing.get();
+  snapshot->m_clientMixInfo = &clientMixInfo();
+
+  /* Pointer first: a mixer announcing the new generation must also see the new snapshot */
+  MixSnapshot* old = m_snapshot.exchange(snapshot);
+  m_snapshotGeneration.store(snapshot->m_generation);
+  if (old)
+    m_retiredSnapshots.push_back({old, {}, {}, {}, std::move(m_retiredState)});
+  m_retiredState.clear();
+  _reclaimSnapshots(false);
+  /* Submixes and captures bring their own buffers */
+  _lockMixBuffers();
+}
+
+void BaseAudioVoiceEngine::_reclaimSnapshots(bool all) {
+  std::unique_lock<std::recursive_mutex> lk(m_dataMutex);
+  /* A mixer that announced generation g reads snapshot g or newer; retirees are in generation order */
+  uint64_t mixerGeneration = m_mixerGeneration.load();
+  auto it = m_retiredSnapshots.begin();
+  for (; it != m_retiredSnapshots.end(); ++it) {
+    if (!all && it->m_snapshot->m_generation >= mixerGeneration)
+      break;
+    for (AudioVoice* vox : it->m_voices)
+      delete vox;
+    for (AudioSubmix* smx : it->m_submixes)
+      delete smx;
+    for (AudioCapture* cap : it->m_captures)
+      delete cap;
+    delete it->m_snapshot;
+  }
+  m_retiredSnapshots.erase(m_retiredSnapshots.begin(), it);
+}
 
-    if (m_ltRtProcessing)
-      std::fill(m_ltRtIn.begin(), m_ltRtIn.end(), 0.f);
+bool BaseAudioVoiceEngine::_isMixingThread() const { return MixingEngine == this; }
 
-    for (auto it = m_linearizedSubmixes.rbegin(); it != m_linearizedSubmixes.rend(); ++it)
-      (*it)->_zeroFill();
+void BaseAudioVoiceEngine::_retireVoice(AudioVoice* voice) {
+  if (MixingEngine == this) {
+    /* Still in the snapshot until the reclaimer republishes; keep it quiet meanwhile */
+    voice->m_running = false;
+    AudioVoice* next = m_voiceGarbage.load(std::memory_order_relaxed);
+    do
+      voice->m_nextGarbage = next;
+    while (!m_voiceGarbage.compare_exchange_weak(next, voice, std::memory_order_release, std::memory_order_relaxed));
+    return;
+  }
+  voice->m_nextGarbage = nullptr;
+  _retireObjects(voice, nullptr, nullptr);
+}
+
+void BaseAudioVoiceEngine::_retireSubmix(AudioSubmix* submix) {
+  if (MixingEngine == this) {
+    AudioSubmix* next = m_submixGarbage.load(std::memory_order_relaxed);
+    do
+      submix->m_nextGarbage = next;
+    while (!m_submixGarbage.compare_exchange_weak(next, submix, std::memory_order_release, std::memory_order_relaxed));
+    return;
+  }
+  submix->m_nextGarbage = nullptr;
+  _retireObjects(nullptr, submix, nullptr);
+}
 
+void BaseAudioVoiceEngine::_retireCapture(AudioCapture* capture) {
+  if (MixingEngine == this) {
+    AudioCapture* next = m_captureGarbage.load(std::memory_order_relaxed);
+    do
+      capture->m_nextGarbage = next;
+    while (!m_captureGarbage.compare_exchange_weak(next, capture, std::memory_order_release, std::memory_order_relaxed));
+    return;
+  }
+  capture->m_nextGarbage = nullptr;
+  _retireObjects(nullptr, nullptr, capture);
+}
+
+void BaseAudioVoiceEngine::_retireObjects(AudioVoice* voices, AudioSubmix* submixes, AudioCapture* captures) {
+  std::unique_lock<std::recursive_mutex> lk(m_dataMutex);
+  for (AudioVoice* vox = voices; vox; vox = vox->m_nextGarbage)
+    vox->_unlink();
+  for (AudioSubmix* smx = submixes; smx; smx = smx->m_nextGarbage)
+    smx->_unlink();
+  for (AudioCapture* cap = captures; cap; cap = cap->m_nextGarbage)
+    cap->_unlink();
+  _publishSnapshot();
+
+  /* The replaced snapshot still lists the objects; they are freed together with that snapshot */
+  RetiredSnapshot* retired = m_retiredSnapshots.empty() ? nullptr : &m_retiredSnapshots.back();
+  while (AudioVoice* vox = voices) {
+    voices = vox->m_nextGarbage;
+    if (retired)
+      retired->m_voices.push_back(vox);
+    else
+      delete vox;
+  }
+  while (AudioSubmix* smx = submixes) {
+    submixes = smx->m_nextGarbage;
+    if (retired)
+      retired->m_submixes.push_back(smx);
+    else
+      delete smx;
+  }
+
+  /* A tapped submix is released only now, so it outlives every snapshot listing its captures */
+  std::vector<ObjToken<IAudioSubmix>> sources;
+  while (AudioCapture* cap = captures) {
+    captures = cap->m_nextGarbage;
+    sources.push_back(std::move(cap->m_sourceToken));
+    if (retired)
+      retired->m_captures.push_back(cap);
+    else
+      delete cap;
+  }
+}
+
+void BaseAudioVoiceEngine::_collectGarbage() {
+  {
+    std::unique_lock<std::recursive_mutex> lk(m_dataMutex);
     if (m_voiceHead)
       for (AudioVoice& vox : *m_voiceHead)
-        if (vox.m_running)
-          vox.pumpAndMix(thisFrames);
+        vox._serviceResampler();
+  }
+
+  AudioVoice* voices = m_voiceGarbage.exchange(nullptr, std::memory_order_acquire);
+  AudioSubmix* submixes = m_submixGarbage.exchange(nullptr, std::memory_order_acquire);
+  AudioCapture* captures = m_captureGarbage.exchange(nullptr, std::memory_order_acquire);
+  if (voices || submixes || captures)
+    _retireObjects(voices, submixes, captures);
+  else
+    _reclaimSnapshots(false);
+}
+
+void BaseAudioVoiceEngine::_reclaimerProc() {
+  logvisor::RegisterThreadName("Boo Audio Reclaimer");
+#if __linux__
+  setpriority(PRIO_PROCESS, id_t(syscall(SYS_gettid)), ReclaimerNiceness);
+#elif _WIN32
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#endif
+
+  std::unique_lock<std::mutex> lk(m_reclaimerMutex);
+  while (!m_reclaimerCv.wait_for(lk, ReclaimInterval, [this]() { return m_reclaimerStop; })) {
+    lk.unlock();
+    _collectGarbage();
+    lk.lock();
+  }
+}
+
+void BaseAudioVoiceEngine::_reserveMixBuffers() {
+  std::unique_lock<std::recursive_mutex> lk(m_dataMutex);
+  /* Intervals never exceed m_mixBlockFrames; multichannel voices need up to eight samples per frame */
+  size_t inSamples = _voiceInputFrames() * 8;
+  if (m_scratchIn.size() < inSamples)
+    m_scratchIn.resize(inSamples);
+  if (m_scratchPre.size() < m_mixBlockFrames * 8)
+    m_scratchPre.resize(m_mixBlockFrames * 8);
+  if (m_scratchPost.size() < m_mixBlockFrames * 8)
+    m_scratchPost.resize(m_mixBlockFrames * 8);
+  m_filterBank.Reserve(m_mixBlockFrames);
+  if (m_outputSrc) {
+    size_t outSamples = m_mixBlockFrames * m_mixInfo.m_channelMap.m_channelCount;
+    if (m_outputSrcIn.size() < outSamples)
+      m_outputSrcIn.resize(outSamples);
+  }
+  if (m_submixHead)
+    for (AudioSubmix& smx : *m_submixHead)
+      smx._reserveScratch(m_mixBlockFrames);
+  _lockMixBuffers();
+}
+
+void BaseAudioVoiceEngine::_lockMixBuffers() {
+  if (!m_options.m_realtimeMixing)
+    return;
+  std::unique_lock<std::recursive_mutex> lk(m_dataMutex);
+
+  m_nextRanges.clear();
+  auto visit = [this](void* ptr, size_t bytes) {
+    if (ptr && bytes)
+      m_nextRanges.push_back({ptr, bytes, false});
+  };
+  visit(m_scratchIn.data(), m_scratchIn.size() * sizeof(int16_t));
+  visit(m_scratchPre.data(), m_scratchPre.size() * sizeof(float));
+  visit(m_scratchPost.data(), m_scratchPost.size() * sizeof(float));
+  visit(m_outputSrcIn.data(), m_outputSrcIn.size() * sizeof(float));
+  m_filterBank.VisitBuffers(visit);
+  if (m_submixHead)
+    for (AudioSubmix& smx : *m_submixHead) {
+      visit(smx.m_scratch.data(), smx.m_scratch.size() * sizeof(float));
+      smx.m_rateConverter.VisitBuffers(visit);
+    }
+  if (m_ltRtProcessing)
+    m_ltRtProcessing->VisitBuffers(visit);
+  if (m_hrtfProcessing)
+    m_hrtfProcessing->VisitBuffers(visit);
+  if (m_captureHead)
+    for (AudioCapture& cap : *m_captureHead)
+      cap.VisitBuffers(visit);
+  auto byAddress = [](const LockedRange& a, const LockedRange& b) { return a.m_ptr < b.m_ptr; };
+  std::sort(m_nextRanges.begin(), m_nextRanges.end(), byAddress);
+  auto find = [&](const std::vector<LockedRange>& ranges, const LockedRange& range) -> const LockedRange* {
+    auto it = std::lower_bound(ranges.begin(), ranges.end(), range, byAddress);
+    return it != ranges.end() && it->m_ptr == range.m_ptr && it->m_bytes == range.m_bytes ? &*it : nullptr;
+  };
+
+  /* Unlock ranges that went away or moved */
+  m_staleRanges.clear();
+  for (const LockedRange& range : m_lockedRanges) {
+    if (find(m_nextRanges, range))
+      continue;
+#if !defined(_WIN32) && !defined(__SWITCH__)
+    if (range.m_locked)
+      munlock(range.m_ptr, range.m_bytes);
+#endif
+    m_staleRanges.push_back(range);
+  }
+
+  /* Locks don't nest, so a kept range sharing a page with an unlocked one is locked again */
+#if !defined(_WIN32) && !defined(__SWITCH__)
+  const uintptr_t pageMask = ~uintptr_t(sysconf(_SC_PAGESIZE) - 1);
+#else
+  const uintptr_t pageMask = ~uintptr_t(PrefaultPageBytes - 1);
+#endif
+  auto sharesStalePage = [&](const LockedRange& range) {
+    uintptr_t first = uintptr_t(range.m_ptr) & pageMask;
+    uintptr_t last = (uintptr_t(range.m_ptr) + range.m_bytes - 1) & pageMask;
+    for (const LockedRange& stale : m_staleRanges)
+      if ((uintptr_t(stale.m_ptr) & pageMask) <= last &&
+          ((uintptr_t(stale.m_ptr) + stale.m_bytes - 1) & pageMask) >= first)
+        return true;
+    return false;
+  };
+
+  bool locked = true;
+  for (LockedRange& range : m_nextRanges) {
+    const LockedRange* prev = find(m_lockedRanges, range);
+    if (prev && !sharesStalePage(range))
+      range.m_locked = prev->m_locked;
+    else
+      range.m_locked = PrefaultAndLock(range.m_ptr, range.m_bytes);
+    locked &= range.m_locked;
+  }
+  m_lockedRanges.swap(m_nextRanges);
+
+  bool firstPass;
+  {
+    std::unique_lock<std::mutex> statusLk(m_realtimeStatusMutex);
+    firstPass = !m_realtimeStatus.m_buffersPrefaulted;
+    m_realtimeStatus.m_memoryLocked = locked;
+    m_realtimeStatus.m_buffersPrefaulted = true;
+  }
+  if (!locked && firstPass)
+    Log.report(logvisor::Warning, FMT_STRING("Unable to lock mixer buffers in memory"));
+}
+
+AudioRealtimeStatus BaseAudioVoiceEngine::getRealtimeStatus() const {
+  std::unique_lock<std::mutex> lk(m_realtimeStatusMutex);
+  return m_realtimeStatus;
+}
+
+void BaseAudioVoiceEngine::_mixBlock(const MixSnapshot& snapshot, size_t frames, float* dataOut) {
+  if (m_engineCallback)
+    m_engineCallback->onBlockInterval(*this, frames / m_internalMixInfo.m_sampleRate);
 
-    for (auto it = m_linearizedSubmixes.rbegin(); it != m_linearizedSubmixes.rend(); ++it)
-      (*it)->_pumpAndMix(thisFrames);
+  /* Surround mix renders straight into the encoder's ring; plain mixing accumulates */
+  if (snapshot.m_ltRtProcessing)
+    m_mainSubmix->m_redirect = snapshot.m_ltRtProcessing->InputBlock(int(frames));
+  else if (snapshot.m_hrtfProcessing)
+    m_mainSubmix->m_redirect = snapshot.m_hrtfProcessing->InputBlock(int(frames));
+  else {
+    if (dataOut)
+      memset(dataOut, 0, sizeof(float) * frames * m_mixInfo.m_channelMap.m_channelCount);
+    m_mainSubmix->m_redirect = dataOut;
+  }
 
-    remFrames -= thisFrames;
-    if (!dataOut)
+  for (AudioSubmix* smx : snapshot.m_submixes)
+    smx->_zeroFill(frames);
+
+  /* Filtered voices wait in the bank, which filters them together whenever it fills */
+  for (AudioVoice* vox : snapshot.m_voices) {
+    if (!vox->m_running)
       continue;
+    if (!m_filterBank.Fits(vox->_channelCount()))
+      _mixFilteredVoices(frames);
 
-    if (m_ltRtProcessing) {
-      m_ltRtProcessing->Process(m_ltRtIn.data(), dataOut, int(thisFrames));
-      m_mainSubmix->m_redirect = m_ltRtIn.data();
+    size_t oDone;
+    {
+      TraceScope trace("AudioVoice::_pump");
+      oDone = vox->_pump(frames, m_scratchPre.data());
+    }
+    if (!oDone)
+      continue;
+
+    BiquadCoefs start, end;
+    if (vox->m_filter.beginBlock(oDone, vox->m_sampleRateOut, start, end)) {
+      m_filterBank.Stage(vox, vox->m_filter, m_scratchPre.data(), vox->_channelCount(), oDone, start, end);
+    } else {
+      TraceScope trace("AudioVoice::_mix");
+      vox->_mix(oDone, m_scratchPre.data(), frames / vox->m_sampleRateOut);
     }
+  }
+  _mixFilteredVoices(frames);
+
+  for (AudioSubmix* smx : snapshot.m_submixes)
+    smx->_pumpAndMix(frames);
+
+  for (AudioCapture* cap : snapshot.m_captures)
+    if (cap->m_source)
+      cap->_push(cap->m_source->m_output, frames, snapshot.m_clientMixInfo->m_channelMap,
+                 m_internalMixInfo.m_sampleRate);
+
+  if (snapshot.m_ltRtProcessing)
+    snapshot.m_ltRtProcessing->Process(dataOut, int(frames));
+  else if (snapshot.m_hrtfProcessing)
+    snapshot.m_hrtfProcessing->Process(dataOut, int(frames));
 
-    size_t sampleCount = thisFrames * m_mixInfo.m_channelMap.m_channelCount;
-    for (size_t i = 0; i < sampleCount; ++i)
-      dataOut[i] *= m_totalVol;
+  if (!dataOut)
+    return;
 
-    dataOut += sampleCount;
+  size_t sampleCount = frames * m_mixInfo.m_channelMap.m_channelCount;
+  for (size_t i = 0; i < sampleCount; ++i)
+    dataOut[i] *= m_totalVol;
+}
+
+void BaseAudioVoiceEngine::_mixFilteredVoices(size_t frames) {
+  if (m_filterBank.Empty())
+    return;
+  TraceScope trace("BaseAudioVoiceEngine::_mixFilteredVoices");
+  m_filterBank.Process();
+  m_filterBank.Drain(m_scratchPre.data(), [&](AudioVoice* vox, size_t oDone) {
+    vox->_mix(oDone, m_scratchPre.data(), frames / vox->m_sampleRateOut);
+  });
+}
+
+size_t BaseAudioVoiceEngine::OutputSRCCallback(BaseAudioVoiceEngine* ctx, float** data, size_t frames) {
+  /* soxr's max_ilen keeps requests within one mixing block */
+  frames = std::min(frames, ctx->m_mixBlockFrames);
+  *data = ctx->m_outputSrcIn.data();
+  ctx->_mixBlock(*ctx->m_pumpSnapshot, frames, ctx->m_outputSrcIn.data());
+  return frames;
+}
+
+void BaseAudioVoiceEngine::_pumpAndMixVoices(size_t frames, float* dataOut) {
+  TraceScope trace("BaseAudioVoiceEngine::_pumpAndMixVoices");
+  bool timing = m_mixTimingEnabled.load(std::memory_order_relaxed);
+  std::chrono::steady_clock::time_point start;
+  if (timing)
+    start = std::chrono::steady_clock::now();
+
+  /* Announce the generation before taking the snapshot so clients keep it (or a newer one) alive */
+  m_mixerGeneration.store(m_snapshotGeneration.load());
+  const MixSnapshot& snapshot = *m_snapshot.load();
+  MixingEngine = this;
+
+  /* Buffers are pre-faulted and locked by whoever sizes them; only the thread itself is set up here */
+  if (m_options.m_realtimeMixing && m_realtimeThread != std::this_thread::get_id())
+    _setupRealtimeThread();
+
+  /* Nothing below may allocate; BOO2_AUDIO_ALLOCATION_TRAP builds enforce it */
+  AllocationTrap trap;
+
+  float* output = dataOut;
+  size_t outputFrames = frames;
+  m_pumpSnapshot = &snapshot;
+  if (m_outputSrc && dataOut) {
+    /* Blocks are mixed at the fixed rate as the resampler pulls them */
+    soxr_output(m_outputSrc, dataOut, frames);
+  } else {
+    /* Without output, advance the mix by the equivalent stretch at the mixing rate */
+    if (m_outputSrc)
+      frames = size_t(std::lround(frames * m_internalMixInfo.m_sampleRate / m_mixInfo.m_sampleRate));
+    size_t sampleCount = m_mixBlockFrames * m_mixInfo.m_channelMap.m_channelCount;
+    while (frames) {
+      size_t thisFrames = std::min(frames, m_mixBlockFrames);
+      _mixBlock(snapshot, thisFrames, dataOut);
+      frames -= thisFrames;
+      if (dataOut)
+        dataOut += sampleCount;
+    }
+  }
+
+  if (output) {
+    m_outputMeter.Process(output, outputFrames, m_mixInfo.m_channelMap, m_mixInfo.m_sampleRate);
+    for (AudioCapture* cap : snapshot.m_captures)
+      if (!cap->m_source)
+        cap->_push(output, outputFrames, m_mixInfo.m_channelMap, m_mixInfo.m_sampleRate);
+  }
+
+  if (timing && outputFrames) {
+    uint64_t ns = uint64_t(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    double nsPerFrame = double(ns) / double(outputFrames);
+    if (m_mixTimingRestart.exchange(false, std::memory_order_relaxed)) {
+      m_mixTimingPumps.store(0, std::memory_order_relaxed);
+      m_mixTimingFrames.store(0, std::memory_order_relaxed);
+      m_mixTimingNs.store(0, std::memory_order_relaxed);
+      m_mixTimingWorst.store(0.0, std::memory_order_relaxed);
+    }
+    m_mixTimingPumps.fetch_add(1, std::memory_order_relaxed);
+    m_mixTimingFrames.fetch_add(outputFrames, std::memory_order_relaxed);
+    m_mixTimingNs.fetch_add(ns, std::memory_order_relaxed);
+    if (nsPerFrame > m_mixTimingWorst.load(std::memory_order_relaxed))
+      m_mixTimingWorst.store(nsPerFrame, std::memory_order_relaxed);
   }
 
   if (m_engineCallback)
     m_engineCallback->onPumpCycleComplete(*this);
+
+  m_pumpSnapshot = nullptr;
+  MixingEngine = nullptr;
+  m_mixerGeneration.store(UINT64_MAX);
+}
+
+void BaseAudioVoiceEngine::_pumpDummy() {
+  /* Failsafe defaults for 1/60sec of samples */
+  bool changed = m_mixInfo.m_sampleRate != 32000.0 || m_mixInfo.m_channelMap.m_channelCount != 2;
+  m_mixInfo.m_sampleRate = 32000.0;
+  m_mixInfo.m_bitsPerSample = 32;
+  _setBlockFrames(32000.0);
+  m_mixInfo.m_periodFrames = m_blockFrames;
+  m_mixInfo.m_channels = AudioChannelSet::Stereo;
+  m_mixInfo.m_channelMap.m_channelCount = 2;
+  m_mixInfo.m_channelMap.m_channels[0] = AudioChannel::FrontLeft;
+  m_mixInfo.m_channelMap.m_channels[1] = AudioChannel::FrontRight;
+  if (changed)
+    _resetSampleRate();
+  _pumpAndMixVoices(32000 / 60, nullptr);
+}
+
+size_t BaseAudioVoiceEngine::_blockFramesForRate(double sampleRate) const {
+  double blockMs = std::clamp(m_options.m_blockMs, MinBlockMs, MaxBlockMs);
+  return std::max(size_t(sampleRate * blockMs / 1000.0), size_t(1));
+}
+
+void BaseAudioVoiceEngine::_setBlockFrames(double sampleRate) {
+  double mixRate = _mixSampleRate(sampleRate);
+  m_blockFrames = _blockFramesForRate(sampleRate);
+  m_mixBlockFrames = _blockFramesForRate(mixRate);
+  m_5msFrames = size_t(mixRate * 5 / 1000);
+}
+
+void BaseAudioVoiceEngine::_resetOutputSrc() {
+  soxr_delete(m_outputSrc);
+  m_outputSrc = nullptr;
+  if (m_internalMixInfo.m_sampleRate == m_mixInfo.m_sampleRate)
+    return;
+
+  unsigned chanCount = m_mixInfo.m_channelMap.m_channelCount;
+  soxr_io_spec_t ioSpec = soxr_io_spec(SOXR_FLOAT32_I, SOXR_FLOAT32_I);
+  soxr_quality_spec_t qSpec = soxr_quality_spec(SOXR_VHQ, 0);
+
+  soxr_error_t err;
+  m_outputSrc = soxr_create(m_internalMixInfo.m_sampleRate, m_mixInfo.m_sampleRate, chanCount, &err, &ioSpec,
+                            &qSpec, nullptr);
+
+  if (err) {
+    Log.report(logvisor::Fatal, FMT_STRING("unable to create soxr resampler: {}"), soxr_strerror(err));
+    m_outputSrc = nullptr;
+    return;
+  }
+
+  soxr_set_input_fn(m_outputSrc, soxr_input_fn_t(OutputSRCCallback), this, m_mixBlockFrames);
 }
 
 void BaseAudioVoiceEngine::_resetSampleRate() {
-  if (m_voiceHead)
+  std::unique_lock<std::recursive_mutex> lk(m_dataMutex);
+  /* With a fixed mixing rate a device change that keeps the layout only replaces the output resampler */
+  double mixRate = _mixSampleRate(m_mixInfo.m_sampleRate);
+  bool mixRateChanged = m_options.m_mixSampleRate <= 0.0 || mixRate != m_internalMixInfo.m_sampleRate;
+  const ChannelMap& oldMap = m_internalMixInfo.m_channelMap;
+  const ChannelMap& newMap = m_mixInfo.m_channelMap;
+  bool layoutChanged = m_mixInfo.m_channels != m_internalMixInfo.m_channels ||
+                       newMap.m_channelCount != oldMap.m_channelCount ||
+                       !std::equal(newMap.m_channels.begin(), newMap.m_channels.begin() + newMap.m_channelCount,
+                                   oldMap.m_channels.begin());
+  m_internalMixInfo = m_mixInfo;
+  m_internalMixInfo.m_sampleRate = mixRate;
+  m_internalMixInfo.m_periodFrames = m_mixBlockFrames;
+  _resetOutputSrc();
+
+  /* Responses and the Lt/Rt ring are prepared for one rate and block size; rebuild (or drop, if no longer stereo) */
+  if (m_hrtfProcessing)
+    enableHRTF(m_hrtfProcessing->hrirs());
+  if (m_ltRtProcessing)
+    enableLtRt(true);
+  _reserveMixBuffers();
+  if (!mixRateChanged && !layoutChanged)
+    return;
+  if (mixRateChanged && m_voiceHead)
     for (AudioVoice& vox : *m_voiceHead)
       vox._resetSampleRate(vox.m_sampleRateIn);
+  /* Submix effects are set up per channel as well as per rate */
   if (m_submixHead)
     for (AudioSubmix& smx : *m_submixHead)
       smx._resetOutputSampleRate();
@@ -87,16 +651,69 @@ void BaseAudioVoiceEngine::_resetSampleRate() {
 
 ObjToken<IAudioVoice> BaseAudioVoiceEngine::allocateNewMonoVoice(double sampleRate, IAudioVoiceCallback* cb,
                                                                  bool dynamicPitch) {
-  return {new AudioVoiceMono(*this, cb, sampleRate, dynamicPitch)};
+  ObjToken<IAudioVoice> ret = {new AudioVoiceMono(*this, cb, sampleRate, dynamicPitch)};
+  _publishSnapshot();
+  return ret;
 }
 
 ObjToken<IAudioVoice> BaseAudioVoiceEngine::allocateNewStereoVoice(double sampleRate, IAudioVoiceCallback* cb,
                                                                    bool dynamicPitch) {
-  return {new AudioVoiceStereo(*this, cb, sampleRate, dynamicPitch)};
+  ObjToken<IAudioVoice> ret = {new AudioVoiceStereo(*this, cb, sampleRate, dynamicPitch)};
+  _publishSnapshot();
+  return ret;
 }
 
-ObjToken<IAudioSubmix> BaseAudioVoiceEngine::allocateNewSubmix(bool mainOut, IAudioSubmixCallback* cb, int busId) {
-  return {new AudioSubmix(*this, cb, busId, mainOut)};
+ObjToken<IAudioVoice> BaseAudioVoiceEngine::allocateNewMultichannelVoice(double sampleRate,
+                                                                         const ChannelMap& channels,
+                                                                         IAudioVoiceCallback* cb, bool dynamicPitch) {
+  if (channels.m_channelCount < 1 || channels.m_channelCount > 8)
+    return {};
+  ObjToken<IAudioVoice> ret = {new AudioVoiceMultichannel(*this, cb, sampleRate, channels, dynamicPitch)};
+  _publishSnapshot();
+  return ret;
+}
+
+ObjToken<IAudioVoice> BaseAudioVoiceEngine::allocateNewSamplerVoice(const AudioSamplerInfo& info) {
+  if (!info.m_frames || info.m_channels < 1 || info.m_channels > 2)
+    return {};
+  if (info.m_format == AudioSampleFormat::PCM16) {
+    if (!info.m_samples)
+      return {};
+  } else {
+    for (unsigned c = 0; c < info.m_channels; ++c)
+      if (!info.m_adpcm[c].m_data)
+        return {};
+  }
+  ObjToken<IAudioVoice> ret;
+  if (info.m_channels == 2)
+    ret = new AudioSamplerVoiceStereo(*this, info);
+  else
+    ret = new AudioSamplerVoiceMono(*this, info);
+  _publishSnapshot();
+  return ret;
+}
+
+ObjToken<IAudioSubmix> BaseAudioVoiceEngine::allocateNewSubmix(bool mainOut, IAudioSubmixCallback* cb, int busId,
+                                                               unsigned rateDivider) {
+  ObjToken<IAudioSubmix> ret = {new AudioSubmix(*this, cb, busId, mainOut, rateDivider)};
+  _publishSnapshot();
+  return ret;
+}
+
+void BaseAudioVoiceEngine::enableMixTiming(bool enable) {
+  if (enable)
+    m_mixTimingRestart.store(true, std::memory_order_relaxed);
+  m_mixTimingEnabled.store(enable, std::memory_order_relaxed);
+}
+
+AudioMixTiming BaseAudioVoiceEngine::getMixTiming() const {
+  AudioMixTiming ret;
+  ret.m_pumps = m_mixTimingPumps.load(std::memory_order_relaxed);
+  ret.m_frames = m_mixTimingFrames.load(std::memory_order_relaxed);
+  if (ret.m_frames)
+    ret.m_meanNsPerFrame = double(m_mixTimingNs.load(std::memory_order_relaxed)) / double(ret.m_frames);
+  ret.m_worstNsPerFrame = m_mixTimingWorst.load(std::memory_order_relaxed);
+  return ret;
 }
 
 void BaseAudioVoiceEngine::setCallbackInterface(IAudioVoiceEngineCallback* cb) { m_engineCallback = cb; }
@@ -104,17 +721,58 @@ void BaseAudioVoiceEngine::setCallbackInterface(IAudioVoiceEngineCallback* cb) {
 void BaseAudioVoiceEngine::setVolume(float vol) { m_totalVol = vol; }
 
 bool BaseAudioVoiceEngine::enableLtRt(bool enable) {
-  if (enable && m_mixInfo.m_channelMap.m_channelCount == 2 && m_mixInfo.m_channels == AudioChannelSet::Stereo)
-    m_ltRtProcessing = std::make_unique<LtRtProcessing>(m_5msFrames, m_mixInfo);
-  else
-    m_ltRtProcessing.reset();
+  std::unique_lock<std::recursive_mutex> lk(m_dataMutex);
+  /* The mixer may be inside the old processor; it is freed once the mixer moves past its snapshot */
+  _retireState(m_ltRtProcessing);
+  if (enable && m_mixInfo.m_channelMap.m_channelCount == 2 && m_mixInfo.m_channels == AudioChannelSet::Stereo) {
+    _retireState(m_hrtfProcessing);
+    m_ltRtProcessing = std::make_unique<LtRtProcessing>(m_mixBlockFrames, m_internalMixInfo);
+  }
+  _reserveMixBuffers();
+  _publishSnapshot();
   return m_ltRtProcessing.operator bool();
 }
 
-const AudioVoiceEngineMixInfo& BaseAudioVoiceEngine::mixInfo() const { return m_mixInfo; }
+bool BaseAudioVoiceEngine::enableHRTF(std::shared_ptr<const AudioHRIRSet> hrirs) {
+  std::unique_lock<std::recursive_mutex> lk(m_dataMutex);
+  /* The mixer may be inside the old processor; it is freed once the mixer moves past its snapshot */
+  _retireState(m_hrtfProcessing);
+  if (hrirs && m_mixInfo.m_channelMap.m_channelCount == 2 && m_mixInfo.m_channels == AudioChannelSet::Stereo) {
+    _retireState(m_ltRtProcessing);
+    m_hrtfProcessing = std::make_unique<HRTFProcessing>(std::move(hrirs), m_mixBlockFrames, m_internalMixInfo);
+  }
+  _reserveMixBuffers();
+  _publishSnapshot();
+  return m_hrtfProcessing.operator bool();
+}
+
+ObjToken<IAudioCapture> BaseAudioVoiceEngine::captureToFile(IAudioSubmix* submix, const char* path,
+                                                            AudioCaptureFile format, double bufferSeconds) {
+  FILE* fp = fopen(path, "wb");
+  if (!fp) {
+    Log.report(logvisor::Error, FMT_STRING("unable to open capture file {}"), path);
+    return {};
+  }
+  ObjToken<IAudioCapture> ret = {
+      new AudioCapture(*this, static_cast<AudioSubmix*>(submix), fp, format, nullptr, bufferSeconds)};
+  _publishSnapshot();
+  return ret;
+}
+
+ObjToken<IAudioCapture> BaseAudioVoiceEngine::captureToCallback(IAudioSubmix* submix, IAudioCaptureCallback* cb,
+                                                                double bufferSeconds) {
+  ObjToken<IAudioCapture> ret = {new AudioCapture(*this, static_cast<AudioSubmix*>(submix), nullptr,
+                                                  AudioCaptureFile::Raw, cb, bufferSeconds)};
+  _publishSnapshot();
+  return ret;
+}
+
+const AudioVoiceEngineMixInfo& BaseAudioVoiceEngine::mixInfo() const { return m_internalMixInfo; }
 
 const AudioVoiceEngineMixInfo& BaseAudioVoiceEngine::clientMixInfo() const {
-  return m_ltRtProcessing ? m_ltRtProcessing->inMixInfo() : m_mixInfo;
+  if (m_ltRtProcessing)
+    return m_ltRtProcessing->inMixInfo();
+  return m_hrtfProcessing ? m_hrtfProcessing->inMixInfo() : m_internalMixInfo;
 }
 
 } // namespace boo2
\ No newline at end of file
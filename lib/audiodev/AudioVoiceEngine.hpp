@@ -1,33 +1,60 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
-#include <list>
 #include <memory>
 #include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "boo2/BooObject.hpp"
 #include "boo2/audiodev/IAudioVoiceEngine.hpp"
+#include "AudioCapture.hpp"
+#include "AudioFilterBank.hpp"
+#include "AudioRouting.hpp"
 #include "AudioSubmix.hpp"
 #include "AudioVoice.hpp"
 #include "Common.hpp"
+#include "../RealtimeLog.hpp"
+#include "HRTFProcessing.hpp"
 #include "LtRtProcessing.hpp"
 
+#include <soxr.h>
+
 namespace boo2 {
 
 /** Base class for managing mixing and sample-rate-conversion amongst active voices */
 class BaseAudioVoiceEngine : public IAudioVoiceEngine {
 protected:
+  friend class AudioCapture;
   friend class AudioVoice;
   friend class AudioSubmix;
   friend class AudioVoiceMono;
   friend class AudioVoiceStereo;
+  friend class AudioVoiceMultichannel;
+  friend class AudioSamplerSource;
+  template <class VoiceBase>
+  friend class AudioSamplerVoice;
+  AudioVoiceEngineOptions m_options;
   float m_totalVol = 1.f;
   AudioVoiceEngineMixInfo m_mixInfo;
+  /* Format voices and submixes are mixed in; differs from m_mixInfo only in rate and
+   * period when AudioVoiceEngineOptions::m_mixSampleRate fixes the mixing rate */
+  AudioVoiceEngineMixInfo m_internalMixInfo;
   std::recursive_mutex m_dataMutex;
   AudioVoice* m_voiceHead = nullptr;
   AudioSubmix* m_submixHead = nullptr;
+  AudioCapture* m_captureHead = nullptr;
+  /* Block size at the device rate; backends size periods from it */
+  size_t m_blockFrames = 0;
+  /* Block size at the mixing rate; equal to m_blockFrames unless the mixing rate is fixed */
+  size_t m_mixBlockFrames = 0;
+  /* Slew duration of parameter changes at the mixing rate, independent of the block size */
   size_t m_5msFrames = 0;
   IAudioVoiceEngineCallback* m_engineCallback = nullptr;
 
@@ -36,20 +63,179 @@ protected:
   std::vector<float> m_scratchPre;
   std::vector<float> m_scratchPost;
 
-  /* LtRt processing if enabled */
+  /* Filters of the voices in each block, several voices per SIMD step */
+  AudioFilterBank m_filterBank;
+
+  /* LtRt processing if enabled; the mixer uses the one published in its snapshot */
   std::unique_ptr<LtRtProcessing> m_ltRtProcessing;
-  std::vector<float> m_ltRtIn;
+
+  /* Binaural processing if enabled; the mixer uses the one published in its snapshot */
+  std::unique_ptr<HRTFProcessing> m_hrtfProcessing;
 
   std::unique_ptr<AudioSubmix> m_mainSubmix;
-  std::list<AudioSubmix*> m_linearizedSubmixes;
-  bool m_submixesDirty = true;
 
+  /* Opt-in levels of the final output */
+  MeterProcessing m_outputMeter;
+
+  /* Opt-in pump timing; only the mixer writes the totals, restarting them when asked */
+  std::atomic<bool> m_mixTimingEnabled = false;
+  std::atomic<bool> m_mixTimingRestart = false;
+  std::atomic<uint64_t> m_mixTimingPumps = 0;
+  std::atomic<uint64_t> m_mixTimingFrames = 0;
+  std::atomic<uint64_t> m_mixTimingNs = 0;
+  std::atomic<double> m_mixTimingWorst = 0.0;
+
+  /* Converts the finished mix to the device rate when the mixing rate is fixed and differs */
+  soxr_t m_outputSrc = nullptr;
+  std::vector<float> m_outputSrcIn;
+
+  /* Immutable view of the mixable objects for the mixing thread.
+   * Clients rebuild and swap it under m_dataMutex; the mixer never locks. */
+  struct MixSnapshot {
+    uint64_t m_generation = 0;
+    std::vector<AudioVoice*> m_voices;
+    /* Submixes in mixing order (C3 linearization, sends before their destinations) */
+    std::vector<AudioSubmix*> m_submixes;
+    std::vector<AudioCapture*> m_captures;
+    LtRtProcessing* m_ltRtProcessing = nullptr;
+    HRTFProcessing* m_hrtfProcessing = nullptr;
+    /* Layout voices and submixes mix in, following the processors above */
+    const AudioVoiceEngineMixInfo* m_clientMixInfo = nullptr;
+  };
+  std::atomic<MixSnapshot*> m_snapshot = nullptr;
+  /* Snapshot being mixed, for blocks pulled in by m_outputSrc and the mixer-side layout */
+  const MixSnapshot* m_pumpSnapshot = nullptr;
+  std::atomic<uint64_t> m_snapshotGeneration = 0;
+
+  /* Generation announced by the mixer before reading m_snapshot; UINT64_MAX while idle */
+  std::atomic<uint64_t> m_mixerGeneration = UINT64_MAX;
+
+  /* Replaced snapshots, and the objects and state released with them, awaiting the mixer moving past */
+  struct RetiredSnapshot {
+    MixSnapshot* m_snapshot;
+    std::vector<AudioVoice*> m_voices;
+    std::vector<AudioSubmix*> m_submixes;
+    std::vector<AudioCapture*> m_captures;
+    std::vector<std::shared_ptr<const void>> m_state;
+  };
+  std::vector<RetiredSnapshot> m_retiredSnapshots;
+
+  /* Routing tables and processors replaced since the last publish; retired with the snapshot that publish replaces */
+  std::vector<std::shared_ptr<const void>> m_retiredState;
+
+  /* Hand an owned processor over for retirement; the caller publishes a snapshot without it */
+  template <class T>
+  void _retireState(std::unique_ptr<T>& state) {
+    if (state)
+      m_retiredState.emplace_back(std::shared_ptr<const T>(std::move(state)));
+  }
+
+  /* Publish table in place of slot's current one (see AudioRoutingTable) */
+  template <class Table>
+  void _replaceRouting(std::atomic<const Table*>& slot, std::type_identity_t<const Table*> table) {
+    std::unique_lock<std::recursive_mutex> lk(m_dataMutex);
+    if (const Table* old = slot.exchange(table, std::memory_order_acq_rel))
+      m_retiredState.emplace_back(std::shared_ptr<const Table>(old));
+    _publishSnapshot();
+  }
+
+  /* Publish a copy of slot's table with route appended */
+  template <class Route>
+  void _addRoute(std::atomic<const AudioRoutingTable<Route>*>& slot, std::shared_ptr<Route> route) {
+    std::unique_lock<std::recursive_mutex> lk(m_dataMutex);
+    const AudioRoutingTable<Route>* old = slot.load(std::memory_order_relaxed);
+    auto* table = old ? new AudioRoutingTable<Route>(*old) : new AudioRoutingTable<Route>;
+    table->push_back(std::move(route));
+    _replaceRouting(slot, table);
+  }
+
+  void _publishSnapshot();
+  void _reclaimSnapshots(bool all);
+  void _retireVoice(AudioVoice* voice);
+  void _retireSubmix(AudioSubmix* submix);
+  void _retireCapture(AudioCapture* capture);
+  void _retireObjects(AudioVoice* voices, AudioSubmix* submixes, AudioCapture* captures);
+
+  /* Whether this thread is inside the engine's pump */
+  bool _isMixingThread() const;
+
+  /* Objects whose last reference dropped on the mixing thread; pushing is all that thread does */
+  std::atomic<AudioVoice*> m_voiceGarbage = nullptr;
+  std::atomic<AudioSubmix*> m_submixGarbage = nullptr;
+  std::atomic<AudioCapture*> m_captureGarbage = nullptr;
+
+  /* Low-priority thread draining the garbage stacks, freeing retired snapshots and building
+   * resamplers asked for on the mixing thread */
+  std::thread m_reclaimerThread;
+  std::mutex m_reclaimerMutex;
+  std::condition_variable m_reclaimerCv;
+  bool m_reclaimerStop = false;
+
+  /* Mixing, MIDI and backend threads report through the real-time log ring */
+  RealtimeLogDrain m_logDrain;
+
+  void _reclaimerProc();
+  void _collectGarbage();
+
+  /* Real-time treatment of the mixing thread, if requested */
+  std::thread::id m_realtimeThread;
+  mutable std::mutex m_realtimeStatusMutex;
+  AudioRealtimeStatus m_realtimeStatus;
+  struct LockedRange {
+    void* m_ptr;
+    size_t m_bytes;
+    bool m_locked;
+  };
+  /* Mixer buffers as of the last pass, sorted by address, plus scratch for the next pass */
+  std::vector<LockedRange> m_lockedRanges;
+  std::vector<LockedRange> m_nextRanges;
+  std::vector<LockedRange> m_staleRanges;
+
+  void _setupRealtimeThread();
+
+  /* Pre-fault and mlock mixer buffers that appeared or moved since the last pass, unlocking the
+   *  ones that went away. Runs on whichever client thread resized them, never on the mixer */
+  void _lockMixBuffers();
+
+  /* Size every mix buffer for the largest interval so mixing never allocates */
+  void _reserveMixBuffers();
+
+  /* Most source frames a voice's resampler may request per input callback */
+  size_t _voiceInputFrames() const { return std::max(m_mixBlockFrames, size_t(1)) * 4; }
+
+  /* Derive m_blockFrames, m_mixBlockFrames and m_5msFrames for an output rate */
+  size_t _blockFramesForRate(double sampleRate) const;
+  void _setBlockFrames(double sampleRate);
+  double _mixSampleRate(double deviceRate) const {
+    return m_options.m_mixSampleRate > 0.0 ? m_options.m_mixSampleRate : deviceRate;
+  }
+
+  /* (Re)create m_outputSrc for the current device format, or drop it when rates match */
+  void _resetOutputSrc();
+  static size_t OutputSRCCallback(BaseAudioVoiceEngine* ctx, float** data, size_t frames);
+
+  /* Mix one block of at most m_mixBlockFrames at the mixing rate */
+  void _mixBlock(const MixSnapshot& snapshot, size_t frames, float* dataOut);
+  void _mixFilteredVoices(size_t frames);
   void _pumpAndMixVoices(size_t frames, float* dataOut);
 
+  /* Failsafe 1/60sec pump at 32kHz stereo for backends without an output device */
+  void _pumpDummy();
+
   void _resetSampleRate();
 
 public:
-  BaseAudioVoiceEngine() : m_mainSubmix(std::make_unique<AudioSubmix>(*this, nullptr, -1, false)) {}
+  explicit BaseAudioVoiceEngine(const AudioVoiceEngineOptions& options = {})
+  : m_options(options), m_mainSubmix(std::make_unique<AudioSubmix>(*this, nullptr, -1, false)) {
+    m_internalMixInfo.m_sampleRate = _mixSampleRate(m_mixInfo.m_sampleRate);
+    if (m_options.m_realtimeMixing) {
+      m_lockedRanges.reserve(64);
+      m_nextRanges.reserve(64);
+      m_staleRanges.reserve(64);
+    }
+    _publishSnapshot();
+    m_reclaimerThread = std::thread(&BaseAudioVoiceEngine::_reclaimerProc, this);
+  }
   ~BaseAudioVoiceEngine() override;
   ObjToken<IAudioVoice> allocateNewMonoVoice(double sampleRate, IAudioVoiceCallback* cb,
                                              bool dynamicPitch = false) override;
@@ -57,17 +243,37 @@ public:
   ObjToken<IAudioVoice> allocateNewStereoVoice(double sampleRate, IAudioVoiceCallback* cb,
                                                bool dynamicPitch = false) override;
 
-  ObjToken<IAudioSubmix> allocateNewSubmix(bool mainOut, IAudioSubmixCallback* cb, int busId) override;
+  ObjToken<IAudioVoice> allocateNewMultichannelVoice(double sampleRate, const ChannelMap& channels,
+                                                     IAudioVoiceCallback* cb, bool dynamicPitch = false) override;
+
+  ObjToken<IAudioVoice> allocateNewSamplerVoice(const AudioSamplerInfo& info) override;
+
+  ObjToken<IAudioSubmix> allocateNewSubmix(bool mainOut, IAudioSubmixCallback* cb, int busId,
+                                           unsigned rateDivider = 1) override;
 
   void setCallbackInterface(IAudioVoiceEngineCallback* cb) override;
 
   void setVolume(float vol) override;
   bool enableLtRt(bool enable) override;
+  bool enableHRTF(std::shared_ptr<const AudioHRIRSet> hrirs) override;
+  ObjToken<IAudioCapture> captureToFile(IAudioSubmix* submix, const char* path, AudioCaptureFile format,
+                                        double bufferSeconds = 1.0) override;
+  ObjToken<IAudioCapture> captureToCallback(IAudioSubmix* submix, IAudioCaptureCallback* cb,
+                                            double bufferSeconds = 1.0) override;
+  void enableOutputMetering(bool enable) override { m_outputMeter.Enable(enable); }
+  AudioMeterReading getOutputMeterReading() const override { return m_outputMeter.Read(); }
   const AudioVoiceEngineMixInfo& mixInfo() const;
   const AudioVoiceEngineMixInfo& clientMixInfo() const;
+  /* Mixer-side: client layout of the snapshot being mixed */
+  const AudioVoiceEngineMixInfo& _blockMixInfo() const { return *m_pumpSnapshot->m_clientMixInfo; }
   AudioChannelSet getAvailableSet() override { return clientMixInfo().m_channels; }
   void pumpAndMixVoices() override {}
+  size_t getBlockFrames() const override { return m_mixBlockFrames; }
   size_t get5MsFrames() const override { return m_5msFrames; }
+  double getOutputLatency() const override { return 0.0; }
+  AudioRealtimeStatus getRealtimeStatus() const override;
+  void enableMixTiming(bool enable) override;
+  AudioMixTiming getMixTiming() const override;
 };
 
 } // namespace boo2
\ No newline at end of file
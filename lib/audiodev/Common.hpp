@@ -14,4 +14,8 @@ struct AudioVoiceEngineMixInfo {
   size_t m_periodFrames = 160;
 };
 
+/** Nominal azimuth of a layout's speaker in degrees clockwise from front (as panned by
+ *  AudioSpatializer); false for LFE and channels the layout lacks */
+bool SpeakerAzimuth(AudioChannelSet layout, AudioChannel channel, float& azimuth);
+
 } // namespace boo2
\ No newline at end of file
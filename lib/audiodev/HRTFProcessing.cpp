@@ -0,0 +1,367 @@
+#include "HRTFProcessing.hpp"
+#include "../Trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#undef min
+#undef max
+
+namespace boo2 {
+#ifndef M_PI
+#define M_PI 3.14159265358979323846 /* pi */
+#endif
+
+/* LFE skips the virtual speakers and reaches both ears at -6dB */
+static constexpr float LFEGain = 0.5f;
+
+/* Measurements closer than this (radians) are used as-is rather than blended */
+static constexpr double ExactDirection = 0.01;
+
+/* Half-width in taps of the windowed-sinc kernels used for delays and resampling */
+static constexpr int SincHalfWidth = 8;
+
+/* Spherical-head model constants (Brown & Duda, 1998) */
+static constexpr double HeadRadius = 0.0875;
+static constexpr double SpeedOfSound = 343.0;
+static constexpr double ShadowAlphaMin = 0.1;
+static constexpr double ShadowThetaMin = 150.0 * M_PI / 180.0;
+
+static void Direction(double azimuth, double elevation, double out[3]) {
+  double az = azimuth * M_PI / 180.0;
+  double el = elevation * M_PI / 180.0;
+  out[0] = std::sin(az) * std::cos(el);
+  out[1] = std::cos(az) * std::cos(el);
+  out[2] = std::sin(el);
+}
+
+static double WindowedSinc(double x, double halfWidth) {
+  if (std::fabs(x) >= halfWidth)
+    return 0.0;
+  double window = 0.5 + 0.5 * std::cos(M_PI * x / halfWidth);
+  if (std::fabs(x) < 1e-9)
+    return window;
+  return window * std::sin(M_PI * x) / (M_PI * x);
+}
+
+/* Band-limited change of rate for an impulse response, preserving its gain */
+static std::vector<float> ResampleResponse(const std::vector<float>& in, double inRate, double outRate) {
+  if (in.empty() || inRate == outRate)
+    return in;
+  double ratio = outRate / inRate;
+  double cutoff = std::min(ratio, 1.0);
+  double halfWidth = SincHalfWidth / cutoff;
+  std::vector<float> out(size_t(std::ceil(in.size() * ratio)) + SincHalfWidth);
+  for (size_t n = 0; n < out.size(); ++n) {
+    double center = n / ratio;
+    int first = std::max(int(std::ceil(center - halfWidth)), 0);
+    int last = std::min(int(std::floor(center + halfWidth)), int(in.size()) - 1);
+    double acc = 0.0;
+    for (int k = first; k <= last; ++k)
+      acc += in[k] * cutoff * WindowedSinc((center - k) * cutoff, SincHalfWidth);
+    out[n] = float(acc / ratio);
+  }
+  return out;
+}
+
+/* Blend the nearest (up to three) measurements by inverse angular distance */
+static void InterpolateResponses(const AudioHRIRSet& hrirs, double azimuth, double elevation, double sampleRate,
+                                 std::vector<float>& left, std::vector<float>& right) {
+  if (hrirs.m_measurements.empty()) {
+    left = right = {1.f};
+    return;
+  }
+
+  double target[3];
+  Direction(azimuth, elevation, target);
+  std::array<std::pair<double, const AudioHRIR*>, 3> nearest;
+  nearest.fill({M_PI * 2.0, nullptr});
+  for (const AudioHRIR& hrir : hrirs.m_measurements) {
+    double dir[3];
+    Direction(hrir.m_azimuth, hrir.m_elevation, dir);
+    double angle = std::acos(std::clamp(dir[0] * target[0] + dir[1] * target[1] + dir[2] * target[2], -1.0, 1.0));
+    for (size_t i = 0; i < nearest.size(); ++i) {
+      if (angle < nearest[i].first) {
+        std::copy_backward(nearest.begin() + i, nearest.end() - 1, nearest.end());
+        nearest[i] = {angle, &hrir};
+        break;
+      }
+    }
+  }
+
+  left.clear();
+  right.clear();
+  double totalWeight = 0.0;
+  for (const auto& [angle, hrir] : nearest) {
+    if (!hrir)
+      break;
+    double weight = nearest[0].first < ExactDirection ? (hrir == nearest[0].second ? 1.0 : 0.0) : 1.0 / angle;
+    if (weight == 0.0)
+      continue;
+    left.resize(std::max(left.size(), hrir->m_left.size()));
+    right.resize(std::max(right.size(), hrir->m_right.size()));
+    for (size_t i = 0; i < hrir->m_left.size(); ++i)
+      left[i] += float(hrir->m_left[i] * weight);
+    for (size_t i = 0; i < hrir->m_right.size(); ++i)
+      right[i] += float(hrir->m_right[i] * weight);
+    totalWeight += weight;
+  }
+  for (float& v : left)
+    v = float(v / totalWeight);
+  for (float& v : right)
+    v = float(v / totalWeight);
+
+  left = ResampleResponse(left, hrirs.m_sampleRate, sampleRate);
+  right = ResampleResponse(right, hrirs.m_sampleRate, sampleRate);
+}
+
+/* One ear of the spherical head: first-order head shadow followed by the interaural delay.
+ * cosIncidence is the cosine of the angle between the source and the ear's axis. */
+static std::vector<float> SphericalHeadEar(double cosIncidence, double sampleRate, size_t length) {
+  double theta = std::acos(std::clamp(cosIncidence, -1.0, 1.0));
+  double alpha = (1.0 + ShadowAlphaMin / 2.0) + (1.0 - ShadowAlphaMin / 2.0) * std::cos(theta / ShadowThetaMin * M_PI);
+  double delay = theta < M_PI / 2.0 ? 1.0 - std::cos(theta) : 1.0 + theta - M_PI / 2.0;
+  delay *= HeadRadius / SpeedOfSound;
+
+  /* Bilinear transform of (1 + alpha*s/2w0) / (1 + s/2w0) */
+  double k = sampleRate * HeadRadius / SpeedOfSound;
+  double b0 = (1.0 + alpha * k) / (1.0 + k);
+  double b1 = (1.0 - alpha * k) / (1.0 + k);
+  double a1 = (1.0 - k) / (1.0 + k);
+  std::vector<double> shadow(length);
+  double y = 0.0;
+  for (size_t n = 0; n < length; ++n) {
+    double x0 = n == 0 ? 1.0 : 0.0;
+    double x1 = n == 1 ? 1.0 : 0.0;
+    y = b0 * x0 + b1 * x1 - a1 * y;
+    shadow[n] = y;
+  }
+
+  /* Fractional delay, offset so the sinc kernel stays causal */
+  double shift = delay * sampleRate + SincHalfWidth;
+  std::vector<float> out(length);
+  for (size_t n = 0; n < length; ++n) {
+    double acc = 0.0;
+    for (size_t m = 0; m < length; ++m)
+      acc += shadow[m] * WindowedSinc(double(n) - double(m) - shift, SincHalfWidth);
+    out[n] = float(acc);
+  }
+  return out;
+}
+
+AudioHRIRSet AudioHRIRSet::SphericalHead(double sampleRate) {
+  AudioHRIRSet ret;
+  ret.m_sampleRate = sampleRate;
+  size_t length = size_t(sampleRate * 0.004);
+  for (int elevation = -45; elevation <= 90; elevation += 45) {
+    int step = elevation == 90 ? 360 : 5;
+    for (int azimuth = -180; azimuth < 180; azimuth += step) {
+      double dir[3];
+      Direction(azimuth, elevation, dir);
+      AudioHRIR& hrir = ret.m_measurements.emplace_back();
+      hrir.m_azimuth = float(azimuth);
+      hrir.m_elevation = float(elevation);
+      hrir.m_left = SphericalHeadEar(-dir[0], sampleRate, length);
+      hrir.m_right = SphericalHeadEar(dir[0], sampleRate, length);
+    }
+  }
+  return ret;
+}
+
+HRTFConvolver::HRTFConvolver(const AudioHRIRSet& hrirs, AudioChannelSet layout, double sampleRate)
+: m_setup(boo2_pffft_new_real_setup(FFTFrames)) {
+  std::array<std::vector<float>, 8> left, right;
+  size_t maxLength = 1;
+  m_bucketOf.fill(-1);
+  for (int ch = 0; ch < 8; ++ch) {
+    float azimuth;
+    if (!SpeakerAzimuth(layout, AudioChannel(ch), azimuth))
+      continue;
+    InterpolateResponses(hrirs, azimuth, 0.0, sampleRate, left[m_bucketCount], right[m_bucketCount]);
+    maxLength = std::max({maxLength, left[m_bucketCount].size(), right[m_bucketCount].size()});
+    m_buckets[m_bucketCount].m_channel = AudioChannel(ch);
+    m_bucketOf[ch] = int(m_bucketCount++);
+  }
+  m_partitions = int((maxLength + PartitionFrames - 1) / PartitionFrames);
+
+  /* Every region is a multiple of FFTFrames, keeping each one SIMD-aligned */
+  m_storageFloats = FFTFrames * (5 + m_bucketCount * (1 + m_partitions * 3));
+  m_storage = boo2_pffft_aligned_alloc(m_storageFloats);
+  float* cur = m_storage;
+  auto take = [&](size_t count) {
+    float* ret = cur;
+    cur += count;
+    return ret;
+  };
+  m_work = take(FFTFrames);
+  m_accL = take(FFTFrames);
+  m_accR = take(FFTFrames);
+  m_output = take(FFTFrames);
+  m_lfe = take(FFTFrames);
+
+  for (size_t b = 0; b < m_bucketCount; ++b) {
+    Bucket& bucket = m_buckets[b];
+    bucket.m_window = take(FFTFrames);
+    bucket.m_kernelL = take(FFTFrames * m_partitions);
+    bucket.m_kernelR = take(FFTFrames * m_partitions);
+    bucket.m_history = take(FFTFrames * m_partitions);
+    bucket.m_quietSteps = m_partitions;
+    for (int p = 0; p < m_partitions; ++p) {
+      auto transform = [&](const std::vector<float>& response, float* kernel) {
+        std::fill(m_accL, m_accL + FFTFrames, 0.f);
+        size_t begin = std::min(response.size(), size_t(p * PartitionFrames));
+        size_t end = std::min(response.size(), size_t((p + 1) * PartitionFrames));
+        std::copy(response.begin() + begin, response.begin() + end, m_accL);
+        boo2_pffft_forward(m_setup, m_accL, kernel + p * FFTFrames, m_work);
+      };
+      transform(left[b], bucket.m_kernelL);
+      transform(right[b], bucket.m_kernelR);
+    }
+  }
+  std::fill(m_accL, m_accL + FFTFrames, 0.f);
+}
+
+HRTFConvolver::~HRTFConvolver() {
+  boo2_pffft_aligned_free(m_storage);
+  boo2_pffft_destroy_setup(m_setup);
+}
+
+void HRTFConvolver::_Step() {
+  const float scale = 1.f / FFTFrames;
+  std::fill(m_accL, m_accL + FFTFrames, 0.f);
+  std::fill(m_accR, m_accR + FFTFrames, 0.f);
+
+  bool audible = false;
+  for (size_t b = 0; b < m_bucketCount; ++b) {
+    Bucket& bucket = m_buckets[b];
+    float* newest = bucket.m_window + PartitionFrames;
+    float* slot = bucket.m_history + m_historyPos * FFTFrames;
+    bool silent = std::all_of(newest, newest + PartitionFrames, [](float v) { return v == 0.f; });
+    if (silent && bucket.m_prevSilent) {
+      /* Zero window; clear its slot once, then stop touching the bucket */
+      if (bucket.m_quietSteps < m_partitions) {
+        std::fill(slot, slot + FFTFrames, 0.f);
+        ++bucket.m_quietSteps;
+      }
+    } else {
+      boo2_pffft_forward(m_setup, bucket.m_window, slot, m_work);
+      bucket.m_quietSteps = 0;
+    }
+    bucket.m_prevSilent = silent;
+    std::copy(newest, newest + PartitionFrames, bucket.m_window);
+    std::fill(newest, newest + PartitionFrames, 0.f);
+
+    for (int p = bucket.m_quietSteps; p < m_partitions; ++p) {
+      const float* spectrum = bucket.m_history + ((m_historyPos + m_partitions - p) % m_partitions) * FFTFrames;
+      boo2_pffft_zconvolve_accumulate(m_setup, spectrum, bucket.m_kernelL + p * FFTFrames, m_accL, scale);
+      boo2_pffft_zconvolve_accumulate(m_setup, spectrum, bucket.m_kernelR + p * FFTFrames, m_accR, scale);
+      audible = true;
+    }
+  }
+  m_historyPos = (m_historyPos + 1) % m_partitions;
+
+  /* Overlap-save: the second half of each inverse transform is the new output partition */
+  if (audible) {
+    boo2_pffft_backward(m_setup, m_accL, m_accL, m_work);
+    boo2_pffft_backward(m_setup, m_accR, m_accR, m_work);
+  }
+  for (int i = 0; i < PartitionFrames; ++i) {
+    float lfe = m_lfe[i] * LFEGain;
+    m_output[i * 2] = m_accL[PartitionFrames + i] + lfe;
+    m_output[i * 2 + 1] = m_accR[PartitionFrames + i] + lfe;
+  }
+  std::fill(m_lfe, m_lfe + PartitionFrames, 0.f);
+}
+
+void HRTFConvolver::Process(const float* input, const ChannelMap& inMap, float* output, const ChannelMap& outMap,
+                            size_t frames) {
+  /* Bucket per input channel; -2 marks LFE */
+  std::array<int, 8> route;
+  for (unsigned i = 0; i < inMap.m_channelCount; ++i) {
+    AudioChannel ch = inMap.m_channels[i];
+    route[i] = ch == AudioChannel::LFE ? -2 : (size_t(ch) < m_bucketOf.size() ? m_bucketOf[size_t(ch)] : -1);
+  }
+  int leftIdx = -1;
+  int rightIdx = -1;
+  for (unsigned i = 0; i < outMap.m_channelCount; ++i) {
+    if (outMap.m_channels[i] == AudioChannel::FrontLeft)
+      leftIdx = int(i);
+    else if (outMap.m_channels[i] == AudioChannel::FrontRight)
+      rightIdx = int(i);
+  }
+
+  for (size_t f = 0; f < frames; ++f) {
+    /* The whole input frame is consumed before an aliased output frame is written */
+    const float* in = input + f * inMap.m_channelCount;
+    for (unsigned i = 0; i < inMap.m_channelCount; ++i) {
+      if (route[i] >= 0)
+        m_buckets[route[i]].m_window[PartitionFrames + m_fill] = in[i];
+      else if (route[i] == -2)
+        m_lfe[m_fill] += in[i];
+    }
+
+    if (output) {
+      float* out = output + f * outMap.m_channelCount;
+      std::fill(out, out + outMap.m_channelCount, 0.f);
+      if (leftIdx >= 0)
+        out[leftIdx] = m_output[m_fill * 2];
+      if (rightIdx >= 0)
+        out[rightIdx] = m_output[m_fill * 2 + 1];
+    }
+
+    if (++m_fill == PartitionFrames) {
+      _Step();
+      m_fill = 0;
+    }
+  }
+}
+
+HRTFProcessing::HRTFProcessing(std::shared_ptr<const AudioHRIRSet> hrirs, int blockFrames,
+                               const AudioVoiceEngineMixInfo& mixInfo)
+: m_inMixInfo(mixInfo)
+, m_outMap(mixInfo.m_channelMap)
+, m_hrirs(std::move(hrirs))
+, m_maxBlockFrames(blockFrames)
+, m_convolver(*m_hrirs, AudioChannelSet::Surround71, mixInfo.m_sampleRate) {
+  m_inMixInfo.m_channels = AudioChannelSet::Surround71;
+  m_inMixInfo.m_channelMap.m_channelCount = 7;
+  m_inMixInfo.m_channelMap.m_channels[0] = AudioChannel::FrontLeft;
+  m_inMixInfo.m_channelMap.m_channels[1] = AudioChannel::FrontRight;
+  m_inMixInfo.m_channelMap.m_channels[2] = AudioChannel::FrontCenter;
+  m_inMixInfo.m_channelMap.m_channels[3] = AudioChannel::RearLeft;
+  m_inMixInfo.m_channelMap.m_channels[4] = AudioChannel::RearRight;
+  m_inMixInfo.m_channelMap.m_channels[5] = AudioChannel::SideLeft;
+  m_inMixInfo.m_channelMap.m_channels[6] = AudioChannel::SideRight;
+  m_block = std::make_unique<float[]>(m_maxBlockFrames * m_inMixInfo.m_channelMap.m_channelCount);
+}
+
+float* HRTFProcessing::InputBlock(int frameCount) {
+  std::fill(m_block.get(), m_block.get() + frameCount * m_inMixInfo.m_channelMap.m_channelCount, 0.f);
+  return m_block.get();
+}
+
+void HRTFProcessing::Process(float* output, int frameCount) {
+  TraceScope trace("HRTFProcessing::Process");
+  m_convolver.Process(m_block.get(), m_inMixInfo.m_channelMap, output, m_outMap, size_t(frameCount));
+}
+
+AudioHRTFRenderer::AudioHRTFRenderer(std::shared_ptr<const AudioHRIRSet> hrirs, AudioChannelSet layout,
+                                     double sampleRate)
+: m_hrirs(std::move(hrirs)), m_layout(layout) {
+  resetOutputSampleRate(sampleRate);
+}
+
+AudioHRTFRenderer::~AudioHRTFRenderer() = default;
+
+void AudioHRTFRenderer::applyEffect(float* audio, size_t frameCount, const ChannelMap& chanMap,
+                                    double sampleRate) const {
+  m_convolver->Process(audio, chanMap, audio, chanMap, frameCount);
+}
+
+void AudioHRTFRenderer::resetOutputSampleRate(double sampleRate) {
+  m_convolver.reset();
+  if (m_hrirs)
+    m_convolver = std::make_unique<HRTFConvolver>(*m_hrirs, m_layout, sampleRate);
+}
+
+} // namespace boo2
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+
+#include "boo2/audiodev/AudioHRTF.hpp"
+#include "boo2/audiodev/IAudioVoice.hpp"
+#include "Common.hpp"
+
+#include "PFFFT.h"
+
+namespace boo2 {
+
+/** Uniformly-partitioned overlap-save convolution of a layout's speakers with HRIR pairs.
+ *  Every speaker is a direction bucket: voices panned onto it share one forward transform,
+ *  and all buckets accumulate into a single spectrum per ear, so a block costs one FFT per
+ *  audible speaker plus two inverse FFTs however many voices feed it. Silent speakers are
+ *  skipped once their history has drained. All storage is allocated up front. */
+class HRTFConvolver {
+public:
+  static constexpr int PartitionFrames = 128;
+  static constexpr int FFTFrames = PartitionFrames * 2;
+
+private:
+  struct Bucket {
+    AudioChannel m_channel;
+    /* Previous and current input partition, transformed in place into the history */
+    float* m_window;
+    /* Partition spectra of the left and right responses */
+    float* m_kernelL;
+    float* m_kernelR;
+    /* Frequency-domain delay line, one spectrum per partition */
+    float* m_history;
+    bool m_prevSilent = true;
+    /* Newest history slots known to be silent; m_partitions means the bucket is idle */
+    int m_quietSteps;
+  };
+  BooPFFFTSetup* m_setup;
+  int m_partitions;
+  int m_historyPos = 0;
+  int m_fill = 0;
+  std::array<Bucket, 8> m_buckets;
+  size_t m_bucketCount = 0;
+  /* Bucket for each AudioChannel; -1 when the layout lacks it */
+  std::array<int, 8> m_bucketOf;
+  float* m_storage;
+  size_t m_storageFloats;
+  float* m_work;
+  float* m_accL;
+  float* m_accR;
+  /* Interleaved ear output of the previous step, drained while the next partition fills */
+  float* m_output;
+  /* LFE bypasses convolution and is folded into both ears */
+  float* m_lfe;
+  void _Step();
+
+public:
+  HRTFConvolver(const AudioHRIRSet& hrirs, AudioChannelSet layout, double sampleRate);
+  ~HRTFConvolver();
+  HRTFConvolver(const HRTFConvolver&) = delete;
+  HRTFConvolver& operator=(const HRTFConvolver&) = delete;
+  /** Render interleaved inMap frames to the FrontLeft/FrontRight channels of outMap, zeroing the
+   *  rest. output may alias input with the same map, or be null to only advance the state */
+  void Process(const float* input, const ChannelMap& inMap, float* output, const ChannelMap& outMap,
+               size_t frames);
+  /** Calls f(ptr, bytes) for each owned buffer */
+  template <typename F>
+  void VisitBuffers(F&& f) const {
+    f(m_storage, sizeof(float) * m_storageFloats);
+  }
+};
+
+/** Binaural rendering of a 7.1 bed (LFE omitted) for stereo headphone output.
+ *  Mirrors LtRtProcessing: the engine mixes into InputBlock(), Process() writes stereo frames */
+class HRTFProcessing {
+  AudioVoiceEngineMixInfo m_inMixInfo;
+  ChannelMap m_outMap;
+  std::shared_ptr<const AudioHRIRSet> m_hrirs;
+  int m_maxBlockFrames;
+  std::unique_ptr<float[]> m_block;
+  HRTFConvolver m_convolver;
+
+public:
+  HRTFProcessing(std::shared_ptr<const AudioHRIRSet> hrirs, int blockFrames, const AudioVoiceEngineMixInfo& mixInfo);
+  /** Zeroed destination for the next frameCount (<= blockFrames) input frames */
+  float* InputBlock(int frameCount);
+  /** Consume the frames mixed into InputBlock(); output may be null to discard */
+  void Process(float* output, int frameCount);
+  const AudioVoiceEngineMixInfo& inMixInfo() const { return m_inMixInfo; }
+  const std::shared_ptr<const AudioHRIRSet>& hrirs() const { return m_hrirs; }
+  /** Calls f(ptr, bytes) for each owned buffer */
+  template <typename F>
+  void VisitBuffers(F&& f) const {
+    f(m_block.get(), sizeof(float) * m_maxBlockFrames * m_inMixInfo.m_channelMap.m_channelCount);
+    m_convolver.VisitBuffers(f);
+  }
+};
+
+} // namespace boo2
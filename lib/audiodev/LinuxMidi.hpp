@@ -5,6 +5,7 @@
 #include <unordered_map>
 
 #include "AudioVoiceEngine.hpp"
+#include "../Trace.hpp"
 
 #include <alsa/asoundlib.h>
 #include <logvisor/logvisor.hpp>
@@ -15,6 +16,8 @@ extern logvisor::Module ALSALog;
 static inline double TimespecToDouble(struct timespec& ts) { return ts.tv_sec + ts.tv_nsec / 1.0e9; }
 
 struct LinuxMidi : BaseAudioVoiceEngine {
+  explicit LinuxMidi(const AudioVoiceEngineOptions& options) : BaseAudioVoiceEngine(options) {}
+
   std::unordered_map<std::string, IMIDIPort*> m_openHandles;
   void _addOpenHandle(const char* name, IMIDIPort* port) { m_openHandles[name] = port; }
   void _removeOpenHandle(IMIDIPort* port) {
@@ -91,6 +94,7 @@ struct LinuxMidi : BaseAudioVoiceEngine {
 
   static void MIDIReceiveProc(snd_rawmidi_t* midi, const ReceiveFunctor& receiver) {
     logvisor::RegisterThreadName("Boo MIDI");
+    TraceThreadName("Boo MIDI");
     snd_rawmidi_status_t* midiStatus;
     snd_rawmidi_status_malloc(&midiStatus);
     pthread_cleanup_push(MIDIFreeProc, midiStatus);
@@ -103,12 +107,13 @@ struct LinuxMidi : BaseAudioVoiceEngine {
       int rdBytes = snd_rawmidi_read(midi, buf, 512);
       if (rdBytes < 0) {
         if (rdBytes != -EINTR) {
-          ALSALog.report(logvisor::Error, FMT_STRING("MIDI connection lost"));
+          RealtimeReport(ALSALog, logvisor::Error, FMT_STRING("MIDI connection lost"));
           break;
         }
         continue;
       }
 
+      TraceScope trace("MIDIReceiveProc");
       int oldtype;
       pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &oldtype);
       receiver(std::vector<uint8_t>(std::cbegin(buf), std::cbegin(buf) + rdBytes), TimespecToDouble(ts));
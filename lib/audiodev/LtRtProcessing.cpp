@@ -1,4 +1,5 @@
 #include "LtRtProcessing.hpp"
+#include "../Trace.hpp"
 
 #include <algorithm>
 #include <cmath>
@@ -7,129 +8,81 @@
 #undef max
 
 namespace boo2 {
-#if INTEL_IPP
-
 #ifndef M_PI
 #define M_PI 3.14159265358979323846 /* pi */
 #endif
 
-#if USE_LPF
-constexpr int FirTaps = 27;
-
-FIRFilter12k::FIRFilter12k(int windowFrames, double sampleRate) {
-  Ipp64f* taps = ippsMalloc_64f(FirTaps);
-  Ipp32f* taps32 = ippsMalloc_32f(FirTaps);
-  int sizeSpec, sizeBuf;
-
-  ippsFIRGenGetBufferSize(FirTaps, &sizeBuf);
-  m_firBuffer = ippsMalloc_8u(sizeBuf);
-  ippsFIRGenLowpass_64f(12000.0 / sampleRate, taps, FirTaps, ippWinBartlett, ippTrue, m_firBuffer);
-  ippsConvert_64f32f(taps, taps32, FirTaps);
-  ippsFree(taps);
-  ippsFree(m_firBuffer);
-
-  m_dlySrc = ippsMalloc_32f(FirTaps);
-
-  ippsFIRSRGetSize(FirTaps, ipp32f, &sizeSpec, &sizeBuf);
-  m_firSpec = (IppsFIRSpec_32f*)ippsMalloc_8u(sizeSpec);
-  m_firBuffer = ippsMalloc_8u(sizeBuf);
-  ippsFIRSRInit_32f(taps32, FirTaps, ippAlgDirect, m_firSpec);
-  ippsFree(taps32);
-
-  m_inBuf = ippsMalloc_32f(windowFrames);
-}
-
-FIRFilter12k::~FIRFilter12k() {
-  ippsFree(m_firSpec);
-  ippsFree(m_firBuffer);
-  ippsFree(m_dlySrc);
-  ippsFree(m_inBuf);
-}
-
-void FIRFilter12k::Process(Ipp32f* buf, int windowFrames) {
-  ippsZero_32f(m_dlySrc, FirTaps);
-  ippsMove_32f(buf, m_inBuf, windowFrames);
-  ippsFIRSR_32f(m_inBuf, buf, windowFrames, m_firSpec, m_dlySrc, nullptr, m_firBuffer);
-}
-#endif
-
 WindowedHilbert::WindowedHilbert(int windowFrames, double sampleRate)
-:
-#if USE_LPF
-    m_fir(windowFrames, sampleRate)
-,
-#endif
-    m_windowFrames(windowFrames)
+: m_windowFrames(windowFrames)
 , m_halfFrames(windowFrames / 2)
-, m_inputBuf(ippsMalloc_32f(m_windowFrames * 2 + m_halfFrames))
-, m_outputBuf(ippsMalloc_32fc(m_windowFrames * 4))
-, m_hammingTable(ippsMalloc_32f(m_halfFrames)) {
-  ippsZero_32f(m_inputBuf, m_windowFrames * 2 + m_halfFrames);
-  ippsZero_32fc(m_outputBuf, m_windowFrames * 4);
+, m_fftFrames(boo2_pffft_next_size(windowFrames))
+, m_inputBuf(boo2_pffft_aligned_alloc(m_windowFrames * 2 + m_halfFrames))
+, m_fftBuf(boo2_pffft_aligned_alloc(m_fftFrames))
+, m_fftWork(boo2_pffft_aligned_alloc(m_fftFrames))
+, m_kernel(boo2_pffft_aligned_alloc(m_fftFrames))
+, m_outputBuf(boo2_pffft_aligned_alloc(m_windowFrames * 4))
+, m_hammingTable(boo2_pffft_aligned_alloc(m_halfFrames)) {
+  m_setup = boo2_pffft_new_real_setup(m_fftFrames);
   m_output[0] = m_outputBuf;
   m_output[1] = m_output[0] + m_windowFrames;
   m_output[2] = m_output[1] + m_windowFrames;
   m_output[3] = m_output[2] + m_windowFrames;
-  int sizeSpec, sizeBuf;
-  ippsHilbertGetSize_32f32fc(m_windowFrames, ippAlgHintFast, &sizeSpec, &sizeBuf);
-  m_spec = (IppsHilbertSpec*)ippMalloc(sizeSpec);
-  m_buffer = (Ipp8u*)ippMalloc(sizeBuf);
-  ippsHilbertInit_32f32fc(m_windowFrames, ippAlgHintFast, m_spec, m_buffer);
+
+  /* Circular discrete Hilbert impulse response (-j*sgn(k) in frequency domain),
+   * pre-scaled by 1/N to normalize the unscaled backward transform */
+  const double norm = 2.0 / (double(m_fftFrames) * m_fftFrames);
+  for (int i = 1; i < m_fftFrames; i += 2)
+    m_kernel[i] = float(norm / std::tan(M_PI * i / m_fftFrames));
+  boo2_pffft_forward(m_setup, m_kernel, m_kernel, m_fftWork);
 
   for (int i = 0; i < m_halfFrames; ++i)
-    m_hammingTable[i] = Ipp32f(std::cos(M_PI * (i / double(m_halfFrames) + 1.0)) * 0.5 + 0.5);
+    m_hammingTable[i] = float(std::cos(M_PI * (i / double(m_halfFrames) + 1.0)) * 0.5 + 0.5);
 }
 
 WindowedHilbert::~WindowedHilbert() {
-  ippFree(m_spec);
-  ippFree(m_buffer);
-  ippsFree(m_inputBuf);
-  ippsFree(m_outputBuf);
-  ippsFree(m_hammingTable);
+  boo2_pffft_destroy_setup(m_setup);
+  boo2_pffft_aligned_free(m_inputBuf);
+  boo2_pffft_aligned_free(m_fftBuf);
+  boo2_pffft_aligned_free(m_fftWork);
+  boo2_pffft_aligned_free(m_kernel);
+  boo2_pffft_aligned_free(m_outputBuf);
+  boo2_pffft_aligned_free(m_hammingTable);
 }
 
-void WindowedHilbert::_AddWindow() {
-#if USE_LPF
-  Ipp32f* inBufBase = &m_inputBuf[m_windowFrames * m_bufIdx + m_halfFrames];
-  m_fir.Process(inBufBase, m_windowFrames);
-#endif
+void WindowedHilbert::_Transform(const float* input, float* output) {
+  /* The kernel is the full-length circular Hilbert response, so this is the N-point
+   * circular transform of the zero-padded window; the Hamming crossfade between
+   * overlapping windows is what hides the resulting edge error */
+  std::copy(input, input + m_windowFrames, m_fftBuf);
+  std::fill(m_fftBuf + m_windowFrames, m_fftBuf + m_fftFrames, 0.f);
+  boo2_pffft_forward(m_setup, m_fftBuf, m_fftBuf, m_fftWork);
+  boo2_pffft_zconvolve(m_setup, m_fftBuf, m_kernel, m_fftBuf);
+  boo2_pffft_backward(m_setup, m_fftBuf, m_fftBuf, m_fftWork);
+  std::copy(m_fftBuf, m_fftBuf + m_windowFrames, output);
+}
 
+void WindowedHilbert::_AddWindow() {
   if (m_bufIdx) {
     /* Mirror last half of samples to start of input buffer */
-    Ipp32f* bufBase = &m_inputBuf[m_windowFrames * 2];
-    ippsCopy_32f(bufBase, m_inputBuf, m_halfFrames);
-    ippsHilbert_32f32fc(&m_inputBuf[m_windowFrames], m_output[2], m_spec, m_buffer);
-    ippsHilbert_32f32fc(&m_inputBuf[m_windowFrames + m_halfFrames], m_output[3], m_spec, m_buffer);
+    float* bufBase = &m_inputBuf[m_windowFrames * 2];
+    std::copy(bufBase, bufBase + m_halfFrames, m_inputBuf);
+    _Transform(&m_inputBuf[m_windowFrames], m_output[2]);
+    _Transform(&m_inputBuf[m_windowFrames + m_halfFrames], m_output[3]);
   } else {
-    ippsHilbert_32f32fc(&m_inputBuf[0], m_output[0], m_spec, m_buffer);
-    ippsHilbert_32f32fc(&m_inputBuf[m_halfFrames], m_output[1], m_spec, m_buffer);
+    _Transform(&m_inputBuf[0], m_output[0]);
+    _Transform(&m_inputBuf[m_halfFrames], m_output[1]);
   }
   m_bufIdx ^= 1;
 }
 
-void WindowedHilbert::AddWindow(const float* input, int stride) {
-  Ipp32f* bufBase = &m_inputBuf[m_windowFrames * m_bufIdx + m_halfFrames];
-  for (int i = 0; i < m_windowFrames; ++i)
-    bufBase[i] = input[i * stride];
-  _AddWindow();
-}
-
-void WindowedHilbert::AddWindow(const int32_t* input, int stride) {
-  Ipp32f* bufBase = &m_inputBuf[m_windowFrames * m_bufIdx + m_halfFrames];
+void WindowedHilbert::AddWindow(const float* ring, uint64_t frame, size_t ringMask, int stride) {
+  float* bufBase = &m_inputBuf[m_windowFrames * m_bufIdx + m_halfFrames];
   for (int i = 0; i < m_windowFrames; ++i)
-    bufBase[i] = input[i * stride] / (float(INT32_MAX) + 1.f);
+    bufBase[i] = ring[((frame + i) & ringMask) * stride];
   _AddWindow();
 }
 
-void WindowedHilbert::AddWindow(const int16_t* input, int stride) {
-  Ipp32f* bufBase = &m_inputBuf[m_windowFrames * m_bufIdx + m_halfFrames];
-  for (int i = 0; i < m_windowFrames; ++i)
-    bufBase[i] = input[i * stride] / (float(INT16_MAX) + 1.f);
-  _AddWindow();
-}
-
-template <typename T>
-void WindowedHilbert::Output(T* output, float lCoef, float rCoef) const {
+void WindowedHilbert::Output(float* output, int offset, int count, float lCoef, float rCoef) const {
   int first, middle, last;
   if (m_bufIdx) {
     first = 3;
@@ -141,51 +94,44 @@ void WindowedHilbert::Output(T* output, float lCoef, float rCoef) const {
     last = 3;
   }
 
-#if 0
-    for (int i=0 ; i<m_windowFrames ; ++i)
-    {
-        float tmp = m_output[middle][i].im;
-        output[i*2] = ClampFull<T>(output[i*2] + tmp * lCoef);
-        output[i*2+1] = ClampFull<T>(output[i*2+1] + tmp * rCoef);
-    }
-    return;
-#endif
-
-  int i, t;
-  for (i = 0, t = 0; i < m_halfFrames; ++i, ++t) {
-    float tmp =
-        m_output[first][m_halfFrames + i].im * (1.f - m_hammingTable[t]) + m_output[middle][i].im * m_hammingTable[t];
-    output[i * 2] = ClampFull<T>(output[i * 2] + tmp * lCoef);
-    output[i * 2 + 1] = ClampFull<T>(output[i * 2 + 1] + tmp * rCoef);
+  const int end = offset + count;
+  const int fadeOutStart = m_windowFrames - m_halfFrames;
+  int i = offset;
+  for (; i < std::min(end, m_halfFrames); ++i, output += 2) {
+    float tmp = m_output[first][m_halfFrames + i] * (1.f - m_hammingTable[i]) + m_output[middle][i] * m_hammingTable[i];
+    output[0] += tmp * lCoef;
+    output[1] += tmp * rCoef;
   }
-  for (; i < m_windowFrames - m_halfFrames; ++i) {
-    float tmp = m_output[middle][i].im;
-    output[i * 2] = ClampFull<T>(output[i * 2] + tmp * lCoef);
-    output[i * 2 + 1] = ClampFull<T>(output[i * 2 + 1] + tmp * rCoef);
+  for (; i < std::min(end, fadeOutStart); ++i, output += 2) {
+    float tmp = m_output[middle][i];
+    output[0] += tmp * lCoef;
+    output[1] += tmp * rCoef;
   }
-  for (t = 0; i < m_windowFrames; ++i, ++t) {
-    float tmp = m_output[middle][i].im * (1.f - m_hammingTable[t]) + m_output[last][t].im * m_hammingTable[t];
-    output[i * 2] = ClampFull<T>(output[i * 2] + tmp * lCoef);
-    output[i * 2 + 1] = ClampFull<T>(output[i * 2 + 1] + tmp * rCoef);
+  for (; i < end; ++i, output += 2) {
+    int t = i - fadeOutStart;
+    float tmp = m_output[middle][i] * (1.f - m_hammingTable[t]) + m_output[last][t] * m_hammingTable[t];
+    output[0] += tmp * lCoef;
+    output[1] += tmp * rCoef;
   }
 }
 
-template void WindowedHilbert::Output<int16_t>(int16_t* output, float lCoef, float rCoef) const;
-template void WindowedHilbert::Output<int32_t>(int32_t* output, float lCoef, float rCoef) const;
-template void WindowedHilbert::Output<float>(float* output, float lCoef, float rCoef) const;
-
-#endif
+static size_t NextPow2(size_t v) {
+  size_t ret = 1;
+  while (ret < v)
+    ret <<= 1;
+  return ret;
+}
 
-LtRtProcessing::LtRtProcessing(int _5msFrames, const AudioVoiceEngineMixInfo& mixInfo)
+/* The Hilbert window spans four 5ms intervals whatever the mixing block size */
+LtRtProcessing::LtRtProcessing(int blockFrames, const AudioVoiceEngineMixInfo& mixInfo)
 : m_inMixInfo(mixInfo)
-, m_windowFrames(_5msFrames * 4)
+, m_windowFrames(int(mixInfo.m_sampleRate * 5 / 1000) * 4)
 , m_halfFrames(m_windowFrames / 2)
-, m_outputOffset(m_windowFrames * 5 * 2)
-#if INTEL_IPP
+, m_maxBlockFrames(blockFrames)
+, m_ringFrames(NextPow2(m_windowFrames * 3 + m_maxBlockFrames))
+, m_ringMask(m_ringFrames - 1)
 , m_hilbertSL(m_windowFrames, mixInfo.m_sampleRate)
-, m_hilbertSR(m_windowFrames, mixInfo.m_sampleRate)
-#endif
-{
+, m_hilbertSR(m_windowFrames, mixInfo.m_sampleRate) {
   m_inMixInfo.m_channels = AudioChannelSet::Surround51;
   m_inMixInfo.m_channelMap.m_channelCount = 5;
   m_inMixInfo.m_channelMap.m_channels[0] = AudioChannel::FrontLeft;
@@ -194,91 +140,70 @@ LtRtProcessing::LtRtProcessing(int _5msFrames, const AudioVoiceEngineMixInfo& mi
   m_inMixInfo.m_channelMap.m_channels[3] = AudioChannel::RearLeft;
   m_inMixInfo.m_channelMap.m_channels[4] = AudioChannel::RearRight;
 
-  const int samples = m_windowFrames * (5 * 2 + 2 * 2);
-  m_fltBuffer = std::make_unique<float[]>(samples);
+  /* Blocks that straddle the end of the ring spill into the trailing overhang */
+  m_ring = std::make_unique<float[]>((m_ringFrames + m_maxBlockFrames) * 5);
 }
 
-void LtRtProcessing::Process(const float* input, float* output, int frameCount) {
-#if 0
-  for (int i = 0; i < frameCount; ++i)
-  {
-    output[i * 2] = input[i * 5 + 3];
-    output[i * 2 + 1] = input[i * 5 + 4];
-  }
-  return;
-#endif
+float* LtRtProcessing::InputBlock(int frameCount) {
+  float* block = &m_ring[(m_position & m_ringMask) * 5];
+  std::fill(block, block + frameCount * 5, 0.f);
+  return block;
+}
 
-  int outFramesRem = frameCount;
-  float* inBuf = _getInBuf();
-  float* outBuf = _getOutBuf();
-  int tail = std::min(m_windowFrames * 2, m_bufferTail + frameCount);
-  int samples = (tail - m_bufferTail) * 5;
-  memmove(&inBuf[m_bufferTail * 5], input, samples * sizeof(float));
-  // fmt::print("input {} to {}\n", tail - m_bufferTail, m_bufferTail);
-  input += samples;
-  frameCount -= tail - m_bufferTail;
+void LtRtProcessing::_Encode(float* output, uint64_t frame, int offset, int count) {
+  /* Dry path is delayed by half a window to line up with the Hilbert output.
+   * Before the first half window this reads the (still silent) tail of the ring. */
+  // x(:,1) + sqrt(.5)*x(:,3) + sqrt(19/25)*x(:,4) + sqrt(6/25)*x(:,5)
+  // x(:,2) + sqrt(.5)*x(:,3) - sqrt(6/25)*x(:,4) - sqrt(19/25)*x(:,5)
+  uint64_t delayI = frame - m_halfFrames;
+  for (int i = 0; i < count; ++i, ++delayI) {
+    const float* in = &m_ring[(delayI & m_ringMask) * 5];
+    output[i * 2] = in[0] + 0.7071068f * in[2];
+    output[i * 2 + 1] = in[1] + 0.7071068f * in[2];
+  }
+  m_hilbertSL.Output(output, offset, count, 0.8717798f, 0.4898979f);
+  m_hilbertSR.Output(output, offset, count, -0.4898979f, -0.8717798f);
+}
 
-  int head = std::min(m_windowFrames * 2, m_bufferHead + outFramesRem);
-  samples = (head - m_bufferHead) * 2;
-  memmove(output, outBuf + m_bufferHead * 2, samples * sizeof(float));
-  // fmt::print("output {} from {}\n", head - m_bufferHead, m_bufferHead);
-  output += samples;
-  outFramesRem -= head - m_bufferHead;
+void LtRtProcessing::Process(float* output, int frameCount) {
+  TraceScope trace("LtRtProcessing::Process");
+  /* Fold any overhang written past the end of the ring back to its start */
+  size_t ringPos = m_position & m_ringMask;
+  if (ringPos + frameCount > m_ringFrames) {
+    size_t spill = ringPos + frameCount - m_ringFrames;
+    std::copy(&m_ring[m_ringFrames * 5], &m_ring[(m_ringFrames + spill) * 5], &m_ring[0]);
+  }
 
-  int bufIdx = m_bufferTail / m_windowFrames;
-  if (tail / m_windowFrames > bufIdx) {
-    float* in = &inBuf[bufIdx * m_windowFrames * 5];
-    float* out = &outBuf[bufIdx * m_windowFrames * 2];
-#if INTEL_IPP
-    m_hilbertSL.AddWindow(in + 3, 5);
-    m_hilbertSR.AddWindow(in + 4, 5);
-#endif
+  const uint64_t windowFrames = m_windowFrames;
+  int done = 0;
+  while (done < frameCount) {
+    uint64_t frame = m_position + done;
+    if (frame < windowFrames) {
+      /* Priming: no complete window has been mixed yet */
+      int count = int(std::min(uint64_t(frameCount - done), windowFrames - frame));
+      if (output)
+        std::fill(output + done * 2, output + (done + count) * 2, 0.f);
+      done += count;
+      continue;
+    }
 
-    // x(:,1) + sqrt(.5)*x(:,3) + sqrt(19/25)*x(:,4) + sqrt(6/25)*x(:,5)
-    // x(:,2) + sqrt(.5)*x(:,3) - sqrt(6/25)*x(:,4) - sqrt(19/25)*x(:,5)
-    if (bufIdx) {
-      int delayI = -m_halfFrames;
-      for (int i = 0; i < m_windowFrames; ++i, ++delayI) {
-        out[i * 2] = in[delayI * 5] + 0.7071068f * in[delayI * 5 + 2];
-        out[i * 2 + 1] = in[delayI * 5 + 1] + 0.7071068f * in[delayI * 5 + 2];
-        // fmt::print("in {} out {}\n", bufIdx * m_5msFrames + delayI, bufIdx * m_5msFrames + i);
-      }
-    } else {
-      int delayI = m_windowFrames * 2 - m_halfFrames;
-      int i;
-      for (i = 0; i < m_halfFrames; ++i, ++delayI) {
-        out[i * 2] = in[delayI * 5] + 0.7071068f * in[delayI * 5 + 2];
-        out[i * 2 + 1] = in[delayI * 5 + 1] + 0.7071068f * in[delayI * 5 + 2];
-        // fmt::print("in {} out {}\n", bufIdx * m_5msFrames + delayI, bufIdx * m_5msFrames + i);
-      }
-      delayI = 0;
-      for (; i < m_windowFrames; ++i, ++delayI) {
-        out[i * 2] = in[delayI * 5] + 0.7071068f * in[delayI * 5 + 2];
-        out[i * 2 + 1] = in[delayI * 5 + 1] + 0.7071068f * in[delayI * 5 + 2];
-        // fmt::print("in {} out {}\n", bufIdx * m_5msFrames + delayI, bufIdx * m_5msFrames + i);
-      }
+    uint64_t encFrame = frame - windowFrames;
+    uint64_t window = encFrame / windowFrames;
+    int offset = int(encFrame % windowFrames);
+    if (window == m_nextWindow) {
+      /* Window is fully mixed into the ring; transform the surround channels in place */
+      m_hilbertSL.AddWindow(m_ring.get() + 3, window * windowFrames, m_ringMask, 5);
+      m_hilbertSR.AddWindow(m_ring.get() + 4, window * windowFrames, m_ringMask, 5);
+      ++m_nextWindow;
     }
-#if INTEL_IPP
-    m_hilbertSL.Output(out, 0.8717798f, 0.4898979f);
-    m_hilbertSR.Output(out, -0.4898979f, -0.8717798f);
-#endif
-  }
-  m_bufferTail = (tail == m_windowFrames * 2) ? 0 : tail;
-  m_bufferHead = (head == m_windowFrames * 2) ? 0 : head;
 
-  if (frameCount) {
-    samples = frameCount * 5;
-    memmove(inBuf, input, samples * sizeof(float));
-    // fmt::print("input {} to {}\n", frameCount, 0);
-    m_bufferTail = frameCount;
+    int count = std::min(frameCount - done, m_windowFrames - offset);
+    if (output)
+      _Encode(output + done * 2, encFrame, offset, count);
+    done += count;
   }
 
-  if (outFramesRem) {
-    samples = outFramesRem * 2;
-    memmove(output, outBuf, samples * sizeof(float));
-    // fmt::print("output {} from {}\n", outFramesRem, 0);
-    m_bufferHead = outFramesRem;
-  }
+  m_position += frameCount;
 }
 
-} // namespace boo2
\ No newline at end of file
+} // namespace boo2
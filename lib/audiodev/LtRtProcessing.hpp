@@ -7,72 +7,78 @@
 #include "boo2/audiodev/IAudioVoice.hpp"
 #include "Common.hpp"
 
-#if INTEL_IPP
-#include "ipp.h"
-#endif
+#include "PFFFT.h"
 
 namespace boo2 {
 
-#if INTEL_IPP
-#define USE_LPF 0
-
-#if USE_LPF
-class FIRFilter12k {
-  IppsFIRSpec_32f* m_firSpec;
-  Ipp8u* m_firBuffer;
-  Ipp32f* m_dlySrc;
-  Ipp32f* m_inBuf;
-
-public:
-  explicit FIRFilter12k(int windowFrames, double sampleRate);
-  ~FIRFilter12k();
-  void Process(Ipp32f* buf, int windowFrames);
-};
-#endif
-
+/** Overlapping-window Hilbert transformer (90 degree phase shift) built on pffft.
+ *  All storage is allocated up front; AddWindow/Output do not allocate. */
 class WindowedHilbert {
-#if USE_LPF
-  FIRFilter12k m_fir;
-#endif
-  IppsHilbertSpec* m_spec;
-  Ipp8u* m_buffer;
-  int m_windowFrames, m_halfFrames;
+  BooPFFFTSetup* m_setup;
+  int m_windowFrames, m_halfFrames, m_fftFrames;
   int m_bufIdx = 0;
-  Ipp32f* m_inputBuf;
-  Ipp32fc* m_outputBuf;
-  Ipp32fc* m_output[4];
-  Ipp32f* m_hammingTable;
+  float* m_inputBuf;
+  float* m_fftBuf;
+  float* m_fftWork;
+  float* m_kernel;
+  float* m_outputBuf;
+  float* m_output[4];
+  float* m_hammingTable;
+  void _Transform(const float* input, float* output);
   void _AddWindow();
 
 public:
   explicit WindowedHilbert(int windowFrames, double sampleRate);
   ~WindowedHilbert();
-  void AddWindow(const float* input, int stride);
-  void AddWindow(const int32_t* input, int stride);
-  void AddWindow(const int16_t* input, int stride);
-  template <typename T>
-  void Output(T* output, float lCoef, float rCoef) const;
+  WindowedHilbert(const WindowedHilbert&) = delete;
+  WindowedHilbert& operator=(const WindowedHilbert&) = delete;
+  /** Gathers one window of a single channel out of an interleaved power-of-two ring */
+  void AddWindow(const float* ring, uint64_t frame, size_t ringMask, int stride);
+  /** Accumulates window positions [offset, offset+count) into interleaved stereo output */
+  void Output(float* output, int offset, int count, float lCoef, float rCoef) const;
+  /** Calls f(ptr, bytes) for each owned buffer */
+  template <typename F>
+  void VisitBuffers(F&& f) const {
+    f(m_inputBuf, sizeof(float) * (m_windowFrames * 2 + m_halfFrames));
+    f(m_fftBuf, sizeof(float) * m_fftFrames);
+    f(m_fftWork, sizeof(float) * m_fftFrames);
+    f(m_kernel, sizeof(float) * m_fftFrames);
+    f(m_outputBuf, sizeof(float) * m_windowFrames * 4);
+    f(m_hammingTable, sizeof(float) * m_halfFrames);
+  }
 };
-#endif
 
+/** Lt/Rt matrix encoder from 5-channel surround to stereo.
+ *  The engine mixes 5-channel frames directly into a power-of-two ring obtained from
+ *  InputBlock(); Process() then encodes from that ring in place, writing stereo frames
+ *  straight to the caller's output pointer. Output lags input by one window. */
 class LtRtProcessing {
   AudioVoiceEngineMixInfo m_inMixInfo;
   int m_windowFrames;
   int m_halfFrames;
-  int m_outputOffset;
-  int m_bufferTail = 0;
-  int m_bufferHead = 0;
-  std::unique_ptr<float[]> m_fltBuffer;
-#if INTEL_IPP
+  int m_maxBlockFrames;
+  size_t m_ringFrames;
+  size_t m_ringMask;
+  uint64_t m_position = 0;
+  uint64_t m_nextWindow = 0;
+  std::unique_ptr<float[]> m_ring;
   WindowedHilbert m_hilbertSL, m_hilbertSR;
-#endif
-  float* _getInBuf() { return m_fltBuffer.get(); }
-  float* _getOutBuf() { return m_fltBuffer.get() + m_outputOffset;}
+  void _Encode(float* output, uint64_t frame, int offset, int count);
 
 public:
-  LtRtProcessing(int _5msFrames, const AudioVoiceEngineMixInfo& mixInfo);
-  void Process(const float* input, float* output, int frameCount);
+  LtRtProcessing(int blockFrames, const AudioVoiceEngineMixInfo& mixInfo);
+  /** Zeroed, contiguous destination for the next frameCount (<= blockFrames) input frames */
+  float* InputBlock(int frameCount);
+  /** Consume the frames mixed into InputBlock(); output may be null to discard */
+  void Process(float* output, int frameCount);
   const AudioVoiceEngineMixInfo& inMixInfo() const { return m_inMixInfo; }
+  /** Calls f(ptr, bytes) for each owned buffer */
+  template <typename F>
+  void VisitBuffers(F&& f) const {
+    f(m_ring.get(), sizeof(float) * (m_ringFrames + m_maxBlockFrames) * 5);
+    m_hilbertSL.VisitBuffers(f);
+    m_hilbertSR.VisitBuffers(f);
+  }
 };
 
 } // namespace boo2
\ No newline at end of file
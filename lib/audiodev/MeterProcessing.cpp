@@ -0,0 +1,380 @@
+#include "MeterProcessing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846 /* pi */
+#endif
+
+#ifdef __ARM_NEON
+#include "sse2neon.h"
+#define __SSE__ 1
+#elif __SSE__
+#include <immintrin.h>
+#endif
+
+#undef min
+#undef max
+
+namespace boo2 {
+
+/* BS.1770 K-weighting: a high shelf modelling the head, then the RLB high-pass.
+ * The standard tabulates 48kHz coefficients; these analog parameters reproduce them at any rate */
+static constexpr double ShelfFrequency = 1681.974450955533;
+static constexpr double ShelfGainDb = 3.999843853973347;
+static constexpr double ShelfQ = 0.7071752369554196;
+static constexpr double ShelfBandwidthExponent = 0.4996667741545416;
+static constexpr double HighpassFrequency = 38.13547087602444;
+static constexpr double HighpassQ = 0.5003270373238773;
+
+/* Offset making a 0dBFS 997Hz sine in one front channel read -3.01 LUFS */
+static constexpr double LoudnessOffset = -0.691;
+
+/* Surround channels count 1.5dB more than front ones */
+static constexpr float SurroundWeight = 1.41f;
+
+/* Kaiser window shape of the true-peak interpolator */
+static constexpr double KaiserBeta = 7.0;
+
+/* Filter state below this is flushed so decays don't crawl through denormals */
+static constexpr float DenormalThreshold = 1e-20f;
+
+/* Zeroth-order modified Bessel function of the first kind */
+static double BesselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 32; ++k) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12)
+      break;
+  }
+  return sum;
+}
+
+static float LoudnessWeight(AudioChannel chan) {
+  switch (chan) {
+  case AudioChannel::FrontLeft:
+  case AudioChannel::FrontRight:
+  case AudioChannel::FrontCenter:
+    return 1.f;
+  case AudioChannel::RearLeft:
+  case AudioChannel::RearRight:
+  case AudioChannel::SideLeft:
+  case AudioChannel::SideRight:
+    return SurroundWeight;
+  default:
+    return 0.f;
+  }
+}
+
+static float ToLUFS(double power) {
+  return power > 0.0 ? float(LoudnessOffset + 10.0 * std::log10(power)) : -INFINITY;
+}
+
+MeterProcessing::MeterProcessing() {
+  /* Windowed sinc at 4x the input rate, cut off at the input Nyquist frequency */
+  constexpr unsigned tapCount = TruePeakTaps * 4;
+  const double center = (tapCount - 1) / 2.0;
+  const double norm = BesselI0(KaiserBeta);
+  double phaseSums[4] = {};
+  for (unsigned j = 0; j < tapCount; ++j) {
+    double x = (j - center) / 4.0;
+    double sinc = std::sin(M_PI * x) / (M_PI * x);
+    double r = (j - center) / center;
+    double window = BesselI0(KaiserBeta * std::sqrt(std::max(1.0 - r * r, 0.0))) / norm;
+    m_truePeakCoefs[j % 4][j / 4][0] = float(sinc * window);
+    phaseSums[j % 4] += sinc * window;
+  }
+  /* Unity gain for every phase */
+  for (unsigned p = 0; p < 4; ++p)
+    for (unsigned k = 0; k < TruePeakTaps; ++k)
+      std::fill(std::begin(m_truePeakCoefs[p][k]), std::end(m_truePeakCoefs[p][k]),
+                float(m_truePeakCoefs[p][k][0] / phaseSums[p]));
+
+  _Publish(AudioMeterReading{});
+}
+
+void MeterProcessing::Enable(bool enable) {
+  if (enable)
+    m_resetRequested.store(true, std::memory_order_relaxed);
+  m_enabled.store(enable, std::memory_order_release);
+}
+
+void MeterProcessing::_Reset(const ChannelMap& chanMap, double sampleRate) {
+  m_sampleRate = sampleRate;
+  m_chanMap = chanMap;
+  for (unsigned c = 0; c < MaxChannels; ++c)
+    m_loudnessWeights[c] = c < m_chanMap.m_channelCount ? LoudnessWeight(m_chanMap.m_channels[c]) : 0.f;
+
+  {
+    double K = std::tan(M_PI * ShelfFrequency / sampleRate);
+    double Vh = std::pow(10.0, ShelfGainDb / 20.0);
+    double Vb = std::pow(Vh, ShelfBandwidthExponent);
+    double a0 = 1.0 + K / ShelfQ + K * K;
+    m_shelf[0] = float((Vh + Vb * K / ShelfQ + K * K) / a0);
+    m_shelf[1] = float(2.0 * (K * K - Vh) / a0);
+    m_shelf[2] = float((Vh - Vb * K / ShelfQ + K * K) / a0);
+    m_shelf[3] = float(2.0 * (K * K - 1.0) / a0);
+    m_shelf[4] = float((1.0 - K / ShelfQ + K * K) / a0);
+  }
+  {
+    double K = std::tan(M_PI * HighpassFrequency / sampleRate);
+    double a0 = 1.0 + K / HighpassQ + K * K;
+    m_highpass[0] = 1.f;
+    m_highpass[1] = -2.f;
+    m_highpass[2] = 1.f;
+    m_highpass[3] = float(2.0 * (K * K - 1.0) / a0);
+    m_highpass[4] = float((1.0 - K / HighpassQ + K * K) / a0);
+  }
+
+  memset(m_kState, 0, sizeof(m_kState));
+  memset(m_truePeakHistory, 0, sizeof(m_truePeakHistory));
+  m_truePeakPos = 0;
+  m_blockFrames = std::max(size_t(sampleRate / 10.0), size_t(1));
+  m_blockPos = 0;
+  std::fill(std::begin(m_peak), std::end(m_peak), 0.f);
+  std::fill(std::begin(m_truePeak), std::end(m_truePeak), 0.f);
+  std::fill(std::begin(m_sumSquares), std::end(m_sumSquares), 0.0);
+  std::fill(std::begin(m_kSumSquares), std::end(m_kSumSquares), 0.0);
+  memset(m_blockPeak, 0, sizeof(m_blockPeak));
+  memset(m_blockTruePeak, 0, sizeof(m_blockTruePeak));
+  memset(m_blockSumSquares, 0, sizeof(m_blockSumSquares));
+  std::fill(std::begin(m_blockLoudness), std::end(m_blockLoudness), 0.0);
+  m_blocksSeen = 0;
+  _Publish(AudioMeterReading{});
+}
+
+void MeterProcessing::Process(const float* audio, size_t frames, const ChannelMap& chanMap, double sampleRate) {
+  if (!m_enabled.load(std::memory_order_acquire) || !chanMap.m_channelCount)
+    return;
+  bool layoutChanged = chanMap.m_channelCount != m_chanMap.m_channelCount ||
+                       !std::equal(chanMap.m_channels.begin(), chanMap.m_channels.begin() + chanMap.m_channelCount,
+                                   m_chanMap.m_channels.begin());
+  if (m_resetRequested.exchange(false, std::memory_order_relaxed) || layoutChanged || sampleRate != m_sampleRate)
+    _Reset(chanMap, sampleRate);
+
+  /* Gating blocks may straddle mixing intervals */
+  while (frames) {
+    size_t thisFrames = std::min(frames, m_blockFrames - m_blockPos);
+    _Measure(audio, thisFrames);
+    audio += thisFrames * m_chanMap.m_channelCount;
+    frames -= thisFrames;
+    m_blockPos += thisFrames;
+    if (m_blockPos == m_blockFrames)
+      _FinishBlock();
+  }
+}
+
+void MeterProcessing::_Measure(const float* audio, size_t frames) {
+  const unsigned chans = m_chanMap.m_channelCount;
+
+#if __SSE__
+  /* One sweep per group of four channels, each in its own lane: every sample is loaded once and
+   * feeds the peak, RMS, K-weighting and true-peak accumulators together */
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  const __m128 sb0 = _mm_set1_ps(m_shelf[0]), sb1 = _mm_set1_ps(m_shelf[1]), sb2 = _mm_set1_ps(m_shelf[2]);
+  const __m128 sa1 = _mm_set1_ps(m_shelf[3]), sa2 = _mm_set1_ps(m_shelf[4]);
+  const __m128 ha1 = _mm_set1_ps(m_highpass[3]), ha2 = _mm_set1_ps(m_highpass[4]);
+  const unsigned groups = (chans + 3) / 4;
+  for (unsigned g = 0; g < groups; ++g) {
+    const unsigned first = g * 4;
+    const unsigned lanes = std::min(chans - first, 4u);
+    __m128 s1 = _mm_load_ps(&m_kState[0][0][first]);
+    __m128 s2 = _mm_load_ps(&m_kState[0][1][first]);
+    __m128 h1 = _mm_load_ps(&m_kState[1][0][first]);
+    __m128 h2 = _mm_load_ps(&m_kState[1][1][first]);
+    __m128 peakAcc = _mm_setzero_ps();
+    __m128 sumAcc = _mm_setzero_ps();
+    __m128 kSumAcc = _mm_setzero_ps();
+    __m128 truePeakAcc = _mm_setzero_ps();
+    float (*history)[4] = m_truePeakHistory[g];
+    unsigned pos = m_truePeakPos;
+    alignas(16) float partial[4] = {};
+    for (size_t f = 0; f < frames; ++f) {
+      const float* frame = audio + f * chans + first;
+      __m128 x;
+      if (lanes == 4) {
+        x = _mm_loadu_ps(frame);
+      } else {
+        for (unsigned l = 0; l < lanes; ++l)
+          partial[l] = frame[l];
+        x = _mm_load_ps(partial);
+      }
+      peakAcc = _mm_max_ps(peakAcc, _mm_and_ps(x, absMask));
+      sumAcc = _mm_add_ps(sumAcc, _mm_mul_ps(x, x));
+
+      __m128 y = _mm_add_ps(_mm_mul_ps(sb0, x), s1);
+      s1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(sb1, x), _mm_mul_ps(sa1, y)), s2);
+      s2 = _mm_sub_ps(_mm_mul_ps(sb2, x), _mm_mul_ps(sa2, y));
+      /* High-pass numerator is 1, -2, 1 */
+      __m128 z = _mm_add_ps(y, h1);
+      h1 = _mm_sub_ps(_mm_sub_ps(h2, _mm_add_ps(y, y)), _mm_mul_ps(ha1, z));
+      h2 = _mm_sub_ps(y, _mm_mul_ps(ha2, z));
+      kSumAcc = _mm_add_ps(kSumAcc, _mm_mul_ps(z, z));
+
+      /* history[pos + 1 .. pos + TruePeakTaps] runs oldest to newest */
+      _mm_store_ps(history[pos], x);
+      _mm_store_ps(history[pos + TruePeakTaps], x);
+      const float(*newest)[4] = history + pos + TruePeakTaps;
+      for (unsigned p = 0; p < 4; ++p) {
+        __m128 v = _mm_mul_ps(_mm_load_ps(m_truePeakCoefs[p][0]), x);
+        for (unsigned k = 1; k < TruePeakTaps; ++k)
+          v = _mm_add_ps(v, _mm_mul_ps(_mm_load_ps(m_truePeakCoefs[p][k]), _mm_load_ps(newest[-int(k)])));
+        truePeakAcc = _mm_max_ps(truePeakAcc, _mm_and_ps(v, absMask));
+      }
+      if (++pos == TruePeakTaps)
+        pos = 0;
+    }
+
+    const __m128 tiny = _mm_set1_ps(DenormalThreshold);
+    s1 = _mm_and_ps(s1, _mm_cmpge_ps(_mm_and_ps(s1, absMask), tiny));
+    s2 = _mm_and_ps(s2, _mm_cmpge_ps(_mm_and_ps(s2, absMask), tiny));
+    h1 = _mm_and_ps(h1, _mm_cmpge_ps(_mm_and_ps(h1, absMask), tiny));
+    h2 = _mm_and_ps(h2, _mm_cmpge_ps(_mm_and_ps(h2, absMask), tiny));
+    _mm_store_ps(&m_kState[0][0][first], s1);
+    _mm_store_ps(&m_kState[0][1][first], s2);
+    _mm_store_ps(&m_kState[1][0][first], h1);
+    _mm_store_ps(&m_kState[1][1][first], h2);
+
+    alignas(16) float peaks[4], sums[4], kSums[4], truePeaks[4];
+    _mm_store_ps(peaks, peakAcc);
+    _mm_store_ps(sums, sumAcc);
+    _mm_store_ps(kSums, kSumAcc);
+    _mm_store_ps(truePeaks, truePeakAcc);
+    for (unsigned l = 0; l < lanes; ++l) {
+      m_peak[first + l] = std::max(m_peak[first + l], peaks[l]);
+      m_sumSquares[first + l] += sums[l];
+      m_kSumSquares[first + l] += kSums[l];
+      m_truePeak[first + l] = std::max(m_truePeak[first + l], truePeaks[l]);
+    }
+  }
+  m_truePeakPos = unsigned((m_truePeakPos + frames) % TruePeakTaps);
+#else
+  for (size_t f = 0; f < frames; ++f) {
+    for (unsigned c = 0; c < chans; ++c) {
+      float x = audio[f * chans + c];
+      m_peak[c] = std::max(m_peak[c], std::fabs(x));
+      m_sumSquares[c] += x * x;
+
+      float* s = m_kState[0][0] + c;
+      float* s2 = m_kState[0][1] + c;
+      float y = m_shelf[0] * x + *s;
+      *s = m_shelf[1] * x - m_shelf[3] * y + *s2;
+      *s2 = m_shelf[2] * x - m_shelf[4] * y;
+      float* h1 = m_kState[1][0] + c;
+      float* h2 = m_kState[1][1] + c;
+      float z = y + *h1;
+      *h1 = -2.f * y - m_highpass[3] * z + *h2;
+      *h2 = y - m_highpass[4] * z;
+      m_kSumSquares[c] += z * z;
+
+      float (*history)[4] = m_truePeakHistory[c / 4];
+      history[m_truePeakPos][c % 4] = history[m_truePeakPos + TruePeakTaps][c % 4] = x;
+      const float(*newest)[4] = history + m_truePeakPos + TruePeakTaps;
+      for (unsigned p = 0; p < 4; ++p) {
+        float v = 0.f;
+        for (unsigned k = 0; k < TruePeakTaps; ++k)
+          v += m_truePeakCoefs[p][k][0] * newest[-int(k)][c % 4];
+        m_truePeak[c] = std::max(m_truePeak[c], std::fabs(v));
+      }
+    }
+    if (++m_truePeakPos == TruePeakTaps)
+      m_truePeakPos = 0;
+  }
+  for (unsigned c = 0; c < chans; ++c)
+    for (unsigned i = 0; i < 2; ++i)
+      for (unsigned j = 0; j < 2; ++j)
+        if (std::fabs(m_kState[i][j][c]) < DenormalThreshold)
+          m_kState[i][j][c] = 0.f;
+#endif
+}
+
+void MeterProcessing::_FinishBlock() {
+  const unsigned chans = m_chanMap.m_channelCount;
+  const unsigned momentarySlot = m_blocksSeen % MomentaryBlocks;
+  double power = 0.0;
+  for (unsigned c = 0; c < chans; ++c) {
+    m_blockPeak[momentarySlot][c] = m_peak[c];
+    m_blockTruePeak[momentarySlot][c] = std::max(m_truePeak[c], m_peak[c]);
+    m_blockSumSquares[momentarySlot][c] = m_sumSquares[c];
+    power += m_loudnessWeights[c] * m_kSumSquares[c];
+    m_peak[c] = 0.f;
+    m_truePeak[c] = 0.f;
+    m_sumSquares[c] = 0.0;
+    m_kSumSquares[c] = 0.0;
+  }
+  m_blockLoudness[m_blocksSeen % ShortTermBlocks] = power / double(m_blockFrames);
+  m_blockPos = 0;
+  ++m_blocksSeen;
+
+  /* Slots not yet filled since the reset are zero, so plain sums over the rings suffice */
+  const unsigned momentaryCount = std::min(m_blocksSeen, MomentaryBlocks);
+  const unsigned shortTermCount = std::min(m_blocksSeen, ShortTermBlocks);
+  AudioMeterReading reading;
+  for (unsigned c = 0; c < chans; ++c) {
+    float peak = 0.f;
+    float truePeak = 0.f;
+    double sumSquares = 0.0;
+    for (unsigned b = 0; b < MomentaryBlocks; ++b) {
+      peak = std::max(peak, m_blockPeak[b][c]);
+      truePeak = std::max(truePeak, m_blockTruePeak[b][c]);
+      sumSquares += m_blockSumSquares[b][c];
+    }
+    auto chan = size_t(m_chanMap.m_channels[c]);
+    if (chan >= MaxChannels)
+      continue; /* AudioChannel::Unknown */
+    reading.m_peak[chan] = peak;
+    reading.m_truePeak[chan] = truePeak;
+    reading.m_rms[chan] = float(std::sqrt(sumSquares / double(momentaryCount * m_blockFrames)));
+  }
+  double momentary = 0.0;
+  for (unsigned b = 0; b < momentaryCount; ++b)
+    momentary += m_blockLoudness[(m_blocksSeen - 1 - b) % ShortTermBlocks];
+  double shortTerm = std::accumulate(std::begin(m_blockLoudness), std::end(m_blockLoudness), 0.0);
+  reading.m_momentaryLUFS = ToLUFS(momentary / momentaryCount);
+  reading.m_shortTermLUFS = ToLUFS(shortTerm / shortTermCount);
+  _Publish(reading);
+}
+
+void MeterProcessing::_Publish(const AudioMeterReading& reading) {
+  uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+  m_sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  size_t i = 0;
+  for (float v : reading.m_peak)
+    m_published[i++].store(v, std::memory_order_relaxed);
+  for (float v : reading.m_truePeak)
+    m_published[i++].store(v, std::memory_order_relaxed);
+  for (float v : reading.m_rms)
+    m_published[i++].store(v, std::memory_order_relaxed);
+  m_published[i++].store(reading.m_momentaryLUFS, std::memory_order_relaxed);
+  m_published[i++].store(reading.m_shortTermLUFS, std::memory_order_relaxed);
+  m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+AudioMeterReading MeterProcessing::Read() const {
+  AudioMeterReading reading;
+  for (;;) {
+    uint32_t sequence = m_sequence.load(std::memory_order_acquire);
+    if (sequence & 1)
+      continue;
+    size_t i = 0;
+    for (float& v : reading.m_peak)
+      v = m_published[i++].load(std::memory_order_relaxed);
+    for (float& v : reading.m_truePeak)
+      v = m_published[i++].load(std::memory_order_relaxed);
+    for (float& v : reading.m_rms)
+      v = m_published[i++].load(std::memory_order_relaxed);
+    reading.m_momentaryLUFS = m_published[i++].load(std::memory_order_relaxed);
+    reading.m_shortTermLUFS = m_published[i++].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m_sequence.load(std::memory_order_relaxed) == sequence)
+      return reading;
+  }
+}
+
+} // namespace boo2
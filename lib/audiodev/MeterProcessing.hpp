@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "boo2/audiodev/AudioMeter.hpp"
+#include "boo2/audiodev/IAudioVoice.hpp"
+
+namespace boo2 {
+
+/** Peak, true-peak, RMS and BS.1770 loudness of an interleaved bus, measured in 100ms gating
+ *  blocks. The mixing thread calls Process() on each finished interval; all state is fixed-size,
+ *  so enabling, rate and layout changes never allocate. Readings are published through a
+ *  sequence lock: Read() retries instead of blocking the mixer */
+class MeterProcessing {
+public:
+  static constexpr unsigned MaxChannels = 8;
+  /* 4x oversampling interpolator for true peak, TruePeakTaps taps per phase */
+  static constexpr unsigned TruePeakTaps = 12;
+  /* Gating blocks of 100ms in the momentary (400ms) and short-term (3s) windows */
+  static constexpr unsigned MomentaryBlocks = 4;
+  static constexpr unsigned ShortTermBlocks = 30;
+
+private:
+  std::atomic<bool> m_enabled = false;
+  std::atomic<bool> m_resetRequested = false;
+
+  double m_sampleRate = 0.0;
+  ChannelMap m_chanMap;
+  float m_loudnessWeights[MaxChannels];
+
+  /* Direct-form II transposed K-weighting stages: b0, b1, b2, a1, a2 */
+  float m_shelf[5];
+  float m_highpass[5];
+  /* Per-channel filter state, [stage][s1/s2][channel] */
+  alignas(16) float m_kState[2][2][MaxChannels];
+
+  /* Coefficients by phase and tap, each repeated across a vector's four lanes */
+  alignas(16) float m_truePeakCoefs[4][TruePeakTaps][4];
+  /* Input history by group of four channels, one lane each, stored twice so the newest
+   * TruePeakTaps frames are contiguous */
+  alignas(16) float m_truePeakHistory[MaxChannels / 4][TruePeakTaps * 2][4];
+  unsigned m_truePeakPos = 0;
+
+  /* Gating block in progress */
+  size_t m_blockFrames = 0;
+  size_t m_blockPos = 0;
+  float m_peak[MaxChannels];
+  float m_truePeak[MaxChannels];
+  double m_sumSquares[MaxChannels];
+  double m_kSumSquares[MaxChannels];
+
+  /* Completed gating blocks, newest at m_blockIndex */
+  float m_blockPeak[MomentaryBlocks][MaxChannels];
+  float m_blockTruePeak[MomentaryBlocks][MaxChannels];
+  double m_blockSumSquares[MomentaryBlocks][MaxChannels];
+  double m_blockLoudness[ShortTermBlocks];
+  unsigned m_blockIndex = 0;
+  unsigned m_blocksSeen = 0;
+
+  /* Published reading: odd m_sequence while a write is in progress */
+  static constexpr size_t PublishedFields = MaxChannels * 3 + 2;
+  std::atomic<uint32_t> m_sequence = 0;
+  std::array<std::atomic<float>, PublishedFields> m_published;
+
+  void _Reset(const ChannelMap& chanMap, double sampleRate);
+  void _Measure(const float* audio, size_t frames);
+  void _FinishBlock();
+  void _Publish(const AudioMeterReading& reading);
+
+public:
+  MeterProcessing();
+
+  /** Start (reset) or stop metering; callable from any thread */
+  void Enable(bool enable);
+  bool Enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+  /** Measure interleaved frames; mixing thread only */
+  void Process(const float* audio, size_t frames, const ChannelMap& chanMap, double sampleRate);
+
+  /** Latest published reading; callable from any thread */
+  AudioMeterReading Read() const;
+};
+
+} // namespace boo2
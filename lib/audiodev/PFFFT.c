@@ -0,0 +1,111 @@
+/* Exposes the pffft implementation vendored with soxr to the rest of boo2.
+ * soxr compiles pffft with internal linkage, so it is instantiated once more here. */
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(i386) || defined(_M_IX86)
+/* SSE path; soxr's aligned allocators are linked in */
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+/* NEON path; AArch64 malloc already returns the 16-byte alignment v4sf needs,
+ * and soxr's SIMD helpers are absent on some ARM targets (NX, iOS) */
+#define _soxr_simd_aligned_free free
+#define _soxr_simd_aligned_malloc malloc
+#define _soxr_simd_aligned_calloc calloc
+#else
+/* 32-bit ARM and everything else use scalar pffft */
+#define _soxr_simd_aligned_free free
+#define _soxr_simd_aligned_malloc malloc
+#define _soxr_simd_aligned_calloc calloc
+#define PFFFT_SIMD_DISABLE
+#endif
+
+#include "pffft.c"
+#include "PFFFT.h"
+
+BooPFFFTSetup* boo2_pffft_new_real_setup(int n) { return (BooPFFFTSetup*)pffft_new_setup(n, PFFFT_REAL); }
+
+void boo2_pffft_destroy_setup(BooPFFFTSetup* setup) { pffft_destroy_setup((PFFFT_Setup*)setup); }
+
+void boo2_pffft_forward(BooPFFFTSetup* setup, const float* input, float* output, float* work) {
+  pffft_transform((PFFFT_Setup*)setup, input, output, work, PFFFT_FORWARD);
+}
+
+void boo2_pffft_backward(BooPFFFTSetup* setup, const float* input, float* output, float* work) {
+  pffft_transform((PFFFT_Setup*)setup, input, output, work, PFFFT_BACKWARD);
+}
+
+void boo2_pffft_zconvolve(BooPFFFTSetup* setup, const float* a, const float* b, float* ab) {
+  pffft_zconvolve((PFFFT_Setup*)setup, a, b, ab);
+}
+
+/* soxr compiles pffft_zconvolve_accumulate out; this is upstream's portable variant of it */
+void boo2_pffft_zconvolve_accumulate(BooPFFFTSetup* setup, const float* a, const float* b, float* ab, float scaling) {
+  PFFFT_Setup* s = (PFFFT_Setup*)setup;
+  int i, Ncvec = s->Ncvec;
+#ifndef PFFFT_SIMD_DISABLE
+  const v4sf* va = (const v4sf*)a;
+  const v4sf* vb = (const v4sf*)b;
+  v4sf* vab = (v4sf*)ab;
+  v4sf vscal = LD_PS1(scaling);
+  /* Real transforms pack the DC and Nyquist terms into the first lane */
+  float ar0 = ((const v4sf_union*)va)[0].f[0];
+  float ai0 = ((const v4sf_union*)va)[1].f[0];
+  float br0 = ((const v4sf_union*)vb)[0].f[0];
+  float bi0 = ((const v4sf_union*)vb)[1].f[0];
+  float abr0 = ((v4sf_union*)vab)[0].f[0];
+  float abi0 = ((v4sf_union*)vab)[1].f[0];
+  for (i = 0; i < Ncvec; i += 2) {
+    v4sf ar, ai, br, bi;
+    ar = va[2 * i + 0];
+    ai = va[2 * i + 1];
+    br = vb[2 * i + 0];
+    bi = vb[2 * i + 1];
+    VCPLXMUL(ar, ai, br, bi);
+    vab[2 * i + 0] = VMADD(ar, vscal, vab[2 * i + 0]);
+    vab[2 * i + 1] = VMADD(ai, vscal, vab[2 * i + 1]);
+    ar = va[2 * i + 2];
+    ai = va[2 * i + 3];
+    br = vb[2 * i + 2];
+    bi = vb[2 * i + 3];
+    VCPLXMUL(ar, ai, br, bi);
+    vab[2 * i + 2] = VMADD(ar, vscal, vab[2 * i + 2]);
+    vab[2 * i + 3] = VMADD(ai, vscal, vab[2 * i + 3]);
+  }
+  ((v4sf_union*)vab)[0].f[0] = abr0 + ar0 * br0 * scaling;
+  ((v4sf_union*)vab)[1].f[0] = abi0 + ai0 * bi0 * scaling;
+#else
+  /* fftpack ordering: DC first, Nyquist last */
+  ab[0] += a[0] * b[0] * scaling;
+  ab[2 * Ncvec - 1] += a[2 * Ncvec - 1] * b[2 * Ncvec - 1] * scaling;
+  ++ab;
+  ++a;
+  ++b;
+  --Ncvec;
+  for (i = 0; i < Ncvec; ++i) {
+    float ar = a[2 * i + 0], ai = a[2 * i + 1];
+    float br = b[2 * i + 0], bi = b[2 * i + 1];
+    VCPLXMUL(ar, ai, br, bi);
+    ab[2 * i + 0] += ar * scaling;
+    ab[2 * i + 1] += ai * scaling;
+  }
+#endif
+}
+
+float* boo2_pffft_aligned_alloc(size_t count) { return (float*)pffft_aligned_calloc(count, sizeof(float)); }
+
+void boo2_pffft_aligned_free(float* ptr) { pffft_aligned_free(ptr); }
+
+int boo2_pffft_next_size(int minSize) {
+  /* Real transforms need N = 32 * 2^a * 3^b */
+  int best = 0;
+  int p3 = 32;
+  for (;;) {
+    int n = p3;
+    while (n < minSize)
+      n *= 2;
+    if (!best || n < best)
+      best = n;
+    if (p3 >= minSize)
+      break;
+    p3 *= 3;
+  }
+  return best;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Opaque handle to a pffft real-transform setup (twiddles are read-only after creation) */
+typedef struct BooPFFFTSetup BooPFFFTSetup;
+
+/** Create setup for real transforms of length n (use boo2_pffft_next_size for a valid n) */
+BooPFFFTSetup* boo2_pffft_new_real_setup(int n);
+void boo2_pffft_destroy_setup(BooPFFFTSetup* setup);
+
+/** Unordered (internal z-domain layout) transforms; backward is not scaled by 1/n.
+ *  All buffers must come from boo2_pffft_aligned_alloc and input/output may alias. */
+void boo2_pffft_forward(BooPFFFTSetup* setup, const float* input, float* output, float* work);
+void boo2_pffft_backward(BooPFFFTSetup* setup, const float* input, float* output, float* work);
+
+/** ab = a * b for spectra produced by boo2_pffft_forward */
+void boo2_pffft_zconvolve(BooPFFFTSetup* setup, const float* a, const float* b, float* ab);
+
+/** ab += a * b * scaling for spectra produced by boo2_pffft_forward */
+void boo2_pffft_zconvolve_accumulate(BooPFFFTSetup* setup, const float* a, const float* b, float* ab, float scaling);
+
+/** Zero-initialized, SIMD-aligned float storage */
+float* boo2_pffft_aligned_alloc(size_t count);
+void boo2_pffft_aligned_free(float* ptr);
+
+/** Smallest supported real-transform length >= minSize */
+int boo2_pffft_next_size(int minSize);
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,13 +2,21 @@
 
 #include "LinuxMidi.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
 #include <logvisor/logvisor.hpp>
 #include <pulse/pulseaudio.h>
 #include <unistd.h>
 
 namespace boo2 {
+#ifndef M_PI
+#define M_PI 3.14159265358979323846 /* pi */
+#endif
+
 static logvisor::Module Log("boo::PulseAudio");
-logvisor::Module ALSALog("boo::ALSA");
 
 static const uint64_t StereoChans = (1 << PA_CHANNEL_POSITION_FRONT_LEFT) | (1 << PA_CHANNEL_POSITION_FRONT_RIGHT);
 
@@ -24,33 +32,96 @@ static const uint64_t S71Chans = (1 << PA_CHANNEL_POSITION_FRONT_LEFT) | (1 << P
                                  (1 << PA_CHANNEL_POSITION_FRONT_CENTER) | (1 << PA_CHANNEL_POSITION_LFE) |
                                  (1 << PA_CHANNEL_POSITION_SIDE_LEFT) | (1 << PA_CHANNEL_POSITION_SIDE_RIGHT);
 
+/* Legacy buffering when no target latency is requested */
+static constexpr double DefaultBufferMs = 120.0;
+
+/* Ceiling for adaptive growth */
+static constexpr double MaxAdaptiveBufferMs = 200.0;
+
+/* Seconds without underflow before the adaptive controller gives back one period */
+static constexpr unsigned AdaptiveShrinkSeconds = 10;
+
+/* Periods the old and new outputs overlap when switching sinks */
+static constexpr size_t CrossfadePeriods = 2;
+
 struct PulseAudioVoiceEngine : LinuxMidi {
   pa_mainloop* m_mainloop = nullptr;
+  pa_threaded_mainloop* m_threadedMainloop = nullptr;
   pa_context* m_ctx = nullptr;
   pa_stream* m_stream = nullptr;
   std::string m_sinkName;
-  bool m_handleMove = false;
+  bool m_mixerThreadSetup = false;
+  pa_stream_flags_t m_streamFlags = PA_STREAM_NOFLAGS;
+
+  /* Sink switching: the new stream connects while m_stream keeps playing, then the mixer
+   * crossfades onto it once ready; the old stream drains its tail in the background */
+  pa_stream* m_pendingStream = nullptr;
+  std::string m_pendingSinkName;
+  pa_stream* m_retiringStream = nullptr;
+  /* Silence to align the new output with the old one's queue, then the crossfade block */
+  std::vector<float> m_crossfadeBuf;
+  std::vector<float> m_fadeOutBuf;
+  size_t m_primeFrames = 0;
   pa_sample_spec m_sampleSpec = {};
   pa_channel_map m_chanMap = {};
 
+  /* Output buffer sizing in bytes; m_tlength moves between the bounds when adaptive */
+  uint32_t m_tlength = 0;
+  uint32_t m_minTlength = 0;
+  uint32_t m_maxTlength = 0;
+  unsigned m_underflows = 0;
+  size_t m_framesSinceUnderflow = 0;
+  std::atomic<double> m_outputLatency = 0.0;
+
+  /* Scoped lock of the threaded mainloop; no-op when driving a blocking pa_mainloop */
+  class PALock {
+    pa_threaded_mainloop* m_ml;
+
+  public:
+    explicit PALock(pa_threaded_mainloop* ml) : m_ml(ml) {
+      if (m_ml)
+        pa_threaded_mainloop_lock(m_ml);
+    }
+    ~PALock() {
+      if (m_ml)
+        pa_threaded_mainloop_unlock(m_ml);
+    }
+    PALock(const PALock&) = delete;
+    PALock& operator=(const PALock&) = delete;
+  };
+
+  static void _signalMainloop(void* obj, pa_threaded_mainloop* ml) { pa_threaded_mainloop_signal(ml, 0); }
+
+  /* Blocks until the server makes progress; in threaded mode the lock must be held */
+  int _paWait() const {
+    int retval = 0;
+    if (m_threadedMainloop)
+      pa_threaded_mainloop_wait(m_threadedMainloop);
+    else
+      pa_mainloop_iterate(m_mainloop, 1, &retval);
+    return retval;
+  }
+
   int _paWaitReady() {
     int retval = 0;
     while (pa_context_get_state(m_ctx) < PA_CONTEXT_READY)
-      pa_mainloop_iterate(m_mainloop, 1, &retval);
+      retval = _paWait();
     return retval;
   }
 
   int _paStreamWaitReady() {
     int retval = 0;
     while (pa_stream_get_state(m_stream) < PA_STREAM_READY)
-      pa_mainloop_iterate(m_mainloop, 1, &retval);
+      retval = _paWait();
     return retval;
   }
 
   int _paIterate(pa_operation* op) const {
+    if (m_threadedMainloop)
+      pa_operation_set_state_callback(op, pa_operation_notify_cb_t(_signalMainloop), m_threadedMainloop);
     int retval = 0;
     while (pa_operation_get_state(op) == PA_OPERATION_RUNNING)
-      pa_mainloop_iterate(m_mainloop, 1, &retval);
+      retval = _paWait();
     return retval;
   }
 
@@ -72,34 +143,56 @@ struct PulseAudioVoiceEngine : LinuxMidi {
       goto err;
     }
 
-    m_5msFrames = m_sampleSpec.rate * 5 / 1000;
+    _setBlockFrames(m_sampleSpec.rate);
 
     m_mixInfo.m_sampleRate = m_sampleSpec.rate;
     m_mixInfo.m_bitsPerSample = 32;
-    m_mixInfo.m_periodFrames = m_5msFrames;
+    m_mixInfo.m_periodFrames = m_blockFrames;
     if (!(m_stream = pa_stream_new(m_ctx, "master", &m_sampleSpec, &m_chanMap))) {
       Log.report(logvisor::Error, FMT_STRING("Unable to pa_stream_new(): {}"), pa_strerror(pa_context_errno(m_ctx)));
       goto err;
     }
 
-    pa_buffer_attr bufAttr;
-    bufAttr.minreq = uint32_t(m_5msFrames * m_sampleSpec.channels * sizeof(float));
-    bufAttr.maxlength = bufAttr.minreq * 24;
-    bufAttr.tlength = bufAttr.maxlength;
-    bufAttr.prebuf = UINT32_MAX;
-    bufAttr.fragsize = UINT32_MAX;
+    if (m_threadedMainloop) {
+      pa_stream_set_state_callback(m_stream, pa_stream_notify_cb_t(_signalMainloop), m_threadedMainloop);
+      pa_stream_set_write_callback(m_stream, pa_stream_request_cb_t(_streamWriteRequest), this);
+    }
 
-    if (pa_stream_connect_playback(m_stream, m_sinkName.c_str(), &bufAttr,
-                                   pa_stream_flags_t(PA_STREAM_START_UNMUTED | PA_STREAM_EARLY_REQUESTS), nullptr,
-                                   nullptr)) {
-      Log.report(logvisor::Error, FMT_STRING("Unable to pa_stream_connect_playback()"));
-      goto err;
+    pa_stream_set_underflow_callback(m_stream, pa_stream_notify_cb_t(_streamUnderflow), this);
+
+    {
+      int flags = PA_STREAM_START_UNMUTED | PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE;
+      uint32_t periodSz = _periodBytes();
+      if (m_options.m_targetLatencyMs > 0.0) {
+        m_minTlength = _periodsForMs(m_options.m_targetLatencyMs) * periodSz;
+        m_maxTlength = std::max(m_minTlength, _periodsForMs(MaxAdaptiveBufferMs) * periodSz);
+        flags |= PA_STREAM_ADJUST_LATENCY;
+      } else {
+        m_minTlength = _periodsForMs(DefaultBufferMs) * periodSz;
+        m_maxTlength = m_options.m_adaptiveLatency ? _periodsForMs(MaxAdaptiveBufferMs) * periodSz : m_minTlength;
+        flags |= PA_STREAM_EARLY_REQUESTS;
+      }
+      m_tlength = m_minTlength;
+      m_underflows = 0;
+      m_framesSinceUnderflow = 0;
+      m_streamFlags = pa_stream_flags_t(flags);
+
+      pa_buffer_attr bufAttr = _bufferAttr();
+      if (pa_stream_connect_playback(m_stream, m_sinkName.c_str(), &bufAttr, pa_stream_flags_t(flags), nullptr,
+                                     nullptr)) {
+        Log.report(logvisor::Error, FMT_STRING("Unable to pa_stream_connect_playback()"));
+        goto err;
+      }
     }
 
     pa_stream_set_moved_callback(m_stream, pa_stream_notify_cb_t(_streamMoved), this);
 
     _paStreamWaitReady();
 
+    /* The server may round the request; adapt from what was actually granted */
+    if (const pa_buffer_attr* attr = pa_stream_get_buffer_attr(m_stream))
+      m_tlength = attr->tlength;
+
     _resetSampleRate();
     return true;
   err:
@@ -111,24 +204,52 @@ struct PulseAudioVoiceEngine : LinuxMidi {
     return false;
   }
 
-  PulseAudioVoiceEngine() {
-    if (!(m_mainloop = pa_mainloop_new())) {
-      Log.report(logvisor::Error, FMT_STRING("Unable to pa_mainloop_new()"));
-      return;
+  explicit PulseAudioVoiceEngine(const AudioVoiceEngineOptions& options) : LinuxMidi(options) {
+    pa_mainloop_api* mlApi;
+    if (m_options.m_threadedMixing) {
+      if (!(m_threadedMainloop = pa_threaded_mainloop_new())) {
+        Log.report(logvisor::Error, FMT_STRING("Unable to pa_threaded_mainloop_new()"));
+        return;
+      }
+      if (pa_threaded_mainloop_start(m_threadedMainloop)) {
+        Log.report(logvisor::Error, FMT_STRING("Unable to pa_threaded_mainloop_start()"));
+        pa_threaded_mainloop_free(m_threadedMainloop);
+        m_threadedMainloop = nullptr;
+        return;
+      }
+      mlApi = pa_threaded_mainloop_get_api(m_threadedMainloop);
+    } else {
+      if (!(m_mainloop = pa_mainloop_new())) {
+        Log.report(logvisor::Error, FMT_STRING("Unable to pa_mainloop_new()"));
+        return;
+      }
+      mlApi = pa_mainloop_get_api(m_mainloop);
     }
 
-    pa_mainloop_api* mlApi = pa_mainloop_get_api(m_mainloop);
+    bool connected;
+    {
+      PALock lk(m_threadedMainloop);
+      connected = _connectContext(mlApi);
+    }
+    if (!connected)
+      _freeMainloop();
+  }
+
+  bool _connectContext(pa_mainloop_api* mlApi) {
     pa_proplist* propList = pa_proplist_new();
     // TODO: boo2
     pa_proplist_sets(propList, PA_PROP_APPLICATION_ICON_NAME, "APP->getUniqueName().data()");
     pa_proplist_sets(propList, PA_PROP_APPLICATION_PROCESS_ID, fmt::format(FMT_STRING("{}"), int(getpid())).c_str());
-    if (!(m_ctx = pa_context_new_with_proplist(mlApi, "APP->getFriendlyName().data()", propList))) {
+    m_ctx = pa_context_new_with_proplist(mlApi, "APP->getFriendlyName().data()", propList);
+    pa_proplist_free(propList);
+    if (!m_ctx) {
       Log.report(logvisor::Error, FMT_STRING("Unable to pa_context_new_with_proplist()"));
-      pa_mainloop_free(m_mainloop);
-      m_mainloop = nullptr;
-      return;
+      return false;
     }
 
+    if (m_threadedMainloop)
+      pa_context_set_state_callback(m_ctx, pa_context_notify_cb_t(_signalMainloop), m_threadedMainloop);
+
     pa_operation* op;
 
     if (pa_context_connect(m_ctx, nullptr, PA_CONTEXT_NOFLAGS, nullptr)) {
@@ -145,34 +266,117 @@ struct PulseAudioVoiceEngine : LinuxMidi {
     if (!_setupSink())
       goto err;
 
-    return;
+    return true;
   err:
     pa_context_disconnect(m_ctx);
     pa_context_unref(m_ctx);
     m_ctx = nullptr;
-    pa_mainloop_free(m_mainloop);
-    m_mainloop = nullptr;
+    return false;
   }
 
-  ~PulseAudioVoiceEngine() override {
-    if (m_stream) {
-      pa_stream_disconnect(m_stream);
-      pa_stream_unref(m_stream);
-    }
-    if (m_ctx) {
-      pa_context_disconnect(m_ctx);
-      pa_context_unref(m_ctx);
+  void _freeMainloop() {
+    if (m_threadedMainloop) {
+      pa_threaded_mainloop_stop(m_threadedMainloop);
+      pa_threaded_mainloop_free(m_threadedMainloop);
+      m_threadedMainloop = nullptr;
     }
     if (m_mainloop) {
       pa_mainloop_free(m_mainloop);
+      m_mainloop = nullptr;
     }
   }
 
+  static void _releaseStream(pa_stream*& stream) {
+    if (stream) {
+      pa_stream_disconnect(stream);
+      pa_stream_unref(stream);
+      stream = nullptr;
+    }
+  }
+
+  ~PulseAudioVoiceEngine() override {
+    {
+      PALock lk(m_threadedMainloop);
+      _releaseStream(m_stream);
+      _releaseStream(m_pendingStream);
+      _releaseStream(m_retiringStream);
+      if (m_ctx) {
+        pa_context_disconnect(m_ctx);
+        pa_context_unref(m_ctx);
+        m_ctx = nullptr;
+      }
+    }
+    _freeMainloop();
+  }
+
+  /* The server moved the stream and converts for the new sink itself, so playback carries on */
   static void _streamMoved(pa_stream* p, PulseAudioVoiceEngine* userdata) {
-    userdata->m_sinkName = pa_stream_get_device_name(p);
-    userdata->m_handleMove = true;
+    if (p == userdata->m_stream)
+      userdata->m_sinkName = pa_stream_get_device_name(p);
+  }
+
+  static void _streamUnderflow(pa_stream* p, PulseAudioVoiceEngine* userdata) {
+    if (p == userdata->m_stream)
+      ++userdata->m_underflows;
+  }
+
+  uint32_t _periodBytes() const { return uint32_t(m_blockFrames * m_sampleSpec.channels * sizeof(float)); }
+
+  /* Whole periods only, and at least two so one can be mixed while the other plays */
+  uint32_t _periodsForMs(double ms) const {
+    double frames = ms * m_sampleSpec.rate / 1000.0;
+    return std::max(uint32_t(std::ceil(frames / m_blockFrames)), 2u);
+  }
+
+  pa_buffer_attr _bufferAttr() const {
+    pa_buffer_attr bufAttr;
+    bufAttr.minreq = _periodBytes();
+    bufAttr.maxlength = m_maxTlength;
+    bufAttr.tlength = m_tlength;
+    bufAttr.prebuf = UINT32_MAX;
+    bufAttr.fragsize = UINT32_MAX;
+    return bufAttr;
+  }
+
+  void _setTlength(uint32_t tlength) {
+    m_tlength = tlength;
+    pa_buffer_attr bufAttr = _bufferAttr();
+    /* Completion isn't waited on; this may run inside a write callback */
+    if (pa_operation* op = pa_stream_set_buffer_attr(m_stream, &bufAttr, nullptr, nullptr))
+      pa_operation_unref(op);
+  }
+
+  /* Runs after each write on the thread servicing the stream */
+  void _updateLatency(size_t framesWritten) {
+    if (m_options.m_adaptiveLatency) {
+      uint32_t periodSz = _periodBytes();
+      if (m_underflows) {
+        m_underflows = 0;
+        m_framesSinceUnderflow = 0;
+        if (m_tlength < m_maxTlength) {
+          uint32_t grow = std::max(m_tlength / periodSz / 2, 1u) * periodSz;
+          _setTlength(std::min(m_tlength + grow, m_maxTlength));
+          RealtimeReport(Log, logvisor::Info, FMT_STRING("Output underflow; buffering raised to {}ms"),
+                         pa_bytes_to_usec(m_tlength, &m_sampleSpec) / PA_USEC_PER_MSEC);
+        }
+      } else {
+        m_framesSinceUnderflow += framesWritten;
+        if (m_framesSinceUnderflow >= size_t(m_sampleSpec.rate) * AdaptiveShrinkSeconds &&
+            m_tlength >= m_minTlength + periodSz) {
+          m_framesSinceUnderflow = 0;
+          _setTlength(m_tlength - periodSz);
+        }
+      }
+    }
+
+    pa_usec_t usec;
+    int negative;
+    if (!pa_stream_get_latency(m_stream, &usec, &negative))
+      m_outputLatency.store(negative ? 0.0 : usec / 1000000.0, std::memory_order_relaxed);
   }
 
+  double getOutputLatency() const override { return m_outputLatency.load(std::memory_order_relaxed); }
+
   static void _getServerInfoReply(pa_context* c, const pa_server_info* i, PulseAudioVoiceEngine* userdata) {
     userdata->m_sinkName = i->default_sink_name;
   }
@@ -271,6 +475,7 @@ struct PulseAudioVoiceEngine : LinuxMidi {
       userdata->m_sinks.push_back(std::make_pair(i->name, i->description));
   }
   std::vector<std::pair<std::string, std::string>> enumerateAudioOutputs() const override {
+    PALock lk(m_threadedMainloop);
     pa_operation* op = pa_context_get_sink_info_list(m_ctx, pa_sink_info_cb_t(_getSinkInfoListReply), (void*)this);
     _paIterate(op);
     pa_operation_unref(op);
@@ -279,80 +484,232 @@ struct PulseAudioVoiceEngine : LinuxMidi {
     return ret;
   }
 
-  std::string getCurrentAudioOutput() const override { return m_sinkName; }
+  std::string getCurrentAudioOutput() const override {
+    PALock lk(m_threadedMainloop);
+    return m_sinkName;
+  }
 
   bool m_sinkOk = false;
   static void _checkAudioSinkReply(pa_context* c, const pa_sink_info* i, int eol, PulseAudioVoiceEngine* userdata) {
     if (i)
       userdata->m_sinkOk = true;
   }
+  /* Playback continues on the current sink until the new stream is ready; getCurrentAudioOutput()
+   * reports the new sink once the mixer has crossfaded onto it */
   bool setCurrentAudioOutput(const char* name) override {
+    PALock lk(m_threadedMainloop);
     m_sinkOk = false;
     pa_operation* op;
     op = pa_context_get_sink_info_by_name(m_ctx, name, pa_sink_info_cb_t(_checkAudioSinkReply), this);
     _paIterate(op);
     pa_operation_unref(op);
-    if (m_sinkOk) {
+    if (!m_sinkOk)
+      return false;
+    if (m_stream && !m_pendingStream && m_sinkName == name)
+      return true;
+    if (!m_stream) {
       m_sinkName = name;
       return _setupSink();
     }
-    return false;
+    return _openPendingStream(name);
+  }
+
+  /* Connect a stream to the named sink in the current mix format, leaving any conversion to the
+   * server so the mixer never reconfigures mid-switch. Doesn't wait for it to become ready */
+  bool _openPendingStream(const char* name) {
+    _releaseStream(m_pendingStream);
+    if (!(m_pendingStream = pa_stream_new(m_ctx, "master", &m_sampleSpec, &m_chanMap))) {
+      Log.report(logvisor::Error, FMT_STRING("Unable to pa_stream_new(): {}"), pa_strerror(pa_context_errno(m_ctx)));
+      return false;
+    }
+
+    pa_stream_set_state_callback(m_pendingStream, pa_stream_notify_cb_t(_pendingStreamState), this);
+    if (m_threadedMainloop)
+      pa_stream_set_write_callback(m_pendingStream, pa_stream_request_cb_t(_streamWriteRequest), this);
+    pa_stream_set_underflow_callback(m_pendingStream, pa_stream_notify_cb_t(_streamUnderflow), this);
+    pa_stream_set_moved_callback(m_pendingStream, pa_stream_notify_cb_t(_streamMoved), this);
+
+    pa_buffer_attr bufAttr = _bufferAttr();
+    if (pa_stream_connect_playback(m_pendingStream, name, &bufAttr, m_streamFlags, nullptr, nullptr)) {
+      Log.report(logvisor::Error, FMT_STRING("Unable to pa_stream_connect_playback()"));
+      pa_stream_unref(m_pendingStream);
+      m_pendingStream = nullptr;
+      return false;
+    }
+    m_pendingSinkName = name;
+
+    /* Staging for the switch, sized here so the mixer doesn't allocate; the silence stays zeroed */
+    size_t chanCount = m_mixInfo.m_channelMap.m_channelCount;
+    m_primeFrames = m_maxTlength / _periodBytes() * m_mixInfo.m_periodFrames;
+    m_crossfadeBuf.assign((m_primeFrames + CrossfadePeriods * m_mixInfo.m_periodFrames) * chanCount, 0.f);
+    m_fadeOutBuf.assign(CrossfadePeriods * m_mixInfo.m_periodFrames * chanCount, 0.f);
+    return true;
+  }
+
+  /* Runs on the thread servicing the streams, which the mixer shares */
+  static void _pendingStreamState(pa_stream* p, PulseAudioVoiceEngine* userdata) {
+    if (p != userdata->m_pendingStream)
+      return;
+    pa_stream_state_t st = pa_stream_get_state(p);
+    if (st == PA_STREAM_FAILED || st == PA_STREAM_TERMINATED) {
+      RealtimeReport(Log, logvisor::Error, FMT_STRING("Unable to open stream on {}; staying on {}"),
+                     userdata->m_pendingSinkName.c_str(), userdata->m_sinkName.c_str());
+      pa_stream_unref(p);
+      userdata->m_pendingStream = nullptr;
+    }
+  }
+
+  static void _retiredStreamDrained(pa_stream* p, int success, PulseAudioVoiceEngine* userdata) {
+    if (p == userdata->m_retiringStream)
+      _releaseStream(userdata->m_retiringStream);
+  }
+
+  /* Mix one block for both streams, fading the old out and the new in (equal power, as the two
+   * outputs don't sum), then make the new stream current and let the old one play out */
+  void _crossfadeToPendingStream(size_t writableSz) {
+    size_t chanCount = m_mixInfo.m_channelMap.m_channelCount;
+    size_t frameSz = chanCount * sizeof(float);
+    size_t periodFrames = m_mixInfo.m_periodFrames;
+    size_t newPeriods = pa_stream_writable_size(m_pendingStream) / (periodFrames * frameSz);
+    size_t fadePeriods = std::min({writableSz / (periodFrames * frameSz), newPeriods, CrossfadePeriods});
+    if (!fadePeriods)
+      return;
+
+    /* Delay the fade-in on the new sink by what the old one still has queued */
+    size_t primeFrames = 0;
+    pa_usec_t usec;
+    int negative;
+    if (!pa_stream_get_latency(m_stream, &usec, &negative) && !negative)
+      primeFrames = pa_usec_to_bytes(usec, &m_sampleSpec) / frameSz / periodFrames * periodFrames;
+    primeFrames = std::min({primeFrames, m_primeFrames, (newPeriods - fadePeriods) * periodFrames});
+
+    size_t fadeFrames = fadePeriods * periodFrames;
+    float* fade = m_crossfadeBuf.data() + m_primeFrames * chanCount;
+    _pumpAndMixVoices(fadeFrames, fade);
+    for (size_t f = 0; f < fadeFrames; ++f) {
+      double t = (f + 0.5) / fadeFrames * (M_PI / 2.0);
+      float outGain = float(std::cos(t));
+      float inGain = float(std::sin(t));
+      for (size_t c = 0; c < chanCount; ++c) {
+        m_fadeOutBuf[f * chanCount + c] = fade[f * chanCount + c] * outGain;
+        fade[f * chanCount + c] *= inGain;
+      }
+    }
+
+    if (pa_stream_write(m_stream, m_fadeOutBuf.data(), fadeFrames * frameSz, nullptr, 0, PA_SEEK_RELATIVE) ||
+        pa_stream_write(m_pendingStream, fade - primeFrames * chanCount, (primeFrames + fadeFrames) * frameSz,
+                        nullptr, 0, PA_SEEK_RELATIVE))
+      RealtimeReport(Log, logvisor::Error, FMT_STRING("Unable to pa_stream_write()"));
+
+    /* Retire the old stream; it stops requesting audio and is released once drained */
+    _releaseStream(m_retiringStream);
+    m_retiringStream = m_stream;
+    pa_stream_set_write_callback(m_retiringStream, nullptr, nullptr);
+    if (pa_operation* op = pa_stream_drain(m_retiringStream, pa_stream_success_cb_t(_retiredStreamDrained), this))
+      pa_operation_unref(op);
+
+    m_stream = m_pendingStream;
+    m_pendingStream = nullptr;
+    std::swap(m_sinkName, m_pendingSinkName);
+    if (const pa_buffer_attr* attr = pa_stream_get_buffer_attr(m_stream))
+      m_tlength = attr->tlength;
+    m_underflows = 0;
+    m_framesSinceUnderflow = 0;
+
+    /* Fill the new stream's buffer and start it without waiting for prebuffering */
+    _writeToStream(pa_stream_writable_size(m_stream));
+    if (pa_operation* op = pa_stream_trigger(m_stream, nullptr, nullptr))
+      pa_operation_unref(op);
   }
 
   void _doIterate() {
     int retval;
     pa_mainloop_iterate(m_mainloop, 1, &retval);
-    if (m_handleMove) {
-      m_handleMove = false;
-      _setupSink();
-    }
   }
 
-  void pumpAndMixVoices() override {
-    if (!m_stream) {
-      /* Dummy pump mode - use failsafe defaults for 1/60sec of samples */
-      m_mixInfo.m_sampleRate = 32000.0;
-      m_mixInfo.m_bitsPerSample = 32;
-      m_5msFrames = 32000 / 60;
-      m_mixInfo.m_periodFrames = m_5msFrames;
-      m_mixInfo.m_channels = AudioChannelSet::Stereo;
-      m_mixInfo.m_channelMap.m_channelCount = 2;
-      m_mixInfo.m_channelMap.m_channels[0] = AudioChannel::FrontLeft;
-      m_mixInfo.m_channelMap.m_channels[1] = AudioChannel::FrontRight;
-      _pumpAndMixVoices(m_5msFrames, (float*)nullptr);
+  /* Mix as many whole periods as fit in writableSz straight into server-provided memory */
+  void _writeToStream(size_t writableSz) {
+    if (m_pendingStream && pa_stream_get_state(m_pendingStream) == PA_STREAM_READY) {
+      _crossfadeToPendingStream(writableSz);
       return;
     }
 
-    size_t writableSz = pa_stream_writable_size(m_stream);
     size_t frameSz = m_mixInfo.m_channelMap.m_channelCount * sizeof(float);
     size_t writableFrames = writableSz / frameSz;
     size_t writablePeriods = writableFrames / m_mixInfo.m_periodFrames;
 
-    if (!writablePeriods) {
-      _doIterate();
+    if (!writablePeriods)
       return;
-    }
 
     void* data = nullptr;
     size_t periodSz = m_mixInfo.m_periodFrames * frameSz;
     size_t nbytes = writablePeriods * periodSz;
     if (pa_stream_begin_write(m_stream, &data, &nbytes)) {
       pa_stream_state_t st = pa_stream_get_state(m_stream);
-      Log.report(logvisor::Error, FMT_STRING("Unable to pa_stream_begin_write(): {} {}"), pa_strerror(pa_context_errno(m_ctx)), st);
-      _doIterate();
+      RealtimeReport(Log, logvisor::Error, FMT_STRING("Unable to pa_stream_begin_write(): {} {}"),
+                     pa_strerror(pa_context_errno(m_ctx)), st);
       return;
     }
 
     writablePeriods = nbytes / periodSz;
+    if (!writablePeriods) {
+      pa_stream_cancel_write(m_stream);
+      return;
+    }
     _pumpAndMixVoices(m_mixInfo.m_periodFrames * writablePeriods, reinterpret_cast<float*>(data));
 
-    if (pa_stream_write(m_stream, data, nbytes, nullptr, 0, PA_SEEK_RELATIVE))
-      Log.report(logvisor::Error, FMT_STRING("Unable to pa_stream_write()"));
+    if (pa_stream_write(m_stream, data, writablePeriods * periodSz, nullptr, 0, PA_SEEK_RELATIVE))
+      RealtimeReport(Log, logvisor::Error, FMT_STRING("Unable to pa_stream_write()"));
 
+    _updateLatency(m_mixInfo.m_periodFrames * writablePeriods);
+  }
+
+  /* Scheduling is left to AudioVoiceEngineOptions::m_realtimeMixing, applied on first mix */
+  static void _setupMixerThread() {
+    logvisor::RegisterThreadName("Boo PulseAudio Mixer");
+    TraceThreadName("Boo PulseAudio Mixer");
+  }
+
+  /* Threaded mode: server-driven request, called on the mainloop thread with its lock held */
+  static void _streamWriteRequest(pa_stream* p, size_t nbytes, PulseAudioVoiceEngine* userdata) {
+    /* A pending stream waits to be crossfaded onto */
+    if (p != userdata->m_stream)
+      return;
+    if (!userdata->m_mixerThreadSetup) {
+      _setupMixerThread();
+      userdata->m_mixerThreadSetup = true;
+    }
+    userdata->_writeToStream(nbytes);
+  }
+
+  void pumpAndMixVoices() override {
+    if (m_threadedMainloop) {
+      /* Mixing happens in _streamWriteRequest, sink switches included */
+      PALock lk(m_threadedMainloop);
+      if (m_stream)
+        return;
+    }
+
+    if (!m_stream) {
+      /* Dummy pump mode */
+      _pumpDummy();
+      return;
+    }
+
+    _writeToStream(pa_stream_writable_size(m_stream));
     _doIterate();
   }
 };
 
-std::unique_ptr<IAudioVoiceEngine> NewAudioVoiceEngine() { return std::make_unique<PulseAudioVoiceEngine>(); }
+std::unique_ptr<IAudioVoiceEngine> NewAudioVoiceEngine(const AudioVoiceEngineOptions& options) {
+  std::unique_ptr<IAudioVoiceEngine> ret = std::make_unique<PulseAudioVoiceEngine>(options);
+  if (!static_cast<PulseAudioVoiceEngine&>(*ret).m_ctx) {
+    /* No sound server; drive the default ALSA PCM directly if possible */
+    Log.report(logvisor::Info, FMT_STRING("PulseAudio unavailable; falling back to ALSA"));
+    if (std::unique_ptr<IAudioVoiceEngine> alsa = NewALSAAudioVoiceEngine("default", options))
+      return alsa;
+  }
+  return ret;
+}
 
-} // namespace boo2
\ No newline at end of file
+} // namespace boo2
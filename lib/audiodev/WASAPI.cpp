@@ -57,7 +57,7 @@ struct WASAPIAudioVoiceEngine : BaseAudioVoiceEngine {
   std::string m_sinkName;
 
   size_t m_curBufFrame = 0;
-  std::vector<float> m_5msBuffer;
+  std::vector<float> m_blockBuffer;
 
 #if !WINDOWS_STORE
   struct NotificationClient final : public IMMNotificationClient {
@@ -222,9 +222,9 @@ struct WASAPIAudioVoiceEngine : BaseAudioVoiceEngine {
       return;
     }
     m_mixInfo.m_sampleRate = pwfx->Format.nSamplesPerSec;
-    m_5msFrames = (m_mixInfo.m_sampleRate * 5 / 500 + 1) / 2;
-    m_curBufFrame = m_5msFrames;
-    m_5msBuffer.resize(m_5msFrames * chMapOut.m_channelCount);
+    _setBlockFrames(m_mixInfo.m_sampleRate);
+    m_curBufFrame = m_blockFrames;
+    m_blockBuffer.resize(m_blockFrames * chMapOut.m_channelCount);
 
     if (pwfx->Format.wFormatTag == WAVE_FORMAT_PCM ||
         (pwfx->Format.wFormatTag == WAVE_FORMAT_EXTENSIBLE && pwfx->SubFormat == KSDATAFORMAT_SUBTYPE_PCM)) {
@@ -317,14 +317,16 @@ struct WASAPIAudioVoiceEngine : BaseAudioVoiceEngine {
     operation->GetActivateResult(&hrActivateResult, &punkAudioInterface);
     punkAudioInterface.As<IAudioClient>(&m_audClient);
     _buildAudioRenderClient();
+    _resetSampleRate();
     m_ready = true;
     return ERROR_SUCCESS;
   }
 #endif
 
-  WASAPIAudioVoiceEngine()
+  explicit WASAPIAudioVoiceEngine(const AudioVoiceEngineOptions& options)
+  : BaseAudioVoiceEngine(options)
 #if !WINDOWS_STORE
-  : m_notificationClient(*this)
+  , m_notificationClient(*this)
 #endif
   {
 #if !WINDOWS_STORE
@@ -367,6 +369,7 @@ struct WASAPIAudioVoiceEngine : BaseAudioVoiceEngine {
     CoTaskMemFree(sinkName);
 
     _buildAudioRenderClient();
+    _resetSampleRate();
 #else
     auto deviceIdStr = MediaDevice::GetDefaultAudioRenderId(Windows::Media::Devices::AudioDeviceRole::Default);
     ComPtr<IActivateAudioInterfaceAsyncOperation> asyncOp;
@@ -441,15 +444,15 @@ struct WASAPIAudioVoiceEngine : BaseAudioVoiceEngine {
       }
 
       for (size_t f = 0; f < frames;) {
-        if (m_curBufFrame == m_5msFrames) {
-          _pumpAndMixVoices(m_5msFrames, m_5msBuffer.data());
+        if (m_curBufFrame == m_blockFrames) {
+          _pumpAndMixVoices(m_blockFrames, m_blockBuffer.data());
           m_curBufFrame = 0;
         }
 
-        size_t remRenderFrames = std::min(frames - f, m_5msFrames - m_curBufFrame);
+        size_t remRenderFrames = std::min(frames - f, m_blockFrames - m_curBufFrame);
         if (remRenderFrames) {
           memmove(reinterpret_cast<float*>(bufOut) + m_mixInfo.m_channelMap.m_channelCount * f,
-                  &m_5msBuffer[m_curBufFrame * m_mixInfo.m_channelMap.m_channelCount],
+                  &m_blockBuffer[m_curBufFrame * m_mixInfo.m_channelMap.m_channelCount],
                   remRenderFrames * m_mixInfo.m_channelMap.m_channelCount * sizeof(float));
           m_curBufFrame += remRenderFrames;
           f += remRenderFrames;
@@ -890,6 +893,8 @@ struct WASAPIAudioVoiceEngine : BaseAudioVoiceEngine {
 #endif
 };
 
-std::unique_ptr<IAudioVoiceEngine> NewAudioVoiceEngine() { return std::make_unique<WASAPIAudioVoiceEngine>(); }
+std::unique_ptr<IAudioVoiceEngine> NewAudioVoiceEngine(const AudioVoiceEngineOptions& options) {
+  return std::make_unique<WASAPIAudioVoiceEngine>(options);
+}
 
 } // namespace boo2
@@ -171,9 +171,11 @@ struct WAVOutVoiceEngine : BaseAudioVoiceEngine {
     m_mixInfo.m_sampleRate = sampleRate;
     m_mixInfo.m_bitsPerSample = 32;
     _buildAudioRenderClient();
+    _resetSampleRate();
   }
 
-  WAVOutVoiceEngine(const char* path, double sampleRate, int numChans) {
+  WAVOutVoiceEngine(const char* path, double sampleRate, int numChans, const AudioVoiceEngineOptions& options)
+  : BaseAudioVoiceEngine(options) {
     m_fp = fopen(path, "wb");
     if (!m_fp)
       return;
@@ -181,7 +183,8 @@ struct WAVOutVoiceEngine : BaseAudioVoiceEngine {
   }
 
 #if _WIN32
-  WAVOutVoiceEngine(const wchar_t* path, double sampleRate, int numChans) {
+  WAVOutVoiceEngine(const wchar_t* path, double sampleRate, int numChans, const AudioVoiceEngineOptions& options)
+  : BaseAudioVoiceEngine(options) {
     m_fp = _wfopen(path, L"wb");
     if (!m_fp)
       return;
@@ -214,12 +217,12 @@ struct WAVOutVoiceEngine : BaseAudioVoiceEngine {
   ~WAVOutVoiceEngine() override { finishWav(); }
 
   void _buildAudioRenderClient() {
-    m_5msFrames = m_mixInfo.m_sampleRate * 5 / 1000;
-    m_interleavedBuf.resize(m_mixInfo.m_channelMap.m_channelCount * m_5msFrames);
+    _setBlockFrames(m_mixInfo.m_sampleRate);
+    m_interleavedBuf.resize(m_mixInfo.m_channelMap.m_channelCount * m_blockFrames);
+    _reserveMixBuffers();
   }
 
-  void _rebuildAudioRenderClient(double sampleRate, size_t periodFrames) {
-    m_mixInfo.m_periodFrames = periodFrames;
+  void _rebuildAudioRenderClient(double sampleRate) {
     m_mixInfo.m_sampleRate = sampleRate;
     _buildAudioRenderClient();
     _resetSampleRate();
@@ -227,22 +230,28 @@ struct WAVOutVoiceEngine : BaseAudioVoiceEngine {
 
   void pumpAndMixVoices() override {
     size_t frameSz = 4 * m_mixInfo.m_channelMap.m_channelCount;
-    _pumpAndMixVoices(m_5msFrames, m_interleavedBuf.data());
-    fwrite(m_interleavedBuf.data(), 1, m_5msFrames * frameSz, m_fp);
-    m_bytesWritten += m_5msFrames * frameSz;
+    _pumpAndMixVoices(m_blockFrames, m_interleavedBuf.data());
+    fwrite(m_interleavedBuf.data(), 1, m_blockFrames * frameSz, m_fp);
+    m_bytesWritten += m_blockFrames * frameSz;
   }
 };
 
-std::unique_ptr<IAudioVoiceEngine> NewWAVAudioVoiceEngine(const char* path, double sampleRate, int numChans) {
-  std::unique_ptr<IAudioVoiceEngine> ret = std::make_unique<WAVOutVoiceEngine>(path, sampleRate, numChans);
+std::unique_ptr<IAudioVoiceEngine> NewWAVAudioVoiceEngine(const char* path, double sampleRate, int numChans,
+                                                          const AudioVoiceEngineOptions& options) {
+  std::unique_ptr<IAudioVoiceEngine> ret = std::make_unique<WAVOutVoiceEngine>(path, sampleRate, numChans, options);
   if (!static_cast<WAVOutVoiceEngine&>(*ret).m_fp)
     return {};
   return ret;
 }
 
+void ResetWAVAudioVoiceEngineSampleRate(IAudioVoiceEngine& engine, double sampleRate) {
+  static_cast<WAVOutVoiceEngine&>(engine)._rebuildAudioRenderClient(sampleRate);
+}
+
 #if _WIN32
-std::unique_ptr<IAudioVoiceEngine> NewWAVAudioVoiceEngine(const wchar_t* path, double sampleRate, int numChans) {
-  std::unique_ptr<IAudioVoiceEngine> ret = std::make_unique<WAVOutVoiceEngine>(path, sampleRate, numChans);
+std::unique_ptr<IAudioVoiceEngine> NewWAVAudioVoiceEngine(const wchar_t* path, double sampleRate, int numChans,
+                                                          const AudioVoiceEngineOptions& options) {
+  std::unique_ptr<IAudioVoiceEngine> ret = std::make_unique<WAVOutVoiceEngine>(path, sampleRate, numChans, options);
   if (!static_cast<WAVOutVoiceEngine&>(*ret).m_fp)
     return {};
   return ret;
@@ -13,7 +13,7 @@ struct LibnxAudioVoiceEngine final : BaseAudioVoiceEngine {
 
   bool supportsVirtualMIDIIn() const override { return false; }
 
-  LibnxAudioVoiceEngine() {}
+  explicit LibnxAudioVoiceEngine(const AudioVoiceEngineOptions& options) : BaseAudioVoiceEngine(options) {}
 
   ~LibnxAudioVoiceEngine() override {}
 
@@ -57,11 +57,13 @@ struct LibnxAudioVoiceEngine final : BaseAudioVoiceEngine {
 
   bool useMIDILock() const override { return false; }
 
+  size_t getBlockFrames() const override { return 0; }
+
   size_t get5MsFrames() const override { return 0; }
 };
 
-std::unique_ptr<IAudioVoiceEngine> NewAudioVoiceEngine() {
-  return std::make_unique<LibnxAudioVoiceEngine>();
+std::unique_ptr<IAudioVoiceEngine> NewAudioVoiceEngine(const AudioVoiceEngineOptions& options) {
+  return std::make_unique<LibnxAudioVoiceEngine>(options);
 }
 
 } // namespace boo2
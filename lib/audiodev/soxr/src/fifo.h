@@ -28,6 +28,14 @@ typedef struct {
   #define FIFO_MIN 0x4000
 #endif
 
+/* boo2 local change, recorded in ../VENDORING: allocated up front. Data is compacted once more than
+ * FIFO_MIN bytes have been read, so twice that leaves room for any steady-state occupancy plus write
+ * below FIFO_MIN without reallocating, and the resampler never allocates once created (boo2 mixes
+ * with allocation forbidden) */
+#if !defined FIFO_INITIAL
+  #define FIFO_INITIAL (FIFO_MIN * 2)
+#endif
+
 #if !defined UNUSED
   #define UNUSED
 #endif
@@ -116,7 +124,7 @@ UNUSED static void fifo_delete(fifo_t * f)
 UNUSED static int fifo_create(fifo_t * f, FIFO_SIZE_T item_size)
 {
   f->item_size = (size_t)item_size;
-  f->allocation = FIFO_MIN;
+  f->allocation = FIFO_INITIAL;
   fifo_clear(f);
   return !(f->data = FIFO_MALLOC(f->allocation));
 }
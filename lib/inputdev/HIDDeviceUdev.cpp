@@ -1,4 +1,5 @@
 #include "IHIDDevice.hpp"
+#include "../Trace.hpp"
 
 #include <condition_variable>
 #include <cstdio>
@@ -61,6 +62,7 @@ class HIDDeviceUdev final : public IHIDDevice {
   }
 
   static void _threadProcUSBLL(std::shared_ptr<HIDDeviceUdev> device) {
+    TraceThreadName("Boo HID Transfer");
     int i;
     std::unique_lock<std::mutex> lk(device->m_initMutex);
     udev_device* udevDev = udev_device_new_from_syspath(GetUdev(), device->m_devPath.data());
@@ -113,8 +115,10 @@ class HIDDeviceUdev final : public IHIDDevice {
 
     /* Start transfer loop */
     device->m_devImp->initialCycle();
-    while (device->m_runningTransferLoop)
+    while (device->m_runningTransferLoop) {
+      TraceScope trace("DeviceBase::transferCycle");
       device->m_devImp->transferCycle();
+    }
     device->m_devImp->finalCycle();
 
     /* Cleanup */
@@ -124,6 +128,7 @@ class HIDDeviceUdev final : public IHIDDevice {
   }
 
   static void _threadProcBTLL(std::shared_ptr<HIDDeviceUdev> device) {
+    TraceThreadName("Boo HID Transfer");
     std::unique_lock<std::mutex> lk(device->m_initMutex);
     udev_device* udevDev = udev_device_new_from_syspath(GetUdev(), device->m_devPath.data());
 
@@ -134,14 +139,17 @@ class HIDDeviceUdev final : public IHIDDevice {
 
     /* Start transfer loop */
     device->m_devImp->initialCycle();
-    while (device->m_runningTransferLoop)
+    while (device->m_runningTransferLoop) {
+      TraceScope trace("DeviceBase::transferCycle");
       device->m_devImp->transferCycle();
+    }
     device->m_devImp->finalCycle();
 
     udev_device_unref(udevDev);
   }
 
   static void _threadProcHID(std::shared_ptr<HIDDeviceUdev> device) {
+    TraceThreadName("Boo HID Transfer");
     std::unique_lock<std::mutex> lk(device->m_initMutex);
     udev_device* udevDev = udev_device_new_from_syspath(GetUdev(), device->m_devPath.data());
 
@@ -196,11 +204,14 @@ class HIDDeviceUdev final : public IHIDDevice {
           ssize_t sz = read(fd, readBuf.get(), readSz);
           if (sz < 0)
             break;
+          TraceScope trace("DeviceBase::receivedHIDReport");
           device->m_devImp->receivedHIDReport(readBuf.get(), sz, HIDReportType::Input, readBuf[0]);
         }
       }
-      if (device->m_runningTransferLoop)
+      if (device->m_runningTransferLoop) {
+        TraceScope trace("DeviceBase::transferCycle");
         device->m_devImp->transferCycle();
+      }
     }
     device->m_devImp->finalCycle();
 
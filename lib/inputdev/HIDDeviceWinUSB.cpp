@@ -1,5 +1,6 @@
 #define _CRT_SECURE_NO_WARNINGS 1 /* STFU MSVC */
 #include "lib/inputdev/IHIDDevice.hpp"
+#include "lib/RealtimeLog.hpp"
 
 #include "boo/inputdev/DeviceToken.hpp"
 #include "boo/inputdev/DeviceBase.hpp"
@@ -24,6 +25,7 @@
 #undef max
 
 namespace boo2 {
+static logvisor::Module Log("boo::HIDDeviceWinUSB");
 
 class HIDDeviceWinUSB final : public IHIDDevice {
   DeviceToken& m_token;
@@ -40,6 +42,8 @@ class HIDDeviceWinUSB final : public IHIDDevice {
   std::mutex m_initMutex;
   std::condition_variable m_initCond;
   std::thread m_thread;
+  /* Transfer failures are reported from the transfer thread */
+  RealtimeLogDrain m_logDrain;
 
   bool _sendUSBInterruptTransfer(const uint8_t* data, size_t length) override {
     if (m_usbHandle) {
@@ -233,14 +237,14 @@ class HIDDeviceWinUSB final : public IHIDDevice {
         }
 
         if (Error != ERROR_IO_PENDING) {
-          fmt::print(stderr, FMT_STRING("Write Failed {:08X}\n"), int(Error));
+          RealtimeReport(Log, logvisor::Error, FMT_STRING("Write Failed {:08X}"), int(Error));
           return false;
         }
       }
 
       if (!GetOverlappedResult(m_hidHandle, &Overlapped, &BytesWritten, TRUE)) {
         DWORD Error = GetLastError();
-        fmt::print(stderr, FMT_STRING("Write Failed {:08X}\n"), int(Error));
+        RealtimeReport(Log, logvisor::Error, FMT_STRING("Write Failed {:08X}"), int(Error));
         return false;
       }
     } else if (tp == HIDReportType::Feature) {
@@ -309,7 +313,7 @@ public:
         m_runningTransferLoop = false;
         return;
       } else if (Error != ERROR_IO_PENDING) {
-        fmt::print(stderr, FMT_STRING("Read Failed: {:08X}\n"), int(Error));
+        RealtimeReport(Log, logvisor::Error, FMT_STRING("Read Failed: {:08X}"), int(Error));
         return;
       } else if (!GetOverlappedResultEx(m_hidHandle, &m_overlapped, &BytesRead, 10, TRUE)) {
         return;
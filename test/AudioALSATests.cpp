@@ -0,0 +1,100 @@
+/* Opens the ALSA engine on a file PCM, which writes whatever is played to a raw file and hands it on
+ * to the null plugin, so it runs without sound hardware or a sound server. Checks the layout that
+ * was negotiated and that the file holds every frame the mixer produced, at the voice's balance.
+ *
+ *   boo2-audio-alsa-tests   exits 0 when the PCM opened as stereo float and the written frames check out */
+
+#include "boo2/audiodev/IAudioVoiceEngine.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace boo2;
+
+namespace {
+
+constexpr const char* RawPath = "alsa.raw";
+constexpr float Levels[8] = {0.8f, 0.4f};
+
+struct SineSource : IAudioVoiceCallback {
+  double m_phase = 0.0;
+
+  void preSupplyAudio(IAudioVoice&, double) override {}
+
+  size_t supplyAudio(IAudioVoice&, size_t frames, int16_t* data) override {
+    for (size_t f = 0; f < frames; ++f) {
+      data[f] = int16_t(std::lround(std::sin(m_phase) * 16000.0));
+      m_phase = std::fmod(m_phase + 0.06, 2.0 * M_PI);
+    }
+    return frames;
+  }
+};
+
+int Fail(const char* message) {
+  fprintf(stderr, "%s\n", message);
+  std::remove(RawPath);
+  return 1;
+}
+
+} // namespace
+
+int main() {
+  /* The file plugin takes the format of whatever is played through it; raw means no header */
+  std::string pcmName = std::string("file:FILE=") + RawPath + ",FORMAT=raw";
+  uint64_t frames = 0;
+  {
+    std::unique_ptr<IAudioVoiceEngine> engine = NewALSAAudioVoiceEngine(pcmName.c_str());
+    if (!engine)
+      return Fail("unable to open the file PCM");
+    /* The null plugin takes any channel count but has no layout of its own; that means stereo */
+    if (engine->getAvailableSet() != AudioChannelSet::Stereo)
+      return Fail("file PCM did not negotiate stereo");
+
+    SineSource source;
+    ObjToken<IAudioVoice> voice = engine->allocateNewMonoVoice(48000.0, &source);
+    voice->setMonoChannelLevels(nullptr, Levels, false);
+    voice->start();
+    engine->enableMixTiming(true);
+    for (int i = 0; i < 20; ++i)
+      engine->pumpAndMixVoices();
+    frames = engine->getMixTiming().m_frames;
+    voice.reset();
+  }
+
+  /* The null plugin takes the preferred float format, so each frame is two floats */
+  std::ifstream file(RawPath, std::ios::binary);
+  std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  file.close();
+  if (!frames)
+    return Fail("no frames were mixed");
+  if (data.size() != frames * 2 * sizeof(float)) {
+    fprintf(stderr, "file holds %zu bytes for %llu mixed frames\n", data.size(), (unsigned long long)frames);
+    return Fail("written frames don't match the mixed frames");
+  }
+
+  std::vector<float> samples(data.size() / sizeof(float));
+  memcpy(samples.data(), data.data(), data.size());
+  size_t audible = 0;
+  for (size_t f = 0; f < frames; ++f) {
+    float l = samples[f * 2];
+    float r = samples[f * 2 + 1];
+    if (std::fabs(l * Levels[1] - r * Levels[0]) > 1e-5f) {
+      fprintf(stderr, "frame %zu is off balance (%g, %g)\n", f, l, r);
+      return Fail("written frames don't hold the voice");
+    }
+    if (std::fabs(l) > 1e-3f)
+      ++audible;
+  }
+  if (!audible)
+    return Fail("written frames are silent");
+
+  std::remove(RawPath);
+  printf("ok: %llu stereo float frames written through %s\n", (unsigned long long)frames, pcmName.c_str());
+  return 0;
+}
@@ -0,0 +1,671 @@
+/* Scripted mixer scenes rendered through the WAV engine.
+ *
+ *   boo2-audio-tests --reference <file> [--update]  compare (or rewrite) each scene's output fingerprint
+ *   boo2-audio-tests --baseline <file> [--update]   compare (or rewrite) each scene's mixer ns/frame
+ *   boo2-audio-tests ... --scene <name>             run one scene only
+ *
+ * Scenes only use the public engine interface and drive it from this thread, so their output is
+ * deterministic for a given build. */
+
+#include "boo2/audiodev/IAudioVoiceEngine.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace boo2;
+
+namespace {
+
+constexpr size_t FingerprintSegments = 16;
+constexpr double DefaultTolerance = 5e-4;
+constexpr double DefaultPerfThreshold = 2.0;
+constexpr int SkipReturnCode = 77;
+
+/* Sine source with a fixed frequency per channel */
+struct ToneSource : IAudioVoiceCallback {
+  std::vector<double> m_phase;
+  std::vector<double> m_inc;
+  double m_amplitude;
+  std::function<void(IAudioVoice&, double)> m_onBlock;
+
+  ToneSource(std::initializer_list<double> freqs, double sampleRate, double amplitude = 0.5)
+  : m_phase(freqs.size()), m_amplitude(amplitude * 32767.0) {
+    for (double freq : freqs)
+      m_inc.push_back(2.0 * M_PI * freq / sampleRate);
+  }
+
+  void preSupplyAudio(IAudioVoice& voice, double dt) override {
+    if (m_onBlock)
+      m_onBlock(voice, dt);
+  }
+
+  void render(size_t frames, int16_t* data) {
+    for (size_t f = 0; f < frames; ++f) {
+      for (size_t c = 0; c < m_phase.size(); ++c) {
+        *data++ = int16_t(std::lround(std::sin(m_phase[c]) * m_amplitude));
+        m_phase[c] = std::fmod(m_phase[c] + m_inc[c], 2.0 * M_PI);
+      }
+    }
+  }
+
+  size_t supplyAudio(IAudioVoice&, size_t frames, int16_t* data) override {
+    render(frames, data);
+    return frames;
+  }
+};
+
+/* Plays a prerendered loop of ToneSource output, keeping client time out of benchmark scenes */
+struct LoopSource : IAudioVoiceCallback {
+  std::vector<int16_t> m_loop;
+  size_t m_channels;
+  size_t m_pos = 0;
+
+  LoopSource(ToneSource&& tone, size_t frames) : m_loop(frames * tone.m_phase.size()), m_channels(tone.m_phase.size()) {
+    tone.render(frames, m_loop.data());
+  }
+
+  void preSupplyAudio(IAudioVoice&, double) override {}
+
+  size_t supplyAudio(IAudioVoice&, size_t frames, int16_t* data) override {
+    size_t loopFrames = m_loop.size() / m_channels;
+    for (size_t remaining = frames; remaining;) {
+      size_t count = std::min(remaining, loopFrames - m_pos);
+      memcpy(data, m_loop.data() + m_pos * m_channels, count * m_channels * sizeof(int16_t));
+      data += count * m_channels;
+      m_pos = (m_pos + count) % loopFrames;
+      remaining -= count;
+    }
+    return frames;
+  }
+};
+
+/* One-pole low-pass with a gain, keeping per-channel state across blocks */
+struct LowPassEffect : IAudioSubmixCallback {
+  float m_coef;
+  float m_gain;
+  mutable std::array<float, 8> m_state{};
+
+  LowPassEffect(float coef, float gain) : m_coef(coef), m_gain(gain) {}
+
+  bool canApplyEffect() const override { return true; }
+  void applyEffect(float* audio, size_t frameCount, const ChannelMap& chanMap, double) const override {
+    for (size_t f = 0; f < frameCount; ++f) {
+      for (unsigned c = 0; c < chanMap.m_channelCount; ++c) {
+        float& s = audio[f * chanMap.m_channelCount + c];
+        m_state[c] += m_coef * (s - m_state[c]);
+        s = m_state[c] * m_gain;
+      }
+    }
+  }
+  void resetOutputSampleRate(double) override { m_state.fill(0.f); }
+};
+
+struct SceneOutput {
+  unsigned m_channels = 0;
+  std::vector<float> m_samples;
+  size_t frames() const { return m_channels ? m_samples.size() / m_channels : 0; }
+};
+
+/* Engine and pump control handed to a scene */
+class SceneContext {
+  IAudioVoiceEngine& m_engine;
+  size_t m_pumps = 0;
+
+public:
+  explicit SceneContext(IAudioVoiceEngine& engine) : m_engine(engine) {}
+  IAudioVoiceEngine& engine() { return m_engine; }
+  void pump(size_t count) {
+    for (size_t i = 0; i < count; ++i)
+      m_engine.pumpAndMixVoices();
+    m_pumps += count;
+  }
+  size_t pumps() const { return m_pumps; }
+};
+
+struct Scene {
+  const char* m_name;
+  double m_sampleRate;
+  int m_channels;
+  std::function<void(SceneContext&)> m_run;
+  /* Optional scene-specific check of the rendered output; returns an error message or empty */
+  std::function<std::string(const SceneOutput&)> m_check;
+};
+
+const float Center[8] = {0.7071f, 0.7071f};
+
+/* Mono, stereo and surround-sourced voices at rates other than the mix rate */
+void VoicesScene(SceneContext& ctx) {
+  IAudioVoiceEngine& engine = ctx.engine();
+  ToneSource mono({440.0}, 22050.0);
+  ToneSource stereo({330.0, 495.0}, 32000.0, 0.4);
+  ToneSource quad({220.0, 277.0, 370.0, 554.0}, 44100.0, 0.3);
+  ChannelMap quadMap;
+  quadMap.m_channelCount = 4;
+  quadMap.m_channels = {AudioChannel::FrontLeft, AudioChannel::FrontRight, AudioChannel::RearLeft,
+                        AudioChannel::RearRight};
+
+  ObjToken<IAudioVoice> v1 = engine.allocateNewMonoVoice(22050.0, &mono);
+  ObjToken<IAudioVoice> v2 = engine.allocateNewStereoVoice(32000.0, &stereo);
+  ObjToken<IAudioVoice> v3 = engine.allocateNewMultichannelVoice(44100.0, quadMap, &quad);
+  const float left[8] = {0.8f, 0.2f};
+  v1->setMonoChannelLevels(nullptr, left, false);
+  const float stereoLevels[8][2] = {{0.6f, 0.f}, {0.f, 0.6f}};
+  v2->setStereoChannelLevels(nullptr, stereoLevels, false);
+  v1->start();
+  v2->start();
+  ctx.pump(40);
+  v3->start();
+  ctx.pump(60);
+  v2->stop();
+  v1->resetSampleRate(24000.0);
+  ctx.pump(100);
+}
+
+/* Dynamic-pitch voices: a glide, slewed steps and per-block vibrato from preSupplyAudio */
+void PitchScene(SceneContext& ctx) {
+  IAudioVoiceEngine& engine = ctx.engine();
+  ToneSource glide({300.0}, 48000.0);
+  ToneSource vibrato({600.0}, 32000.0, 0.3);
+  double lfo = 0.0;
+  vibrato.m_onBlock = [&lfo](IAudioVoice& voice, double dt) {
+    lfo += dt;
+    voice.setPitchRatio(1.0 + 0.02 * std::sin(2.0 * M_PI * 5.0 * lfo), false);
+  };
+
+  ObjToken<IAudioVoice> v1 = engine.allocateNewMonoVoice(48000.0, &glide, true);
+  ObjToken<IAudioVoice> v2 = engine.allocateNewMonoVoice(32000.0, &vibrato, true);
+  v1->setMonoChannelLevels(nullptr, Center, false);
+  const float right[8] = {0.2f, 0.7f};
+  v2->setMonoChannelLevels(nullptr, right, false);
+  v1->start();
+  v2->start();
+  v1->glidePitchRatio(2.0, 300.0);
+  ctx.pump(80);
+  v1->setPitchRatio(0.75, true);
+  ctx.pump(40);
+  v1->glidePitchRatio(1.25, 120.0);
+  v1->glidePitchRatio(0.5, 200.0);
+  ctx.pump(80);
+}
+
+/* Diamond of submixes with effects, a rate-divided bus and slewed send changes */
+void SubmixScene(SceneContext& ctx) {
+  IAudioVoiceEngine& engine = ctx.engine();
+  LowPassEffect mainFx(0.3f, 0.9f);
+  LowPassEffect reducedFx(0.5f, 1.2f);
+  ObjToken<IAudioSubmix> bus = engine.allocateNewSubmix(true, &mainFx, 1);
+  ObjToken<IAudioSubmix> reduced = engine.allocateNewSubmix(false, &reducedFx, 2, 2);
+  ObjToken<IAudioSubmix> split = engine.allocateNewSubmix(false, nullptr, 3);
+  reduced->setSendLevel(bus.get(), 0.8f, false);
+  split->setSendLevel(bus.get(), 0.5f, false);
+  split->setSendLevel(reduced.get(), 0.5f, false);
+
+  ToneSource a({523.0}, 48000.0);
+  ToneSource b({784.0, 1046.0}, 48000.0, 0.3);
+  ObjToken<IAudioVoice> v1 = engine.allocateNewMonoVoice(48000.0, &a);
+  ObjToken<IAudioVoice> v2 = engine.allocateNewStereoVoice(48000.0, &b);
+  v1->setMonoChannelLevels(split.get(), Center, false);
+  const float stereoLevels[8][2] = {{0.5f, 0.1f}, {0.1f, 0.5f}};
+  v2->setStereoChannelLevels(reduced.get(), stereoLevels, false);
+  v2->setStereoChannelLevels(nullptr, stereoLevels, false);
+  v1->start();
+  v2->start();
+  ctx.pump(60);
+  split->setSendLevel(bus.get(), 0.1f, true);
+  reduced->setSendLevel(bus.get(), 1.0f, true);
+  ctx.pump(60);
+  v2->resetChannelLevels();
+  v2->setStereoChannelLevels(split.get(), stereoLevels, true);
+  ctx.pump(60);
+}
+
+/* 5.1 mix folded to Lt/Rt on a stereo engine */
+void LtRtScene(SceneContext& ctx) {
+  IAudioVoiceEngine& engine = ctx.engine();
+  if (!engine.enableLtRt(true))
+    return;
+  ToneSource surround({200.0, 300.0, 400.0, 500.0, 250.0, 60.0}, 48000.0, 0.25);
+  ChannelMap map51;
+  map51.m_channelCount = 6;
+  map51.m_channels = {AudioChannel::FrontLeft, AudioChannel::FrontRight, AudioChannel::RearLeft,
+                      AudioChannel::RearRight, AudioChannel::FrontCenter, AudioChannel::LFE};
+  ToneSource rear({880.0}, 48000.0);
+  ObjToken<IAudioVoice> v1 = engine.allocateNewMultichannelVoice(47800.0, map51, &surround);
+  ObjToken<IAudioVoice> v2 = engine.allocateNewMonoVoice(48000.0, &rear);
+  const float rearLevels[8] = {0.f, 0.f, 0.6f, 0.3f};
+  v2->setMonoChannelLevels(nullptr, rearLevels, false);
+  v1->start();
+  v2->start();
+  ctx.pump(100);
+  const float frontLevels[8] = {0.3f, 0.6f};
+  v2->rampMonoChannelLevels(nullptr, frontLevels, 250.0, AudioRampCurve::EqualPower);
+  ctx.pump(100);
+}
+
+/* Lt/Rt stays on across device changes that grow and shrink the mixing block; the encoder's ring
+ * and Hilbert window must follow the new rate */
+void LtRtRateScene(SceneContext& ctx) {
+  IAudioVoiceEngine& engine = ctx.engine();
+  if (!engine.enableLtRt(true))
+    return;
+  ToneSource surround({200.0, 300.0, 400.0, 500.0, 250.0, 60.0}, 48000.0, 0.25);
+  ChannelMap map51;
+  map51.m_channelCount = 6;
+  map51.m_channels = {AudioChannel::FrontLeft, AudioChannel::FrontRight, AudioChannel::RearLeft,
+                      AudioChannel::RearRight, AudioChannel::FrontCenter, AudioChannel::LFE};
+  ObjToken<IAudioVoice> voice = engine.allocateNewMultichannelVoice(48000.0, map51, &surround);
+  voice->start();
+  ctx.pump(60);
+  ResetWAVAudioVoiceEngineSampleRate(engine, 96000.0);
+  ctx.pump(60);
+  ResetWAVAudioVoiceEngineSampleRate(engine, 44100.0);
+  ctx.pump(60);
+}
+
+/* Long 5.1 mix with no resampling or ramps, so the mixer's cost is dominated by the Lt/Rt encoder when
+ * it's enabled; comparing against the bypassed variant gives the encoder's own cost per frame.
+ * It mixes at 47.8 kHz so the 5 ms blocks are 239 frames and the encoder's surround ring wraps mid-block */
+void LtRtBenchScene(SceneContext& ctx, bool ltRt) {
+  IAudioVoiceEngine& engine = ctx.engine();
+  if (ltRt && !engine.enableLtRt(true))
+    return;
+  /* Whole cycles of every tone fit in the 4780-frame loop */
+  LoopSource surround(ToneSource({200.0, 300.0, 400.0, 500.0, 250.0, 60.0}, 47800.0, 0.25), 4780);
+  ChannelMap map51;
+  map51.m_channelCount = 6;
+  map51.m_channels = {AudioChannel::FrontLeft, AudioChannel::FrontRight, AudioChannel::RearLeft,
+                      AudioChannel::RearRight, AudioChannel::FrontCenter, AudioChannel::LFE};
+  ObjToken<IAudioVoice> voice = engine.allocateNewMultichannelVoice(47800.0, map51, &surround);
+  voice->start();
+  ctx.pump(1000);
+}
+
+/* Level ramps on each curve, retargeted mid-ramp, with filter sweeps and master volume steps */
+void SlewScene(SceneContext& ctx) {
+  IAudioVoiceEngine& engine = ctx.engine();
+  ToneSource a({440.0}, 48000.0);
+  ToneSource b({660.0, 990.0}, 48000.0, 0.4);
+  ObjToken<IAudioVoice> v1 = engine.allocateNewMonoVoice(48000.0, &a);
+  ObjToken<IAudioVoice> v2 = engine.allocateNewStereoVoice(48000.0, &b);
+  const float silent[8] = {};
+  v1->setMonoChannelLevels(nullptr, silent, false);
+  const float stereoLevels[8][2] = {{0.5f, 0.f}, {0.f, 0.5f}};
+  v2->setStereoChannelLevels(nullptr, stereoLevels, false);
+  v1->start();
+  v2->start();
+  const float full[8] = {0.9f, 0.3f};
+  v1->rampMonoChannelLevels(nullptr, full, 200.0, AudioRampCurve::Linear);
+  ctx.pump(20);
+  const float swapped[8] = {0.3f, 0.9f};
+  v1->rampMonoChannelLevels(nullptr, swapped, 150.0, AudioRampCurve::SCurve);
+  v2->setFilter(AudioFilterType::LowPass, 2000.0, 0.7071, false);
+  ctx.pump(40);
+  v1->rampMonoChannelLevels(nullptr, silent, 100.0, AudioRampCurve::EqualPower);
+  v2->rampFilter(AudioFilterType::HighPass, 500.0, 1.0, 150.0);
+  const float crossed[8][2] = {{0.f, 0.5f}, {0.5f, 0.f}};
+  v2->rampStereoChannelLevels(nullptr, crossed, 120.0, AudioRampCurve::SCurve);
+  ctx.pump(40);
+  engine.setVolume(0.5f);
+  v1->setMonoChannelLevels(nullptr, full, true);
+  ctx.pump(40);
+  engine.setVolume(1.f);
+  ctx.pump(40);
+}
+
+/* Off-center mono voice on odd-length blocks, ramping between levels of the same 8:3 balance.
+ * Every output frame must keep that balance: the SSE stereo kernel once paired each sample with
+ * its neighbour's level and read past the end of odd blocks */
+const float PanLevels[8] = {0.8f, 0.3f};
+const float PanLevelsQuiet[8] = {0.4f, 0.15f};
+
+void MonoPanScene(SceneContext& ctx) {
+  IAudioVoiceEngine& engine = ctx.engine();
+  ToneSource tone({1000.0}, 47800.0, 0.9);
+  ObjToken<IAudioVoice> voice = engine.allocateNewMonoVoice(47800.0, &tone);
+  voice->setMonoChannelLevels(nullptr, PanLevels, false);
+  voice->start();
+  ctx.pump(50);
+  voice->rampMonoChannelLevels(nullptr, PanLevelsQuiet, 150.0, AudioRampCurve::SCurve);
+  ctx.pump(50);
+  voice->setMonoChannelLevels(nullptr, PanLevels, true);
+  ctx.pump(50);
+}
+
+std::string CheckMonoPan(const SceneOutput& out) {
+  for (size_t f = 0; f < out.frames(); ++f) {
+    double l = out.m_samples[f * 2];
+    double r = out.m_samples[f * 2 + 1];
+    if (std::fabs(l * PanLevels[1] - r * PanLevels[0]) > 1e-5) {
+      char buf[96];
+      snprintf(buf, sizeof(buf), "frame %zu is off balance (%g, %g)", f, l, r);
+      return buf;
+    }
+  }
+  return {};
+}
+
+const std::vector<Scene>& Scenes() {
+  static const std::vector<Scene> scenes = {
+      {"voices", 48000.0, 2, VoicesScene, {}},
+      {"voices-quad", 44100.0, 4, VoicesScene, {}},
+      {"pitch", 48000.0, 2, PitchScene, {}},
+      {"submix", 48000.0, 2, SubmixScene, {}},
+      {"ltrt", 48000.0, 2, LtRtScene, {}},
+      {"slew", 48000.0, 2, SlewScene, {}},
+      {"ltrt-rate", 32000.0, 2, LtRtRateScene, {}},
+      /* 239-frame blocks at the default 5 ms */
+      {"mono-pan", 47800.0, 2, MonoPanScene, CheckMonoPan},
+      {"ltrt-bench", 47800.0, 2, [](SceneContext& ctx) { LtRtBenchScene(ctx, true); }, {}},
+      {"ltrt-bench-bypass", 47800.0, 2, [](SceneContext& ctx) { LtRtBenchScene(ctx, false); }, {}},
+  };
+  return scenes;
+}
+
+bool ReadWAV(const std::string& path, SceneOutput& out) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+  std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) || memcmp(data.data() + 8, "WAVE", 4))
+    return false;
+  auto u32 = [&](size_t off) {
+    uint32_t v;
+    memcpy(&v, data.data() + off, 4);
+    return v;
+  };
+  auto u16 = [&](size_t off) {
+    uint16_t v;
+    memcpy(&v, data.data() + off, 2);
+    return v;
+  };
+  for (size_t off = 12; off + 8 <= data.size();) {
+    uint32_t size = u32(off + 4);
+    if (!memcmp(data.data() + off, "fmt ", 4)) {
+      out.m_channels = u16(off + 10);
+    } else if (!memcmp(data.data() + off, "data", 4)) {
+      size = std::min<uint32_t>(size, uint32_t(data.size() - off - 8));
+      out.m_samples.resize(size / sizeof(float));
+      memcpy(out.m_samples.data(), data.data() + off + 8, out.m_samples.size() * sizeof(float));
+      return out.m_channels != 0;
+    }
+    off += 8 + size + (size & 1);
+  }
+  return false;
+}
+
+struct SceneRun {
+  SceneOutput m_output;
+  AudioMixTiming m_timing;
+};
+
+bool RunScene(const Scene& scene, SceneRun& run) {
+  std::string path = std::string(scene.m_name) + ".wav";
+  {
+    std::unique_ptr<IAudioVoiceEngine> engine =
+        NewWAVAudioVoiceEngine(path.c_str(), scene.m_sampleRate, scene.m_channels);
+    if (!engine) {
+      fprintf(stderr, "%s: unable to open %s\n", scene.m_name, path.c_str());
+      return false;
+    }
+    engine->enableMixTiming(true);
+    SceneContext ctx(*engine);
+    scene.m_run(ctx);
+    run.m_timing = engine->getMixTiming();
+  }
+  bool read = ReadWAV(path, run.m_output);
+  std::remove(path.c_str());
+  if (!read)
+    fprintf(stderr, "%s: unable to read back %s\n", scene.m_name, path.c_str());
+  return read;
+}
+
+/* FNV-1a over the output as 16-bit PCM; identical for identical mixes on any platform */
+uint64_t HashOutput(const SceneOutput& out) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (float s : out.m_samples) {
+    int16_t q = int16_t(std::lround(std::clamp(s, -1.f, 1.f) * 32767.f));
+    for (int b = 0; b < 2; ++b) {
+      hash ^= uint8_t(q >> (b * 8));
+      hash *= 0x100000001b3ull;
+    }
+  }
+  return hash;
+}
+
+/* RMS of each channel over equal segments of the output */
+std::vector<double> Fingerprint(const SceneOutput& out) {
+  std::vector<double> rms(out.m_channels * FingerprintSegments, 0.0);
+  size_t frames = out.frames();
+  for (size_t seg = 0; seg < FingerprintSegments; ++seg) {
+    size_t begin = frames * seg / FingerprintSegments;
+    size_t end = frames * (seg + 1) / FingerprintSegments;
+    for (unsigned c = 0; c < out.m_channels; ++c) {
+      double sum = 0.0;
+      for (size_t f = begin; f < end; ++f) {
+        double s = out.m_samples[f * out.m_channels + c];
+        sum += s * s;
+      }
+      rms[seg * out.m_channels + c] = end > begin ? std::sqrt(sum / double(end - begin)) : 0.0;
+    }
+  }
+  return rms;
+}
+
+struct Reference {
+  unsigned m_channels = 0;
+  size_t m_frames = 0;
+  uint64_t m_hash = 0;
+  std::vector<double> m_fingerprint;
+};
+
+/* Parses "key value..." lines, skipping comments; the first token selects the entry */
+std::map<std::string, std::vector<std::string>> ReadTable(const std::string& path) {
+  std::map<std::string, std::vector<std::string>> table;
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::istringstream in(line);
+    std::string key, token;
+    in >> key;
+    std::vector<std::string>& values = table[key];
+    while (in >> token)
+      values.push_back(token);
+  }
+  return table;
+}
+
+double TableValue(const std::map<std::string, std::vector<std::string>>& table, const char* key, double fallback) {
+  auto search = table.find(key);
+  return search != table.end() && !search->second.empty() ? std::strtod(search->second[0].c_str(), nullptr)
+                                                          : fallback;
+}
+
+bool WriteFile(const std::string& path, const std::string& header, const std::string& body) {
+  FILE* fp = fopen(path.c_str(), "w");
+  if (!fp)
+    return false;
+  fputs(header.c_str(), fp);
+  fputs(body.c_str(), fp);
+  fclose(fp);
+  return true;
+}
+
+const char* ReferenceHeader =
+    "# Reference output of each scene: name, channels, frames, FNV-1a hash of the output as 16-bit PCM,\n"
+    "# then the RMS of each channel over 16 equal segments. A scene passes on an identical hash, or when\n"
+    "# every segment RMS is within the tolerance of the reference.\n"
+    "# Regenerate with: boo2-audio-tests --reference <this file> --update\n";
+
+const char* BaselineHeader =
+    "# Mean mixer cost of each scene in ns per output frame (best of several runs), measured in an\n"
+    "# optimized x86-64 build. A scene fails when it exceeds its baseline times the threshold;\n"
+    "# BOO2_AUDIO_PERF_THRESHOLD overrides the threshold for slower machines.\n"
+    "# Regenerate with: boo2-audio-tests --baseline <this file> --update\n";
+
+int CheckReference(const std::string& path, bool update, const char* only) {
+  auto table = ReadTable(path);
+  double tolerance = TableValue(table, "tolerance", DefaultTolerance);
+  std::string body;
+  char buf[64];
+  snprintf(buf, sizeof(buf), "tolerance %g\n", tolerance);
+  body += buf;
+  int failures = 0;
+  for (const Scene& scene : Scenes()) {
+    if (only && strcmp(only, scene.m_name))
+      continue;
+    SceneRun run;
+    if (!RunScene(scene, run)) {
+      ++failures;
+      continue;
+    }
+    const SceneOutput& out = run.m_output;
+    uint64_t hash = HashOutput(out);
+    std::vector<double> fingerprint = Fingerprint(out);
+
+    std::string line = scene.m_name;
+    snprintf(buf, sizeof(buf), " %u %zu %016" PRIx64, out.m_channels, out.frames(), hash);
+    line += buf;
+    for (double v : fingerprint) {
+      snprintf(buf, sizeof(buf), " %.6f", v);
+      line += buf;
+    }
+    body += line + "\n";
+
+    std::string error;
+    if (scene.m_check)
+      error = scene.m_check(out);
+    auto search = table.find(scene.m_name);
+    if (!update && error.empty()) {
+      if (search == table.end() || search->second.size() < 3) {
+        error = "no reference";
+      } else {
+        const std::vector<std::string>& ref = search->second;
+        if (std::strtoul(ref[0].c_str(), nullptr, 10) != out.m_channels ||
+            std::strtoull(ref[1].c_str(), nullptr, 10) != out.frames()) {
+          error = "layout or length differs from reference";
+        } else if (std::strtoull(ref[2].c_str(), nullptr, 16) != hash) {
+          double worst = 0.0;
+          if (ref.size() - 3 != fingerprint.size())
+            worst = INFINITY;
+          else
+            for (size_t i = 0; i < fingerprint.size(); ++i)
+              worst = std::max(worst, std::fabs(fingerprint[i] - std::strtod(ref[i + 3].c_str(), nullptr)));
+          if (worst > tolerance) {
+            snprintf(buf, sizeof(buf), "segment RMS off by %g (tolerance %g)", worst, tolerance);
+            error = buf;
+          } else {
+            printf("%s: hash differs, output within tolerance (%g)\n", scene.m_name, worst);
+          }
+        }
+      }
+    }
+    if (!error.empty()) {
+      printf("%s: FAILED: %s\n", scene.m_name, error.c_str());
+      ++failures;
+    } else {
+      printf("%s: ok (%zu frames)\n", scene.m_name, out.frames());
+    }
+  }
+  if (update && !only && !WriteFile(path, ReferenceHeader, body)) {
+    fprintf(stderr, "unable to write %s\n", path.c_str());
+    return 1;
+  }
+  return failures ? 1 : 0;
+}
+
+int CheckBaseline(const std::string& path, bool update, const char* only) {
+#ifndef NDEBUG
+  if (!update) {
+    printf("skipped: the baseline is for optimized builds\n");
+    return SkipReturnCode;
+  }
+#endif
+  auto table = ReadTable(path);
+  double threshold = TableValue(table, "threshold", DefaultPerfThreshold);
+  if (const char* env = getenv("BOO2_AUDIO_PERF_THRESHOLD"))
+    threshold = std::strtod(env, nullptr);
+  std::string body;
+  char buf[64];
+  snprintf(buf, sizeof(buf), "threshold %g\n", TableValue(table, "threshold", DefaultPerfThreshold));
+  body += buf;
+  int failures = 0;
+  for (const Scene& scene : Scenes()) {
+    if (only && strcmp(only, scene.m_name))
+      continue;
+    /* Best of several runs, which is far steadier than the mean on a shared machine */
+    double best = INFINITY;
+    for (int i = 0; i < 5; ++i) {
+      SceneRun run;
+      if (!RunScene(scene, run)) {
+        best = NAN;
+        break;
+      }
+      best = std::min(best, run.m_timing.m_meanNsPerFrame);
+    }
+    if (std::isnan(best)) {
+      ++failures;
+      continue;
+    }
+    snprintf(buf, sizeof(buf), "%s %.1f\n", scene.m_name, best);
+    body += buf;
+    double baseline = TableValue(table, scene.m_name, 0.0);
+    if (update) {
+      printf("%s: %.1f ns/frame\n", scene.m_name, best);
+    } else if (baseline <= 0.0) {
+      printf("%s: FAILED: %.1f ns/frame, no baseline\n", scene.m_name, best);
+      ++failures;
+    } else if (best > baseline * threshold) {
+      printf("%s: FAILED: %.1f ns/frame, baseline %.1f x %g\n", scene.m_name, best, baseline, threshold);
+      ++failures;
+    } else {
+      printf("%s: ok, %.1f ns/frame (baseline %.1f)\n", scene.m_name, best, baseline);
+    }
+  }
+  if (update && !only && !WriteFile(path, BaselineHeader, body)) {
+    fprintf(stderr, "unable to write %s\n", path.c_str());
+    return 1;
+  }
+  return failures ? 1 : 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const char* reference = nullptr;
+  const char* baseline = nullptr;
+  const char* only = nullptr;
+  bool update = false;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--reference") && i + 1 < argc)
+      reference = argv[++i];
+    else if (!strcmp(argv[i], "--baseline") && i + 1 < argc)
+      baseline = argv[++i];
+    else if (!strcmp(argv[i], "--scene") && i + 1 < argc)
+      only = argv[++i];
+    else if (!strcmp(argv[i], "--update"))
+      update = true;
+    else {
+      fprintf(stderr, "usage: %s (--reference <file> | --baseline <file>) [--update] [--scene <name>]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (reference)
+    return CheckReference(reference, update, only);
+  if (baseline)
+    return CheckBaseline(baseline, update, only);
+  fprintf(stderr, "usage: %s (--reference <file> | --baseline <file>) [--update] [--scene <name>]\n", argv[0]);
+  return 1;
+}
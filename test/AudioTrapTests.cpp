@@ -0,0 +1,182 @@
+/* Pumps a busy scene against the allocation-trap build of the mixing core, which aborts on any heap
+ * allocation inside the mix path. Voices have their rates reset both by the client and from their
+ * own callbacks on the mixing thread, and the mix snapshot keeps changing underneath: voices and
+ * submixes come and go, routes are added and dropped, Lt/Rt is toggled, and a voice releases itself
+ * from its callback. A second client thread repeats the changes while the mixer runs.
+ *
+ *   boo2-audio-trap-tests   exits 0 when the whole scene mixed without tripping the trap */
+
+#include "boo2/audiodev/AudioSampler.hpp"
+#include "boo2/audiodev/IAudioVoiceEngine.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace boo2;
+
+namespace {
+
+constexpr double MixRate = 48000.0;
+constexpr double SourceRates[] = {22050.0, 32000.0, 44100.0, 48000.0};
+
+/* Sine source that can hop its own rate and release its own voice from the mixing thread */
+struct TrapSource : IAudioVoiceCallback {
+  double m_phase = 0.0;
+  unsigned m_channels;
+  size_t m_blocks = 0;
+  size_t m_hopInterval = 0;
+  size_t m_releaseAfter = 0;
+  ObjToken<IAudioVoice> m_self;
+
+  explicit TrapSource(unsigned channels, size_t hopInterval = 0, size_t releaseAfter = 0)
+  : m_channels(channels), m_hopInterval(hopInterval), m_releaseAfter(releaseAfter) {}
+
+  void preSupplyAudio(IAudioVoice& voice, double) override {
+    ++m_blocks;
+    if (m_hopInterval && m_blocks % m_hopInterval == 0)
+      voice.resetSampleRate(SourceRates[(m_blocks / m_hopInterval) % std::size(SourceRates)]);
+    if (m_releaseAfter && m_blocks == m_releaseAfter)
+      m_self = nullptr;
+  }
+
+  size_t supplyAudio(IAudioVoice&, size_t frames, int16_t* data) override {
+    for (size_t f = 0; f < frames; ++f) {
+      int16_t s = int16_t(std::sin(m_phase) * 8000.0);
+      m_phase = std::fmod(m_phase + 0.05, 2.0 * M_PI);
+      for (unsigned c = 0; c < m_channels; ++c)
+        *data++ = s;
+    }
+    return frames;
+  }
+};
+
+struct PassEffect : IAudioSubmixCallback {
+  bool canApplyEffect() const override { return true; }
+  void applyEffect(float* audio, size_t frameCount, const ChannelMap& chanMap, double) const override {
+    for (size_t i = 0; i < frameCount * chanMap.m_channelCount; ++i)
+      audio[i] *= 0.9f;
+  }
+  void resetOutputSampleRate(double) override {}
+};
+
+const float MonoLevels[8] = {0.5f, 0.5f, 0.3f, 0.3f};
+const float StereoLevels[8][2] = {{0.5f, 0.f}, {0.f, 0.5f}};
+
+/* One round of client-side changes; step varies what gets touched */
+struct SceneClient {
+  IAudioVoiceEngine& m_engine;
+  PassEffect m_effect;
+  std::vector<std::unique_ptr<TrapSource>> m_sources;
+  std::vector<ObjToken<IAudioVoice>> m_voices;
+  ObjToken<IAudioSubmix> m_submix;
+
+  explicit SceneClient(IAudioVoiceEngine& engine) : m_engine(engine) {}
+
+  void step(size_t step) {
+    if (step % 3 == 0) {
+      /* New voice; every other one hops its rate from the mixing thread */
+      unsigned channels = step % 2 ? 1 : 2;
+      auto& src = m_sources.emplace_back(std::make_unique<TrapSource>(channels, step % 2 ? 7 : 0));
+      double rate = SourceRates[step % std::size(SourceRates)];
+      ObjToken<IAudioVoice> voice = channels == 1 ? m_engine.allocateNewMonoVoice(rate, src.get(), true)
+                                                  : m_engine.allocateNewStereoVoice(rate, src.get(), true);
+      voice->start();
+      m_voices.push_back(voice);
+    }
+    if (step % 5 == 0 && m_voices.size() > 4)
+      m_voices.erase(m_voices.begin());
+    if (!m_voices.empty()) {
+      IAudioVoice& voice = *m_voices[step % m_voices.size()];
+      voice.resetSampleRate(SourceRates[(step / 2) % std::size(SourceRates)]);
+      voice.glidePitchRatio(step % 2 ? 1.5 : 0.75, 20.0);
+      voice.setFilter(step % 2 ? AudioFilterType::LowPass : AudioFilterType::HighPass, 1000.0 + step, 0.7, true);
+    }
+    if (step % 4 == 0) {
+      m_submix = m_engine.allocateNewSubmix(true, &m_effect, int(step), step % 8 ? 1 : 2);
+      for (ObjToken<IAudioVoice>& voice : m_voices)
+        voice->setMonoChannelLevels(m_submix.get(), MonoLevels, true);
+    } else if (step % 4 == 2 && m_submix) {
+      for (ObjToken<IAudioVoice>& voice : m_voices)
+        voice->resetChannelLevels();
+      m_submix = nullptr;
+    }
+    if (!m_voices.empty())
+      m_voices.back()->rampStereoChannelLevels(nullptr, StereoLevels, 10.0, AudioRampCurve::EqualPower);
+    if (step % 6 == 0)
+      m_engine.enableLtRt(step % 12 == 0);
+  }
+};
+
+void RunScene(IAudioVoiceEngine& engine) {
+  /* A voice that releases its own token from the mixing thread */
+  TrapSource oneShot(1, 3, 40);
+  oneShot.m_self = engine.allocateNewMonoVoice(32000.0, &oneShot);
+  oneShot.m_self->start();
+
+  /* Looping sampler voices, which swap resamplers in their own pump */
+  std::vector<int16_t> samples(4800 * 2);
+  for (size_t i = 0; i < samples.size(); ++i)
+    samples[i] = int16_t(std::sin(double(i) * 0.03) * 8000.0);
+  AudioSamplerInfo monoInfo;
+  monoInfo.m_samples = samples.data();
+  monoInfo.m_frames = samples.size();
+  monoInfo.m_sampleRate = 22050.0;
+  monoInfo.m_loopEnd = monoInfo.m_frames;
+  AudioSamplerInfo stereoInfo = monoInfo;
+  stereoInfo.m_channels = 2;
+  stereoInfo.m_frames = samples.size() / 2;
+  stereoInfo.m_loopEnd = stereoInfo.m_frames;
+  ObjToken<IAudioVoice> samplers[] = {engine.allocateNewSamplerVoice(monoInfo),
+                                      engine.allocateNewSamplerVoice(stereoInfo)};
+
+  /* Client changes between pumps */
+  SceneClient client(engine);
+  for (size_t step = 0; step < 120; ++step) {
+    client.step(step);
+    for (ObjToken<IAudioVoice>& sampler : samplers) {
+      if (step % 10 == 0)
+        sampler->start();
+      sampler->resetSampleRate(SourceRates[step % std::size(SourceRates)]);
+    }
+    engine.pumpAndMixVoices();
+    engine.pumpAndMixVoices();
+    /* Let the reclaimer build the rates asked for from the mixing thread */
+    if (step % 20 == 19)
+      std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  }
+
+  /* The same changes from another thread while the mixer runs; its voices outlive the pumping */
+  SceneClient concurrent(engine);
+  std::atomic_bool done = false;
+  std::thread other([&]() {
+    for (size_t step = 0; step < 200; ++step) {
+      concurrent.step(step);
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    done.store(true);
+  });
+  while (!done.load())
+    engine.pumpAndMixVoices();
+  other.join();
+}
+
+} // namespace
+
+int main() {
+  std::unique_ptr<IAudioVoiceEngine> engine = NewWAVAudioVoiceEngine("trap.wav", MixRate, 2);
+  if (!engine) {
+    fprintf(stderr, "unable to open trap.wav\n");
+    return 1;
+  }
+  RunScene(*engine);
+  engine.reset();
+  std::remove("trap.wav");
+  printf("ok: no heap allocation in the mix path\n");
+  return 0;
+}